@@ -61,6 +61,7 @@ void define_enums(py::module &m) {
         .value("RoundUp", TailStrategy::RoundUp)
         .value("GuardWithIf", TailStrategy::GuardWithIf)
         .value("ShiftInwards", TailStrategy::ShiftInwards)
+        .value("Predicate", TailStrategy::Predicate)
         .value("Auto", TailStrategy::Auto)
     ;
 
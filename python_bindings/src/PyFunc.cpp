@@ -156,6 +156,8 @@ void define_func(py::module &m) {
 
         .def("store_in", &Func::store_in,
             py::arg("memory_type"))
+        .def("store_nontemporal", &Func::store_nontemporal,
+            py::arg("nontemporal") = true)
 
         .def("compile_to", &Func::compile_to,
             py::arg("outputs"), py::arg("arguments"), py::arg("fn_name"), py::arg("target") = get_target_from_environment())
@@ -224,8 +226,8 @@ void define_func(py::module &m) {
         }, py::arg("idx") = 0)
         .def("rvars", &Func::rvars, py::arg("idx") = 0)
 
-        .def("trace_loads", &Func::trace_loads)
-        .def("trace_stores", &Func::trace_stores)
+        .def("trace_loads", (Func &(Func::*)()) &Func::trace_loads)
+        .def("trace_stores", (Func &(Func::*)()) &Func::trace_stores)
         .def("trace_realizations", &Func::trace_realizations)
         .def("print_loop_nest", &Func::print_loop_nest)
         .def("add_trace_tag", &Func::add_trace_tag, py::arg("trace_tag"))
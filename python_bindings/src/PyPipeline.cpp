@@ -44,8 +44,10 @@ void define_pipeline(py::module &m) {
         .def(py::init<const std::vector<Func> &>())
 
         .def("outputs", &Pipeline::outputs)
-        .def("auto_schedule", &Pipeline::auto_schedule,
+        .def("auto_schedule", (std::string (Pipeline::*)(const Target &, const MachineParams &)) &Pipeline::auto_schedule,
             py::arg("target"), py::arg("machine_params") = MachineParams::generic())
+        .def("auto_schedule_candidate", &Pipeline::auto_schedule_candidate,
+            py::arg("target"), py::arg("machine_params"), py::arg("candidate"))
         .def("get_func", &Pipeline::get_func,
             py::arg("index"))
         .def("print_loop_nest", &Pipeline::print_loop_nest)
@@ -115,6 +115,8 @@ HALIDE_NEVER_INLINE void add_schedule_methods(PythonClass &class_instance) {
         // Templated function; specializing only on ImageParam for now
         return t.prefetch(image, var, offset, strategy);
     }, py::arg("image"), py::arg("var"), py::arg("offset") = 1, py::arg("strategy") = PrefetchBoundStrategy::GuardWithIf)
+    .def("auto_prefetch", &T::auto_prefetch,
+        py::arg("var"), py::arg("offset") = 1, py::arg("strategy") = PrefetchBoundStrategy::GuardWithIf)
 
     .def("source_location", &T::source_location)
     ;
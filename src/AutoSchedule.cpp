@@ -1,8 +1,29 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <regex>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
 
 #include "AutoSchedule.h"
 #include "AutoScheduleUtils.h"
+#include "Associativity.h"
 #include "ExprUsesVar.h"
 #include "FindCalls.h"
 #include "Func.h"
@@ -184,8 +205,10 @@ struct DependenceAnalysis {
             : bounds(b), regions(r) {}
     };
     // Cache for bounds queries (bound queries with the same parameters are
-    // common during the grouping process).
+    // common during the grouping process). Grouping choices are evaluated
+    // on several threads, so accesses to the cache are guarded.
     map<RegionsRequiredQuery, vector<RegionsRequired>> regions_required_cache;
+    std::shared_ptr<std::mutex> regions_required_cache_mutex = std::make_shared<std::mutex>();
 
     DependenceAnalysis(const map<string, Function> &env, const vector<string> &order,
                        const FuncValueBounds &func_val_bounds)
@@ -387,13 +410,16 @@ DependenceAnalysis::regions_required(Function f, int stage_num,
 
     // Check the cache if we've already computed this previously.
     RegionsRequiredQuery query(f.name(), stage_num, prods, only_regions_computed);
-    const auto &iter = regions_required_cache.find(query);
-    if (iter != regions_required_cache.end()) {
-        const auto &it = std::find_if(iter->second.begin(), iter->second.end(),
-            [&bounds](const RegionsRequired &r) { return (r.bounds == bounds); });
-        if (it != iter->second.end()) {
-            internal_assert((iter->first == query) && (it->bounds == bounds));
-            return it->regions;
+    {
+        std::lock_guard<std::mutex> lock(*regions_required_cache_mutex);
+        const auto &iter = regions_required_cache.find(query);
+        if (iter != regions_required_cache.end()) {
+            const auto &it = std::find_if(iter->second.begin(), iter->second.end(),
+                [&bounds](const RegionsRequired &r) { return (r.bounds == bounds); });
+            if (it != iter->second.end()) {
+                internal_assert((iter->first == query) && (it->bounds == bounds));
+                return it->regions;
+            }
         }
     }
 
@@ -573,7 +599,10 @@ DependenceAnalysis::regions_required(Function f, int stage_num,
         concrete_regions[f_reg.first] = concrete_box;
     }
 
-    regions_required_cache[query].push_back(RegionsRequired(bounds, concrete_regions));
+    {
+        std::lock_guard<std::mutex> lock(*regions_required_cache_mutex);
+        regions_required_cache[query].push_back(RegionsRequired(bounds, concrete_regions));
+    }
     return concrete_regions;
 }
 
@@ -711,6 +740,20 @@ map<string, Box> get_pipeline_bounds(DependenceAnalysis &analysis,
     return pipeline_bounds;
 }
 
+// An update stage whose outermost RVar was split and rfactored into a new
+// pure Var of an intermediate Func, so that the reduction can be
+// parallelized.
+struct RFactorChoice {
+    // The Func and stage that was rfactored, and the intermediate Func.
+    string func;
+    int stage;
+    string intermediate;
+    // The RVar split, the resulting outer and inner RVars, and the Var
+    // the outer RVar became in the intermediate.
+    string rvar, outer, inner, var;
+    int64_t factor;
+};
+
 struct AutoSchedule {
     struct Stage {
         string function;
@@ -744,6 +787,10 @@ struct AutoSchedule {
     // function stages.
     map<string, map<int, set<string>>> used_vars;
 
+    // The rfactors applied to the pipeline before it was scheduled. They
+    // create the intermediate Funcs, so they come before the schedules.
+    vector<RFactorChoice> rfactors;
+
     AutoSchedule(const map<string, Function> &env, const vector<string> &order) : env(env) {
         for (size_t i = 0; i < order.size(); ++i) {
             topological_order.emplace(order[i], i);
@@ -759,6 +806,11 @@ struct AutoSchedule {
     // Given a function name, return a string representation of getting the
     // function handle
     string get_func_handle(const string &name) const {
+        for (const auto &rf : rfactors) {
+            if (rf.intermediate == name) {
+                return get_sanitized_name(name);
+            }
+        }
         size_t index = get_element(topological_order, name);
         return "pipeline.get_func(" + std::to_string(index) + ")";
     }
@@ -778,9 +830,22 @@ struct AutoSchedule {
         std::ostringstream func_ss;
         std::ostringstream schedule_ss;
 
+        // The intermediate Funcs are created by rfactor, rather than
+        // looked up in the pipeline.
+        std::ostringstream rfactor_ss;
+        for (const auto &rf : sched.rfactors) {
+            rfactor_ss << "Func " << get_sanitized_name(rf.intermediate) << " = "
+                       << sched.get_func_handle(rf.func) << ".update(" << rf.stage - 1 << ")\n"
+                       << "    .split(RVar(\"" << rf.rvar << "\"), RVar(\"" << rf.outer << "\"), RVar(\""
+                       << rf.inner << "\"), " << rf.factor << ")\n"
+                       << "    .rfactor(RVar(\"" << rf.outer << "\"), Var(\"" << rf.var << "\"));\n";
+        }
+
         for (const auto &f : sched.func_schedules) {
             const string &fname = get_sanitized_name(f.first);
-            func_ss << "Func " << fname << " = " << sched.get_func_handle(f.first) << ";\n";
+            if (sched.get_func_handle(f.first) != fname) {
+                func_ss << "Func " << fname << " = " << sched.get_func_handle(f.first) << ";\n";
+            }
 
             schedule_ss << "{\n";
 
@@ -824,6 +889,9 @@ struct AutoSchedule {
         }
 
         stream << func_ss.str() << "\n";
+        if (!sched.rfactors.empty()) {
+            stream << rfactor_ss.str() << "\n";
+        }
         stream << schedule_ss.str() << "\n";
 
         return stream;
@@ -849,6 +917,76 @@ struct AutoSchedule {
     }
 };
 
+// The cost model the auto-scheduler uses unless told otherwise.
+class DefaultCostModel : public CostModel {
+public:
+    Expr arith_cost(const GroupFeatures &features, const MachineParams &params) override {
+        return features.arith;
+    }
+
+    // TODO: Use smooth step curve from Jon to better model cache behavior,
+    // where each step corresponds to different cache level.
+    //
+    // The current cost model drops off linearly. Larger memory footprint is
+    // penalized more than smaller memory footprint (since smaller one can fit
+    // more in the cache). The cost is clamped at 'balance', which is roughly at
+    // memory footprint equal to or larger than the last level cache size.
+    Expr memory_cost(const GroupFeatures &features, const MachineParams &params) override {
+        Expr load_slope = cast<float>(params.balance) / params.last_level_cache_size;
+        Expr cost = make_zero(Int(64));
+        for (const auto &load : features.loads) {
+            if (!load.count.defined() || !load.footprint.defined()) {
+                return Expr();
+            }
+            Expr cost_factor = cast<int64_t>(min(1 + load.footprint * load_slope, params.balance));
+            cost += cost_factor * load.count;
+        }
+        return simplify(cost);
+    }
+};
+
+// Call 'f' for each index in [0, n) on up to 'num_threads' threads. If 'f'
+// throws, the first exception is rethrown on the calling thread once all
+// the threads have finished.
+void parallel_for(int n, int num_threads, const std::function<void(int)> &f) {
+    num_threads = std::max(1, std::min(num_threads, n));
+    if (num_threads == 1) {
+        for (int i = 0; i < n; i++) {
+            f(i);
+        }
+        return;
+    }
+
+    std::atomic<int> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&]() {
+        for (int i = next++; i < n; i = next++) {
+            try {
+                f(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next = n;
+            }
+        }
+    };
+
+    vector<std::thread> threads;
+    for (int t = 1; t < num_threads; t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : threads) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
 // Implement the grouping algorithm and the cost model for making the grouping
 // choices.
 struct Partitioner {
@@ -974,6 +1112,8 @@ struct Partitioner {
         // Estimate of the parallelism that can be exploited while computing
         // the group.
         Expr parallelism;
+        // The features of the group the cost was estimated from.
+        GroupFeatures features;
 
         GroupAnalysis() : cost(Cost()) , parallelism(Expr()) {}
         GroupAnalysis(const Cost &c, Expr p) : cost(c), parallelism(std::move(p)) {}
@@ -1015,6 +1155,13 @@ struct Partitioner {
     // re-evaluated and caching them improves performance significantly.
     map<GroupingChoice, GroupConfig> grouping_cache;
 
+    // Cache for the analysis of group configurations, keyed by group_key().
+    // The analysis only depends on the members, inlined functions and tile
+    // sizes of a group, and deep pipelines analyze the same configuration
+    // many times while groups elsewhere in the pipeline are being merged.
+    map<string, GroupAnalysis> analysis_cache;
+    std::mutex analysis_cache_mutex;
+
     // Each group in the pipeline has a single output stage. A group is comprised
     // of function stages that are computed together in tiles (stages of a function
     // are always grouped together). 'groups' is the mapping from the output stage
@@ -1047,12 +1194,25 @@ struct Partitioner {
     RegionCosts &costs;
     // Output functions of the pipeline.
     const vector<Function> &outputs;
+    // The target the schedule is generated for.
+    const Target &target;
+    // The model used to turn the features of each group into a cost.
+    CostModel &cost_model;
+    // Which of the tile configurations that beat not tiling, ranked by
+    // estimated benefit, find_best_tile_config() should pick. Zero picks
+    // the best one. Empirical autotuning explores the others. The same
+    // rank applies to every group, so the candidates are not the K best
+    // combinations of per-group choices, just a cheap walk away from
+    // the best one.
+    int tile_config_rank;
 
     Partitioner(const map<string, Box> &_pipeline_bounds,
                 const MachineParams &_arch_params,
                 const vector<Function> &_outputs,
                 DependenceAnalysis &_dep_analysis,
-                RegionCosts &_costs);
+                RegionCosts &_costs,
+                const Target &_target,
+                CostModel &_cost_model);
 
     void initialize_groups();
 
@@ -1070,6 +1230,17 @@ struct Partitioner {
     // parallelism that can be potentially exploited when computing that group.
     GroupAnalysis analyze_group(const Group &g, bool show_analysis);
 
+    // Same as above, without consulting or updating 'analysis_cache'.
+    GroupAnalysis analyze_group_uncached(const Group &g, bool show_analysis);
+
+    // Return a string that uniquely identifies the configuration of a group.
+    string group_key(const Group &g);
+
+    // Compute the number of tiles of the output of group 'g', and how many
+    // of them can be computed in parallel. Return false if the extent of a
+    // tiled dimension is unknown.
+    bool count_tiles(const Group &g, Expr *tiles, Expr *parallelism);
+
     // For each group in the partition, return the regions of the producers
     // need to be allocated to compute a tile of the group's output.
     map<FStage, map<string, Box>> group_storage_bounds();
@@ -1292,9 +1463,12 @@ Partitioner::Partitioner(const map<string, Box> &_pipeline_bounds,
                          const MachineParams &_arch_params,
                          const vector<Function> &_outputs,
                          DependenceAnalysis &_dep_analysis,
-                         RegionCosts &_costs)
+                         RegionCosts &_costs,
+                         const Target &_target,
+                         CostModel &_cost_model)
         : pipeline_bounds(_pipeline_bounds), arch_params(_arch_params),
-          dep_analysis(_dep_analysis), costs(_costs), outputs(_outputs) {
+          dep_analysis(_dep_analysis), costs(_costs), outputs(_outputs),
+          target(_target), cost_model(_cost_model), tile_config_rank(0) {
     // Place each stage of a function in its own group. Each stage is
     // a node in the pipeline graph.
     for (const auto &f : dep_analysis.env) {
@@ -1394,6 +1568,33 @@ map<string, Expr> Partitioner::evaluate_reuse(const FStage &stg,
 vector<pair<Partitioner::GroupingChoice, Partitioner::GroupConfig>>
 Partitioner::choose_candidate_grouping(const vector<pair<string, string>> &cands,
                                        Partitioner::Level level) {
+    // Evaluate the choices that haven't been evaluated before. Each
+    // evaluation only reads the current grouping, so they are done in
+    // parallel.
+    vector<GroupingChoice> new_choices;
+    for (const auto &p : cands) {
+        const Function &prod_f = get_element(dep_analysis.env, p.first);
+        FStage prod(prod_f, prod_f.updates().size());
+        for (const FStage &c : get_element(children, prod)) {
+            GroupingChoice cand_choice(prod_f.name(), c);
+            if (grouping_cache.find(cand_choice) == grouping_cache.end() &&
+                std::find(new_choices.begin(), new_choices.end(), cand_choice) == new_choices.end()) {
+                new_choices.push_back(cand_choice);
+            }
+        }
+    }
+
+    vector<GroupConfig> new_configs(new_choices.size());
+    // Keep the debug output in order when it is verbose.
+    int num_threads = debug::debug_level() >= 3 ? 1 : (int)std::thread::hardware_concurrency();
+    parallel_for((int)new_choices.size(), num_threads, [&](int i) {
+        new_configs[i] = evaluate_choice(new_choices[i], level);
+    });
+    for (size_t i = 0; i < new_choices.size(); i++) {
+        // Cache the result of the evaluation for the pair
+        grouping_cache.emplace(new_choices[i], new_configs[i]);
+    }
+
     vector<pair<GroupingChoice, GroupConfig>> best_grouping;
     Expr best_benefit = make_zero(Int(64));
     for (const auto &p : cands) {
@@ -1406,19 +1607,8 @@ Partitioner::choose_candidate_grouping(const vector<pair<string, string>> &cands
         FStage prod(prod_f, final_stage);
 
         for (const FStage &c : get_element(children, prod)) {
-            GroupConfig best_config;
             GroupingChoice cand_choice(prod_f.name(), c);
-
-            // Check if the candidate has been evaluated for grouping before
-            const auto &iter = grouping_cache.find(cand_choice);
-            if (iter != grouping_cache.end()) {
-                best_config = iter->second;
-            } else {
-                best_config = evaluate_choice(cand_choice, level);
-                // Cache the result of the evaluation for the pair
-                grouping_cache.emplace(cand_choice, best_config);
-            }
-
+            const GroupConfig &best_config = get_element(grouping_cache, cand_choice);
             grouping.push_back(make_pair(cand_choice, best_config));
         }
 
@@ -1577,6 +1767,61 @@ Partitioner::find_best_tile_config(const Group &g) {
     // Generate tiling configurations
     vector<map<string, Expr>> configs = generate_tile_configs(g.output);
 
+    // Counting tiles is much cheaper than analyzing the group. Configurations
+    // with fewer parallel tiles than the machine has cores are rejected by
+    // estimate_benefit() regardless of their cost, so drop them before
+    // analyzing them. This only filters out configurations that could
+    // never be chosen; it does not bound the cost of the others, every one
+    // of which is still analyzed.
+    configs.erase(std::remove_if(configs.begin(), configs.end(),
+                                 [&](const map<string, Expr> &config) {
+                                     Group new_group = g;
+                                     new_group.tile_sizes = config;
+                                     Expr tiles, parallelism;
+                                     return (count_tiles(new_group, &tiles, &parallelism) &&
+                                             !can_prove(parallelism >= arch_params.parallelism));
+                                 }),
+                  configs.end());
+
+    if (tile_config_rank > 0) {
+        // Rank the configurations that beat not tiling by their estimated
+        // benefit over not tiling, and pick the requested one (or the
+        // worst of them, if there aren't enough). Symbolic benefits
+        // can't be compared reliably, so configurations whose benefit
+        // isn't a constant rank after all the others, in the order
+        // they were generated.
+        struct RankedConfig {
+            bool known;
+            int64_t benefit;
+            size_t index;
+        };
+        vector<RankedConfig> ranked;
+        for (size_t i = 0; i < configs.size(); i++) {
+            Group new_group = g;
+            new_group.tile_sizes = configs[i];
+            GroupAnalysis new_analysis = analyze_group(new_group, show_analysis);
+            Expr benefit = estimate_benefit(no_tile_analysis, new_analysis, false, true);
+            if (benefit.defined() && can_prove(benefit > 0)) {
+                const int64_t *b = as_const_int(simplify(benefit));
+                ranked.push_back({b != nullptr, b ? *b : 0, i});
+            }
+        }
+        if (ranked.empty()) {
+            return make_pair(best_config, best_analysis);
+        }
+        std::stable_sort(ranked.begin(), ranked.end(),
+                         [](const RankedConfig &a, const RankedConfig &b) {
+                             if (a.known != b.known) {
+                                 return a.known;
+                             }
+                             return a.known && a.benefit > b.benefit;
+                         });
+        size_t pick = ranked[std::min((size_t)tile_config_rank, ranked.size() - 1)].index;
+        Group picked = g;
+        picked.tile_sizes = configs[pick];
+        return make_pair(configs[pick], analyze_group(picked, show_analysis));
+    }
+
     Group best_group = g;
     for (const auto &config : configs) {
         Group new_group = g;
@@ -1776,7 +2021,87 @@ DimBounds Partitioner::get_bounds_from_tile_sizes(const FStage &s,
     return bounds;
 }
 
+string Partitioner::group_key(const Group &g) {
+    std::ostringstream key;
+    key << g.output << ':';
+    set<string> members;
+    for (const FStage &s : g.members) {
+        std::ostringstream m;
+        m << s;
+        members.insert(m.str());
+    }
+    for (const string &m : members) {
+        key << m << ',';
+    }
+    key << ':';
+    for (const string &f : g.inlined) {
+        key << f << ',';
+    }
+    key << ':';
+    for (const auto &t : g.tile_sizes) {
+        key << t.first << '=' << t.second << ',';
+    }
+    return key.str();
+}
+
+bool Partitioner::count_tiles(const Group &g, Expr *tiles, Expr *parallelism) {
+    *tiles = make_one(Int(64));
+    *parallelism = make_one(Int(64));
+
+    if (g.output.func.has_extern_definition()) {
+        return true;
+    }
+
+    // Get the definition corresponding to the group output
+    Definition def = get_stage_definition(g.output.func, g.output.stage_num);
+    const vector<Dim> &dims = def.schedule().dims();
+
+    DimBounds stg_bounds = get_bounds(g.output);
+
+    for (int d = 0; d < (int)dims.size() - 1; d++) {
+        const string &var = dims[d].var;
+        const auto &iter = g.tile_sizes.find(var);
+        if (iter != g.tile_sizes.end()) {
+            const Expr &size = iter->second;
+            Expr extent = get_extent(get_element(stg_bounds, var));
+            if (!extent.defined()) {
+                return false;
+            }
+
+            Expr dim_tiles = simplify((extent + size - 1) / size);
+            *tiles *= dim_tiles;
+            // Since all Vars are inherently parallelizable by construct, we
+            // only need to take RVars into account for the analysis.
+            if (can_parallelize_rvar(var, g.output.func.name(), def)) {
+                *parallelism *= dim_tiles;
+            }
+        }
+    }
+    return true;
+}
+
 Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_analysis) {
+    if (show_analysis) {
+        return analyze_group_uncached(g, show_analysis);
+    }
+
+    string key = group_key(g);
+    {
+        std::lock_guard<std::mutex> lock(analysis_cache_mutex);
+        const auto &iter = analysis_cache.find(key);
+        if (iter != analysis_cache.end()) {
+            return iter->second;
+        }
+    }
+
+    GroupAnalysis analysis = analyze_group_uncached(g, show_analysis);
+
+    std::lock_guard<std::mutex> lock(analysis_cache_mutex);
+    analysis_cache.emplace(key, analysis);
+    return analysis;
+}
+
+Partitioner::GroupAnalysis Partitioner::analyze_group_uncached(const Group &g, bool show_analysis) {
     set<string> group_inputs;
     set<string> group_members;
 
@@ -1798,35 +2123,9 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
     }
 
     // Count the number of tiles
-    Expr estimate_tiles = make_one(Int(64));
-    Expr parallelism = make_one(Int(64));
-
-    if (!g.output.func.has_extern_definition()) {
-        // Get the definition corresponding to the group output
-        Definition def = get_stage_definition(g.output.func, g.output.stage_num);
-        const vector<Dim> &dims = def.schedule().dims();
-
-        DimBounds stg_bounds = get_bounds(g.output);
-
-        for (int d = 0; d < (int)dims.size() - 1; d++) {
-            const string &var = dims[d].var;
-            const auto &iter = g.tile_sizes.find(var);
-            if (iter != g.tile_sizes.end()) {
-                const Expr &size = iter->second;
-                Expr extent = get_extent(get_element(stg_bounds, var));
-                if (!extent.defined()) {
-                    return GroupAnalysis();
-                }
-
-                Expr dim_tiles = simplify((extent + size - 1) / size);
-                estimate_tiles *= dim_tiles;
-                // Since all Vars are inherently parallelizable by construct, we
-                // only need to take RVars into account for the analysis.
-                if (can_parallelize_rvar(var, g.output.func.name(), def)) {
-                    parallelism *= dim_tiles;
-                }
-            }
-        }
+    Expr estimate_tiles, parallelism;
+    if (!count_tiles(g, &estimate_tiles, &parallelism)) {
+        return GroupAnalysis();
     }
 
     // Get the regions of the pipeline required to compute a tile of the group
@@ -1878,6 +2177,27 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
     Cost group_cost(simplify(tile_cost.arith + out_cost.arith),
                     simplify(tile_cost.memory + out_cost.memory));
 
+    GroupFeatures features;
+    features.arith = simplify(group_cost.arith * estimate_tiles);
+    features.inlined_arith = make_zero(Int(64));
+    if (!g.inlined.empty() && cost_model.uses_inlined_arith()) {
+        // Inlining recomputes a producer for each use instead of loading
+        // it. The extra work is the difference from computing every
+        // member once per point of its region.
+        Cost flat_cost = costs.region_cost(group_reg, set<string>());
+        Cost flat_out_cost = costs.stage_region_cost(g.output.func.name(),
+                                                     g.output.stage_num,
+                                                     tile_bounds, set<string>());
+        if (flat_cost.defined() && flat_out_cost.defined()) {
+            Expr extra = group_cost.arith - flat_cost.arith - flat_out_cost.arith;
+            features.inlined_arith = simplify(max(extra, 0) * estimate_tiles);
+        }
+    }
+    features.tiles = estimate_tiles;
+    features.parallelism = parallelism;
+    features.vector_width = target.natural_vector_size(g.output.func.output_types()[0]);
+    features.num_inlined = (int)g.inlined.size();
+
     // Detailed load costs for all the group intermediates
     map<string, Expr> group_load_costs =
         costs.detailed_load_costs(group_reg, g.inlined);
@@ -1902,8 +2222,6 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
         }
     }
 
-    Cost per_tile_cost(group_cost.arith, make_zero(Int(64)));
-
     // This is the old cost model; keeping it here for reference, for now.
     /*
     if (tile_inter_size > arch_params.l1_size) {
@@ -1921,21 +2239,15 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
                                      tile_cost.second);
     }*/
 
-    // TODO: Use smooth step curve from Jon to better model cache behavior,
-    // where each step corresponds to different cache level.
-    //
-    // The current cost model drops off linearly. Larger memory footprint is
-    // penalized more than smaller memory footprint (since smaller one can fit
-    // more in the cache). The cost is clamped at 'balance', which is roughly at
-    // memory footprint equal to or larger than the last level cache size.
+    // Record the number of loads from each Func or input along with the
+    // footprint they are made within; 'cost_model' turns these into a
+    // memory cost.
 
     // If 'model_reuse' is set, the cost model should take into account memory
     // reuse within the tile, e.g. matrix multiply reuses inputs multiple times.
     // TODO: Implement a better reuse model.
     bool model_reuse = false;
 
-    // Linear dropoff
-    Expr load_slope = cast<float>(arch_params.balance) / arch_params.last_level_cache_size;
     for (const auto &f_load : group_load_costs) {
         internal_assert(g.inlined.find(f_load.first) == g.inlined.end())
             << "Intermediates of inlined pure fuction \"" << f_load.first
@@ -1977,9 +2289,9 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
             }
 
             if (model_reuse) {
-                Expr initial_factor =
-                    cast<int64_t>(min(1 + initial_footprint * load_slope, arch_params.balance));
-                per_tile_cost.memory += initial_factor * footprint;
+                features.loads.push_back({f_load.first,
+                                          simplify(footprint * estimate_tiles),
+                                          initial_footprint});
             } else {
                 footprint = initial_footprint;
             }
@@ -1989,8 +2301,17 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
             }
         }
 
-        Expr cost_factor = cast<int64_t>(min(1 + footprint * load_slope, arch_params.balance));
-        per_tile_cost.memory += cost_factor * f_load.second;
+        Expr count = f_load.second;
+        if (count.defined()) {
+            count = simplify(count * estimate_tiles);
+        }
+        features.loads.push_back({f_load.first, count, footprint});
+    }
+
+    Cost group_total_cost(cost_model.arith_cost(features, arch_params),
+                          cost_model.memory_cost(features, arch_params));
+    if (!group_total_cost.defined()) {
+        return GroupAnalysis();
     }
 
     if (show_analysis) {
@@ -2000,13 +2321,12 @@ Partitioner::GroupAnalysis Partitioner::analyze_group(const Group &g, bool show_
         }
         debug(0) << '\n';
 
-        debug(0) << "\nPer tile memory cost:" << per_tile_cost.memory << '\n';
-        debug(0) << "Per tile arith cost:" << per_tile_cost.arith << '\n';
+        debug(0) << "\nGroup memory cost:" << group_total_cost.memory << '\n';
+        debug(0) << "Group arith cost:" << group_total_cost.arith << '\n';
     }
 
-    GroupAnalysis g_analysis(
-        Cost(per_tile_cost.arith * estimate_tiles, per_tile_cost.memory * estimate_tiles),
-        parallelism);
+    GroupAnalysis g_analysis(group_total_cost, parallelism);
+    g_analysis.features = std::move(features);
     g_analysis.simplify();
 
     return g_analysis;
@@ -2402,6 +2722,9 @@ pair<VarOrRVar, VarOrRVar> Partitioner::split_dim(
         case TailStrategy::ShiftInwards:
             oss << ", TailStrategy::ShiftInwards)";
             break;
+        case TailStrategy::Predicate:
+            oss << ", TailStrategy::Predicate)";
+            break;
         case TailStrategy::Auto:
             oss << ")";
             break;
@@ -2455,11 +2778,40 @@ void Partitioner::vectorize_stage(const Group &g, Stage f_handle, int stage_num,
         bool is_rvar = (rvars.find(vec_dim_name) != rvars.end());
         internal_assert(is_rvar == dims[vec_dim_index].is_rvar());
 
+        // If an update is vectorized over a pure dimension outside of
+        // serial RVars, move the vector loop innermost. Pure dimensions
+        // can always be reordered with respect to RVars.
+        vector<VarOrRVar> serial_inner_dims;
+        if (stage_num > 0 && !is_rvar) {
+            for (int d = 0; d < vec_dim_index; d++) {
+                if (!dims[d].is_rvar()) {
+                    serial_inner_dims.clear();
+                    break;
+                }
+                serial_inner_dims.push_back(VarOrRVar(get_base_name(dims[d].var), true));
+            }
+        }
+
         VarOrRVar vec_var(vec_dim_name, is_rvar);
         pair<VarOrRVar, VarOrRVar> split_vars =
             split_dim(g, f_handle, stage_num, def, is_group_output, vec_var, vec_len,
                       "_vi", "_vo", estimates, sched);
 
+        if (!serial_inner_dims.empty()) {
+            vector<VarOrRVar> ordering = {split_vars.first};
+            string var_order = split_vars.first.name();
+            set<string> var_list = {split_vars.first.name()};
+            for (const auto &v : serial_inner_dims) {
+                ordering.push_back(v);
+                var_order += ", " + v.name();
+                var_list.insert(v.name());
+            }
+            f_handle.reorder(ordering);
+            sched.push_schedule(f_handle.name(), stage_num,
+                                "reorder(" + var_order + ")", var_list);
+            vec_dim_index = 0;
+        }
+
         f_handle.vectorize(split_vars.first);
         sched.push_schedule(f_handle.name(), stage_num,
                             "vectorize(" + split_vars.first.name() + ")",
@@ -3309,13 +3661,155 @@ bool inline_unbounded(const vector<Function> &outputs,
     return inlined;
 }
 
+// Return the value of 'e' if it is a constant integer, or -1 otherwise.
+int64_t const_extent(const Expr &e) {
+    if (!e.defined()) {
+        return -1;
+    }
+    const int64_t *v = as_const_int(simplify(e));
+    return v ? *v : -1;
+}
+
+// Reductions that can't be parallelized over their pure dimensions run
+// serially over their whole reduction domain. Where the update is associative
+// and the reduction domain is large, split its outermost RVar and rfactor the
+// outer part into a pure Var of an intermediate Func, which the partitioner
+// can then parallelize and vectorize like any other stage. The split factor
+// is chosen to make a few tasks per core. This is only done when the
+// estimated time of the rfactored reduction, including merging the partial
+// results, beats the serial one. Returns true if any stage was rfactored.
+bool rfactor_serial_reductions(const vector<Function> &outputs,
+                               const vector<string> &order,
+                               const map<string, Function> &env,
+                               const MachineParams &arch_params,
+                               vector<RFactorChoice> &choices) {
+    // Don't bother with reductions over fewer points than this.
+    const int64_t min_reduction_size = 4096;
+    // Aim for this many tasks per core.
+    const int64_t tasks_per_core = 4;
+
+    bool has_reductions = false;
+    for (const auto &iter : env) {
+        for (const Definition &def : iter.second.updates()) {
+            has_reductions = has_reductions || !def.schedule().rvars().empty();
+        }
+    }
+    const int64_t parallelism = const_extent(arch_params.parallelism);
+    const int64_t balance = const_extent(arch_params.balance);
+    if (!has_reductions || parallelism <= 1 || balance < 0) {
+        return false;
+    }
+
+    FuncValueBounds func_val_bounds = compute_function_value_bounds(order, env);
+    RegionCosts costs(env);
+    DependenceAnalysis dep_analysis(env, order, func_val_bounds);
+    map<string, Box> pipeline_bounds =
+        get_pipeline_bounds(dep_analysis, outputs, &costs.input_estimates);
+
+    bool rfactored = false;
+    for (const string &name : order) {
+        Function f = get_element(env, name);
+        if (f.has_extern_definition() || !pipeline_bounds.count(name)) {
+            continue;
+        }
+        const Box &bounds = get_element(pipeline_bounds, name);
+        for (int s = 1; s <= (int)f.updates().size(); s++) {
+            const Definition &def = f.updates()[s - 1];
+            const vector<ReductionVariable> &rvars = def.schedule().rvars();
+            if (rvars.empty()) {
+                continue;
+            }
+
+            // The size of the reduction domain, and of its outermost
+            // dimension, which is the one that gets split.
+            int64_t reduction_size = 1;
+            for (const auto &rv : rvars) {
+                int64_t extent = const_extent(rv.extent);
+                reduction_size = extent < 0 ? -1 : reduction_size * extent;
+                if (reduction_size < 0) {
+                    break;
+                }
+            }
+            const ReductionVariable &outer_rv = rvars.back();
+            const int64_t outer_extent = const_extent(outer_rv.extent);
+            if (reduction_size < min_reduction_size || outer_extent < 2) {
+                continue;
+            }
+
+            // The parallelism available over the pure dimensions.
+            int64_t pure_size = 1;
+            for (const Dim &d : def.schedule().dims()) {
+                if (d.is_rvar() || d.var == Var::outermost().name()) {
+                    continue;
+                }
+                const vector<string> &args = f.args();
+                auto arg = std::find(args.begin(), args.end(), d.var);
+                int64_t extent = -1;
+                if (arg != args.end() && (size_t)(arg - args.begin()) < bounds.size()) {
+                    extent = const_extent(get_extent(bounds[arg - args.begin()]));
+                }
+                pure_size = extent < 0 ? -1 : pure_size * extent;
+                if (pure_size < 0) {
+                    break;
+                }
+            }
+            if (pure_size < 0 || pure_size >= parallelism) {
+                continue;
+            }
+
+            if (!prove_associativity(name, def.args(), def.values()).associative()) {
+                continue;
+            }
+
+            // Compare the serial and rfactored reductions. The merge
+            // loads each partial result once.
+            const Cost &point_cost = get_element(costs.func_cost, name)[s];
+            int64_t arith = std::max<int64_t>(const_extent(point_cost.arith), 1);
+            int64_t factor = std::max<int64_t>(
+                (outer_extent + parallelism * tasks_per_core - 1) / (parallelism * tasks_per_core), 1);
+            int64_t chunks = (outer_extent + factor - 1) / factor;
+            double work = (double)reduction_size * pure_size * arith;
+            double serial_time = work / pure_size;
+            double rfactored_time = work / std::min(pure_size * chunks, parallelism) +
+                (double)chunks * (arith + balance);
+            debug(3) << "Reduction " << name << ".update(" << s - 1 << ") estimated serial time "
+                     << serial_time << ", rfactored into " << chunks << " parts " << rfactored_time << "\n";
+            if (chunks < 2 || rfactored_time >= serial_time) {
+                continue;
+            }
+
+            RFactorChoice rf;
+            rf.func = name;
+            rf.stage = s;
+            rf.rvar = outer_rv.var;
+            rf.outer = outer_rv.var + "_rfo";
+            rf.inner = outer_rv.var + "_rfi";
+            rf.var = get_sanitized_name(outer_rv.var) + "_rfv";
+            rf.factor = factor;
+
+            Stage stage = Func(f).update(s - 1);
+            stage.split(RVar(rf.rvar), RVar(rf.outer), RVar(rf.inner), (int)factor);
+            Func intm = stage.rfactor(RVar(rf.outer), Var(rf.var));
+            rf.intermediate = intm.name();
+            debug(2) << "Rfactoring " << name << ".update(" << s - 1 << ") over " << rf.rvar
+                     << " into " << chunks << " parts\n";
+            choices.push_back(rf);
+            rfactored = true;
+        }
+    }
+    return rfactored;
+}
+
 } // anonymous namespace
 
 // Generate schedules for all functions in the pipeline required to compute the
 // outputs. This applies the schedules and returns a string representation of
 // the schedules. The target architecture is specified by 'target'.
 string generate_schedules(const vector<Function> &outputs, const Target &target,
-                          const MachineParams &arch_params) {
+                          const MachineParams &arch_params, int candidate,
+                          CostModel *cost_model) {
+    user_assert(candidate >= 0) << "Auto-scheduler candidate must be non-negative\n";
+
     // Make an environment map which is used throughout the auto scheduling process.
     map<string, Function> env;
     for (Function f : outputs) {
@@ -3399,6 +3893,20 @@ string generate_schedules(const vector<Function> &outputs, const Target &target,
         order = realization_order(outputs, env).first;
     }
 
+    // Run a pre-pass that splits up large reductions which can't otherwise be
+    // parallelized. This introduces new Funcs, so 'env' and 'order' need to
+    // be recomputed.
+    debug(2) << "Rfactoring serial reductions...\n";
+    vector<RFactorChoice> rfactors;
+    if (rfactor_serial_reductions(outputs, order, env, arch_params, rfactors)) {
+        env.clear();
+        for (Function f : outputs) {
+            map<string, Function> more_funcs = find_transitive_calls(f);
+            env.insert(more_funcs.begin(), more_funcs.end());
+        }
+        order = realization_order(outputs, env).first;
+    }
+
     // Compute the bounds of function values which are used for dependence analysis.
     debug(2) << "Computing function value bounds...\n";
     FuncValueBounds func_val_bounds = compute_function_value_bounds(order, env);
@@ -3449,7 +3957,13 @@ string generate_schedules(const vector<Function> &outputs, const Target &target,
     }
 
     debug(2) << "Initializing partitioner...\n";
-    Partitioner part(pipeline_bounds, arch_params, outputs, dep_analysis, costs);
+    DefaultCostModel default_cost_model;
+    if (!cost_model) {
+        cost_model = &default_cost_model;
+    }
+    Partitioner part(pipeline_bounds, arch_params, outputs, dep_analysis, costs,
+                     target, *cost_model);
+    part.tile_config_rank = candidate;
 
     // Compute and display reuse
     /* TODO: Use the reuse estimates to reorder loops
@@ -3496,14 +4010,34 @@ string generate_schedules(const vector<Function> &outputs, const Target &target,
         part.disp_pipeline_graph();
     }
 
+    // Let the cost model know what it predicted for the groups chosen.
+    for (const auto &g : part.groups) {
+        const auto &iter = part.group_costs.find(g.first);
+        if (iter == part.group_costs.end() || !iter->second.defined()) {
+            continue;
+        }
+        vector<string> funcs;
+        for (const FStage &s : g.second.members) {
+            if (!g.second.inlined.count(s.func.name()) &&
+                std::find(funcs.begin(), funcs.end(), s.func.name()) == funcs.end()) {
+                funcs.push_back(s.func.name());
+            }
+        }
+        cost_model->observe_group(funcs, iter->second.features, arch_params);
+    }
+
     debug(2) << "Initializing AutoSchedule...\n";
     AutoSchedule sched(env, top_order);
+    sched.rfactors = rfactors;
     debug(2) << "Generating CPU schedule...\n";
     part.generate_cpu_schedule(target, sched);
 
     std::ostringstream oss;
     oss << "// Target: " << target.to_string() << "\n";
     oss << "// MachineParams: " << arch_params.to_string() << "\n";
+    if (candidate > 0) {
+        oss << "// Candidate: " << candidate << "\n";
+    }
     oss << "\n";
     oss << sched;
     string sched_string = oss.str();
@@ -3524,6 +4058,248 @@ MachineParams MachineParams::generic() {
   return MachineParams(16, 16 * 1024 * 1024, 40);
 }
 
+namespace {
+
+// The number of hardware threads the host can run at once.
+int host_hardware_threads() {
+#ifdef __linux__
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0) {
+        return (int)n;
+    }
+#endif
+    return (int)std::thread::hardware_concurrency();
+}
+
+// Read a small sysfs file as a string, without the trailing newline.
+std::string read_sysfs(const std::string &path) {
+    std::ifstream f(path);
+    std::string result;
+    std::getline(f, result);
+    return result;
+}
+
+// Parse a sysfs cpu list such as "0-3,8-11" into a count of cpus.
+int count_cpu_list(const std::string &list) {
+    int count = 0;
+    for (const std::string &range : Internal::split_string(list, ",")) {
+        if (range.empty()) {
+            continue;
+        }
+        size_t dash = range.find('-');
+        if (dash == std::string::npos) {
+            count++;
+        } else {
+            count += std::atoi(range.c_str() + dash + 1) - std::atoi(range.c_str()) + 1;
+        }
+    }
+    return count;
+}
+
+// Find the size (in bytes) of the last-level data or unified cache of
+// cpu0 from sysfs, along with the number of hardware threads sharing
+// it. Returns false if sysfs doesn't describe the caches.
+bool sysfs_last_level_cache(int64_t *size, int *sharing) {
+    int best_level = 0;
+    for (int i = 0; ; i++) {
+        std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(i) + "/";
+        std::string level = read_sysfs(dir + "level");
+        if (level.empty()) {
+            break;
+        }
+        if (read_sysfs(dir + "type") == "Instruction") {
+            continue;
+        }
+        std::string s = read_sysfs(dir + "size");
+        int64_t bytes = std::atoll(s.c_str());
+        if (!s.empty() && (s.back() == 'K' || s.back() == 'k')) {
+            bytes *= 1024;
+        } else if (!s.empty() && s.back() == 'M') {
+            bytes *= 1024 * 1024;
+        }
+        int l = std::atoi(level.c_str());
+        if (bytes > 0 && l > best_level) {
+            best_level = l;
+            *size = bytes;
+            *sharing = std::max(1, count_cpu_list(read_sysfs(dir + "shared_cpu_list")));
+        }
+    }
+    return best_level > 0;
+}
+
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || \
+    (!defined(_MSC_VER) && (defined(__x86_64__) || defined(__i386__)))
+void host_cpuid(int info[4], int leaf, int subleaf) {
+#ifdef _MSC_VER
+    __cpuidex(info, leaf, subleaf);
+#else
+    unsigned int a, b, c, d;
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+    info[0] = a; info[1] = b; info[2] = c; info[3] = d;
+#endif
+}
+
+// Find the size (in bytes) of the last-level cache with cpuid, using the
+// deterministic cache parameters leaf (4 on Intel, 0x8000001D on AMD).
+bool cpuid_last_level_cache(int64_t *size, int *sharing) {
+    int info[4];
+    host_cpuid(info, 0, 0);
+    int max_leaf = info[0];
+    host_cpuid(info, 0x80000000, 0);
+    int max_ext_leaf = info[0];
+
+    int leaf = 0;
+    if (max_leaf >= 4) {
+        host_cpuid(info, 4, 0);
+        if (info[0] & 0x1f) {
+            leaf = 4;
+        }
+    }
+    if (!leaf && (unsigned)max_ext_leaf >= 0x8000001D) {
+        leaf = 0x8000001D;
+    }
+    if (!leaf) {
+        return false;
+    }
+
+    int best_level = 0;
+    for (int i = 0; i < 16; i++) {
+        host_cpuid(info, leaf, i);
+        int type = info[0] & 0x1f;
+        if (type == 0) {
+            break;
+        }
+        if (type == 2) {
+            // Instruction cache
+            continue;
+        }
+        int level = (info[0] >> 5) & 0x7;
+        int64_t ways = ((info[1] >> 22) & 0x3ff) + 1;
+        int64_t partitions = ((info[1] >> 12) & 0x3ff) + 1;
+        int64_t line_size = (info[1] & 0xfff) + 1;
+        int64_t sets = (int64_t)(unsigned)info[2] + 1;
+        if (level > best_level) {
+            best_level = level;
+            *size = ways * partitions * line_size * sets;
+            *sharing = ((info[0] >> 14) & 0xfff) + 1;
+        }
+    }
+    return best_level > 0;
+}
+#else
+bool cpuid_last_level_cache(int64_t *size, int *sharing) {
+    return false;
+}
+#endif
+
+// Estimate how many times longer a load that misses the last-level
+// cache takes than an arithmetic operation. Loads are timed walking a
+// buffer several times larger than the cache, one cache line at a time
+// in a shuffled order so that the prefetchers don't hide the latency
+// entirely, with enough independent walks in flight to use the memory
+// bandwidth. Arithmetic is timed as independent multiply-adds.
+int measure_balance(int64_t llc_size) {
+    using Clock = std::chrono::steady_clock;
+    auto seconds_since = [](Clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() - t).count();
+    };
+
+    const int64_t line = 64;
+    const int64_t lines = std::min<int64_t>(std::max<int64_t>(4 * llc_size, 16 << 20), 128 << 20) / line;
+    const int64_t stride = line / sizeof(int64_t);
+    std::vector<int64_t> buf(lines * stride);
+    // A single cycle through all the lines, in a shuffled order. The
+    // seed is fixed so that the measurement is repeatable.
+    std::vector<int64_t> order(lines);
+    for (int64_t i = 0; i < lines; i++) {
+        order[i] = i;
+    }
+    std::mt19937_64 rng(0);
+    std::shuffle(order.begin(), order.end(), rng);
+    for (int64_t i = 0; i < lines; i++) {
+        buf[order[i] * stride] = order[(i + 1) % lines] * stride;
+    }
+
+    // Each walk starts on a different part of the cycle.
+    const int walks = 8;
+    int64_t pos[walks];
+    for (int i = 0; i < walks; i++) {
+        pos[i] = order[(lines / walks) * i] * stride;
+    }
+    const int64_t loads_per_walk = lines / walks;
+    auto start = Clock::now();
+    for (int64_t j = 0; j < loads_per_walk; j++) {
+        for (int i = 0; i < walks; i++) {
+            pos[i] = buf[pos[i]];
+        }
+    }
+    double load_time = seconds_since(start) / (loads_per_walk * walks);
+
+    const int64_t iters = 1 << 22;
+    volatile int64_t seed = 3;
+    int64_t acc[walks];
+    for (int i = 0; i < walks; i++) {
+        acc[i] = seed + i;
+    }
+    start = Clock::now();
+    for (int64_t j = 0; j < iters; j++) {
+        for (int i = 0; i < walks; i++) {
+            acc[i] = acc[i] * 3 + j;
+        }
+    }
+    double arith_time = seconds_since(start) / (iters * walks * 2);
+
+    // Keep the results alive.
+    int64_t sink = 0;
+    for (int i = 0; i < walks; i++) {
+        sink += acc[i] + pos[i];
+    }
+    seed = sink;
+
+    if (!(arith_time > 0) || !(load_time > 0)) {
+        return 0;
+    }
+    double balance = load_time / arith_time;
+    return (int)std::min(std::max(balance, 1.0), 1000.0);
+}
+
+}  // namespace
+
+MachineParams MachineParams::host() {
+    static MachineParams params = []() {
+        MachineParams generic = MachineParams::generic();
+        MachineParams result = generic;
+
+        int threads = host_hardware_threads();
+        if (threads > 0) {
+            result.parallelism = threads;
+        }
+
+        int64_t llc_size = 0;
+        int sharing = 0;
+        if (sysfs_last_level_cache(&llc_size, &sharing) ||
+            cpuid_last_level_cache(&llc_size, &sharing)) {
+            // On machines with several last-level caches (e.g. multiple
+            // sockets or core complexes), parallel tiles use all of them.
+            int caches = threads > sharing ? std::max(1, threads / sharing) : 1;
+            result.last_level_cache_size =
+                (int32_t)std::min<int64_t>(llc_size * caches, std::numeric_limits<int32_t>::max());
+        } else {
+            llc_size = 16 * 1024 * 1024;
+        }
+
+        int balance = measure_balance(llc_size);
+        if (balance > 0) {
+            result.balance = balance;
+        }
+
+        Internal::debug(1) << "Host machine parameters: " << result.to_string()
+                           << " (" << sharing << " threads per last-level cache)\n";
+        return result;
+    }();
+    return params;
+}
+
 std::string MachineParams::to_string() const {
     internal_assert(parallelism.type().is_int() &&
                     last_level_cache_size.type().is_int() &&
@@ -3534,6 +4310,10 @@ std::string MachineParams::to_string() const {
 }
 
 MachineParams::MachineParams(const std::string &s) {
+    if (s == "host") {
+        *this = MachineParams::host();
+        return;
+    }
     std::vector<std::string> v = Internal::split_string(s, ",");
     user_assert(v.size() == 3) << "Unable to parse MachineParams: " << s;
     parallelism = Internal::string_to_int(v[0]);
@@ -3541,4 +4321,288 @@ MachineParams::MachineParams(const std::string &s) {
     balance = Internal::string_to_int(v[2]);
 }
 
+namespace {
+
+// The size of a typical L1 data cache, in bytes. MachineParams doesn't
+// describe it.
+const double typical_l1_size = 32 * 1024;
+
+Expr f64(double x) {
+    return Internal::make_const(Float(64), x);
+}
+
+// The features of a group as Float(64) Exprs, in the order documented in
+// LearnedCostModel. Returns an empty vector if any of them is undefined.
+std::vector<Expr> learned_cost_model_features(const GroupFeatures &f, const MachineParams &params) {
+    if (!f.arith.defined() || !f.inlined_arith.defined() ||
+        !f.tiles.defined() || !f.parallelism.defined()) {
+        return {};
+    }
+    Expr arith = cast<double>(f.arith);
+    Expr loads = f64(0);
+    Expr l1_loads = f64(0);
+    Expr llc_loads = f64(0);
+    for (const auto &load : f.loads) {
+        if (!load.count.defined() || !load.footprint.defined()) {
+            return {};
+        }
+        Expr count = cast<double>(load.count);
+        Expr footprint = cast<double>(load.footprint);
+        loads += count;
+        l1_loads += count * min(footprint / f64(typical_l1_size), f64(1));
+        llc_loads += count * min(footprint / cast<double>(params.last_level_cache_size), f64(1));
+    }
+    Expr parallelism = cast<double>(max(min(f.parallelism, params.parallelism), 1));
+    std::vector<Expr> result = {
+        arith / std::max(f.vector_width, 1),
+        arith,
+        cast<double>(f.inlined_arith),
+        loads,
+        l1_loads,
+        llc_loads,
+        cast<double>(f.tiles),
+        (arith + loads) / parallelism,
+    };
+    internal_assert((int)result.size() == LearnedCostModel::num_features);
+    for (Expr &e : result) {
+        e = Internal::simplify(e);
+    }
+    return result;
+}
+
+// The same features, if they are all constant.
+bool learned_cost_model_features(const GroupFeatures &f, const MachineParams &params,
+                                 std::vector<double> *values) {
+    std::vector<Expr> exprs = learned_cost_model_features(f, params);
+    if (exprs.empty()) {
+        return false;
+    }
+    values->clear();
+    for (const Expr &e : exprs) {
+        const double *v = Internal::as_const_float(e);
+        if (!v || !std::isfinite(*v)) {
+            return false;
+        }
+        values->push_back(*v);
+    }
+    return true;
+}
+
+// Weighted sum of the features at the given indices, as an Int(64) cost in
+// picoseconds.
+Expr weighted_cost(const std::vector<Expr> &features, const std::vector<double> &w,
+                   const std::vector<int> &indices) {
+    if (features.empty()) {
+        return Expr();
+    }
+    Expr sum = f64(0);
+    for (int i : indices) {
+        if (w[i] != 0) {
+            sum += features[i] * f64(w[i]);
+        }
+    }
+    return Internal::simplify(cast<int64_t>(sum * 1000));
+}
+
+// Solve the least squares problem min |A w - b| subject to w >= 0, where
+// A has one row per sample. Columns are scaled to unit norm for
+// conditioning, and constraints are enforced by repeatedly dropping the
+// most negative weight and solving again.
+std::vector<double> non_negative_least_squares(const std::vector<std::vector<double>> &A,
+                                               const std::vector<double> &b) {
+    const size_t n = A[0].size();
+    std::vector<double> scale(n, 0);
+    for (const auto &row : A) {
+        for (size_t j = 0; j < n; j++) {
+            scale[j] += row[j] * row[j];
+        }
+    }
+    std::vector<bool> active(n);
+    for (size_t j = 0; j < n; j++) {
+        scale[j] = std::sqrt(scale[j]);
+        active[j] = scale[j] > 0;
+    }
+
+    std::vector<double> w(n, 0);
+    while (true) {
+        std::vector<size_t> cols;
+        for (size_t j = 0; j < n; j++) {
+            if (active[j]) {
+                cols.push_back(j);
+            }
+        }
+        const size_t m = cols.size();
+        std::fill(w.begin(), w.end(), 0);
+        if (m == 0) {
+            return w;
+        }
+
+        // Normal equations, with a little ridge regularization to keep
+        // collinear features solvable.
+        std::vector<std::vector<double>> M(m, std::vector<double>(m + 1, 0));
+        for (size_t r = 0; r < A.size(); r++) {
+            for (size_t i = 0; i < m; i++) {
+                double ai = A[r][cols[i]] / scale[cols[i]];
+                for (size_t j = 0; j < m; j++) {
+                    M[i][j] += ai * A[r][cols[j]] / scale[cols[j]];
+                }
+                M[i][m] += ai * b[r];
+            }
+        }
+        for (size_t i = 0; i < m; i++) {
+            M[i][i] += 1e-9;
+        }
+
+        // Gaussian elimination with partial pivoting.
+        for (size_t i = 0; i < m; i++) {
+            size_t pivot = i;
+            for (size_t k = i + 1; k < m; k++) {
+                if (std::abs(M[k][i]) > std::abs(M[pivot][i])) {
+                    pivot = k;
+                }
+            }
+            std::swap(M[i], M[pivot]);
+            for (size_t k = i + 1; k < m; k++) {
+                double f = M[k][i] / M[i][i];
+                for (size_t j = i; j <= m; j++) {
+                    M[k][j] -= f * M[i][j];
+                }
+            }
+        }
+        std::vector<double> x(m);
+        for (size_t i = m; i > 0; i--) {
+            double v = M[i - 1][m];
+            for (size_t j = i; j < m; j++) {
+                v -= M[i - 1][j] * x[j];
+            }
+            x[i - 1] = v / M[i - 1][i - 1];
+        }
+
+        size_t most_negative = m;
+        for (size_t i = 0; i < m; i++) {
+            w[cols[i]] = x[i] / scale[cols[i]];
+            if (x[i] < 0 && (most_negative == m || x[i] < x[most_negative])) {
+                most_negative = i;
+            }
+        }
+        if (most_negative == m) {
+            return w;
+        }
+        active[cols[most_negative]] = false;
+    }
+}
+
+}  // namespace
+
+LearnedCostModel::LearnedCostModel() {
+    // Approximate the default model for generic machine parameters: one
+    // unit per operation, and one unit per load plus up to 'balance'
+    // more as the footprint approaches the size of the last-level cache.
+    w = {0, 1, 0, 1, 0, 39, 0, 0};
+    internal_assert((int)w.size() == num_features);
+}
+
+LearnedCostModel::LearnedCostModel(const std::string &weights_path) {
+    load(weights_path);
+}
+
+Expr LearnedCostModel::arith_cost(const GroupFeatures &features, const MachineParams &params) {
+    return weighted_cost(learned_cost_model_features(features, params), w, {0, 1, 2, 6, 7});
+}
+
+Expr LearnedCostModel::memory_cost(const GroupFeatures &features, const MachineParams &params) {
+    return weighted_cost(learned_cost_model_features(features, params), w, {3, 4, 5});
+}
+
+void LearnedCostModel::observe_group(const std::vector<std::string> &funcs,
+                                     const GroupFeatures &features,
+                                     const MachineParams &params) {
+    std::vector<double> values;
+    if (learned_cost_model_features(features, params, &values)) {
+        observed.push_back({funcs, values});
+    }
+}
+
+int LearnedCostModel::add_samples(const std::map<std::string, double> &func_times) {
+    int added = 0;
+    for (const auto &group : observed) {
+        double time = 0;
+        bool measured = false;
+        for (const std::string &f : group.first) {
+            const auto &iter = func_times.find(f);
+            if (iter != func_times.end()) {
+                time += iter->second;
+                measured = true;
+            }
+        }
+        if (measured) {
+            sample_features.push_back(group.second);
+            sample_times.push_back(time * 1e9);
+            added++;
+        }
+    }
+    observed.clear();
+    return added;
+}
+
+int LearnedCostModel::add_samples(const halide_profiler_pipeline_stats &stats) {
+    std::map<std::string, double> func_times;
+    const int runs = std::max(stats.runs, 1);
+    for (int i = 0; i < stats.num_funcs; i++) {
+        const halide_profiler_func_stats &f = stats.funcs[i];
+        if (f.name) {
+            func_times[f.name] += f.time * 1e-9 / runs;
+        }
+    }
+    return add_samples(func_times);
+}
+
+bool LearnedCostModel::train() {
+    if ((int)sample_times.size() < num_features) {
+        return false;
+    }
+    w = non_negative_least_squares(sample_features, sample_times);
+    Internal::debug(1) << "Trained cost model on " << sample_times.size() << " samples:";
+    for (double x : w) {
+        Internal::debug(1) << " " << x;
+    }
+    Internal::debug(1) << "\n";
+    return true;
+}
+
+void LearnedCostModel::save(const std::string &path) const {
+    std::ofstream f(path);
+    user_assert(f.good()) << "Unable to open " << path << " for writing\n";
+    f.precision(17);
+    for (double x : w) {
+        f << x << "\n";
+    }
+}
+
+void LearnedCostModel::load(const std::string &path) {
+    std::ifstream f(path);
+    user_assert(f.good()) << "Unable to open " << path << " for reading\n";
+    std::vector<double> weights;
+    double x;
+    while (f >> x) {
+        weights.push_back(x);
+    }
+    user_assert((int)weights.size() == num_features)
+        << "Expected " << num_features << " cost model weights in " << path
+        << " but found " << weights.size() << "\n";
+    w = weights;
+}
+
+double LearnedCostModel::predict(const GroupFeatures &features, const MachineParams &params) const {
+    std::vector<double> values;
+    if (!learned_cost_model_features(features, params, &values)) {
+        return -1;
+    }
+    double t = 0;
+    for (int i = 0; i < num_features; i++) {
+        t += w[i] * values[i];
+    }
+    return t * 1e-9;
+}
+
 }
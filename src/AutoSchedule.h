@@ -6,9 +6,13 @@
  * Defines the method that does automatic scheduling of Funcs within a pipeline.
  */
 
+#include <map>
+
 #include "Function.h"
 #include "Target.h"
 
+struct halide_profiler_pipeline_stats;
+
 namespace Halide {
 
 /** A struct representing the machine parameters to generate the auto-scheduled
@@ -16,7 +20,7 @@ namespace Halide {
 struct MachineParams {
     /** Maximum level of parallelism avalaible. */
     Expr parallelism;
-    /** Size of the last-level cache (in KB). */
+    /** Size of the last-level cache (in bytes). */
     Expr last_level_cache_size;
     /** Indicates how much more expensive is the cost of a load compared to
      * the cost of an arithmetic operation at last level cache. */
@@ -28,6 +32,16 @@ struct MachineParams {
     /** Default machine parameters for generic CPU architecture. */
     static MachineParams generic();
 
+    /** Machine parameters for the machine this is running on. The number
+     * of hardware threads and the size of the last-level cache(s) are
+     * read from sysfs on Linux, or from cpuid on x86, and the balance is
+     * measured with a short microbenchmark comparing loads that miss the
+     * cache to arithmetic. This takes a fraction of a second the first
+     * time it is called; the result is reused afterwards. Anything that
+     * can't be determined falls back to the generic value. The string
+     * form "host" also produces these parameters. */
+    static MachineParams host();
+
     /** Convert the MachineParams into canonical string form. */
     std::string to_string() const;
 
@@ -35,16 +49,163 @@ struct MachineParams {
     explicit MachineParams(const std::string &s);
 };
 
+/** The features of a group of stages computed together in tiles, as seen
+ * by the auto-scheduler's cost model. Counts are totals over all tiles of
+ * the group, and may be symbolic. */
+struct GroupFeatures {
+    /** The loads done from one Func or input buffer. */
+    struct Load {
+        /** The name of the Func or buffer loaded from. */
+        std::string name;
+        /** The number of loads. */
+        Expr count;
+        /** The footprint (in bytes) of the region loaded from between
+         * reuses, which approximates the reuse distance. */
+        Expr footprint;
+    };
+
+    /** Arithmetic operations, including those of inlined Funcs. */
+    Expr arith;
+    /** The part of 'arith' due to inlining producers into their
+     * consumers rather than loading them. Only computed (it is zero
+     * otherwise) for cost models whose uses_inlined_arith() is true,
+     * since it takes a second pass over the group's regions. */
+    Expr inlined_arith;
+    /** The number of tiles the group is computed in. */
+    Expr tiles;
+    /** The number of tiles that may be computed in parallel. */
+    Expr parallelism;
+    /** The natural vector width of the group output on the target. */
+    int vector_width = 1;
+    /** The number of Funcs inlined into the group. */
+    int num_inlined = 0;
+    /** The loads done by the group. */
+    std::vector<Load> loads;
+};
+
+/** The interface to the cost model the auto-scheduler uses to compare
+ * groupings and tilings. A cost is an Int(64) Expr in arbitrary (but
+ * consistent) units; lower is better. The arithmetic and memory parts
+ * are kept apart because groupings that add arithmetic are treated
+ * specially. The default model charges each arithmetic operation 1, and
+ * each load between 1 and the machine 'balance', growing linearly with
+ * its footprint relative to the last-level cache.
+ *
+ * The auto-scheduler evaluates grouping choices on several threads, so
+ * arith_cost() and memory_cost() may be called concurrently.
+ * observe_group() is only called from the thread that called
+ * generate_schedules(). */
+class CostModel {
+public:
+    virtual ~CostModel() {}
+
+    /** The arithmetic cost of computing a group. */
+    virtual Expr arith_cost(const GroupFeatures &features, const MachineParams &params) = 0;
+
+    /** The memory cost of computing a group. */
+    virtual Expr memory_cost(const GroupFeatures &features, const MachineParams &params) = 0;
+
+    /** Whether the model reads GroupFeatures::inlined_arith. */
+    virtual bool uses_inlined_arith() const { return false; }
+
+    /** Called once for each group of the schedule finally chosen, with
+     * the names of the Funcs it computes (not counting inlined
+     * ones). Models that learn from measurements of the scheduled
+     * pipeline can use this to remember what they predicted. */
+    virtual void observe_group(const std::vector<std::string> &funcs,
+                               const GroupFeatures &features,
+                               const MachineParams &params) {}
+};
+
+/** A cost model that predicts the running time of each group as a linear
+ * combination of its features, with weights fitted to measured running
+ * times. To train it: auto-schedule a pipeline with it, compile the
+ * pipeline for a target with Target::Profile, run it, pass the per-Func
+ * times reported by the profiler to add_samples(), and repeat with
+ * other pipelines or estimates before calling train(). Until trained,
+ * the weights approximate the default cost model with generic machine
+ * parameters. */
+class LearnedCostModel : public CostModel {
+public:
+    /** The features, in the order of the weights:
+     * - vector operations: arithmetic / vector width
+     * - scalar operations: arithmetic
+     * - inlined operations: arithmetic due to inlining
+     * - loads
+     * - loads weighted by footprint relative to a 32KB L1 cache, saturating at 1
+     * - loads weighted by footprint relative to the last-level cache, saturating at 1
+     * - tiles
+     * - work (arithmetic + loads) divided by the usable parallelism
+     */
+    static const int num_features = 8;
+
+    LearnedCostModel();
+
+    /** Construct a model using weights previously written by save(). */
+    explicit LearnedCostModel(const std::string &weights_path);
+
+    Expr arith_cost(const GroupFeatures &features, const MachineParams &params) override;
+    Expr memory_cost(const GroupFeatures &features, const MachineParams &params) override;
+    bool uses_inlined_arith() const override { return true; }
+    void observe_group(const std::vector<std::string> &funcs,
+                       const GroupFeatures &features,
+                       const MachineParams &params) override;
+
+    /** Add a training sample for each group of the last schedule this
+     * model was used for, given the measured time (in seconds) spent
+     * in each Func. Groups with symbolic features or with no
+     * measurements are skipped. Returns the number of samples added. */
+    int add_samples(const std::map<std::string, double> &func_times);
+
+    /** Same as above, but using the statistics gathered by the profiler
+     * for a pipeline compiled with Target::Profile, e.g. obtained from
+     * halide_profiler_get_pipeline_state(). */
+    int add_samples(const halide_profiler_pipeline_stats &stats);
+
+    /** Fit the weights to the samples added so far, by least squares
+     * with the weights constrained to be non-negative. Returns false
+     * (leaving the weights unchanged) if there are too few samples. */
+    bool train();
+
+    /** Write the weights to a file, one per line. */
+    void save(const std::string &path) const;
+
+    /** Read weights written by save(). */
+    void load(const std::string &path);
+
+    /** The current weights. Once trained, they map features to
+     * nanoseconds. */
+    const std::vector<double> &weights() const { return w; }
+
+    /** Predict the running time (in seconds) of a group with constant
+     * features, or return a negative value if they are not constant. */
+    double predict(const GroupFeatures &features, const MachineParams &params) const;
+
+private:
+    std::vector<double> w;
+    std::vector<std::pair<std::vector<std::string>, std::vector<double>>> observed;
+    std::vector<std::vector<double>> sample_features;
+    std::vector<double> sample_times;
+};
+
 namespace Internal {
 
 /** Generate schedules for Funcs within a pipeline. The Funcs should not already
  * have specializations or schedules as the current auto-scheduler does not take
  * into account user-defined schedules or specializations. This applies the
  * schedules and returns a string representation of the schedules. The target
- * architecture is specified by 'target'. */
+ * architecture is specified by 'target'. A nonzero 'candidate' picks the
+ * candidate-th best tile configuration of each group according to the cost
+ * model, instead of the best one, which also changes the grouping
+ * decisions. The same rank is used for every group: candidates are not
+ * ranked over all combinations of per-group choices, which would grow
+ * exponentially with the number of groups. This is used for empirical
+ * autotuning. If 'cost_model' is null, the default cost model is used. */
 std::string generate_schedules(const std::vector<Function> &outputs,
                                const Target &target,
-                               const MachineParams &arch_params);
+                               const MachineParams &arch_params,
+                               int candidate = 0,
+                               CostModel *cost_model = nullptr);
 
 }
 }
@@ -0,0 +1,375 @@
+#include <set>
+
+#include "BlockTranspose.h"
+#include "IREquality.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Util.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Check if an index is a ramp whose stride equals its number of lanes,
+// which is one column of a square block stored row-major. If so,
+// split the base into a non-constant part and a constant offset.
+bool is_block_column(const Expr &index, Expr *base, int64_t *offset) {
+    const Ramp *r = index.as<Ramp>();
+    if (!r || (r->lanes != 4 && r->lanes != 8 && r->lanes != 16) ||
+        !is_const(r->stride, r->lanes)) {
+        return false;
+    }
+    const Add *add = r->base.as<Add>();
+    const int64_t *k = nullptr;
+    if (add && (k = as_const_int(add->b))) {
+        *base = add->a;
+        *offset = *k;
+    } else if ((k = as_const_int(r->base))) {
+        *base = make_zero(r->base.type());
+        *offset = *k;
+    } else {
+        *base = r->base;
+        *offset = 0;
+    }
+    return true;
+}
+
+// Collect the loads that might be columns of a block. Loads under a
+// Let might depend on the Let, and loads under an if_then_else might
+// not be safe to do unconditionally, so they're left alone.
+class FindBlockColumnLoads : public IRVisitor {
+    using IRVisitor::visit;
+
+    int depth = 0;
+
+    void visit(const Let *op) {
+        op->value.accept(this);
+        depth++;
+        op->body.accept(this);
+        depth--;
+    }
+
+    void visit(const Call *op) {
+        if (op->is_intrinsic(Call::if_then_else)) {
+            depth++;
+            IRVisitor::visit(op);
+            depth--;
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+    void visit(const Load *op) {
+        IRVisitor::visit(op);
+        Expr base;
+        int64_t offset;
+        if (depth == 0 && is_one(op->predicate) &&
+            is_block_column(op->index, &base, &offset)) {
+            loads.push_back(op);
+        }
+    }
+
+public:
+    vector<const Load *> loads;
+};
+
+// Check whether a stmt or expr loads from or stores to a buffer.
+class AccessesBuffer : public IRVisitor {
+    using IRVisitor::visit;
+
+    const string &name;
+    bool check_loads;
+
+    void visit(const Load *op) {
+        IRVisitor::visit(op);
+        result = result || (check_loads && op->name == name);
+    }
+
+    void visit(const Store *op) {
+        IRVisitor::visit(op);
+        result = result || op->name == name;
+    }
+
+public:
+    bool result = false;
+    AccessesBuffer(const string &n, bool l) : name(n), check_loads(l) {}
+};
+
+bool stores_to(const Stmt &s, const string &name) {
+    AccessesBuffer a(name, false);
+    s.accept(&a);
+    return a.result;
+}
+
+bool loads_from(const Expr &e, const string &name) {
+    AccessesBuffer a(name, true);
+    e.accept(&a);
+    return a.result;
+}
+
+// Check whether evaluating an expr might have side effects, or give a
+// different result when moved past other side effects. Loads from
+// buffers other than the one being stored to are fine.
+class HasImpureCall : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        result = result || !op->is_pure();
+    }
+
+public:
+    bool result = false;
+};
+
+bool has_impure_call(const Expr &e) {
+    HasImpureCall h;
+    e.accept(&h);
+    return h.result;
+}
+
+// A set of loads that together cover every column of a block.
+struct BlockLoads {
+    const Load *first;
+    Expr base;
+    map<int64_t, vector<const Load *>> columns;
+    size_t first_stmt, last_stmt;
+};
+
+class LowerBlockTransposes : public IRMutator2 {
+    using IRMutator2::visit;
+
+    // Replace the loads found by FindBlockColumnLoads. Like it, this
+    // doesn't look under Lets or if_then_else, where the same Load
+    // node might not refer to the same memory, or might not be safe
+    // to do early.
+    class ReplaceLoads : public IRMutator2 {
+        using IRMutator2::visit;
+
+        const map<const Load *, Expr> &replacements;
+
+        Expr visit(const Let *op) override {
+            Expr value = mutate(op->value);
+            if (value.same_as(op->value)) {
+                return op;
+            }
+            return Let::make(op->name, value, op->body);
+        }
+
+        Expr visit(const Call *op) override {
+            if (op->is_intrinsic(Call::if_then_else)) {
+                return op;
+            }
+            return IRMutator2::visit(op);
+        }
+
+        Expr visit(const Load *op) override {
+            auto it = replacements.find(op);
+            if (it != replacements.end()) {
+                return it->second;
+            }
+            return IRMutator2::visit(op);
+        }
+
+    public:
+        ReplaceLoads(const map<const Load *, Expr> &r) : replacements(r) {}
+    };
+
+    Stmt visit(const For *op) override {
+        if (op->device_api != DeviceAPI::None &&
+            op->device_api != DeviceAPI::Host) {
+            return op;
+        }
+        return IRMutator2::visit(op);
+    }
+
+    // Replace each run of stores to the columns of a block with a
+    // single dense store of the transposed values.
+    void merge_column_stores(vector<Stmt> &stmts) {
+        vector<Stmt> result;
+        for (size_t i = 0; i < stmts.size(); i++) {
+            const Store *first = stmts[i].as<Store>();
+            Expr base;
+            int64_t offset;
+            if (!first || !is_one(first->predicate) ||
+                !is_block_column(first->index, &base, &offset)) {
+                result.push_back(stmts[i]);
+                continue;
+            }
+
+            const int n = first->value.type().lanes();
+            map<int64_t, Expr> columns;
+            for (size_t j = i; j < stmts.size() && j < i + n; j++) {
+                const Store *s = stmts[j].as<Store>();
+                Expr b;
+                int64_t k;
+                if (!s || s->name != first->name ||
+                    s->value.type() != first->value.type() ||
+                    !is_one(s->predicate) ||
+                    !is_block_column(s->index, &b, &k) ||
+                    !equal(b, base) ||
+                    loads_from(s->value, first->name) ||
+                    has_impure_call(s->value) ||
+                    columns.count(k)) {
+                    break;
+                }
+                columns[k] = s->value;
+            }
+
+            if ((int)columns.size() != n ||
+                columns.rbegin()->first - columns.begin()->first != n - 1) {
+                result.push_back(stmts[i]);
+                continue;
+            }
+
+            vector<Expr> values;
+            for (const auto &c : columns) {
+                values.push_back(c.second);
+            }
+            Expr index = Ramp::make(simplify_base(base, columns.begin()->first), 1, n * n);
+            Expr value = Shuffle::make_transpose(values, n);
+            debug(3) << "Merging " << n << " column stores to " << first->name << "\n";
+            result.push_back(Store::make(first->name, value, index, first->param, const_true(n * n)));
+            i += n - 1;
+        }
+        stmts.swap(result);
+    }
+
+    Expr simplify_base(const Expr &base, int64_t offset) {
+        if (is_zero(base)) {
+            return make_const(base.type(), offset);
+        } else if (offset == 0) {
+            return base;
+        } else {
+            return base + make_const(base.type(), offset);
+        }
+    }
+
+    // Replace loads of all the columns of a block with slices of a
+    // transposed dense load. Returns the lets to wrap around each
+    // stmt, keyed by the index of the stmt.
+    map<size_t, vector<std::pair<string, Expr>>> transpose_column_loads(vector<Stmt> &stmts) {
+        vector<BlockLoads> groups;
+        for (size_t i = 0; i < stmts.size(); i++) {
+            // Only look at the loads done unconditionally by this
+            // stmt, in the scope enclosing the block.
+            if (!stmts[i].as<Store>() && !stmts[i].as<Evaluate>()) {
+                continue;
+            }
+            FindBlockColumnLoads finder;
+            stmts[i].accept(&finder);
+            for (const Load *load : finder.loads) {
+                Expr base;
+                int64_t offset;
+                is_block_column(load->index, &base, &offset);
+                BlockLoads *group = nullptr;
+                for (BlockLoads &g : groups) {
+                    if (g.first->name == load->name &&
+                        g.first->type == load->type &&
+                        equal(g.base, base)) {
+                        group = &g;
+                        break;
+                    }
+                }
+                if (!group) {
+                    groups.push_back({load, base, {}, i, i});
+                    group = &groups.back();
+                }
+                group->columns[offset].push_back(load);
+                group->last_stmt = i;
+            }
+        }
+
+        // The replacements for the loads in each stmt. A group's loads
+        // are only replaced in the stmts it was found in, as the same
+        // Load node elsewhere might be out of the scope of its let, or
+        // read the block after it has been written to.
+        map<size_t, map<const Load *, Expr>> replacements;
+        map<size_t, vector<std::pair<string, Expr>>> lets;
+        for (const BlockLoads &g : groups) {
+            const int n = g.first->type.lanes();
+            if ((int)g.columns.size() != n ||
+                g.columns.rbegin()->first - g.columns.begin()->first != n - 1) {
+                continue;
+            }
+
+            // The block must not change between the loads.
+            bool written = false;
+            for (size_t i = g.first_stmt; i <= g.last_stmt && !written; i++) {
+                written = stores_to(stmts[i], g.first->name);
+            }
+            if (written) {
+                continue;
+            }
+
+            int64_t min_offset = g.columns.begin()->first;
+            Expr index = Ramp::make(simplify_base(g.base, min_offset), 1, n * n);
+            Expr block = Load::make(g.first->type.with_lanes(n * n), g.first->name, index,
+                                    g.first->image, g.first->param, const_true(n * n));
+            string name = unique_name('t');
+            Expr value = Shuffle::make_transpose({block}, n);
+            Expr var = Variable::make(value.type(), name);
+            debug(3) << "Transposing " << n << " column loads from " << g.first->name << "\n";
+
+            for (const auto &c : g.columns) {
+                Expr column = Shuffle::make_slice(var, (int)(c.first - min_offset) * n, 1, n);
+                for (const Load *load : c.second) {
+                    for (size_t i = g.first_stmt; i <= g.last_stmt; i++) {
+                        replacements[i][load] = column;
+                    }
+                }
+            }
+            lets[g.first_stmt].push_back({name, value});
+        }
+
+        for (const auto &r : replacements) {
+            Stmt &s = stmts[r.first];
+            if (s.as<Store>() || s.as<Evaluate>()) {
+                s = ReplaceLoads(r.second).mutate(s);
+            }
+        }
+        return lets;
+    }
+
+    Stmt visit(const Block *op) override {
+        vector<Stmt> stmts;
+        Stmt rest = op;
+        while (const Block *b = rest.as<Block>()) {
+            stmts.push_back(mutate(b->first));
+            rest = b->rest;
+        }
+        stmts.push_back(mutate(rest));
+
+        merge_column_stores(stmts);
+        auto lets = transpose_column_loads(stmts);
+
+        // Rebuild the block from the back, so that each let wraps
+        // the stmt that first uses it and everything after it.
+        Stmt result;
+        for (size_t i = stmts.size(); i > 0; i--) {
+            result = result.defined() ? Block::make(stmts[i - 1], result) : stmts[i - 1];
+            auto it = lets.find(i - 1);
+            if (it != lets.end()) {
+                for (const auto &let : it->second) {
+                    result = LetStmt::make(let.first, let.second, result);
+                }
+            }
+        }
+        return result;
+    }
+};
+
+}  // namespace
+
+Stmt lower_block_transposes(Stmt s) {
+    return LowerBlockTransposes().mutate(s);
+}
+
+}
+}
@@ -0,0 +1,27 @@
+#ifndef HALIDE_BLOCK_TRANSPOSE_H
+#define HALIDE_BLOCK_TRANSPOSE_H
+
+/** \file
+ * Defines a lowering pass that turns unrolled groups of strided vector
+ * loads and stores into dense accesses and an in-register transpose.
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Look for sequences of statements that together load or store every
+ * column of a 4x4, 8x8, or 16x16 block of a buffer, one strided vector
+ * at a time. This is what a transpose vectorized across the strided
+ * dimension and unrolled across the other looks like. Loads are
+ * replaced with slices of a single dense load of the block transposed
+ * in registers, and stores with a single dense store of the
+ * transposed values. Accesses inside GPU and Hexagon loops are left
+ * alone. */
+Stmt lower_block_transposes(Stmt s);
+
+}
+}
+
+#endif
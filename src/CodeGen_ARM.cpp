@@ -637,8 +637,15 @@ void CodeGen_ARM::visit(const Store *op) {
         return;
     }
 
-    // First dig through let expressions
+    // First dig through let expressions. There are no non-temporal
+    // vstN instructions, so an interleaving store that was marked as
+    // non-temporal still uses vstN, and only loses the hint.
     Expr rhs = op->value;
+    if (const Call *c = rhs.as<Call>()) {
+        if (c->is_intrinsic(Call::nontemporal_store)) {
+            rhs = c->args[0];
+        }
+    }
     vector<pair<string, Expr>> lets;
     while (const Let *let = rhs.as<Let>()) {
         rhs = let->body;
@@ -259,7 +259,8 @@ CodeGen_LLVM::CodeGen_LLVM(Target t) :
     min_f64(Float(64).min()),
     max_f64(Float(64).max()),
     destructor_block(nullptr),
-    strict_float(t.has_feature(Target::StrictFloat)) {
+    strict_float(t.has_feature(Target::StrictFloat)),
+    emitted_nontemporal_store(false) {
     initialize_llvm();
 }
 
@@ -718,8 +719,14 @@ void CodeGen_LLVM::compile_func(const LoweredFunc &f, const std::string &simple_
 
      // Generate the function body.
     debug(1) << "Generating llvm bitcode for function " << f.name << "...\n";
+    emitted_nontemporal_store = false;
     f.body.accept(this);
 
+    if (emitted_nontemporal_store) {
+        codegen_nontemporal_store_fence();
+        emitted_nontemporal_store = false;
+    }
+
     // Clean up and return.
     end_func(f.args);
 }
@@ -1902,6 +1909,34 @@ Value *CodeGen_LLVM::interleave_vectors(const std::vector<Value *> &vecs) {
     }
 }
 
+Value *CodeGen_LLVM::transpose_square(Value *vec, int n) {
+    // Transpose an n x n matrix with log2(n) rounds of interleaving
+    // row i with row i + n/2 and splitting the result in half. Each
+    // of these is a two-input shuffle that maps directly onto the
+    // unpack (x86) or zip (ARM) instructions.
+    vector<Value *> rows;
+    for (int i = 0; i < n; i++) {
+        rows.push_back(slice_vector(vec, i * n, n));
+    }
+
+    vector<int> lo(n), hi(n);
+    for (int i = 0; i < n; i++) {
+        lo[i] = i % 2 == 0 ? i / 2 : i / 2 + n;
+        hi[i] = lo[i] + n / 2;
+    }
+
+    for (int step = 1; step < n; step *= 2) {
+        vector<Value *> new_rows;
+        for (int i = 0; i < n / 2; i++) {
+            new_rows.push_back(shuffle_vectors(rows[i], rows[i + n / 2], lo));
+            new_rows.push_back(shuffle_vectors(rows[i], rows[i + n / 2], hi));
+        }
+        rows.swap(new_rows);
+    }
+
+    return concat_vectors(rows);
+}
+
 void CodeGen_LLVM::scalarize(Expr e) {
     llvm::Type *result_type = llvm_type_of(e.type());
 
@@ -2690,6 +2725,10 @@ void CodeGen_LLVM::visit(const Call *op) {
         builder->setFastMathFlags(safe_flags);
         builder->setDefaultFPMathTag(strict_fp_math_md);
         value = codegen(op->args[0]);
+    } else if (op->is_intrinsic(Call::nontemporal_store)) {
+        // The marker only matters to the enclosing Store, which
+        // checks for it directly. Anywhere else it's a no-op.
+        value = codegen(op->args[0]);
     } else if (op->is_intrinsic()) {
         internal_error << "Unknown intrinsic: " << op->name << "\n";
     } else if (op->call_type == Call::PureExtern && op->name == "pow_f32") {
@@ -3110,8 +3149,15 @@ void CodeGen_LLVM::visit(const For *op) {
         // Load everything from the closure into the new scope
         unpack_closure(closure, symbol_table, closure_t, closure_handle, builder);
 
-        // Generate the new function body
+        // Generate the new function body. Each task fences its own
+        // non-temporal stores before signalling completion.
+        bool parent_emitted_nontemporal_store = emitted_nontemporal_store;
+        emitted_nontemporal_store = false;
         codegen(op->body);
+        if (emitted_nontemporal_store) {
+            codegen_nontemporal_store_fence();
+        }
+        emitted_nontemporal_store = parent_emitted_nontemporal_store;
 
         // Return success
         return_with_error_code(ConstantInt::get(i32_t, 0));
@@ -3149,6 +3195,10 @@ void CodeGen_LLVM::visit(const For *op) {
     }
 }
 
+void CodeGen_LLVM::codegen_nontemporal_store_fence() {
+    builder->CreateFence(AtomicOrdering::SequentiallyConsistent);
+}
+
 void CodeGen_LLVM::visit(const Store *op) {
     // Even on 32-bit systems, Handles are treated as 64-bit in
     // memory, so convert stores of handles to stores of uint64_ts.
@@ -3167,6 +3217,8 @@ void CodeGen_LLVM::visit(const Store *op) {
     Halide::Type value_type = op->value.type();
     Value *val = codegen(op->value);
     bool is_external = (external_buffer.find(op->name) != external_buffer.end());
+    const Call *value_call = op->value.as<Call>();
+    bool nontemporal = value_call && value_call->is_intrinsic(Call::nontemporal_store);
     // Scalar
     if (value_type.is_scalar()) {
         Value *ptr = codegen_buffer_pointer(op->name, value_type, op->index);
@@ -3216,6 +3268,14 @@ void CodeGen_LLVM::visit(const Store *op) {
                 Value *vec_ptr = builder->CreatePointerCast(elt_ptr, slice_val->getType()->getPointerTo());
                 StoreInst *store = builder->CreateAlignedStore(slice_val, vec_ptr, alignment);
                 add_tbaa_metadata(store, op->name, slice_index);
+                // Streaming stores must be aligned to the vector
+                // size, otherwise backends split them into scalar
+                // non-temporal stores.
+                if (nontemporal && alignment >= slice_lanes * value_type.bytes()) {
+                    store->setMetadata(LLVMContext::MD_nontemporal,
+                                       MDNode::get(*context, {ConstantAsMetadata::get(ConstantInt::get(i32_t, 1))}));
+                    emitted_nontemporal_store = true;
+                }
             }
         } else if (ramp) {
             Type ptr_type = value_type.element_of();
@@ -3315,6 +3375,10 @@ void CodeGen_LLVM::visit(const Shuffle *op) {
             // If this is just a concat, we're done.
         } else if (op->is_slice() && op->slice_stride() == 1) {
             value = slice_vector(value, op->indices[0], op->indices.size());
+        } else if (op->is_transpose() &&
+                   op->transpose_factor() * op->transpose_factor() == (int)op->indices.size() &&
+                   (op->transpose_factor() & (op->transpose_factor() - 1)) == 0) {
+            value = transpose_square(value, op->transpose_factor());
         } else {
             value = shuffle_vectors(value, op->indices);
         }
@@ -370,6 +370,11 @@ protected:
      * inject the appropriate target-specific cleanup code. */
     virtual void prepare_for_early_exit() {}
 
+    /** Emit a fence that makes the non-temporal stores issued so far
+     * by this thread visible to other threads. The default is a
+     * sequentially-consistent fence. */
+    virtual void codegen_nontemporal_store_fence();
+
     /** Get the llvm type equivalent to the given halide type in the
      * current context. */
     llvm::Type *llvm_type_of(Type);
@@ -415,6 +420,10 @@ protected:
     /** Concatenate a bunch of llvm vectors. Must be of the same type. */
     virtual llvm::Value *concat_vectors(const std::vector<llvm::Value *> &);
 
+    /** Transpose a square matrix stored row-major in a vector with
+     * n*n lanes, where n is a power of two. */
+    llvm::Value *transpose_square(llvm::Value *vec, int n);
+
     /** Create an LLVM shuffle vectors instruction. */
     virtual llvm::Value *shuffle_vectors(llvm::Value *a, llvm::Value *b,
                                          const std::vector<int> &indices);
@@ -463,6 +472,10 @@ private:
     /** Turn off all unsafe math flags in scopes while this is set. */
     bool strict_float;
 
+    /** Set when the function being generated has emitted a
+     * non-temporal store that hasn't been fenced yet. */
+    bool emitted_nontemporal_store;
+
     /** Embed an instance of halide_filter_metadata_t in the code, using
      * the given name (by convention, this should be ${FUNCTIONNAME}_metadata)
      * as extern "C" linkage. Note that the return value is a function-returning-
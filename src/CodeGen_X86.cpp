@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 
 #include "CodeGen_X86.h"
@@ -60,6 +61,70 @@ bool should_use_pmaddwd(Expr a, Expr b, vector<Expr> &result) {
     return true;
 }
 
+bool has_avx512(const Target &t) {
+    return (t.has_feature(Target::AVX512) ||
+            t.has_feature(Target::AVX512_KNL) ||
+            t.has_feature(Target::AVX512_Skylake) ||
+            t.has_feature(Target::AVX512_Cannonlake));
+}
+
+// Decide whether a vector load or store of the given type and index
+// should be done with hardware gathers or scatters, and if so, how
+// many lanes each instruction should cover. Returns zero if it should
+// be scalarized instead.
+//
+// Scalarizing costs an index extract, a scalar memory op, and an
+// insert or extract of the value per lane: about three uops. The
+// hardware instructions are cracked into roughly one uop per lane on
+// AVX2 parts, and about half that on AVX-512 parts, plus a fixed
+// overhead for setting up the mask and address generation. Only 32-
+// and 64-bit elements can be gathered; widening narrower lookups
+// would read past the end of the buffer.
+int gather_scatter_lanes(const Target &t, Type type, const Expr &index, bool is_store) {
+    if (type.is_scalar() || type.is_handle() ||
+        (type.bits() != 32 && type.bits() != 64) ||
+        index.type() != Int(32, type.lanes())) {
+        return 0;
+    }
+
+    // Ramps have better special cases, and a broadcast index is a
+    // scalar load.
+    if (index.as<Ramp>() || index.as<Broadcast>()) {
+        return 0;
+    }
+
+    bool avx512 = has_avx512(t);
+    bool avx2 = t.has_feature(Target::AVX2);
+    if (!avx512 && !(avx2 && !is_store)) {
+        return 0;
+    }
+
+    int lanes = 0;
+    if (avx512) {
+        lanes = std::min(512 / type.bits(), type.lanes());
+    } else if (type.lanes() % (256 / type.bits()) == 0) {
+        lanes = 256 / type.bits();
+    } else if (type.bits() == 32) {
+        // The 128-bit forms of the 64-bit element gathers still take
+        // four indices, so only use the narrow form for 32-bit elements.
+        lanes = 128 / type.bits();
+    }
+    if (lanes == 0 || type.lanes() % lanes != 0) {
+        return 0;
+    }
+
+    // Costs in half-uops.
+    const int fixed_cost = 8;
+    const int per_lane_cost = avx512 ? 1 : 2;
+    int instructions = type.lanes() / lanes;
+    int hardware_cost = instructions * (fixed_cost + lanes * per_lane_cost);
+    int scalar_cost = type.lanes() * 6;
+    if (hardware_cost >= scalar_cost) {
+        return 0;
+    }
+    return lanes;
+}
+
 }
 
 
@@ -373,6 +438,116 @@ Expr CodeGen_X86::mulhi_shr(Expr a, Expr b, int shr) {
     return CodeGen_Posix::mulhi_shr(a, b, shr);
 }
 
+Value *CodeGen_X86::interleave_vectors(const vector<Value *> &vecs) {
+    if (vecs.size() == 3) {
+        // LLVM turns the generic three-way interleave into long
+        // chains of inserts and blends. A four-way interleave is a
+        // tree of unpacks, and the compaction afterwards is a single
+        // shuffle of one input, which becomes pshufb and permutes.
+        int lanes = vecs[0]->getType()->getVectorNumElements();
+        Value *padded = CodeGen_Posix::interleave_vectors({vecs[0], vecs[1], vecs[2],
+                                                           UndefValue::get(vecs[0]->getType())});
+        vector<int> indices;
+        for (int i = 0; i < lanes * 4; i++) {
+            if (i % 4 != 3) {
+                indices.push_back(i);
+            }
+        }
+        return shuffle_vectors(padded, indices);
+    }
+    return CodeGen_Posix::interleave_vectors(vecs);
+}
+
+void CodeGen_X86::visit(const Load *op) {
+    int lanes = gather_scatter_lanes(target, op->type, op->index, false);
+    if (lanes == 0) {
+        CodeGen_Posix::visit(op);
+        return;
+    }
+
+    Type elem = op->type.element_of();
+    Value *base = codegen_buffer_pointer(op->name, elem, ConstantInt::get(i32_t, 0));
+    Value *index = codegen(op->index);
+    Value *mask = is_one(op->predicate) ? nullptr : codegen(op->predicate);
+
+    if (has_avx512(target)) {
+        // LLVM selects vpgather for the generic intrinsic when
+        // AVX-512 is available.
+        Value *ptrs = builder->CreateInBoundsGEP(base, index);
+        Instruction *gather = builder->CreateMaskedGather(ptrs, elem.bytes(), mask);
+        add_tbaa_metadata(gather, op->name, op->index);
+        value = gather;
+        return;
+    }
+
+    // On AVX2, LLVM only selects vpgather for the generic intrinsic
+    // when tuning for a part with fast gathers, so call the
+    // target-specific ones directly.
+    Intrinsic::ID id;
+    if (elem.is_float()) {
+        if (elem.bits() == 32) {
+            id = lanes == 8 ? Intrinsic::x86_avx2_gather_d_ps_256 : Intrinsic::x86_avx2_gather_d_ps;
+        } else {
+            id = Intrinsic::x86_avx2_gather_d_pd_256;
+        }
+    } else {
+        if (elem.bits() == 32) {
+            id = lanes == 8 ? Intrinsic::x86_avx2_gather_d_d_256 : Intrinsic::x86_avx2_gather_d_d;
+        } else {
+            id = Intrinsic::x86_avx2_gather_d_q_256;
+        }
+    }
+    llvm::Function *gather = Intrinsic::getDeclaration(module.get(), id);
+
+    llvm::Type *slice_t = VectorType::get(llvm_type_of(elem), lanes);
+    llvm::Type *mask_t = VectorType::get(llvm_type_of(elem.with_code(Type::Int)), lanes);
+    Value *base_i8 = builder->CreatePointerCast(base, i8_t->getPointerTo());
+    Value *scale = ConstantInt::get(i8_t, elem.bytes());
+    Value *passthru = Constant::getNullValue(slice_t);
+
+    // The gathers take the mask as a vector of the element type, and
+    // look at the sign bit of each lane.
+    vector<Value *> results;
+    for (int i = 0; i < op->type.lanes(); i += lanes) {
+        Value *slice_mask;
+        if (mask) {
+            slice_mask = builder->CreateSExt(slice_vector(mask, i, lanes), mask_t);
+        } else {
+            slice_mask = Constant::getAllOnesValue(mask_t);
+        }
+        slice_mask = builder->CreateBitCast(slice_mask, slice_t);
+        Value *slice_index = slice_vector(index, i, lanes);
+        Instruction *slice = builder->CreateCall(gather, {passthru, base_i8, slice_index, slice_mask, scale});
+        add_tbaa_metadata(slice, op->name, op->index);
+        results.push_back(slice);
+    }
+    value = concat_vectors(results);
+}
+
+void CodeGen_X86::visit(const Store *op) {
+    int lanes = gather_scatter_lanes(target, op->value.type(), op->index, true);
+    if (lanes == 0) {
+        CodeGen_Posix::visit(op);
+        return;
+    }
+
+    // Overlapping lanes of a scatter are written in order from lowest
+    // to highest, which matches the semantics of a scalarized store.
+    Type elem = op->value.type().element_of();
+    Value *val = codegen(op->value);
+    Value *base = codegen_buffer_pointer(op->name, elem, ConstantInt::get(i32_t, 0));
+    Value *index = codegen(op->index);
+    Value *mask = is_one(op->predicate) ? nullptr : codegen(op->predicate);
+    Value *ptrs = builder->CreateInBoundsGEP(base, index);
+    Instruction *scatter = builder->CreateMaskedScatter(val, ptrs, elem.bytes(), mask);
+    add_tbaa_metadata(scatter, op->name, op->index);
+}
+
+void CodeGen_X86::codegen_nontemporal_store_fence() {
+    llvm::Function *sfence = llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::x86_sse_sfence);
+    builder->CreateCall(sfence);
+}
+
 string CodeGen_X86::mcpu() const {
     if (target.has_feature(Target::AVX512_Cannonlake)) return "cannonlake";
     if (target.has_feature(Target::AVX512_Skylake)) return "skylake-avx512";
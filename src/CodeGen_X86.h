@@ -31,6 +31,13 @@ protected:
 
     Expr mulhi_shr(Expr a, Expr b, int shr);
 
+    /** Three-way interleaves are done as four-way interleaves with
+     * an undef fourth vector, followed by dropping every fourth lane. */
+    llvm::Value *interleave_vectors(const std::vector<llvm::Value *> &);
+
+    /** Non-temporal stores only need an sfence, not an mfence. */
+    void codegen_nontemporal_store_fence();
+
     using CodeGen_Posix::visit;
 
     /** Nodes for which we want to emit specific sse/avx intrinsics */
@@ -46,6 +53,14 @@ protected:
     void visit(const NE *);
     void visit(const Select *);
     // @}
+
+    /** Use hardware gathers (AVX2, AVX-512) and scatters (AVX-512)
+     * for vector loads and stores with data-dependent indices, when
+     * that looks cheaper than doing them one lane at a time. */
+    // @{
+    void visit(const Load *);
+    void visit(const Store *);
+    // @}
 };
 
 }}
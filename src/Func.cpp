@@ -964,7 +964,7 @@ void Stage::split(const string &old, const string &outer, const string &inner, E
             << " in update definition of " << name() << ". "
             << "It may redundantly recompute some values, which "
             << "could change the meaning of the algorithm. "
-            << "Use TailStrategy::GuardWithIf instead.";
+            << "Use TailStrategy::GuardWithIf or TailStrategy::Predicate instead.";
     }
 
 
@@ -1029,9 +1029,9 @@ void Stage::split(const string &old, const string &outer, const string &inner, E
     }
 
     if (exact) {
-        user_assert(tail == TailStrategy::GuardWithIf)
+        user_assert(tail == TailStrategy::GuardWithIf || tail == TailStrategy::Predicate)
             << "When splitting Var " << old_name
-            << " the tail strategy must be GuardWithIf or Auto. "
+            << " the tail strategy must be GuardWithIf, Predicate, or Auto. "
             << "Anything else may change the meaning of the algorithm\n";
     }
 
@@ -1723,6 +1723,12 @@ Stage &Stage::prefetch(const Internal::Parameter &param, VarOrRVar var, Expr off
     return *this;
 }
 
+Stage &Stage::auto_prefetch(VarOrRVar var, Expr offset, PrefetchBoundStrategy strategy) {
+    PrefetchDirective prefetch = {"", var.name(), offset, strategy, Parameter()};
+    definition.schedule().prefetches().push_back(prefetch);
+    return *this;
+}
+
 Stage &Stage::compute_with(LoopLevel loop_level, const map<string, LoopAlignStrategy> &align) {
     loop_level.lock();
     user_assert(!loop_level.is_inlined() && !loop_level.is_root())
@@ -1986,6 +1992,12 @@ Func &Func::store_in(MemoryType t) {
     return *this;
 }
 
+Func &Func::store_nontemporal(bool nontemporal) {
+    invalidate_cache();
+    func.schedule().nontemporal() = nontemporal;
+    return *this;
+}
+
 Stage Func::specialize(Expr c) {
     invalidate_cache();
     return Stage(func, func.definition(), 0, args()).specialize(c);
@@ -2301,6 +2313,12 @@ Func &Func::prefetch(const Internal::Parameter &param, VarOrRVar var, Expr offse
     return *this;
 }
 
+Func &Func::auto_prefetch(VarOrRVar var, Expr offset, PrefetchBoundStrategy strategy) {
+    invalidate_cache();
+    Stage(func, func.definition(), 0, args()).auto_prefetch(var, offset, strategy);
+    return *this;
+}
+
 Func &Func::reorder_storage(Var x, Var y) {
     invalidate_cache();
 
@@ -2446,12 +2464,24 @@ Func &Func::trace_loads() {
     return *this;
 }
 
+Func &Func::trace_loads(const TraceSampling &sampling) {
+    invalidate_cache();
+    func.trace_loads(sampling);
+    return *this;
+}
+
 Func &Func::trace_stores() {
     invalidate_cache();
     func.trace_stores();
     return *this;
 }
 
+Func &Func::trace_stores(const TraceSampling &sampling) {
+    invalidate_cache();
+    func.trace_stores(sampling);
+    return *this;
+}
+
 Func &Func::trace_realizations() {
     invalidate_cache();
     func.trace_realizations();
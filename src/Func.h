@@ -407,6 +407,12 @@ public:
     }
     // @}
 
+    /** Prefetch data 'offset' iterations ahead of the loop over 'var'
+     * in this stage, choosing the buffers to prefetch automatically.
+     * See Func::auto_prefetch. */
+    Stage &auto_prefetch(VarOrRVar var, Expr offset = 1,
+                         PrefetchBoundStrategy strategy = PrefetchBoundStrategy::GuardWithIf);
+
     /** Attempt to get the source file and line where this stage was
      * defined by parsing the process's own debug symbols. Returns an
      * empty string if no debug symbols were found or the debug
@@ -1048,8 +1054,11 @@ public:
      * debugging.
      *
      * If filename ends in ".tif" or ".tiff" (case insensitive) the file
-     * is in TIFF format and can be read by standard tools. Oherwise, the
-     * file format is as follows:
+     * is in TIFF format and can be read by standard tools. If it ends
+     * in ".mat", the file is a level 5 MATLAB file. If it ends in
+     * ".npy", the file is a NumPy array whose axes are the dimensions
+     * of the Func, in order, which np.load can map in place with
+     * mmap_mode='r'. Oherwise, the file format is as follows:
      *
      * All data is in the byte-order of the target platform.  First, a
      * 20 byte-header containing four 32-bit ints, giving the extents
@@ -1884,6 +1893,33 @@ public:
     }
     // @}
 
+    /** Prefetch data 'offset' iterations ahead of the loop over 'var',
+     * like prefetch(), but let the compiler choose which buffers to
+     * prefetch. Buffers streamed contiguously are left to the
+     * hardware prefetcher, and ones whose footprint doesn't move
+     * across 'var' are skipped. Of the others, only the part of the
+     * footprint not already touched by earlier iterations is
+     * prefetched, trimmed to its leading cache lines if it is too
+     * large to fit comfortably in L1. Data-dependent gathers, whose
+     * coordinates are loaded from another buffer, are instead
+     * prefetched one element per call site, by computing the
+     * coordinates 'offset' iterations ahead; this requires the
+     * coordinates not to depend on loops or lets inside 'var', so it
+     * is usually the innermost serial loop that should be given.
+     * Buffers named in an explicit prefetch on the same loop are left
+     * alone. For example:
+     \code
+     f.compute_root();
+     g(x, y) = f(y, x);
+     g.split(x, xo, xi, 8).auto_prefetch(xo, 2);
+     \endcode
+     *
+     * will prefetch the eight rows of 'f' that the iteration of xo two
+     * ahead of the current one will read.
+     */
+    Func &auto_prefetch(VarOrRVar var, Expr offset = 1,
+                        PrefetchBoundStrategy strategy = PrefetchBoundStrategy::GuardWithIf);
+
     /** Specify how the storage for the function is laid out. These
      * calls let you specify the nesting order of the dimensions. For
      * example, foo.reorder_storage(y, x) tells Halide to use
@@ -2233,16 +2269,43 @@ public:
      * on MemoryType for more detail. */
     Func &store_in(MemoryType memory_type);
 
+    /** Write this Func using non-temporal (streaming) stores, which
+     * bypass the cache and avoid reading the destination lines in
+     * before overwriting them. This is a good idea for large buffers
+     * that are written once and not read again soon, e.g. the output
+     * of a resize or a format conversion. Only aligned, dense,
+     * unpredicated vector stores are affected, so this is usually
+     * combined with vectorize and align_storage or a suitably aligned
+     * output buffer. A fence is emitted at the end of each parallel
+     * task and of the pipeline so that the stores are visible to
+     * other threads. Has no effect on GPU or Hexagon loops, or with
+     * the C backend. */
+    Func &store_nontemporal(bool nontemporal = true);
+
     /** Trace all loads from this Func by emitting calls to
      * halide_trace. If the Func is inlined, this has no
      * effect. */
     Func &trace_loads();
 
+    /** Trace some of the loads from this Func, as selected by
+     * 'sampling'. Accesses that are not traced cost a few arithmetic
+     * operations and a branch. E.g. to trace about one in 1000 vectors
+     * of loads from the top-left 100x100 corner of f:
+     \code
+     f.trace_loads(TraceSampling({{0, 100}, {0, 100}}, 1000));
+     \endcode
+     */
+    Func &trace_loads(const TraceSampling &sampling);
+
     /** Trace all stores to the buffer backing this Func by emitting
      * calls to halide_trace. If the Func is inlined, this call
      * has no effect. */
     Func &trace_stores();
 
+    /** Trace some of the stores to the buffer backing this Func, as
+     * selected by 'sampling'. */
+    Func &trace_stores(const TraceSampling &sampling);
+
     /** Trace all realizations of this Func by emitting calls to
      * halide_trace. */
     Func &trace_realizations();
@@ -88,6 +88,7 @@ struct FunctionContents {
     Expr extern_proxy_expr;
 
     bool trace_loads = false, trace_stores = false, trace_realizations = false;
+    TraceSampling trace_loads_sampling, trace_stores_sampling;
     std::vector<string> trace_tags;
 
     bool frozen = false;
@@ -117,6 +118,17 @@ struct FunctionContents {
             }
         }
 
+        for (const TraceSampling *s : {&trace_loads_sampling, &trace_stores_sampling}) {
+            for (const auto &r : s->region) {
+                if (r.first.defined()) {
+                    r.first.accept(visitor);
+                }
+                if (r.second.defined()) {
+                    r.second.accept(visitor);
+                }
+            }
+        }
+
         for (Parameter i : output_buffers) {
             for (size_t j = 0; j < args.size(); j++) {
                 if (i.min_constraint(j).defined()) {
@@ -151,6 +163,17 @@ struct FunctionContents {
             }
             extern_proxy_expr = mutator->mutate(extern_proxy_expr);
         }
+
+        for (TraceSampling *s : {&trace_loads_sampling, &trace_stores_sampling}) {
+            for (auto &r : s->region) {
+                if (r.first.defined()) {
+                    r.first = mutator->mutate(r.first);
+                }
+                if (r.second.defined()) {
+                    r.second = mutator->mutate(r.second);
+                }
+            }
+        }
     }
 };
 
@@ -341,6 +364,8 @@ void Function::deep_copy(FunctionPtr copy, DeepCopyMap &copied_map) const {
     copy->trace_loads = contents->trace_loads;
     copy->trace_stores = contents->trace_stores;
     copy->trace_realizations = contents->trace_realizations;
+    copy->trace_loads_sampling = contents->trace_loads_sampling;
+    copy->trace_stores_sampling = contents->trace_stores_sampling;
     copy->trace_tags = contents->trace_tags;
     copy->frozen = contents->frozen;
     copy->output_buffers = contents->output_buffers;
@@ -878,11 +903,13 @@ std::string &Function::debug_file() {
     return contents->debug_file;
 }
 
-void Function::trace_loads() {
+void Function::trace_loads(const TraceSampling &sampling) {
     contents->trace_loads = true;
+    contents->trace_loads_sampling = sampling;
 }
-void Function::trace_stores() {
+void Function::trace_stores(const TraceSampling &sampling) {
     contents->trace_stores = true;
+    contents->trace_stores_sampling = sampling;
 }
 void Function::trace_realizations() {
     contents->trace_realizations = true;
@@ -900,6 +927,12 @@ bool Function::is_tracing_stores() const {
 bool Function::is_tracing_realizations() const {
     return contents->trace_realizations;
 }
+const TraceSampling &Function::get_trace_loads_sampling() const {
+    return contents->trace_loads_sampling;
+}
+const TraceSampling &Function::get_trace_stores_sampling() const {
+    return contents->trace_stores_sampling;
+}
 const std::vector<std::string> &Function::get_trace_tags() const {
     return contents->trace_tags;
 }
@@ -50,6 +50,41 @@ struct ExternFuncArgument {
     bool defined() const {return arg_type != UndefinedArg;}
 };
 
+/** Limits which loads from or stores to a Func are traced, so that
+ * tracing is cheap enough to leave on, e.g. to gather access pattern
+ * statistics from production runs. See Func::trace_loads and
+ * Func::trace_stores. */
+struct TraceSampling {
+    /** Trace about one in every this many accesses. The accesses
+     * traced are chosen by hashing their coordinates, so the same ones
+     * are chosen on every run, and no state is shared between
+     * threads. Vectorized accesses are traced or skipped a whole
+     * vector at a time, depending on the coordinates of the first
+     * lane. */
+    int every = 1;
+
+    /** Mixed into the hash, to trace a different subset of the
+     * accesses. */
+    int seed = 0;
+
+    /** If not empty, only trace accesses that fall inside this
+     * region, given as a (min, extent) pair per dimension of the
+     * Func. Pairs of undefined Exprs don't restrict their
+     * dimension. A vector is traced if its first lane is inside the
+     * region. */
+    std::vector<std::pair<Expr, Expr>> region;
+
+    TraceSampling() = default;
+    TraceSampling(int every, int seed = 0) : every(every), seed(seed) {}
+    TraceSampling(const std::vector<std::pair<Expr, Expr>> &region, int every = 1)
+        : every(every), region(region) {}
+
+    /** Whether every access is traced. */
+    bool traces_all() const {
+        return every <= 1 && region.empty();
+    }
+};
+
 /** An enum to specify calling convention for extern stages. */
 enum class NameMangling {
     Default,   ///< Match whatever is specified in the Target
@@ -275,13 +310,15 @@ public:
     /** Tracing calls and accessors, passed down from the Func
      * equivalents. */
     // @{
-    void trace_loads();
-    void trace_stores();
+    void trace_loads(const TraceSampling &sampling = TraceSampling());
+    void trace_stores(const TraceSampling &sampling = TraceSampling());
     void trace_realizations();
     void add_trace_tag(const std::string &trace_tag);
     bool is_tracing_loads() const;
     bool is_tracing_stores() const;
     bool is_tracing_realizations() const;
+    const TraceSampling &get_trace_loads_sampling() const;
+    const TraceSampling &get_trace_stores_sampling() const;
     const std::vector<std::string> &get_trace_tags() const;
     // @}
 
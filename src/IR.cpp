@@ -665,6 +665,25 @@ Expr Shuffle::make_extract_element(Expr vector, int i) {
     return make_slice(std::move(vector), i, 1, 1);
 }
 
+Expr Shuffle::make_transpose(const std::vector<Expr> &vectors, int cols) {
+    int lanes = 0;
+    for (const Expr &v : vectors) {
+        lanes += v.type().lanes();
+    }
+    internal_assert(cols > 0 && lanes % cols == 0)
+        << "Can't transpose a vector of " << lanes << " lanes with " << cols << " columns\n";
+    int rows = lanes / cols;
+
+    std::vector<int> indices(lanes);
+    for (int i = 0; i < cols; i++) {
+        for (int j = 0; j < rows; j++) {
+            indices[i * rows + j] = j * cols + i;
+        }
+    }
+
+    return make(vectors, indices);
+}
+
 bool Shuffle::is_interleave() const {
     int lanes = vectors.front().type().lanes();
 
@@ -732,6 +751,30 @@ bool Shuffle::is_slice() const {
     return indices.size() < input_lanes && is_ramp(indices, slice_stride());
 }
 
+bool Shuffle::is_transpose() const {
+    int input_lanes = 0;
+    for (Expr i : vectors) {
+        input_lanes += i.type().lanes();
+    }
+
+    int lanes = (int)indices.size();
+    int cols = transpose_factor();
+    if (lanes != input_lanes || cols <= 1 || cols >= lanes || lanes % cols != 0) {
+        return false;
+    }
+
+    int rows = lanes / cols;
+    for (int i = 0; i < cols; i++) {
+        for (int j = 0; j < rows; j++) {
+            if (indices[i * rows + j] != j * cols + i) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
 bool Shuffle::is_extract_element() const {
     return indices.size() == 1;
 }
@@ -868,6 +911,7 @@ Call::ConstString Call::extract_mask_element = "extract_mask_element";
 Call::ConstString Call::require = "require";
 Call::ConstString Call::size_of_halide_buffer_t = "size_of_halide_buffer_t";
 Call::ConstString Call::strict_float = "strict_float";
+Call::ConstString Call::nontemporal_store = "nontemporal_store";
 
 Call::ConstString Call::buffer_get_min = "_halide_buffer_get_min";
 Call::ConstString Call::buffer_get_extent = "_halide_buffer_get_extent";
@@ -517,7 +517,8 @@ struct Call : public ExprNode<Call> {
         extract_mask_element,
         require,
         size_of_halide_buffer_t,
-        strict_float;
+        strict_float,
+        nontemporal_store;
 
     // We also declare some symbolic names for some of the runtime
     // functions that we want to construct Call nodes to here to avoid
@@ -705,10 +706,23 @@ struct Shuffle : public ExprNode<Shuffle> {
      * extracting a single element. */
     static Expr make_extract_element(Expr vector, int i);
 
+    /** Convenience constructor for making a shuffle representing a
+     * transpose of a row-major matrix with 'cols' columns, stored in
+     * the concatenation of the vectors. */
+    static Expr make_transpose(const std::vector<Expr> &vectors, int cols);
+
     /** Check if this shuffle is an interleaving of the vector
      * arguments. */
     bool is_interleave() const;
 
+    /** Check if this shuffle is a transpose of a row-major matrix
+     * stored in the concatenation of the vector arguments, and if so,
+     * the number of columns of that matrix. */
+    ///@{
+    bool is_transpose() const;
+    int transpose_factor() const { return indices.size() >= 2 ? indices[1] : 1; }
+    ///@}
+
     /** Check if this shuffle is a concatenation of the vector
      * arguments. */
     bool is_concat() const;
@@ -87,6 +87,11 @@ void ImageParam::trace_loads() {
     func.trace_loads();
 }
 
+void ImageParam::trace_loads(const TraceSampling &sampling) {
+    internal_assert(func.defined());
+    func.trace_loads(sampling);
+}
+
 ImageParam &ImageParam::add_trace_tag(const std::string &trace_tag) {
     internal_assert(func.defined());
     func.add_trace_tag(trace_tag);
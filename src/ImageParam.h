@@ -132,6 +132,10 @@ public:
     /** Trace all loads from this ImageParam by emitting calls to halide_trace. */
     void trace_loads();
 
+    /** Trace some of the loads from this ImageParam, as selected by
+     * 'sampling'. See Func::trace_loads. */
+    void trace_loads(const TraceSampling &sampling);
+
     /** Add a trace tag to this ImageParam's Func. */
     ImageParam &add_trace_tag(const std::string &trace_tag);
 };
@@ -8,6 +8,7 @@
 #include "AddImageChecks.h"
 #include "AddParameterChecks.h"
 #include "AllocationBoundsInference.h"
+#include "BlockTranspose.h"
 #include "Bounds.h"
 #include "BoundsInference.h"
 #include "BoundSmallAllocations.h"
@@ -35,6 +36,7 @@
 #include "LoopCarry.h"
 #include "LowerWarpShuffles.h"
 #include "Memoization.h"
+#include "NontemporalStores.h"
 #include "PartitionLoops.h"
 #include "Prefetch.h"
 #include "Profiling.h"
@@ -266,7 +268,7 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     debug(2) << "Lowering after unrolling:\n" << s << "\n\n";
 
     debug(1) << "Vectorizing...\n";
-    s = vectorize_loops(s, t);
+    s = vectorize_loops(s, env, t);
     s = simplify(s);
     debug(2) << "Lowering after vectorizing:\n" << s << "\n\n";
 
@@ -310,6 +312,12 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
         debug(2) << "Lowering after injecting warp shuffles:\n" << s << "\n\n";
     }
 
+    if (t.arch != Target::Hexagon) {
+        debug(1) << "Lowering block transposes...\n";
+        s = lower_block_transposes(s);
+        debug(2) << "Lowering after lowering block transposes:\n" << s << "\n\n";
+    }
+
     debug(1) << "Simplifying...\n";
     s = common_subexpression_elimination(s);
 
@@ -329,6 +337,10 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
     s = loop_invariant_code_motion(s);
     debug(1) << "Lowering after final simplification:\n" << s << "\n\n";
 
+    debug(1) << "Marking non-temporal stores...\n";
+    s = inject_nontemporal_stores(s, env);
+    debug(2) << "Lowering after marking non-temporal stores:\n" << s << "\n\n";
+
     if (t.arch != Target::Hexagon && (t.features_any_of({Target::HVX_64, Target::HVX_128}))) {
         debug(1) << "Splitting off Hexagon offload...\n";
         s = inject_hexagon_rpc(s, t, result_module);
@@ -0,0 +1,73 @@
+#include <set>
+
+#include "NontemporalStores.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+
+namespace {
+
+class InjectNontemporalStores : public IRMutator2 {
+    const set<string> &buffers;
+
+    using IRMutator2::visit;
+
+    Stmt visit(const For *op) override {
+        if (op->device_api != DeviceAPI::None &&
+            op->device_api != DeviceAPI::Host) {
+            // Device loops have their own backends, which don't know
+            // about non-temporal stores.
+            return op;
+        }
+        return IRMutator2::visit(op);
+    }
+
+    Stmt visit(const Store *op) override {
+        const Ramp *ramp = op->index.as<Ramp>();
+        if (buffers.count(op->name) &&
+            ramp && is_one(ramp->stride) &&
+            is_one(op->predicate)) {
+            Expr value = Call::make(op->value.type(), Call::nontemporal_store,
+                                    {op->value}, Call::PureIntrinsic);
+            return Store::make(op->name, value, op->index, op->param, op->predicate);
+        }
+        return op;
+    }
+
+public:
+    InjectNontemporalStores(const set<string> &b) : buffers(b) {}
+};
+
+}
+
+Stmt inject_nontemporal_stores(Stmt s, const map<string, Function> &env) {
+    set<string> buffers;
+    for (const auto &iter : env) {
+        const Function &f = iter.second;
+        if (!f.schedule().nontemporal()) {
+            continue;
+        }
+        if (f.outputs() == 1) {
+            buffers.insert(f.name());
+        } else {
+            // Tuple-valued Funcs were split into one buffer per value.
+            for (int i = 0; i < f.outputs(); i++) {
+                buffers.insert(f.name() + "." + std::to_string(i));
+            }
+        }
+    }
+
+    if (buffers.empty()) {
+        return s;
+    }
+    return InjectNontemporalStores(buffers).mutate(s);
+}
+
+}
+}
@@ -0,0 +1,27 @@
+#ifndef HALIDE_NONTEMPORAL_STORES_H
+#define HALIDE_NONTEMPORAL_STORES_H
+
+/** \file
+ * Defines a lowering pass that marks stores to Funcs scheduled with
+ * store_nontemporal.
+ */
+
+#include <map>
+
+#include "Function.h"
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Wrap the value of every dense, unpredicated vector store to a Func
+ * scheduled with Func::store_nontemporal in a call to the
+ * nontemporal_store intrinsic, which tells the backend to emit a
+ * streaming store that bypasses the cache. Stores inside GPU and
+ * Hexagon loops are left alone. */
+Stmt inject_nontemporal_stores(Stmt s, const std::map<std::string, Function> &env);
+
+}
+}
+
+#endif
@@ -158,6 +158,22 @@ string Pipeline::auto_schedule(const Target &target, const MachineParams &arch_p
     return generate_schedules(contents->outputs, target, arch_params);
 }
 
+string Pipeline::auto_schedule(const Target &target, const MachineParams &arch_params,
+                               CostModel &cost_model) {
+    user_assert(target.arch == Target::X86 || target.arch == Target::ARM ||
+                target.arch == Target::POWERPC || target.arch == Target::MIPS)
+        << "Automatic scheduling is currently supported only on these architectures.";
+    return generate_schedules(contents->outputs, target, arch_params, 0, &cost_model);
+}
+
+string Pipeline::auto_schedule_candidate(const Target &target, const MachineParams &arch_params,
+                                         int candidate) {
+    user_assert(target.arch == Target::X86 || target.arch == Target::ARM ||
+                target.arch == Target::POWERPC || target.arch == Target::MIPS)
+        << "Automatic scheduling is currently supported only on these architectures.";
+    return generate_schedules(contents->outputs, target, arch_params, candidate);
+}
+
 Func Pipeline::get_func(size_t index) {
     // Compute an environment
     std::map<string, Function> env;
@@ -122,6 +122,27 @@ public:
                                      const MachineParams &arch_params = MachineParams::generic());
     //@}
 
+    /** Generate a schedule for the pipeline as above, but using a custom
+     * cost model, e.g. a LearnedCostModel trained on this machine. */
+    std::string auto_schedule(const Target &target,
+                              const MachineParams &arch_params,
+                              CostModel &cost_model);
+
+    /** Generate the candidate-th best schedule for the pipeline
+     * according to the auto-scheduler's cost model. Candidate zero is
+     * the schedule auto_schedule() would pick. Candidate k gives every
+     * group its k-th best tile configuration (or its worst one that
+     * still beats not tiling, if it has fewer), and groups Funcs
+     * based on those; it is not the k-th best of all combinations of
+     * per-group choices. This is meant for
+     * empirical autotuning (see tools/halide_autotune.h), which
+     * measures several candidates on fresh copies of the pipeline
+     * and keeps the fastest. Different candidates may produce the
+     * same schedule. */
+    std::string auto_schedule_candidate(const Target &target,
+                                        const MachineParams &arch_params,
+                                        int candidate);
+
     /** Return handle to the index-th Func within the pipeline based on the
      * topological order. */
     Func get_func(size_t index);
@@ -1,13 +1,16 @@
 #include <algorithm>
+#include <cstdlib>
 #include <map>
 #include <string>
 
 #include "Prefetch.h"
 #include "Bounds.h"
 #include "ExprUsesVar.h"
+#include "IREquality.h"
 #include "IRMutator.h"
 #include "Scope.h"
 #include "Simplify.h"
+#include "Substitute.h"
 #include "Util.h"
 
 namespace Halide {
@@ -31,6 +34,8 @@ const Definition &get_stage_definition(const Function &f, int stage_num) {
 class CollectExternalBufferBounds : public IRVisitor {
 public:
     map<string, Box> buffers;
+    // The parameters backing the external buffers, where there is one.
+    map<string, Parameter> params;
 
     using IRVisitor::visit;
 
@@ -46,6 +51,9 @@ public:
             b.push_back(Interval(buf_min_i, buf_max_i));
         }
         buffers.emplace(name, b);
+        if (param.defined()) {
+            params.emplace(name, param);
+        }
     }
 
     void visit(const Call *op) {
@@ -60,14 +68,139 @@ public:
     }
 };
 
+// Collect the names of all the buffers realized inside a stmt.
+class CollectRealizations : public IRVisitor {
+public:
+    set<string> names;
+
+    using IRVisitor::visit;
+
+    void visit(const Realize *op) {
+        names.insert(op->name);
+        IRVisitor::visit(op);
+    }
+};
+
+// Heuristics for automatic prefetching. Streams along the innermost
+// storage dimension advancing by less than a page per iteration are
+// left to the hardware prefetcher, which tracks those well. Only the
+// leading part of a footprint larger than a fraction of the L1 is
+// prefetched, so as not to evict the data being worked on; the
+// hardware prefetcher can pick up the rest once it is touched. At
+// most a few distinct gather sites per buffer are prefetched, as
+// each costs a recomputation of its coordinates.
+const int auto_prefetch_hw_stream_bytes = 4096;
+const int auto_prefetch_max_cache_lines = 256;
+const int auto_prefetch_cache_line_bytes = 64;
+const int auto_prefetch_max_gather_sites = 8;
+
+// Find the calls in a loop body whose coordinates depend on values
+// loaded from other buffers, e.g. the lookups into the grid in
+// apps/bilateral_grid. Bounds inference can only say such a call
+// reads anywhere in the range its coordinates are clamped to, so
+// these are prefetched one site at a time instead, by computing their
+// coordinates some iterations ahead.
+class CollectGathers : public IRVisitor {
+    // Does an expression read from a buffer?
+    class ReadsBuffer : public IRVisitor {
+        using IRVisitor::visit;
+
+        void visit(const Call *op) {
+            if (op->call_type == Call::Halide || op->call_type == Call::Image) {
+                result = true;
+            }
+            IRVisitor::visit(op);
+        }
+    public:
+        bool result = false;
+    };
+
+    // The variables and buffers an expression refers to.
+    class CollectNames : public IRVisitor {
+        using IRVisitor::visit;
+
+        void visit(const Variable *op) {
+            names.insert(op->name);
+        }
+
+        void visit(const Call *op) {
+            if (op->call_type == Call::Halide || op->call_type == Call::Image) {
+                names.insert(op->name);
+            }
+            IRVisitor::visit(op);
+        }
+    public:
+        set<string> names;
+    };
+
+    // Names defined inside the body: loop variables, lets, and
+    // realizations.
+    set<string> inner;
+
+    using IRVisitor::visit;
+
+    void visit(const For *op) {
+        inner.insert(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const LetStmt *op) {
+        inner.insert(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Let *op) {
+        inner.insert(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Realize *op) {
+        inner.insert(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Call *op) {
+        if (op->call_type == Call::Halide || op->call_type == Call::Image) {
+            ReadsBuffer reads;
+            for (const Expr &arg : op->args) {
+                arg.accept(&reads);
+            }
+            if (reads.result) {
+                sites[op->name].push_back(op);
+            }
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    map<string, vector<const Call *>> sites;
+
+    // Can the coordinates of a call be computed outside the body?
+    bool hoistable(const Call *op) const {
+        CollectNames refs;
+        for (const Expr &arg : op->args) {
+            arg.accept(&refs);
+        }
+        for (const string &n : refs.names) {
+            if (inner.count(n)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
 class InjectPrefetch : public IRMutator2 {
 public:
-    InjectPrefetch(const map<string, Function> &e, const map<string, Box> &buffers)
-        : env(e), external_buffers(buffers), current_func(nullptr), stage(-1) { }
+    InjectPrefetch(const map<string, Function> &e, const map<string, Box> &buffers,
+                   const map<string, Parameter> &params)
+        : env(e), external_buffers(buffers), external_params(params),
+          current_func(nullptr), stage(-1) { }
 
 private:
     const map<string, Function> &env;
     const map<string, Box> &external_buffers;
+    const map<string, Parameter> &external_params;
     const Function *current_func;
     int stage;
     Scope<Box> buffer_bounds;
@@ -129,7 +262,7 @@ private:
         return IRMutator2::visit(op);
     }
 
-    Stmt add_prefetch(string buf_name, const Parameter &param, const Box &box, Stmt body) {
+    Stmt make_prefetch(const string &buf_name, const Parameter &param, const Box &box) {
         // Construct the region to be prefetched.
         Region bounds;
         for (size_t i = 0; i < box.size(); i++) {
@@ -149,7 +282,229 @@ private:
         if (box.maybe_unused()) {
             prefetch = IfThenElse::make(box.used, prefetch);
         }
-        return Block::make({prefetch, body});
+        return prefetch;
+    }
+
+    Stmt add_prefetch(const string &buf_name, const Parameter &param, const Box &box, Stmt body) {
+        return Block::make({make_prefetch(buf_name, param, box), body});
+    }
+
+    Box apply_bound_strategy(PrefetchBoundStrategy strategy, Box prefetch_box, const Box &bounds) {
+        internal_assert(prefetch_box.size() == bounds.size());
+
+        if (strategy == PrefetchBoundStrategy::Clamp) {
+            prefetch_box = box_intersection(prefetch_box, bounds);
+        } else if (strategy == PrefetchBoundStrategy::GuardWithIf) {
+            Expr predicate = prefetch_box.used.defined() ? prefetch_box.used : const_true();
+            for (size_t i = 0; i < bounds.size(); ++i) {
+                predicate = predicate && (prefetch_box[i].min >= bounds[i].min) &&
+                            (prefetch_box[i].max <= bounds[i].max);
+            }
+            prefetch_box.used = simplify(predicate);
+        } else {
+            internal_assert(strategy == PrefetchBoundStrategy::NonFaulting);
+            // Assume the prefetch won't fault when accessing region
+            // outside the bounds.
+        }
+        return prefetch_box;
+    }
+
+    // Find the type of a buffer to prefetch, and its parameter if it
+    // is an external one. Returns false if it can't be prefetched.
+    bool find_prefetchable_buffer(const string &name, Parameter *param, Type *type) {
+        if (buffer_bounds.contains(name)) {
+            const auto &it = env.find(name);
+            if (it == env.end() || it->second.outputs() != 1) {
+                return false;
+            }
+            *type = it->second.output_types()[0];
+            return true;
+        } else if (external_buffers.count(name)) {
+            const auto &it = external_params.find(name);
+            if (it == external_params.end()) {
+                // Probably an embedded image; it has no parameter
+                // to refer to it by.
+                return false;
+            }
+            *param = it->second;
+            *type = param->type();
+            return true;
+        }
+        return false;
+    }
+
+    // Prefetch the elements read by the gathers from a buffer 'p.offset'
+    // iterations of the loop ahead. Their coordinates are computed from
+    // other buffers, so they are only evaluated when that iteration
+    // exists.
+    Stmt add_gather_prefetches(const For *loop, const PrefetchDirective &p, const string &name,
+                               const Parameter &param, const vector<const Call *> &sites,
+                               const CollectGathers &gathers, Stmt body) {
+        Expr loop_var = Variable::make(Int(32), loop->name);
+        Expr fetch_at = loop_var + p.offset;
+        Expr loop_max = loop->min + loop->extent - 1;
+        Expr in_loop = simplify(fetch_at >= loop->min && fetch_at <= loop_max);
+        Box bounds = get_buffer_bounds(name, sites[0]->args.size());
+
+        vector<const Call *> done;
+        for (const Call *c : sites) {
+            if ((int)done.size() == auto_prefetch_max_gather_sites) {
+                break;
+            }
+            if (!gathers.hoistable(c) || c->args.size() != bounds.size()) {
+                continue;
+            }
+            bool duplicate = false;
+            for (const Call *d : done) {
+                duplicate = duplicate || equal(Expr(c), Expr(d));
+            }
+            if (duplicate) {
+                continue;
+            }
+            done.push_back(c);
+
+            Box site;
+            for (const Expr &arg : c->args) {
+                site.push_back(Interval::single_point(substitute(loop->name, fetch_at, arg)));
+            }
+            site = apply_bound_strategy(p.strategy, site, bounds);
+            Stmt prefetch = IfThenElse::make(in_loop, make_prefetch(name, param, site));
+            body = Block::make({prefetch, body});
+        }
+        debug(3) << "Auto-prefetching " << done.size() << " gathers from " << name
+                 << " over " << loop->name << "\n";
+        return body;
+    }
+
+    // Pick out the buffers read by 'body' that are worth prefetching
+    // 'p.offset' iterations of 'loop' ahead, and prefetch only the part
+    // of each that the iteration at that distance newly touches, up to
+    // a budget of cache lines. Data-dependent gathers are prefetched
+    // site by site, where their coordinates don't depend on anything
+    // defined inside the body.
+    Stmt add_auto_prefetches(const For *loop, const PrefetchDirective &p,
+                             const set<string> &explicit_prefetches, Stmt body) {
+        const string &loop_name = loop->name;
+        Expr loop_var = Variable::make(Int(32), loop_name);
+        map<string, Box> boxes_here = boxes_required(body);
+        map<string, Box> boxes_ahead = boxes_required(LetStmt::make(loop_name, loop_var + p.offset, body));
+
+        CollectRealizations inner;
+        body.accept(&inner);
+
+        CollectGathers gathers;
+        body.accept(&gathers);
+
+        for (const auto &b : boxes_ahead) {
+            const string &name = b.first;
+            if (explicit_prefetches.count(name) || inner.names.count(name) ||
+                (current_func && name == current_func->name())) {
+                continue;
+            }
+
+            // We need to know the type and bounds of whatever we prefetch.
+            Parameter param;
+            Type type;
+            if (!find_prefetchable_buffer(name, &param, &type)) {
+                continue;
+            }
+
+            const auto &g = gathers.sites.find(name);
+            if (g != gathers.sites.end()) {
+                body = add_gather_prefetches(loop, p, name, param, g->second, gathers, body);
+                continue;
+            }
+
+            const auto &here = boxes_here.find(name);
+            if (here == boxes_here.end() || here->second.size() != b.second.size()) {
+                continue;
+            }
+
+            // Find how far each dimension of the footprint moves. The
+            // distance is undefined where it isn't a constant.
+            Box prefetch_box = b.second;
+            vector<Expr> deltas;
+            bool bounded = true;
+            for (size_t i = 0; bounded && i < prefetch_box.size(); i++) {
+                const Interval &ahead = prefetch_box[i];
+                const Interval &now = here->second[i];
+                bounded = ahead.is_bounded() && now.is_bounded();
+                if (bounded) {
+                    Expr delta = simplify(ahead.min - now.min);
+                    deltas.push_back(is_const(delta) ? delta : Expr());
+                }
+            }
+            if (!bounded) {
+                debug(3) << "Not auto-prefetching " << name << " over " << loop_name
+                         << ": unbounded footprint\n";
+                continue;
+            }
+
+            int moving_dims = 0, moving_dim = -1;
+            for (size_t i = 0; i < deltas.size(); i++) {
+                if (!deltas[i].defined() || !is_zero(deltas[i])) {
+                    moving_dims++;
+                    moving_dim = i;
+                }
+            }
+            if (moving_dims == 0) {
+                // Loop-invariant. It's already in cache.
+                continue;
+            }
+            const int64_t *d = moving_dims == 1 ? as_const_int(deltas[moving_dim]) : nullptr;
+            if (d && moving_dim == 0 &&
+                std::abs(*d) * type.bytes() < auto_prefetch_hw_stream_bytes) {
+                continue;
+            }
+
+            // If the footprints of successive iterations overlap along
+            // a single dimension, only the new slice needs fetching.
+            if (d) {
+                Interval &dim = prefetch_box[moving_dim];
+                Expr extent = simplify(dim.max - dim.min + 1);
+                if (can_prove(extent > (int)std::abs(*d))) {
+                    if (*d > 0) {
+                        dim.min = simplify(dim.max - (int)(*d - 1));
+                    } else {
+                        dim.max = simplify(dim.min + (int)(-*d - 1));
+                    }
+                }
+            }
+
+            // Trim the footprint to its leading cache lines, outermost
+            // dimensions first.
+            int64_t lines = 1;
+            for (size_t i = 0; i < prefetch_box.size(); i++) {
+                Interval &dim = prefetch_box[i];
+                Expr extent = simplify(dim.max - dim.min + 1);
+                Expr bound = find_constant_bound(extent, Direction::Upper);
+                const int64_t *e = bound.defined() ? as_const_int(bound) : nullptr;
+                int64_t keep;
+                if (i == 0) {
+                    int64_t max_elems = (auto_prefetch_max_cache_lines - 1) *
+                        auto_prefetch_cache_line_bytes / type.bytes();
+                    keep = e ? std::min(*e, max_elems) : max_elems;
+                    lines = (keep * type.bytes() + auto_prefetch_cache_line_bytes - 1) /
+                        auto_prefetch_cache_line_bytes + 1;
+                } else {
+                    int64_t max_rows = std::max(auto_prefetch_max_cache_lines / lines, (int64_t)1);
+                    keep = e ? std::min(*e, max_rows) : max_rows;
+                    lines *= std::max(keep, (int64_t)1);
+                }
+                if (!e || keep < *e) {
+                    debug(3) << "Trimming auto-prefetch of " << name << " over " << loop_name
+                             << " to " << keep << " elements in dimension " << i << "\n";
+                    dim.max = simplify(min(dim.max, dim.min + (int)(keep - 1)));
+                }
+            }
+
+            debug(3) << "Auto-prefetching " << name << " over " << loop_name
+                     << " (" << lines << " cache lines)\n";
+            Box bounds = get_buffer_bounds(name, prefetch_box.size());
+            prefetch_box = apply_bound_strategy(p.strategy, prefetch_box, bounds);
+            body = add_prefetch(name, param, prefetch_box, body);
+        }
+        return body;
     }
 
     Stmt visit(const For *op) override {
@@ -167,7 +522,8 @@ private:
             set<string> seen;
             for (int i = prefetch_list.size() - 1; i >= 0; --i) {
                 const PrefetchDirective &p = prefetch_list[i];
-                if (!ends_with(op->name, "." + p.var) || (seen.find(p.name) != seen.end())) {
+                if (p.name.empty() || !ends_with(op->name, "." + p.var) ||
+                    (seen.find(p.name) != seen.end())) {
                     continue;
                 }
                 seen.insert(p.name);
@@ -185,28 +541,22 @@ private:
                 // the box is completely within the bounds.
                 const auto &b = boxes_rw.find(p.name);
                 if (b != boxes_rw.end()) {
-                    Box prefetch_box = b->second;
                     // Only prefetch the region that is in bounds.
                     Box bounds = get_buffer_bounds(b->first, b->second.size());
-                    internal_assert(prefetch_box.size() == bounds.size());
-
-                    if (p.strategy == PrefetchBoundStrategy::Clamp) {
-                        prefetch_box = box_intersection(prefetch_box, bounds);
-                    } else if (p.strategy == PrefetchBoundStrategy::GuardWithIf) {
-                        Expr predicate = prefetch_box.used.defined() ? prefetch_box.used : const_true();
-                        for (size_t i = 0; i < bounds.size(); ++i) {
-                            predicate = predicate && (prefetch_box[i].min >= bounds[i].min) &&
-                                        (prefetch_box[i].max <= bounds[i].max);
-                        }
-                        prefetch_box.used = simplify(predicate);
-                    } else {
-                        internal_assert(p.strategy == PrefetchBoundStrategy::NonFaulting);
-                        // Assume the prefetch won't fault when accessing region
-                        // outside the bounds.
-                    }
+                    Box prefetch_box = apply_bound_strategy(p.strategy, b->second, bounds);
                     body = add_prefetch(b->first, p.param, prefetch_box, body);
                 }
             }
+
+            // Automatic prefetch directives have an empty name. If
+            // there are several on this loop, use the most recent one.
+            for (int i = prefetch_list.size() - 1; i >= 0; --i) {
+                const PrefetchDirective &p = prefetch_list[i];
+                if (p.name.empty() && ends_with(op->name, "." + p.var)) {
+                    body = add_auto_prefetches(op, p, seen, body);
+                    break;
+                }
+            }
         }
 
         Stmt stmt;
@@ -343,7 +693,7 @@ public:
 Stmt inject_prefetch(Stmt s, const map<string, Function> &env) {
     CollectExternalBufferBounds finder;
     s.accept(&finder);
-    return InjectPrefetch(env, finder.buffers).mutate(s);
+    return InjectPrefetch(env, finder.buffers, finder.params).mutate(s);
 }
 
 Stmt reduce_prefetch_dimension(Stmt stmt, const Target &t) {
@@ -47,6 +47,15 @@ private:
 
     bool profiling_memory = true;
 
+    // The variable holding the profiler slot of the thread running the
+    // code being mutated. Each task of a parallel loop claims its own.
+    string slot_name = "profiler_slot";
+
+    // Whether we're inside code offloaded to an accelerator, which
+    // reports the current func through its own copy of the profiler
+    // state instead of a slot.
+    bool in_remote = false;
+
     // Strip down the tuple name, e.g. f.0 into f
     string normalize_name(const string &name) {
         vector<string> v = split_string(name, ".");
@@ -201,11 +210,18 @@ private:
         }
 
         Expr profiler_token = Variable::make(Int(32), "profiler_token");
-        Expr profiler_state = Variable::make(Handle(), "profiler_state");
 
-        // This call gets inlined and becomes a single store instruction.
-        Expr set_task = Call::make(Int(32), "halide_profiler_set_current_func",
-                                   {profiler_state, profiler_token, idx}, Call::Extern);
+        // These calls get inlined and become a single store instruction.
+        Expr set_task;
+        if (in_remote) {
+            Expr profiler_state = Variable::make(Handle(), "profiler_state");
+            set_task = Call::make(Int(32), "halide_profiler_set_current_func",
+                                  {profiler_state, profiler_token, idx}, Call::Extern);
+        } else {
+            Expr slot = Variable::make(Handle(), slot_name);
+            set_task = Call::make(Int(32), "halide_profiler_set_slot_func",
+                                  {slot, profiler_token, idx}, Call::Extern);
+        }
 
         body = Block::make(Evaluate::make(set_task), body);
 
@@ -216,11 +232,18 @@ private:
         Stmt body = op->body;
 
         // The for loop indicates a device transition or a
-        // parallel job launch. Decrement the number of active
+        // parallel job launch. On the host, the thread launching it
+        // marks its slot as waiting, and each parallel task claims a
+        // slot of its own. Code running on a device counts its
+        // active threads instead: decrement the number of active
         // threads outside the loop, and increment it inside the
         // body.
-        bool update_active_threads = (op->device_api == DeviceAPI::Hexagon ||
-                                      op->is_parallel());
+        bool offload = (op->device_api == DeviceAPI::Hexagon);
+        bool on_host = (op->device_api == DeviceAPI::None ||
+                        op->device_api == DeviceAPI::Host);
+        bool launches_work = (offload || (on_host && op->is_parallel()));
+        bool claim_slot = (launches_work && !offload && !in_remote);
+        bool update_active_threads = (launches_work && (offload || in_remote));
 
         Expr state = Variable::make(Handle(), "profiler_state");
         Stmt incr_active_threads =
@@ -241,9 +264,12 @@ private:
             // hexagon. We don't support per-func stats remotely,
             // which means we can't do memory accounting.
             bool old_profiling_memory = profiling_memory;
+            bool old_in_remote = in_remote;
             profiling_memory = false;
+            in_remote = true;
             body = mutate(body);
             profiling_memory = old_profiling_memory;
+            in_remote = old_in_remote;
 
             // Get the profiler state pointer from scratch inside the
             // kernel. There will be a separate copy of the state on
@@ -251,8 +277,25 @@ private:
             Expr get_state = Call::make(Handle(), "halide_profiler_get_state", {}, Call::Extern);
             body = substitute("profiler_state", Variable::make(Handle(), "hvx_profiler_state"), body);
             body = LetStmt::make("hvx_profiler_state", get_state, body);
-        } else if (op->device_api == DeviceAPI::None ||
-                   op->device_api == DeviceAPI::Host) {
+        } else if (claim_slot) {
+            string old_slot_name = slot_name;
+            slot_name = op->name + ".profiler_slot";
+            body = mutate(body);
+            slot_name = old_slot_name;
+
+            // Each task claims a slot, starting out computing the same
+            // func as the thread that launched it. The slot is released
+            // by a destructor, so that it is also released when the
+            // task returns an error.
+            Expr token = Variable::make(Int(32), "profiler_token");
+            Expr slot = Variable::make(Handle(), op->name + ".profiler_slot");
+            Expr acquire = Call::make(Handle(), "halide_profiler_acquire_slot",
+                                      {state, token + stack.back()}, Call::Extern);
+            Expr release = Call::make(Int(32), Call::register_destructor,
+                                      {Expr("halide_profiler_task_end"), slot}, Call::Intrinsic);
+            body = LetStmt::make(op->name + ".profiler_slot", acquire,
+                                 Block::make(Evaluate::make(release), body));
+        } else if (on_host) {
             body = mutate(body);
         } else {
             body = op->body;
@@ -260,8 +303,16 @@ private:
 
         Stmt stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
 
-        if (update_active_threads) {
+        if (in_remote && launches_work) {
             stmt = Block::make({decr_active_threads, stmt, incr_active_threads});
+        } else if (launches_work) {
+            Expr slot = Variable::make(Handle(), slot_name);
+            Expr token = Variable::make(Int(32), "profiler_token");
+            Stmt wait = Evaluate::make(Call::make(Int(32), "halide_profiler_wait_slot",
+                                                  {slot}, Call::Extern));
+            Stmt resume = Evaluate::make(Call::make(Int(32), "halide_profiler_resume_slot",
+                                                    {state, slot, token, stack.back()}, Call::Extern));
+            stmt = Block::make({wait, stmt, resume});
         }
         return stmt;
     }
@@ -284,8 +335,17 @@ Stmt inject_profiling(Stmt s, string pipeline_name) {
 
     Expr profiler_token = Variable::make(Int(32), "profiler_token");
 
+    Expr profiler_state = Variable::make(Handle(), "profiler_state");
+
+    // The calling thread claims a slot for the duration of the
+    // pipeline, starting out in the overhead func.
+    Expr acquire_slot = Call::make(Handle(), "halide_profiler_acquire_slot",
+                                   {profiler_state, profiler_token}, Call::Extern);
+
+    Expr profiler_slot = Variable::make(Handle(), "profiler_slot");
+
     Expr stop_profiler = Call::make(Int(32), Call::register_destructor,
-                                    {Expr("halide_profiler_pipeline_end"), get_state}, Call::Intrinsic);
+                                    {Expr("halide_profiler_pipeline_end"), profiler_slot}, Call::Intrinsic);
 
     bool no_stack_alloc = profiling.func_stack_peak.empty();
     if (!no_stack_alloc) {
@@ -297,16 +357,9 @@ Stmt inject_profiling(Stmt s, string pipeline_name) {
         s = Block::make(update_stack, s);
     }
 
-    Expr profiler_state = Variable::make(Handle(), "profiler_state");
-    Stmt incr_active_threads =
-        Evaluate::make(Call::make(Int(32), "halide_profiler_incr_active_threads",
-                                  {profiler_state}, Call::Extern));
-    Stmt decr_active_threads =
-        Evaluate::make(Call::make(Int(32), "halide_profiler_decr_active_threads",
-                                  {profiler_state}, Call::Extern));
-    s = Block::make({incr_active_threads, s, decr_active_threads});
-
     s = LetStmt::make("profiler_pipeline_state", get_pipeline_state, s);
+    s = Block::make(Evaluate::make(stop_profiler), s);
+    s = LetStmt::make("profiler_slot", acquire_slot, s);
     s = LetStmt::make("profiler_state", get_state, s);
     // If there was a problem starting the profiler, it will call an
     // appropriate halide error function and then return the
@@ -332,7 +385,6 @@ Stmt inject_profiling(Stmt s, string pipeline_name) {
     s = Block::make(s, Free::make("profiling_func_names"));
     s = Allocate::make("profiling_func_names", Handle(),
                        MemoryType::Auto, {num_funcs}, const_true(), s);
-    s = Block::make(Evaluate::make(stop_profiler), s);
 
     return s;
 }
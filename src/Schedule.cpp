@@ -213,11 +213,12 @@ struct FuncScheduleContents {
     std::vector<Bound> estimates;
     std::map<std::string, Internal::FunctionPtr> wrappers;
     bool memoized;
+    bool nontemporal;
     MemoryType memory_type;
 
     FuncScheduleContents() :
         store_level(LoopLevel::inlined()), compute_level(LoopLevel::inlined()),
-        memoized(false), memory_type(MemoryType::Auto) {};
+        memoized(false), nontemporal(false), memory_type(MemoryType::Auto) {};
 
     // Pass an IRMutator2 through to all Exprs referenced in the FuncScheduleContents
     void mutate(IRMutator2 *mutator) {
@@ -327,6 +328,7 @@ FuncSchedule FuncSchedule::deep_copy(
     copy.contents->bounds = contents->bounds;
     copy.contents->estimates = contents->estimates;
     copy.contents->memoized = contents->memoized;
+    copy.contents->nontemporal = contents->nontemporal;
     copy.contents->memory_type = contents->memory_type;
 
     // Deep-copy wrapper functions.
@@ -347,6 +349,14 @@ bool FuncSchedule::memoized() const {
     return contents->memoized;
 }
 
+bool &FuncSchedule::nontemporal() {
+    return contents->nontemporal;
+}
+
+bool FuncSchedule::nontemporal() const {
+    return contents->nontemporal;
+}
+
 MemoryType FuncSchedule::memory_type() const {
     return contents->memory_type;
 }
@@ -61,6 +61,20 @@ enum class TailStrategy {
      * instead of a multiple of the split factor as with RoundUp. */
     ShiftInwards,
 
+    /** Guard the inner loop with an if statement like GuardWithIf,
+     * but if the inner loop is vectorized, handle the tail case with
+     * a single vector iteration whose loads and stores are
+     * predicated, instead of falling back to scalar code. Always
+     * legal. Pros: no redundant re-evaluation; does not constrain
+     * input or output sizes; the tail stays vectorized even for
+     * types the target can't cheaply predicate (where GuardWithIf
+     * would scalarize). Cons: the predicated iteration is slower
+     * than a full vector iteration, and on targets without masked
+     * vector loads and stores (e.g. x86 without AVX2) the masked
+     * memory operations are expanded lane by lane. Not supported
+     * by the C backend or inside GPU kernels. */
+    Predicate,
+
     /** For pure definitions use ShiftInwards. For pure vars in
      * update definitions use RoundUp. For RVars in update
      * definitions use GuardWithIf. */
@@ -258,7 +272,7 @@ struct Split {
     Expr factor;
     bool exact; // Is it required that the factor divides the extent
                 // of the old var. True for splits of RVars. Forces
-                // tail strategy to be GuardWithIf.
+                // tail strategy to be GuardWithIf or Predicate.
     TailStrategy tail;
 
     enum SplitType {SplitVar = 0, RenameVar, FuseVars, PurifyRVar};
@@ -351,6 +365,9 @@ struct FusedPair {
     }
 };
 
+/** A prefetch requested by the schedule. An empty name means the
+ * buffers to prefetch are chosen automatically at lowering time (see
+ * Func::auto_prefetch). */
 struct PrefetchDirective {
     std::string name;
     std::string var;
@@ -393,6 +410,13 @@ public:
     bool memoized() const;
     // @}
 
+    /** This flag is set to true if dense vector stores to this
+     * function should bypass the cache. */
+    // @{
+    bool &nontemporal();
+    bool nontemporal() const;
+    // @}
+
     /** The list and order of dimensions used to store this
      * function. The first dimension in the vector corresponds to the
      * innermost dimension for storage (i.e. which dimension is
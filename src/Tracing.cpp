@@ -1,6 +1,7 @@
 #include "Tracing.h"
 #include "IRMutator.h"
 #include "IROperator.h"
+#include "Random.h"
 #include "runtime/HalideRuntime.h"
 
 namespace Halide {
@@ -40,6 +41,33 @@ struct TraceEventBuilder {
     }
 };
 
+namespace {
+
+// Make a trace call conditional on the access at the given
+// coordinates being selected by the sampling. The vectorizer decides
+// once per vector, from the first lane (see VectorizeLoops.cpp).
+Expr apply_sampling(Expr trace, const TraceSampling &sampling, const vector<Expr> &coords) {
+    if (sampling.traces_all()) {
+        return trace;
+    }
+    Expr cond = const_true();
+    for (size_t i = 0; i < sampling.region.size() && i < coords.size(); i++) {
+        Expr min = sampling.region[i].first, extent = sampling.region[i].second;
+        if (min.defined() && extent.defined()) {
+            min = cast<int>(min);
+            cond = cond && coords[i] >= min && coords[i] < min + cast<int>(extent);
+        }
+    }
+    if (sampling.every > 1) {
+        vector<Expr> args = coords;
+        args.push_back(sampling.seed);
+        cond = cond && random_int(args) % make_const(UInt(32), sampling.every) == 0;
+    }
+    return Call::make(Int(32), Call::if_then_else, {cond, trace, 0}, Call::PureIntrinsic);
+}
+
+}  // namespace
+
 class InjectTracing : public IRMutator2 {
 public:
     const map<string, Function> &env;
@@ -73,6 +101,7 @@ private:
         internal_assert(op);
         bool trace_it = false;
         Expr trace_parent;
+        TraceSampling sampling;
         if (op->call_type == Call::Halide) {
             auto it = env.find(op->name);
             internal_assert(it != env.end()) << op->name << " not in environment\n";
@@ -81,6 +110,9 @@ private:
 
             trace_it = f.is_tracing_loads() || trace_all_loads;
             trace_parent = Variable::make(Int(32), op->name + ".trace_id");
+            if (f.is_tracing_loads()) {
+                sampling = f.get_trace_loads_sampling();
+            }
             if (trace_it) {
                 add_trace_tags(op->name, f.get_trace_tags());
             }
@@ -99,6 +131,9 @@ private:
                     f.can_be_inlined() &&
                     f.schedule().compute_level().is_inlined()) {
                     trace_it = true;
+                    if (f.is_tracing_loads()) {
+                        sampling = f.get_trace_loads_sampling();
+                    }
                     add_trace_tags(op->name, f.get_trace_tags());
                 }
             }
@@ -118,7 +153,7 @@ private:
             builder.event = halide_trace_load;
             builder.parent_id = trace_parent;
             builder.value_index = op->value_index;
-            Expr trace = builder.build();
+            Expr trace = apply_sampling(builder.build(), sampling, op->args);
 
             expr = Let::make(value_var_name, op,
                              Call::make(op->type, Call::return_second,
@@ -157,6 +192,9 @@ private:
                 builder.value_index = (int)i;
                 builder.value = {value_var};
                 Expr trace = builder.build();
+                if (f.is_tracing_stores()) {
+                    trace = apply_sampling(trace, f.get_trace_stores_sampling(), op->args);
+                }
 
                 traces[i] = Let::make(value_var_name, values[i],
                                       Call::make(t, Call::return_second,
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <set>
 
 #include "VectorizeLoops.h"
 #include "IRMutator.h"
@@ -17,6 +18,8 @@
 namespace Halide {
 namespace Internal {
 
+using std::map;
+using std::set;
 using std::string;
 using std::vector;
 using std::pair;
@@ -236,6 +239,7 @@ class PredicateLoadStore : public IRMutator2 {
     string var;
     Expr vector_predicate;
     bool in_hexagon;
+    bool predicate_tail;
     const Target &target;
     int lanes;
     bool valid;
@@ -248,6 +252,13 @@ class PredicateLoadStore : public IRMutator2 {
             internal_assert(target.features_any_of({Target::HVX_64, Target::HVX_128}))
                 << "We are inside a hexagon loop, but the target doesn't have hexagon's features\n";
             return true;
+        } else if (predicate_tail) {
+            // The schedule asked for TailStrategy::Predicate. LLVM
+            // lowers masked loads and stores to vpmaskmov on AVX2
+            // and to masked moves on AVX-512, and expands them lane
+            // by lane elsewhere, which still beats scalarizing the
+            // whole loop body.
+            return true;
         } else if (target.arch == Target::X86) {
             // Should only attempt to predicate store/load if the lane size is
             // no less than 4
@@ -332,9 +343,9 @@ class PredicateLoadStore : public IRMutator2 {
     }
 
 public:
-    PredicateLoadStore(string v, Expr vpred, bool in_hexagon, const Target &t) :
-            var(v), vector_predicate(vpred), in_hexagon(in_hexagon), target(t),
-            lanes(vpred.type().lanes()), valid(true), vectorized(false) {
+    PredicateLoadStore(string v, Expr vpred, bool in_hexagon, bool predicate_tail, const Target &t) :
+            var(v), vector_predicate(vpred), in_hexagon(in_hexagon), predicate_tail(predicate_tail),
+            target(t), lanes(vpred.type().lanes()), valid(true), vectorized(false) {
         internal_assert(lanes > 1);
     }
 
@@ -356,6 +367,9 @@ class VectorSubs : public IRMutator2 {
 
     bool in_hexagon; // Are we inside the hexagon loop?
 
+    // Does this loop come from a split with TailStrategy::Predicate?
+    bool predicate_tail;
+
     // A suffix to attach to widened variables.
     string widening_suffix;
 
@@ -481,6 +495,18 @@ class VectorSubs : public IRMutator2 {
 
         if (!changed) {
             return op;
+        } else if (op->is_intrinsic(Call::if_then_else) &&
+                   op->args[1].as<Call>() &&
+                   op->args[1].as<Call>()->name == Call::trace) {
+            // A sampled trace call (see Tracing.cpp). Like the trace
+            // call itself, it stays scalar, so decide whether to trace
+            // the whole vector from its first lane.
+            Expr cond = new_args[0];
+            if (cond.type().is_vector()) {
+                cond = Shuffle::make_extract_element(cond, 0);
+            }
+            return Call::make(op->type, Call::if_then_else,
+                              {cond, new_args[1], new_args[2]}, Call::PureIntrinsic);
         } else if (op->name == Call::trace) {
             // Call::trace vectorizes uniquely, because we want a
             // single trace call for the entire vector, instead of
@@ -681,12 +707,12 @@ class VectorSubs : public IRMutator2 {
             bool vectorize_predicate = !uses_gpu_vars(cond);
             Stmt predicated_stmt;
             if (vectorize_predicate) {
-                PredicateLoadStore p(var, cond, in_hexagon, target);
+                PredicateLoadStore p(var, cond, in_hexagon, predicate_tail, target);
                 predicated_stmt = p.mutate(then_case);
                 vectorize_predicate = p.is_vectorized();
             }
             if (vectorize_predicate && else_case.defined()) {
-                PredicateLoadStore p(var, !cond, in_hexagon, target);
+                PredicateLoadStore p(var, !cond, in_hexagon, predicate_tail, target);
                 predicated_stmt = Block::make(predicated_stmt, p.mutate(else_case));
                 vectorize_predicate = p.is_vectorized();
             }
@@ -897,8 +923,8 @@ class VectorSubs : public IRMutator2 {
     }
 
 public:
-    VectorSubs(string v, Expr r, bool in_hexagon, const Target &t) :
-            var(v), replacement(r), target(t), in_hexagon(in_hexagon) {
+    VectorSubs(string v, Expr r, bool in_hexagon, bool predicate_tail, const Target &t) :
+            var(v), replacement(r), target(t), in_hexagon(in_hexagon), predicate_tail(predicate_tail) {
         widening_suffix = ".x" + std::to_string(replacement.type().lanes());
     }
 };
@@ -906,6 +932,7 @@ public:
 // Vectorize all loops marked as such in a Stmt
 class VectorizeLoops : public IRMutator2 {
     const Target &target;
+    const set<string> &predicated_loops;
     bool in_hexagon;
 
     using IRMutator2::visit;
@@ -929,7 +956,8 @@ class VectorizeLoops : public IRMutator2 {
             // Replace the var with a ramp within the body
             Expr for_var = Variable::make(Int(32), for_loop->name);
             Expr replacement = Ramp::make(for_loop->min, 1, extent->value);
-            stmt = VectorSubs(for_loop->name, replacement, in_hexagon, target).mutate(for_loop->body);
+            bool predicate_tail = predicated_loops.count(for_loop->name) > 0;
+            stmt = VectorSubs(for_loop->name, replacement, in_hexagon, predicate_tail, target).mutate(for_loop->body);
         } else {
             stmt = IRMutator2::visit(for_loop);
         }
@@ -942,13 +970,45 @@ class VectorizeLoops : public IRMutator2 {
     }
 
 public:
-    VectorizeLoops(const Target &t) : target(t), in_hexagon(false) {}
+    VectorizeLoops(const Target &t, const set<string> &p) :
+        target(t), predicated_loops(p), in_hexagon(false) {}
 };
 
+// Find the names of the loops guarded by a split with
+// TailStrategy::Predicate. Any loop produced by further splitting the
+// inner dimension of such a split is still inside its guard.
+set<string> find_predicated_loops(const map<string, Function> &env) {
+    set<string> result;
+    for (const auto &iter : env) {
+        const Function &f = iter.second;
+        for (int stage = 0; stage <= (int)f.updates().size(); stage++) {
+            const Definition &def = (stage == 0) ? f.definition() : f.update(stage - 1);
+            if (!def.defined()) {
+                continue;
+            }
+            string prefix = f.name() + ".s" + std::to_string(stage) + ".";
+            set<string> guarded;
+            for (const Split &split : def.schedule().splits()) {
+                if (!split.is_split()) {
+                    continue;
+                }
+                if (split.tail == TailStrategy::Predicate || guarded.count(split.old_var)) {
+                    guarded.insert(split.inner);
+                }
+            }
+            for (const string &v : guarded) {
+                result.insert(prefix + v);
+            }
+        }
+    }
+    return result;
+}
+
 } // Anonymous namespace
 
-Stmt vectorize_loops(Stmt s, const Target &t) {
-    return VectorizeLoops(t).mutate(s);
+Stmt vectorize_loops(Stmt s, const map<string, Function> &env, const Target &t) {
+    set<string> predicated_loops = find_predicated_loops(env);
+    return VectorizeLoops(t, predicated_loops).mutate(s);
 }
 
 }
@@ -5,6 +5,9 @@
  * Defines the lowering pass that vectorizes loops marked as such
  */
 
+#include <map>
+
+#include "Function.h"
 #include "IR.h"
 #include "Target.h"
 
@@ -13,9 +16,11 @@ namespace Internal {
 
 /** Take a statement with for loops marked for vectorization, and turn
  * them into single statements that operate on vectors. The loops in
- * question must have constant extent.
+ * question must have constant extent. Vectorized loops that come from
+ * splits with TailStrategy::Predicate in the environment always handle
+ * their tail case with predicated vector loads and stores.
  */
-Stmt vectorize_loops(Stmt s, const Target &t);
+Stmt vectorize_loops(Stmt s, const std::map<std::string, Function> &env, const Target &t);
 
 }
 }
@@ -753,6 +753,21 @@ public:
         buf.host = (uint8_t *)((uintptr_t)(unaligned_ptr + alignment - 1) & ~(alignment - 1));
     }
 
+    /** Allocation functions for allocate() that use the Halide
+     * runtime's halide_malloc and halide_free, so that large buffers
+     * are backed by huge pages once a threshold has been set with
+     * halide_set_huge_page_threshold (or go to the custom allocator,
+     * if one has been set). E.g.
+     * buf.allocate(Buffer<>::halide_malloc_fn, Buffer<>::halide_free_fn) */
+    // @{
+    static void *halide_malloc_fn(size_t size) {
+        return halide_malloc(nullptr, size);
+    }
+    static void halide_free_fn(void *ptr) {
+        halide_free(nullptr, ptr);
+    }
+    // @}
+
     /** Drop reference to any owned host or device memory, possibly
      * freeing it, if this buffer held the last reference to
      * it. Retains the shape of the buffer. Does nothing if this
@@ -761,6 +776,18 @@ public:
         decref();
     }
 
+    /** Take over an allocation of host memory made outside of this
+     * class, such as a memory-mapped file, which the host pointer
+     * must already point into. The header starts with a reference
+     * count of one, which becomes this buffer's; once the last
+     * buffer sharing it lets go, its deallocate_fn is called with
+     * the header itself. The buffer must not already own host
+     * memory. */
+    void adopt_host_allocation(AllocationHeader *header) {
+        assert(!owns_host_memory());
+        alloc = header;
+    }
+
     /** Drop reference to any owned device memory, possibly freeing it
      * if this buffer held the last reference to it. Asserts that
      * device_dirty is false. */
@@ -205,6 +205,14 @@ extern halide_malloc_t halide_set_custom_malloc(halide_malloc_t user_malloc);
 extern halide_free_t halide_set_custom_free(halide_free_t user_free);
 //@}
 
+/** Make halide_default_malloc back allocations of at least the given
+ * number of bytes with huge pages, where the OS supports it (currently
+ * Linux, via transparent huge pages), to reduce TLB misses when
+ * accessing large buffers. Each such allocation is rounded up to a
+ * multiple of 2MB. Zero (the default) disables this. Returns the
+ * previous threshold. */
+extern size_t halide_set_huge_page_threshold(size_t bytes);
+
 /** Halide calls these functions to interact with the underlying
  * system runtime functions. To replace in AOT code on platforms that
  * support weak linking, define these functions yourself, or use
@@ -383,7 +391,8 @@ struct halide_trace_event_t {
  * HL_TRACE_FILE is defined, dumps the trace to that file in a
  * sequence of trace packets. The header for a trace packet is defined
  * below. If the trace is going to be large, you may want to make the
- * file a named pipe, and then read from that pipe into gzip.
+ * file a named pipe, and then read from that pipe into gzip, or set
+ * HL_TRACE_COMPRESS (see halide_trace_file_header_t).
  *
  * halide_trace returns a unique ID which will be passed to future
  * events that "belong" to the earlier event as the parent id. The
@@ -499,6 +508,68 @@ struct halide_trace_packet_t {
     #endif
 };
 
+/** If the environment variable HL_TRACE_COMPRESS is set to 1 when
+ * halide_default_trace opens HL_TRACE_FILE, the file is overwritten
+ * rather than appended to, and the packets are written compressed and
+ * indexed, so that tools can skip to the packets of a given Func or
+ * range of ids without decompressing the rest. The file is laid out
+ * as:
+ *
+ * - a halide_trace_file_header_t,
+ * - a sequence of blocks, each a halide_trace_block_header_t followed
+ *   by a run of whole packets compressed in the LZ4 block format (or
+ *   stored as-is if that is no smaller), ended by a block header with
+ *   both sizes zero,
+ * - the index: a uint32_t count of Funcs followed by their
+ *   nul-terminated names, then a uint32_t count of blocks followed by
+ *   a halide_trace_block_index_t for each,
+ * - a halide_trace_file_trailer_t giving the offset of the index.
+ *
+ * The index and trailer are written by halide_shutdown_trace (which
+ * runs at exit). A file without them can still be read from start to
+ * end. Like the packets themselves, all fields are in the byte order
+ * of the host that wrote the file, so the file must be read on a host
+ * of the same endianness. */
+// @{
+enum {
+    halide_trace_file_magic = 0x5a544c48,  ///< "HLTZ"
+    halide_trace_index_magic = 0x49544c48, ///< "HLTI"
+    halide_trace_file_version = 1,
+    /** Funcs beyond this many are not named in the index. Blocks
+     * containing them set the last bit of their func_mask. */
+    halide_trace_max_indexed_funcs = 255
+};
+
+struct halide_trace_file_header_t {
+    uint32_t magic, version;
+};
+
+struct halide_trace_block_header_t {
+    /** The number of bytes that follow. If equal to uncompressed_size,
+     * the packets are stored as-is. */
+    uint32_t compressed_size;
+    /** The total size of the packets in the block. */
+    uint32_t uncompressed_size;
+};
+
+struct halide_trace_block_index_t {
+    /** The offset of the block's header in the file. */
+    uint64_t offset;
+    /** The range of packet ids in the block. */
+    int32_t min_id, max_id;
+    /** Bit i is set if the block contains packets with event code i. */
+    uint32_t event_mask;
+    /** Bit i is set if the block contains packets for the i'th Func
+     * named in the index. */
+    uint32_t func_mask[(halide_trace_max_indexed_funcs + 1) / 32];
+};
+
+struct halide_trace_file_trailer_t {
+    uint64_t index_offset;
+    uint32_t magic, reserved;
+};
+// @}
+
 
 
 /** Set the file descriptor that Halide should write binary trace
@@ -522,6 +593,24 @@ extern int halide_get_trace_file(void *user_context);
  * (flushing the trace). Returns zero on success. */
 extern int halide_shutdown_trace();
 
+/** Start recording a timeline of what the pipelines run do to a file,
+ * in the Chrome trace event JSON format, which chrome://tracing and
+ * the Perfetto UI (ui.perfetto.dev) can display. The realizations,
+ * productions and consumptions of Funcs in pipelines compiled with
+ * trace_realizations, the tasks of parallel loops, and copies between
+ * host and device memory are recorded as spans on the thread that
+ * ran them. The heap usage of pipelines compiled with profile is
+ * recorded as a counter. While a timeline is being recorded, trace
+ * events are not also printed to stdout. If never called, Halide
+ * checks for an environment variable called HL_TIMELINE_FILE at
+ * startup, and if it is defined records a timeline to that file until
+ * the process exits. Returns zero on success. */
+extern int halide_start_timeline(void *user_context, const char *filename);
+
+/** Stop recording the timeline, and finish writing the file. Returns
+ * zero on success. */
+extern int halide_stop_timeline(void *user_context);
+
 /** All Halide GPU or device backend implementations provide an
  * interface to be used with halide_device_malloc, etc. This is
  * accessed via the functions below.
@@ -1446,9 +1535,22 @@ struct halide_filter_metadata_t {
  * the -profile target flag, which runs a sampling profiler thread
  * alongside the pipeline. */
 
+/** The hardware counters the profiler can sample, as indices into
+ * the counters arrays of the stats below. */
+enum halide_profiler_counter {
+    halide_profiler_cycles = 0,
+    halide_profiler_instructions,
+    halide_profiler_cache_misses,
+    halide_profiler_branch_misses,
+    halide_profiler_num_counters
+};
+
 /** Per-Func state tracked by the sampling profiler. */
 struct halide_profiler_func_stats {
-    /** Total time taken evaluating this Func (in nanoseconds). */
+    /** Total time taken evaluating this Func (in nanoseconds). When
+     * several threads are busy in a pipeline at once, the time is
+     * split between the Funcs they are working on, so that the times
+     * of the Funcs add up to the time of the pipeline. */
     uint64_t time;
 
     /** The current memory allocation of this Func. */
@@ -1463,7 +1565,8 @@ struct halide_profiler_func_stats {
     /** The peak stack allocation of this Func's threads. */
     uint64_t stack_peak;
 
-    /** The average number of thread pool worker threads active while computing this Func. */
+    /** The average number of threads computing this Func while it
+     * was being computed. */
     uint64_t active_threads_numerator, active_threads_denominator;
 
     /** The name of this Func. A global constant string. */
@@ -1471,6 +1574,11 @@ struct halide_profiler_func_stats {
 
     /** The total number of memory allocation of this Func. */
     int num_allocs;
+
+    /** The hardware counters of the threads computing this Func,
+     * indexed by halide_profiler_counter. Zero unless the profiler was
+     * asked to read them (see halide_profiler_state). */
+    uint64_t counters[halide_profiler_num_counters];
 };
 
 /** Per-pipeline state tracked by the sampling profiler. These exist
@@ -1516,6 +1624,26 @@ struct halide_profiler_pipeline_stats {
 
     /** The total number of memory allocation of funcs in this pipeline. */
     int num_allocs;
+
+    /** The time (in nanoseconds) this pipeline kept each profiler slot
+     * busy (see halide_profiler_state), i.e. a per-slot breakdown of
+     * the work done by its threads. A slot is claimed by a thread for
+     * the duration of a pipeline or a parallel task and then released,
+     * so over a run an entry covers the work of whichever threads held
+     * that slot, and slots are shared with any other pipelines running
+     * at the same time. The entries add up to the total busy time of
+     * all threads, which exceeds 'time' when several were busy at
+     * once. An array of halide_profiler_num_slots entries. */
+    uint64_t *thread_time;
+
+    /** The hardware counters of the threads running this pipeline,
+     * indexed by halide_profiler_counter. */
+    uint64_t counters[halide_profiler_num_counters];
+};
+
+/** The number of threads the sampling profiler can follow at once. */
+enum {
+    halide_profiler_num_slots = 256
 };
 
 /** The global state of the profiler. */
@@ -1533,11 +1661,14 @@ struct halide_profiler_state {
     /** An internal id used for bookkeeping. */
     int first_free_id;
 
-    /** The id of the current running Func. Set by the pipeline, read
-     * periodically by the profiler thread. */
+    /** The id of the current running Func. Set by pipelines running on
+     * an accelerator with its own copy of this state (e.g. Hexagon), and
+     * read periodically by the profiler thread. Pipelines running on
+     * the host use 'slots' instead. Setting it to
+     * halide_profiler_please_stop stops the profiler thread. */
     int current_func;
 
-    /** The number of threads currently doing work. */
+    /** The number of threads currently doing work on an accelerator. */
     int active_threads;
 
     /** A linked list of stats gathered for each pipeline. */
@@ -1550,6 +1681,29 @@ struct halide_profiler_state {
 
     /** Sampling thread reference to be joined at shutdown. */
     struct halide_thread *sampling_thread;
+
+    /** The id of the Func each thread running Halide code is currently
+     * computing. A thread claims a free slot (one that is
+     * halide_profiler_outside_of_halide) when it starts running a
+     * pipeline or a task of a parallel loop, and frees it when it is
+     * done, so the profiler thread can sample all of them without
+     * taking any locks on the pipeline side. */
+    int slots[halide_profiler_num_slots];
+
+    /** Used instead of a slot by threads that found none free. Not
+     * sampled. */
+    int overflow_slot;
+
+    /** Whether to also sample hardware counters (cycles, instructions,
+     * last level cache misses and branch misses) of the threads in
+     * the slots, so that the report can show the IPC and miss rates
+     * of each Func. Positive to sample them, zero not to, and
+     * negative if they were asked for but are not available (only
+     * Linux on x86 supports them, and containers often forbid them),
+     * in which case only time and memory are reported. Initialized
+     * from the environment variable HL_PROFILER_COUNTERS when the
+     * profiler thread starts. */
+    int use_counters;
 };
 
 /** Profiler func ids with special meanings. */
@@ -1559,7 +1713,10 @@ enum {
     /// Set current_func to this value to tell the profiling thread to
     /// halt. It will start up again next time you run a pipeline with
     /// profiling enabled.
-    halide_profiler_please_stop = -2
+    halide_profiler_please_stop = -2,
+    /// A slot takes on this value while its thread waits for the tasks
+    /// of a parallel loop, which are billed through their own slots.
+    halide_profiler_waiting = -3
 };
 
 /** Get a pointer to the global profiler state for programmatic
@@ -3,6 +3,7 @@
 #include "device_interface.h"
 #include "printer.h"
 #include "scoped_mutex_lock.h"
+#include "timeline.h"
 
 extern "C" {
 
@@ -41,7 +42,9 @@ WEAK int copy_to_host_already_locked(void *user_context, struct halide_buffer_t
         debug(user_context) << "copy_to_host_already_locked " << buf << " interface is NULL\n";
         return halide_error_code_no_device_interface;
     }
+    timeline_event(user_context, "copy to host", "copy", 'B');
     int result = interface->impl->copy_to_host(user_context, buf);
+    timeline_event(user_context, "copy to host", "copy", 'E');
     if (result != 0) {
         debug(user_context) << "copy_to_host_already_locked " << buf << " device copy_to_host returned an error\n";
         return halide_error_code_copy_to_host_failed;
@@ -159,7 +162,9 @@ WEAK int copy_to_device_already_locked(void *user_context,
             debug(user_context) << "halide_copy_to_device " << buf << " dev_dirty is true error\n";
             return halide_error_code_copy_to_device_failed;
         } else {
+            timeline_event(user_context, "copy to device", "copy", 'B');
             result = device_interface->impl->copy_to_device(user_context, buf);
+            timeline_event(user_context, "copy to device", "copy", 'E');
             if (result == 0) {
                 buf->set_host_dirty(false);
             } else {
@@ -522,6 +527,7 @@ WEAK int halide_buffer_copy(void *user_context, struct halide_buffer_t *src,
         src_device_interface->impl->use_module();
     }
 
+    timeline_event(user_context, "buffer copy", "copy", 'B');
     if (dst_device_interface) {
         // Make the dst interface handle arbitrary src device
         // interfaces (e.g. CUDA might know how to copy out of an
@@ -539,6 +545,7 @@ WEAK int halide_buffer_copy(void *user_context, struct halide_buffer_t *src,
         // handle this.
         err = halide_default_buffer_copy(user_context, src, dst_device_interface, dst);
     }
+    timeline_event(user_context, "buffer copy", "copy", 'E');
 
     if (dst != src) {
         if (dst_device_interface) {
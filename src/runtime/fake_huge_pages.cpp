@@ -0,0 +1,14 @@
+#include "HalideRuntime.h"
+
+extern "C" {
+
+WEAK void *halide_huge_page_malloc(size_t size) {
+    // Huge pages are not available on this platform, so fall back to
+    // the usual allocator.
+    return NULL;
+}
+
+WEAK void halide_huge_page_free(void *ptr, size_t size) {
+}
+
+}
@@ -0,0 +1,17 @@
+#include "HalideRuntime.h"
+
+extern "C" {
+
+WEAK int halide_perf_counters_open(int *fds) {
+    // Hardware counters are not available on this platform.
+    return -1;
+}
+
+WEAK int halide_perf_counters_read(const int *fds, uint64_t *counts) {
+    return -1;
+}
+
+WEAK void halide_perf_counters_close(int *fds) {
+}
+
+}
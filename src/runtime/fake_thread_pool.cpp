@@ -35,6 +35,11 @@ WEAK halide_thread *halide_spawn_thread(void (*f)(void *), void *closure) {
     return NULL;
 }
 
+WEAK uint64_t halide_current_thread_id() {
+    // There is only one thread.
+    return 0;
+}
+
 WEAK void halide_mutex_lock(halide_mutex *mutex) {
 }
 
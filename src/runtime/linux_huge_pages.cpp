@@ -0,0 +1,61 @@
+#include "HalideRuntime.h"
+#include "runtime_internal.h"
+
+extern "C" {
+
+extern void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset);
+extern int munmap(void *addr, size_t length);
+extern int madvise(void *addr, size_t length, int advice);
+
+}
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// From sys/mman.h. These are the same on every architecture we
+// target on Linux except MIPS, which uses fake_huge_pages.cpp.
+const static int prot_read = 0x1;
+const static int prot_write = 0x2;
+const static int map_private = 0x02;
+const static int map_anonymous = 0x20;
+const static int madv_hugepage = 14;
+
+const static size_t huge_page_size = 2 * 1024 * 1024;
+
+WEAK size_t round_up_to_huge_page(size_t size) {
+    return (size + huge_page_size - 1) & ~(huge_page_size - 1);
+}
+
+}}} // namespace Halide::Runtime::Internal
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK void *halide_huge_page_malloc(size_t size) {
+    // Map an extra huge page so that we can trim the mapping to start
+    // on a huge page boundary; transparent huge pages are only used
+    // for aligned 2MB ranges.
+    size = round_up_to_huge_page(size);
+    uint8_t *mapping = (uint8_t *)mmap(NULL, size + huge_page_size, prot_read | prot_write,
+                                       map_private | map_anonymous, -1, 0);
+    if (mapping == (uint8_t *)-1) {
+        return NULL;
+    }
+    uint8_t *start = (uint8_t *)round_up_to_huge_page((size_t)mapping);
+    if (start > mapping) {
+        munmap(mapping, start - mapping);
+    }
+    if (start + size < mapping + size + huge_page_size) {
+        munmap(start + size, (mapping + size + huge_page_size) - (start + size));
+    }
+    // This is only advice: if transparent huge pages are disabled, we
+    // still have a working (if slower) allocation.
+    madvise(start, size, madv_hugepage);
+    return start;
+}
+
+WEAK void halide_huge_page_free(void *ptr, size_t size) {
+    munmap(ptr, round_up_to_huge_page(size));
+}
+
+}
@@ -0,0 +1,106 @@
+#include "HalideRuntime.h"
+
+extern "C" {
+
+extern int syscall(int num, ...);
+extern ssize_t read(int fd, void *buf, size_t bytes);
+
+}
+
+// The syscall number for perf_event_open varies across platforms:
+// -- i386 is 336
+// -- x64 is 298
+
+#ifndef SYS_PERF_EVENT_OPEN
+
+#ifdef BITS_64
+#define SYS_PERF_EVENT_OPEN 298
+#endif
+
+#ifdef BITS_32
+#define SYS_PERF_EVENT_OPEN 336
+#endif
+
+#endif
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// The first version of struct perf_event_attr from
+// linux/perf_event.h. The kernel accepts any version no larger than
+// its own.
+struct perf_event_attr {
+    uint32_t type;
+    uint32_t size;
+    uint64_t config;
+    uint64_t sample_period;
+    uint64_t sample_type;
+    uint64_t read_format;
+    uint64_t flags;
+    uint32_t wakeup_events;
+    uint32_t bp_type;
+    uint64_t config1;
+};
+
+const static uint32_t perf_type_hardware = 0;
+const static uint64_t perf_format_group = 1 << 3;
+const static uint64_t perf_flag_exclude_kernel = 1 << 5;
+const static uint64_t perf_flag_exclude_hv = 1 << 6;
+
+// The generic hardware events, in the order of halide_profiler_counter.
+const static uint64_t perf_hw_events[halide_profiler_num_counters] = {
+    0,  // PERF_COUNT_HW_CPU_CYCLES
+    1,  // PERF_COUNT_HW_INSTRUCTIONS
+    3,  // PERF_COUNT_HW_CACHE_MISSES (last level cache misses)
+    5,  // PERF_COUNT_HW_BRANCH_MISSES
+};
+
+}}} // namespace Halide::Runtime::Internal
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK int halide_perf_counters_open(int *fds) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = perf_type_hardware;
+    attr.size = sizeof(attr);
+    attr.read_format = perf_format_group;
+    // Only count user code, which unprivileged processes are usually
+    // allowed to do.
+    attr.flags = perf_flag_exclude_kernel | perf_flag_exclude_hv;
+
+    for (int i = 0; i < halide_profiler_num_counters; i++) {
+        attr.config = perf_hw_events[i];
+        // Count the calling thread on whichever cpu it runs, in a
+        // group led by the first counter so they can be read at once.
+        fds[i] = syscall(SYS_PERF_EVENT_OPEN, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+        if (fds[i] < 0) {
+            for (int j = 0; j < i; j++) {
+                close(fds[j]);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+WEAK int halide_perf_counters_read(const int *fds, uint64_t *counts) {
+    uint64_t values[1 + halide_profiler_num_counters];
+    if (read(fds[0], values, sizeof(values)) != (ssize_t)sizeof(values) ||
+        values[0] != halide_profiler_num_counters) {
+        return -1;
+    }
+    for (int i = 0; i < halide_profiler_num_counters; i++) {
+        counts[i] = values[i + 1];
+    }
+    return 0;
+}
+
+WEAK void halide_perf_counters_close(int *fds) {
+    for (int i = 0; i < halide_profiler_num_counters; i++) {
+        close(fds[i]);
+    }
+}
+
+}
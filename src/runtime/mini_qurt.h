@@ -164,6 +164,7 @@ static inline void qurt_thread_attr_set_priority (qurt_thread_attr_t *attr, unsi
 
 extern int qurt_thread_set_priority (qurt_thread_t threadid, unsigned short newprio);
 extern int qurt_thread_create (qurt_thread_t *thread_id, qurt_thread_attr_t *attr, void (*entrypoint) (void *), void *arg);
+extern qurt_thread_t qurt_thread_get_id (void);
 /**
    Waits for a specified thread to finish.
    The specified thread should be another thread within the same process.
@@ -6,9 +6,42 @@ extern "C" {
 extern void *malloc(size_t);
 extern void free(void *);
 
+}
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// Allocations of at least this many bytes are backed by huge pages,
+// if the OS supports them. Zero means never.
+WEAK size_t huge_page_threshold = 0;
+
+}}} // namespace Halide::Runtime::Internal
+
+extern "C" {
+
+WEAK size_t halide_set_huge_page_threshold(size_t bytes) {
+    size_t result = Halide::Runtime::Internal::huge_page_threshold;
+    Halide::Runtime::Internal::huge_page_threshold = bytes;
+    return result;
+}
+
 WEAK void *halide_default_malloc(void *user_context, size_t x) {
     // Allocate enough space for aligning the pointer we return.
     const size_t alignment = halide_malloc_alignment();
+    const size_t threshold = Halide::Runtime::Internal::huge_page_threshold;
+    if (threshold && x >= threshold) {
+        void *orig = halide_huge_page_malloc(x + alignment);
+        if (orig) {
+            // The mapping is aligned, so just skip the first
+            // 'alignment' bytes. Tag the original pointer (which
+            // malloc would never return with the low bit set) so that
+            // free knows to unmap it, and store the size of the
+            // mapping before it.
+            void *ptr = (void *)((size_t)orig + alignment);
+            ((void **)ptr)[-1] = (void *)((size_t)orig | 1);
+            ((size_t *)ptr)[-2] = x + alignment;
+            return ptr;
+        }
+    }
     void *orig = malloc(x + alignment);
     if (orig == NULL) {
         // Will result in a failed assertion and a call to halide_error
@@ -21,7 +54,12 @@ WEAK void *halide_default_malloc(void *user_context, size_t x) {
 }
 
 WEAK void halide_default_free(void *user_context, void *ptr) {
-    free(((void**)ptr)[-1]);
+    void *orig = ((void**)ptr)[-1];
+    if ((size_t)orig & 1) {
+        halide_huge_page_free((void *)((size_t)orig & ~(size_t)1), ((size_t *)ptr)[-2]);
+        return;
+    }
+    free(orig);
 }
 
 }
@@ -128,3 +128,11 @@ struct thread_parker {
 #include "synchronization_common.h"
 
 #include "thread_pool_common.h"
+
+extern "C" {
+
+WEAK uint64_t halide_current_thread_id() {
+    return (uint64_t)(uintptr_t)pthread_self();
+}
+
+}
@@ -1,6 +1,8 @@
 #include "HalideRuntime.h"
 #include "printer.h"
 #include "scoped_mutex_lock.h"
+#include "scoped_spin_lock.h"
+#include "timeline.h"
 
 // Note: The profiler thread may out-live any valid user_context, or
 // be used across many different user_contexts, so nothing it calls
@@ -50,6 +52,18 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
         free(p);
         return NULL;
     }
+    p->thread_time = (uint64_t *)malloc(halide_profiler_num_slots * sizeof(uint64_t));
+    if (!p->thread_time) {
+        free(p->funcs);
+        free(p);
+        return NULL;
+    }
+    for (int i = 0; i < halide_profiler_num_slots; i++) {
+        p->thread_time[i] = 0;
+    }
+    for (int i = 0; i < halide_profiler_num_counters; i++) {
+        p->counters[i] = 0;
+    }
     for (int i = 0; i < num_funcs; i++) {
         p->funcs[i].time = 0;
         p->funcs[i].name = (const char *)(func_names[i]);
@@ -60,13 +74,16 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
         p->funcs[i].stack_peak = 0;
         p->funcs[i].active_threads_numerator = 0;
         p->funcs[i].active_threads_denominator = 0;
+        for (int j = 0; j < halide_profiler_num_counters; j++) {
+            p->funcs[i].counters[j] = 0;
+        }
     }
     s->first_free_id += num_funcs;
     s->pipelines = p;
     return p;
 }
 
-WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int active_threads) {
+WEAK halide_profiler_pipeline_stats *find_pipeline(halide_profiler_state *s, int func_id) {
     halide_profiler_pipeline_stats *p_prev = NULL;
     for (halide_profiler_pipeline_stats *p = s->pipelines; p;
          p = (halide_profiler_pipeline_stats *)(p->next)) {
@@ -77,19 +94,206 @@ WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int ac
                 p->next = s->pipelines;
                 s->pipelines = p;
             }
-            halide_profiler_func_stats *f = p->funcs + func_id - p->first_func_id;
-            f->time += time;
-            f->active_threads_numerator += active_threads;
-            f->active_threads_denominator += 1;
+            return p;
+        }
+        p_prev = p;
+    }
+    // Someone must have called reset_state while a kernel was running.
+    return NULL;
+}
+
+WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int active_threads) {
+    halide_profiler_pipeline_stats *p = find_pipeline(s, func_id);
+    if (!p) {
+        return;
+    }
+    halide_profiler_func_stats *f = p->funcs + func_id - p->first_func_id;
+    f->time += time;
+    f->active_threads_numerator += active_threads;
+    f->active_threads_denominator += 1;
+    p->time += time;
+    p->samples++;
+    p->active_threads_numerator += active_threads;
+    p->active_threads_denominator += 1;
+}
+
+// Bill the time since the last sample to the Funcs the threads in
+// each slot are computing. The time of each pipeline is split between
+// the Funcs its busy threads are working on.
+WEAK void bill_slots(halide_profiler_state *s, uint64_t time) {
+    int slot[halide_profiler_num_slots];
+    int func[halide_profiler_num_slots];
+    halide_profiler_pipeline_stats *pipeline[halide_profiler_num_slots];
+    int n = 0;
+    for (int i = 0; i < halide_profiler_num_slots; i++) {
+        int f = ((volatile int *)(s->slots))[i];
+        if (f >= 0) {
+            slot[n] = i;
+            func[n] = f;
+            pipeline[n] = find_pipeline(s, f);
+            n++;
+        }
+    }
+
+    // There are at most as many busy slots as threads, so the
+    // quadratic search for other threads in the same pipeline and
+    // Func is cheap.
+    for (int i = 0; i < n; i++) {
+        halide_profiler_pipeline_stats *p = pipeline[i];
+        if (!p) {
+            continue;
+        }
+        int p_threads = 0, f_threads = 0;
+        bool first_in_p = true, first_in_f = true;
+        for (int j = 0; j < n; j++) {
+            if (pipeline[j] == p) {
+                p_threads++;
+                first_in_p = first_in_p && j >= i;
+            }
+            if (func[j] == func[i]) {
+                f_threads++;
+                first_in_f = first_in_f && j >= i;
+            }
+        }
+
+        p->thread_time[slot[i]] += time;
+        if (first_in_p) {
             p->time += time;
             p->samples++;
-            p->active_threads_numerator += active_threads;
+            p->active_threads_numerator += p_threads;
             p->active_threads_denominator += 1;
+        }
+        if (first_in_f) {
+            halide_profiler_func_stats *f = p->funcs + func[i] - p->first_func_id;
+            f->time += (time * f_threads) / p_threads;
+            f->active_threads_numerator += f_threads;
+            f->active_threads_denominator += 1;
+        }
+    }
+}
+
+// The hardware counters of each thread that has claimed a slot while
+// use_counters was set. Threads are added by the pipelines, and only
+// read by the profiler thread.
+struct counted_thread {
+    uint64_t id;
+    int fds[halide_profiler_num_counters];
+    uint64_t last[halide_profiler_num_counters];
+    bool primed;
+    // The slot the thread last claimed.
+    volatile int slot;
+};
+
+WEAK counted_thread counted_threads[halide_profiler_num_slots];
+WEAK volatile int num_counted_threads = 0;
+WEAK int counted_threads_lock = 0;
+
+// The counted thread that last claimed each slot.
+WEAK volatile int slot_thread[halide_profiler_num_slots];
+
+// Note that the calling thread has claimed a slot, opening its
+// counters the first time it is seen.
+WEAK void count_thread_in_slot(halide_profiler_state *s, int slot) {
+    uint64_t id = halide_current_thread_id();
+    int n = num_counted_threads;
+    int t = 0;
+    while (t < n && counted_threads[t].id != id) {
+        t++;
+    }
+    if (t == n) {
+        ScopedSpinLock lock(&counted_threads_lock);
+        t = num_counted_threads;
+        if (t == halide_profiler_num_slots) {
+            return;
+        }
+        counted_thread *c = counted_threads + t;
+        if (halide_perf_counters_open(c->fds) != 0) {
+            if (t == 0) {
+                // No thread can read counters, so stop trying.
+                s->use_counters = -1;
+            }
+            return;
+        }
+        c->id = id;
+        c->primed = false;
+        c->slot = -1;
+        __sync_synchronize();
+        num_counted_threads = t + 1;
+    }
+    slot_thread[slot] = t;
+    counted_threads[t].slot = slot;
+}
+
+// Note that the calling thread has released a slot, so that its counts
+// are no longer billed to whatever the slot is used for next. A thread
+// that claimed a slot for a parallel task while waiting for the tasks
+// of its own parallel loop reclaims its previous slot with
+// count_thread_in_slot when it resumes.
+WEAK void uncount_thread_in_slot(int slot) {
+    uint64_t id = halide_current_thread_id();
+    int n = num_counted_threads;
+    for (int t = 0; t < n; t++) {
+        if (counted_threads[t].id == id) {
+            if (counted_threads[t].slot == slot) {
+                counted_threads[t].slot = -1;
+            }
+            if (slot_thread[slot] == t) {
+                slot_thread[slot] = -1;
+            }
             return;
         }
-        p_prev = p;
     }
-    // Someone must have called reset_state while a kernel was running. Do nothing.
+}
+
+// Bill the counts of each thread since the last sample to the Func it
+// is computing now, the same way bill_slots bills time. Counts of
+// threads that are not in a slot, e.g. idle in the thread pool, are
+// dropped.
+WEAK void bill_counters(halide_profiler_state *s) {
+    int n = num_counted_threads;
+    for (int t = 0; t < n; t++) {
+        counted_thread *c = counted_threads + t;
+        uint64_t counts[halide_profiler_num_counters];
+        if (halide_perf_counters_read(c->fds, counts) != 0) {
+            continue;
+        }
+        uint64_t delta[halide_profiler_num_counters];
+        for (int i = 0; i < halide_profiler_num_counters; i++) {
+            delta[i] = counts[i] - c->last[i];
+            c->last[i] = counts[i];
+        }
+        if (!c->primed) {
+            c->primed = true;
+            continue;
+        }
+
+        // The thread may have released its slot since, in which case
+        // it is either free or claimed by another thread.
+        int slot = c->slot;
+        if (slot < 0 || slot_thread[slot] != t) {
+            continue;
+        }
+        int func = ((volatile int *)(s->slots))[slot];
+        if (func < 0) {
+            continue;
+        }
+        halide_profiler_pipeline_stats *p = find_pipeline(s, func);
+        if (!p) {
+            continue;
+        }
+        halide_profiler_func_stats *f = p->funcs + func - p->first_func_id;
+        for (int i = 0; i < halide_profiler_num_counters; i++) {
+            p->counters[i] += delta[i];
+            f->counters[i] += delta[i];
+        }
+    }
+}
+
+WEAK void close_counted_threads() {
+    for (int t = 0; t < num_counted_threads; t++) {
+        halide_perf_counters_close(counted_threads[t].fds);
+    }
+    num_counted_threads = 0;
 }
 
 WEAK void sampling_profiler_thread(void *) {
@@ -103,22 +307,24 @@ WEAK void sampling_profiler_thread(void *) {
         uint64_t t1 = halide_current_time_ns(NULL);
         uint64_t t = t1;
         while (1) {
-            int func, active_threads;
-            if (s->get_remote_profiler_state) {
+            uint64_t t_now = halide_current_time_ns(NULL);
+            if (s->current_func == halide_profiler_please_stop) {
+                break;
+            } else if (s->get_remote_profiler_state) {
                 // Execution has disappeared into remote code running
                 // on an accelerator (e.g. Hexagon DSP)
+                int func, active_threads;
                 s->get_remote_profiler_state(&func, &active_threads);
+                if (func >= 0) {
+                    bill_func(s, func, t_now - t, active_threads);
+                }
             } else {
-                func = s->current_func;
-                active_threads = s->active_threads;
-            }
-            uint64_t t_now = halide_current_time_ns(NULL);
-            if (func == halide_profiler_please_stop) {
-                break;
-            } else if (func >= 0) {
                 // Assume all time since I was last awake is due to
-                // the currently running func.
-                bill_func(s, func, t_now - t, active_threads);
+                // the currently running funcs.
+                bill_slots(s, t_now - t);
+                if (s->use_counters > 0) {
+                    bill_counters(s);
+                }
             }
             t = t_now;
 
@@ -179,6 +385,13 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
     ScopedMutexLock lock(&s->lock);
 
     if (!s->sampling_thread) {
+        for (int i = 0; i < halide_profiler_num_slots; i++) {
+            s->slots[i] = halide_profiler_outside_of_halide;
+        }
+        const char *use_counters = getenv("HL_PROFILER_COUNTERS");
+        if (use_counters && s->use_counters == 0) {
+            s->use_counters = atoi(use_counters) > 0 ? 1 : 0;
+        }
         halide_start_clock(user_context);
         s->sampling_thread = halide_spawn_thread(sampling_profiler_thread, NULL);
     }
@@ -242,6 +455,7 @@ WEAK void halide_profiler_memory_allocate(void *user_context,
     __sync_add_and_fetch(&p_stats->memory_total, incr);
     uint64_t p_mem_current = __sync_add_and_fetch(&p_stats->memory_current, incr);
     sync_compare_max_and_swap(&p_stats->memory_peak, p_mem_current);
+    timeline_event(user_context, p_stats->name, "memory", 'C', p_mem_current);
 
     // Update per-func memory stats
     __sync_add_and_fetch(&f_stats->num_allocs, 1);
@@ -274,17 +488,35 @@ WEAK void halide_profiler_memory_free(void *user_context,
     // unless user specifically calls halide_profiler_reset().
 
     // Update per-pipeline memory stats
-    __sync_sub_and_fetch(&p_stats->memory_current, decr);
+    uint64_t p_mem_current = __sync_sub_and_fetch(&p_stats->memory_current, decr);
+    timeline_event(user_context, p_stats->name, "memory", 'C', p_mem_current);
 
     // Update per-func memory stats
     __sync_sub_and_fetch(&f_stats->memory_current, decr);
 }
 
+// Print the instructions per cycle, and the cache and branch misses
+// per thousand instructions.
+WEAK void print_counter_rates(Printer<StringStreamPrinter, 1024> &sstr, const uint64_t *counters) {
+    float cycles = counters[halide_profiler_cycles];
+    float kinstrs = counters[halide_profiler_instructions] / 1000.0f + 1e-10f;
+    sstr << counters[halide_profiler_instructions] / cycles;
+    sstr.erase(4);
+    sstr << "  LLC misses/kinstr: " << counters[halide_profiler_cache_misses] / kinstrs;
+    sstr.erase(4);
+    sstr << "  branch misses/kinstr: " << counters[halide_profiler_branch_misses] / kinstrs;
+    sstr.erase(4);
+}
+
 WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_state *s) {
 
     char line_buf[1024];
     Printer<StringStreamPrinter, sizeof(line_buf)> sstr(user_context, line_buf);
 
+    if (s->use_counters < 0) {
+        halide_print(user_context, "Hardware counters are not available; reporting time and memory only.\n");
+    }
+
     for (halide_profiler_pipeline_stats *p = s->pipelines; p;
          p = (halide_profiler_pipeline_stats *)(p->next)) {
         float t = p->time / 1000000.0f;
@@ -303,9 +535,32 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
              << "  time/run: " << t / p->runs << " ms\n";
         if (!serial) {
             sstr << " average threads used: " << threads << "\n";
+            // The busy time of each slot. A slot is not a thread:
+            // it is held by whichever thread claimed it for a
+            // pipeline or a parallel task.
+            int num_slots = 0;
+            for (int i = 0; i < halide_profiler_num_slots; i++) {
+                if (p->thread_time[i]) {
+                    num_slots = i + 1;
+                }
+            }
+            sstr << " busy time/run per profiler slot:";
+            for (int i = 0; i < num_slots; i++) {
+                sstr << " " << p->thread_time[i] / (p->runs * 1000000.0f);
+                // We don't need 6 sig. figs.
+                sstr.erase(3);
+            }
+            sstr << " ms\n";
         }
         sstr << " heap allocations: " << p->num_allocs
              << "  peak heap usage: " << p->memory_peak << " bytes\n";
+        if (p->counters[halide_profiler_cycles]) {
+            sstr << " cycles: " << p->counters[halide_profiler_cycles]
+                 << "  instructions: " << p->counters[halide_profiler_instructions]
+                 << "  IPC: ";
+            print_counter_rates(sstr, p->counters);
+            sstr << "\n";
+        }
         halide_print(user_context, sstr.str());
 
         bool print_f_states = p->time || p->memory_total;
@@ -374,6 +629,10 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
                 if (fs->stack_peak > 0) {
                     sstr << " stack: " << fs->stack_peak;
                 }
+                if (fs->counters[halide_profiler_cycles]) {
+                    sstr << " cycles: " << fs->counters[halide_profiler_cycles] << "  IPC: ";
+                    print_counter_rates(sstr, fs->counters);
+                }
                 sstr << "\n";
 
                 halide_print(user_context, sstr.str());
@@ -394,6 +653,7 @@ WEAK void halide_profiler_reset_unlocked(halide_profiler_state *s) {
         halide_profiler_pipeline_stats *p = s->pipelines;
         s->pipelines = (halide_profiler_pipeline_stats *)(p->next);
         free(p->funcs);
+        free(p->thread_time);
         free(p);
     }
     s->first_free_id = 0;
@@ -422,6 +682,7 @@ WEAK void halide_profiler_shutdown() {
     halide_join_thread(s->sampling_thread);
     s->sampling_thread = NULL;
     s->current_func = halide_profiler_outside_of_halide;
+    close_counted_threads();
 
     // Print results. No need to lock anything because we just shut
     // down the thread.
@@ -452,8 +713,49 @@ WEAK void halide_windows_profiler_shutdown() {
 #endif
 }
 
-WEAK void halide_profiler_pipeline_end(void *user_context, void *state) {
-    ((halide_profiler_state *)state)->current_func = halide_profiler_outside_of_halide;
+// Called by halide_profiler_resume_slot in profiler_inlined.cpp, and by
+// halide_profiler_task_end, while counters are being read.
+WEAK void halide_profiler_count_thread(halide_profiler_state *state, int *slot) {
+    int i = (int)(slot - state->slots);
+    if (i >= 0 && i < halide_profiler_num_slots) {
+        count_thread_in_slot(state, i);
+    }
+}
+
+WEAK void halide_profiler_uncount_thread(halide_profiler_state *state, int *slot) {
+    int i = (int)(slot - state->slots);
+    if (i >= 0 && i < halide_profiler_num_slots) {
+        uncount_thread_in_slot(i);
+    }
+}
+
+// Claim a free slot for the calling thread, and set it to 'func_id'.
+WEAK int *halide_profiler_acquire_slot(halide_profiler_state *state, int func_id) {
+    for (int i = 0; i < halide_profiler_num_slots; i++) {
+        volatile int *slot = state->slots + i;
+        if (*slot == halide_profiler_outside_of_halide &&
+            __sync_bool_compare_and_swap(slot, halide_profiler_outside_of_halide, func_id)) {
+            if (state->use_counters > 0) {
+                count_thread_in_slot(state, i);
+            }
+            return (int *)slot;
+        }
+    }
+    return &state->overflow_slot;
+}
+
+WEAK void halide_profiler_pipeline_end(void *user_context, void *slot) {
+    *((volatile int *)slot) = halide_profiler_outside_of_halide;
+    halide_profiler_state *s = halide_profiler_get_state();
+    if (s->use_counters > 0) {
+        halide_profiler_uncount_thread(s, (int *)slot);
+    }
+}
+
+// Registered as a destructor by each parallel task that claims a slot,
+// so that the slot is released however the task exits.
+WEAK void halide_profiler_task_end(void *user_context, void *slot) {
+    halide_profiler_pipeline_end(user_context, slot);
 }
 
 } // extern "C"
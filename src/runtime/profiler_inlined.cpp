@@ -2,6 +2,11 @@
 
 extern "C" {
 
+// Defined in profiler.cpp. Only called while hardware counters are
+// being read, to keep track of the slot each thread is in.
+void halide_profiler_count_thread(halide_profiler_state *state, int *slot);
+void halide_profiler_uncount_thread(halide_profiler_state *state, int *slot);
+
 WEAK __attribute__((always_inline)) int halide_profiler_set_current_func(halide_profiler_state *state, int tok, int t) {
     // Use empty volatile asm blocks to prevent code motion. Otherwise
     // llvm reorders or elides the stores.
@@ -12,6 +17,37 @@ WEAK __attribute__((always_inline)) int halide_profiler_set_current_func(halide_
     return 0;
 }
 
+WEAK __attribute__((always_inline)) int halide_profiler_set_slot_func(int *slot, int tok, int t) {
+    volatile int *ptr = slot;
+    asm volatile ("":::);
+    *ptr = tok + t;
+    asm volatile ("":::);
+    return 0;
+}
+
+WEAK __attribute__((always_inline)) int halide_profiler_wait_slot(int *slot) {
+    volatile int *ptr = slot;
+    asm volatile ("":::);
+    *ptr = halide_profiler_waiting;
+    asm volatile ("":::);
+    return 0;
+}
+
+// Called by the thread that launched a parallel loop, once its tasks
+// are done.
+WEAK __attribute__((always_inline)) int halide_profiler_resume_slot(halide_profiler_state *state, int *slot, int tok, int t) {
+    volatile int *ptr = slot;
+    asm volatile ("":::);
+    *ptr = tok + t;
+    asm volatile ("":::);
+    // The thread may have run some of the tasks in slots of their own
+    // while it waited.
+    if (state->use_counters > 0) {
+        halide_profiler_count_thread(state, slot);
+    }
+    return 0;
+}
+
 WEAK __attribute__((always_inline)) int halide_profiler_incr_active_threads(halide_profiler_state *state) {
     volatile int *ptr = &(state->active_threads);
     asm volatile ("":::);
@@ -114,3 +114,11 @@ struct thread_parker {
 #include "synchronization_common.h"
 
 #include "thread_pool_common.h"
+
+extern "C" {
+
+WEAK uint64_t halide_current_thread_id() {
+    return qurt_thread_get_id();
+}
+
+}
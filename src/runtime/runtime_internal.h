@@ -135,6 +135,20 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
                                         int num_funcs,
                                         const uint64_t *func_names);
 WEAK int halide_host_cpu_count();
+WEAK uint64_t halide_current_thread_id();
+
+// Hardware performance counters of the calling thread, used by the
+// profiler. Opening fills in halide_profiler_num_counters handles, and
+// returns nonzero if the counters are not available.
+WEAK int halide_perf_counters_open(int *fds);
+WEAK int halide_perf_counters_read(const int *fds, uint64_t *counts);
+WEAK void halide_perf_counters_close(int *fds);
+
+// Memory backed by huge pages where the OS supports it, used by
+// halide_default_malloc for large allocations. Returns NULL if huge
+// pages are not available.
+WEAK void *halide_huge_page_malloc(size_t size);
+WEAK void halide_huge_page_free(void *ptr, size_t size);
 
 WEAK int halide_device_and_host_malloc(void *user_context, struct halide_buffer_t *buf,
                                        const struct halide_device_interface_t *device_interface);
@@ -1,3 +1,5 @@
+#include "timeline.h"
+
 extern "C" void * pthread_self();
 
 namespace Halide { namespace Runtime { namespace Internal {
@@ -152,8 +154,10 @@ WEAK void worker_thread_already_locked(work *owned_job) {
 
             // Release the lock and do the task.
             halide_mutex_unlock(&work_queue.mutex);
+            timeline_event(myjob.user_context, "task", "task", 'B');
             int result = halide_do_task(myjob.user_context, myjob.f, myjob.next,
                                         myjob.closure);
+            timeline_event(myjob.user_context, "task", "task", 'E');
             halide_mutex_lock(&work_queue.mutex);
 
             // If this task failed, set the exit status on the job.
@@ -0,0 +1,27 @@
+#ifndef HALIDE_RUNTIME_TIMELINE_H
+#define HALIDE_RUNTIME_TIMELINE_H
+
+namespace Halide { namespace Runtime { namespace Internal {
+
+// Records an event on the timeline started by halide_start_timeline
+// (see tracing.cpp). 'phase' is a Chrome trace event phase: 'B' and
+// 'E' begin and end a span on the calling thread, and 'C' sets the
+// counter 'name' to 'value'.
+typedef void (*timeline_event_fn)(void *user_context, const char *name, const char *category,
+                                  char phase, int64_t value);
+
+// Set by the tracing runtime while a timeline is being recorded, so
+// that recording costs a single load and branch the rest of the time.
+WEAK timeline_event_fn timeline_hook = NULL;
+
+WEAK __attribute__((always_inline)) void timeline_event(void *user_context, const char *name, const char *category,
+                                                        char phase, int64_t value = 0) {
+    timeline_event_fn f = timeline_hook;
+    if (f) {
+        f(user_context, name, category, phase, value);
+    }
+}
+
+}}} // namespace Halide::Runtime::Internal
+
+#endif
@@ -1,6 +1,7 @@
 #include "HalideRuntime.h"
 #include "printer.h"
 #include "scoped_spin_lock.h"
+#include "timeline.h"
 
 extern "C" {
 
@@ -66,13 +67,228 @@ public:
     }
 
     SharedExclusiveSpinLock() : lock(0) {}
+
+    void reset() {
+        lock = 0;
+    }
 };
 
 const static int buffer_size = 1024 * 1024;
 
+// The worst case size of buffer_size bytes in the LZ4 block format.
+const static int compressed_buffer_size = buffer_size + buffer_size / 255 + 16;
+const static int lz4_hash_log = 14;
+
+// The state needed to write a compressed, indexed trace file (see
+// halide_trace_file_header_t).
+struct TraceCompressor {
+    uint64_t offset;
+    uint8_t out[compressed_buffer_size];
+    uint32_t hash_table[1 << lz4_hash_log];
+    halide_trace_block_index_t *blocks;
+    int num_blocks, max_blocks;
+    int num_funcs, last_func;
+    char *funcs[halide_trace_max_indexed_funcs];
+};
+
+WEAK bool trace_write(int fd, const void *data, size_t size, uint64_t *offset) {
+    *offset += size;
+    return size == (size_t)write(fd, data, size);
+}
+
+WEAK __attribute__((always_inline)) uint32_t load_u32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+WEAK __attribute__((always_inline)) uint8_t *lz4_write_length(uint8_t *op, uint32_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+// Compress n bytes from src into dst in the LZ4 block format, using a
+// single-entry hash table of recent positions and greedy matching.
+// Returns the compressed size.
+WEAK uint32_t lz4_compress(const uint8_t *src, uint32_t n, uint8_t *dst, uint32_t *table) {
+    // The format requires the last match to start at least 12 bytes
+    // before the end, and the last 5 bytes to be literals.
+    const uint32_t match_start_limit = 12, last_literals = 5;
+
+    memset(table, 0, sizeof(uint32_t) << lz4_hash_log);
+    uint8_t *op = dst;
+    uint32_t ip = 1, anchor = 0;
+    while (n > match_start_limit && ip < n - match_start_limit) {
+        uint32_t seq = load_u32(src + ip);
+        uint32_t h = (seq * 2654435761U) >> (32 - lz4_hash_log);
+        uint32_t ref = table[h];
+        table[h] = ip;
+        if (ip - ref > 65535 || load_u32(src + ref) != seq) {
+            ip++;
+            continue;
+        }
+
+        uint32_t match_len = 4;
+        while (ip + match_len < n - last_literals &&
+               src[ref + match_len] == src[ip + match_len]) {
+            match_len++;
+        }
+
+        uint32_t literals = ip - anchor;
+        uint8_t *token = op++;
+        *token = (uint8_t)((literals < 15 ? literals : 15) << 4);
+        if (literals >= 15) {
+            op = lz4_write_length(op, literals - 15);
+        }
+        memcpy(op, src + anchor, literals);
+        op += literals;
+
+        uint32_t offset = ip - ref;
+        *op++ = (uint8_t)(offset & 0xff);
+        *op++ = (uint8_t)(offset >> 8);
+
+        uint32_t len = match_len - 4;
+        *token |= (uint8_t)(len < 15 ? len : 15);
+        if (len >= 15) {
+            op = lz4_write_length(op, len - 15);
+        }
+
+        ip += match_len;
+        anchor = ip;
+    }
+
+    uint32_t literals = n - anchor;
+    *op++ = (uint8_t)((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15) {
+        op = lz4_write_length(op, literals - 15);
+    }
+    memcpy(op, src + anchor, literals);
+    op += literals;
+    return (uint32_t)(op - dst);
+}
+
+// The position of a Func in the index, or
+// halide_trace_max_indexed_funcs if there are too many to name.
+WEAK int trace_func_index(TraceCompressor *c, const char *name) {
+    // Consecutive packets are usually from the same Func.
+    if (c->last_func < c->num_funcs && strcmp(c->funcs[c->last_func], name) == 0) {
+        return c->last_func;
+    }
+    for (int i = 0; i < c->num_funcs; i++) {
+        if (strcmp(c->funcs[i], name) == 0) {
+            return c->last_func = i;
+        }
+    }
+    if (c->num_funcs == halide_trace_max_indexed_funcs) {
+        return halide_trace_max_indexed_funcs;
+    }
+    size_t len = strlen(name) + 1;
+    char *copy = (char *)malloc(len);
+    if (!copy) {
+        return halide_trace_max_indexed_funcs;
+    }
+    memcpy(copy, name, len);
+    c->funcs[c->num_funcs] = copy;
+    return c->last_func = c->num_funcs++;
+}
+
+WEAK bool trace_write_block(TraceCompressor *c, int fd, const uint8_t *data, uint32_t size) {
+    bool success = true;
+    if (c->offset == 0) {
+        halide_trace_file_header_t header = {halide_trace_file_magic, halide_trace_file_version};
+        success = trace_write(fd, &header, sizeof(header), &c->offset);
+    }
+
+    if (c->num_blocks == c->max_blocks) {
+        int new_max = c->max_blocks ? c->max_blocks * 2 : 64;
+        halide_trace_block_index_t *new_blocks =
+            (halide_trace_block_index_t *)malloc(new_max * sizeof(halide_trace_block_index_t));
+        if (!new_blocks) {
+            return false;
+        }
+        if (c->blocks) {
+            memcpy(new_blocks, c->blocks, c->num_blocks * sizeof(halide_trace_block_index_t));
+            free(c->blocks);
+        }
+        c->blocks = new_blocks;
+        c->max_blocks = new_max;
+    }
+
+    // Summarize the packets in the block for the index.
+    halide_trace_block_index_t *b = c->blocks + c->num_blocks++;
+    memset(b, 0, sizeof(*b));
+    b->offset = c->offset;
+    bool first = true;
+    for (uint32_t pos = 0; pos < size;) {
+        const halide_trace_packet_t *p = (const halide_trace_packet_t *)(data + pos);
+        if (first || p->id < b->min_id) {
+            b->min_id = p->id;
+        }
+        if (first || p->id > b->max_id) {
+            b->max_id = p->id;
+        }
+        first = false;
+        b->event_mask |= 1U << p->event;
+        int f = trace_func_index(c, p->func());
+        b->func_mask[f / 32] |= 1U << (f % 32);
+        pos += p->size;
+    }
+
+    halide_trace_block_header_t header;
+    header.uncompressed_size = size;
+    header.compressed_size = lz4_compress(data, size, c->out, c->hash_table);
+    const void *payload = c->out;
+    if (header.compressed_size >= size) {
+        header.compressed_size = size;
+        payload = data;
+    }
+    success = success && trace_write(fd, &header, sizeof(header), &c->offset);
+    success = success && trace_write(fd, payload, header.compressed_size, &c->offset);
+    return success;
+}
+
+WEAK bool trace_write_index(TraceCompressor *c, int fd) {
+    if (c->offset == 0) {
+        // Nothing was traced. Write an empty file with a valid header.
+        halide_trace_file_header_t header = {halide_trace_file_magic, halide_trace_file_version};
+        if (!trace_write(fd, &header, sizeof(header), &c->offset)) {
+            return false;
+        }
+    }
+
+    // Mark the end of the blocks for readers that don't seek.
+    halide_trace_block_header_t end = {0, 0};
+    bool success = trace_write(fd, &end, sizeof(end), &c->offset);
+
+    halide_trace_file_trailer_t trailer = {c->offset, halide_trace_index_magic, 0};
+    uint32_t count = c->num_funcs;
+    success = success && trace_write(fd, &count, sizeof(count), &c->offset);
+    for (int i = 0; i < c->num_funcs; i++) {
+        success = success && trace_write(fd, c->funcs[i], strlen(c->funcs[i]) + 1, &c->offset);
+    }
+    count = c->num_blocks;
+    success = success && trace_write(fd, &count, sizeof(count), &c->offset);
+    success = success && trace_write(fd, c->blocks, c->num_blocks * sizeof(halide_trace_block_index_t), &c->offset);
+    success = success && trace_write(fd, &trailer, sizeof(trailer), &c->offset);
+    return success;
+}
+
+WEAK void trace_free_compressor(TraceCompressor *c) {
+    for (int i = 0; i < c->num_funcs; i++) {
+        free(c->funcs[i]);
+    }
+    free(c->blocks);
+    free(c);
+}
+
 class TraceBuffer {
     SharedExclusiveSpinLock lock;
     uint32_t cursor, overage;
+    TraceCompressor *compressor;
     uint8_t buf[buffer_size];
 
     // Attempt to atomically acquire space in the buffer to write a
@@ -103,7 +319,11 @@ public:
         bool success = true;
         if (cursor) {
             cursor -= overage;
-            success = (cursor == (uint32_t)write(fd, buf, cursor));
+            if (compressor) {
+                success = trace_write_block(compressor, fd, buf, cursor);
+            } else {
+                success = (cursor == (uint32_t)write(fd, buf, cursor));
+            }
             cursor = 0;
             overage = 0;
         }
@@ -132,7 +352,41 @@ public:
         lock.release_shared();
     }
 
-    TraceBuffer() : cursor(0), overage(0) {}
+    // Set up a buffer allocated with malloc. If 'compress' is true,
+    // write a compressed, indexed trace file. Returns false if out of
+    // memory.
+    bool init(bool compress) {
+        lock.reset();
+        cursor = 0;
+        overage = 0;
+        compressor = NULL;
+        if (compress) {
+            compressor = (TraceCompressor *)malloc(sizeof(TraceCompressor));
+            if (!compressor) {
+                return false;
+            }
+            compressor->offset = 0;
+            compressor->blocks = NULL;
+            compressor->num_blocks = compressor->max_blocks = 0;
+            compressor->num_funcs = compressor->last_func = 0;
+        }
+        return true;
+    }
+
+    // Flush the buffer, and write the index of a compressed trace
+    // file. Nothing may be traced afterwards.
+    bool finish(void *user_context, int fd) {
+        flush(user_context, fd);
+        bool success = true;
+        if (compressor) {
+            success = trace_write_index(compressor, fd);
+            trace_free_compressor(compressor);
+            compressor = NULL;
+        }
+        return success;
+    }
+
+    TraceBuffer() : cursor(0), overage(0), compressor(NULL) {}
 };
 
 WEAK TraceBuffer *halide_trace_buffer = NULL;
@@ -141,6 +395,132 @@ WEAK int halide_trace_file_lock = 0;
 WEAK bool halide_trace_file_initialized = false;
 WEAK void *halide_trace_file_internally_opened = NULL;
 
+// The timeline being recorded by halide_start_timeline. Events are
+// formatted into one of two buffers under a lock. When the buffer
+// fills up, recording switches to the other one, and the full one is
+// written to the file after the lock is released, so other threads
+// can keep recording events during the write.
+const static int timeline_buffer_size = 64 * 1024;
+const static int timeline_max_threads = 256;
+
+struct Timeline {
+    void *file;
+    int fd;
+    // The buffer events are being appended to, and its length.
+    int current;
+    int cursor;
+    // The length of each buffer waiting to be written, and whether it
+    // has been written yet.
+    int length[2];
+    volatile bool writing[2];
+    bool first_event;
+    int num_threads;
+    uint64_t threads[timeline_max_threads];
+    char buf[2][timeline_buffer_size];
+};
+
+WEAK Timeline *halide_timeline = NULL;
+WEAK int halide_timeline_lock = 0;
+
+// Append to the current buffer. Must be called with
+// halide_timeline_lock held. If the buffer is full, recording switches
+// to the other one, and the index of the full one is returned, which
+// the caller must pass to timeline_write once it has released the
+// lock. Otherwise returns -1.
+WEAK int timeline_append(Timeline *t, const char *str, size_t len) {
+    int full = -1;
+    if (t->cursor + (int)len > timeline_buffer_size) {
+        full = t->current;
+        t->length[full] = t->cursor;
+        t->writing[full] = true;
+        t->current = full ^ 1;
+        t->cursor = 0;
+        // The other buffer may not have been written out yet. Only one
+        // buffer is ever being written, so they are written in the
+        // order they filled up.
+        while (t->writing[t->current]) {
+        }
+    }
+    memcpy(t->buf[t->current] + t->cursor, str, len);
+    t->cursor += len;
+    return full;
+}
+
+// Write out a buffer returned by timeline_append.
+WEAK void timeline_write(void *user_context, Timeline *t, int b) {
+    if (b < 0) {
+        return;
+    }
+    bool success = (t->length[b] == (int)write(t->fd, t->buf[b], t->length[b]));
+    __sync_synchronize();
+    t->writing[b] = false;
+    halide_assert(user_context, success && "Could not write to timeline file");
+}
+
+// Func names may be arbitrary strings, so escape anything JSON cares about.
+WEAK void timeline_append_string(Printer<StringStreamPrinter, 512> &ss, const char *str) {
+    ss << "\"";
+    char c[2] = {0, 0};
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            ss << "\\";
+        } else if ((unsigned char)*str < 32) {
+            continue;
+        }
+        c[0] = *str;
+        ss << c;
+    }
+    ss << "\"";
+}
+
+WEAK void timeline_record(void *user_context, const char *name, const char *category,
+                          char phase, int64_t value) {
+    // Chrome trace timestamps are in microseconds.
+    uint64_t ns = (uint64_t)halide_current_time_ns(user_context);
+    uint64_t thread = halide_current_thread_id();
+    char ph[2] = {phase, 0};
+    char frac[4] = {(char)('0' + (ns / 100) % 10),
+                    (char)('0' + (ns / 10) % 10),
+                    (char)('0' + ns % 10), 0};
+
+    Printer<StringStreamPrinter, 512> ss(user_context);
+    Timeline *t = NULL;
+    int full = -1;
+    {
+        ScopedSpinLock lock(&halide_timeline_lock);
+        t = halide_timeline;
+        if (!t) {
+            return;
+        }
+
+        // Give each thread a small id, in the order they were first seen.
+        int tid = 0;
+        while (tid < t->num_threads && t->threads[tid] != thread) {
+            tid++;
+        }
+        if (tid == t->num_threads) {
+            if (tid < timeline_max_threads) {
+                t->threads[t->num_threads++] = thread;
+            } else {
+                tid = timeline_max_threads;
+            }
+        }
+
+        ss << (t->first_event ? "" : ",\n") << "{\"name\":";
+        timeline_append_string(ss, name);
+        ss << ",\"cat\":\"" << category << "\",\"ph\":\"" << ph
+           << "\",\"ts\":" << (ns / 1000) << "." << frac
+           << ",\"pid\":0,\"tid\":" << tid;
+        if (phase == 'C') {
+            ss << ",\"args\":{\"bytes\":" << value << "}";
+        }
+        ss << "}";
+        t->first_event = false;
+        full = timeline_append(t, ss.str(), ss.size());
+    }
+    timeline_write(user_context, t, full);
+}
+
 }}}
 
 extern "C" {
@@ -152,7 +532,11 @@ WEAK int32_t halide_default_trace(void *user_context, const halide_trace_event_t
 
     // If we're dumping to a file, use a binary format
     int fd = halide_get_trace_file(user_context);
-    if (fd > 0) {
+    if (fd <= 0 && timeline_hook) {
+        // The event has already been recorded on the timeline, which
+        // is more useful than stdout.
+        return my_id;
+    } else if (fd > 0) {
         // Compute the total packet size
         uint32_t value_bytes = (uint32_t)(e->type.lanes * e->type.bytes());
         uint32_t header_bytes = (uint32_t)sizeof(halide_trace_packet_t);
@@ -331,12 +715,17 @@ WEAK int halide_get_trace_file(void *user_context) {
     if (halide_trace_file < 0) {
         const char *trace_file_name = getenv("HL_TRACE_FILE");
         if (trace_file_name) {
-            void *file = fopen(trace_file_name, "ab");
+            const char *compress_var = getenv("HL_TRACE_COMPRESS");
+            bool compress = compress_var && atoi(compress_var) > 0;
+            // A compressed file can't be appended to.
+            void *file = fopen(trace_file_name, compress ? "wb" : "ab");
             halide_assert(user_context, file && "Failed to open trace file\n");
             halide_set_trace_file(fileno(file));
             halide_trace_file_internally_opened = file;
             if (!halide_trace_buffer) {
                 halide_trace_buffer = (TraceBuffer *)malloc(sizeof(TraceBuffer));
+                bool success = halide_trace_buffer && halide_trace_buffer->init(compress);
+                halide_assert(user_context, success && "Failed to allocate trace buffer\n");
             }
         } else {
             halide_set_trace_file(0);
@@ -346,17 +735,63 @@ WEAK int halide_get_trace_file(void *user_context) {
 }
 
 WEAK int32_t halide_trace(void *user_context, const halide_trace_event_t *e) {
+    if (timeline_hook) {
+        const char *category = NULL;
+        char phase = 'B';
+        switch (e->event) {
+        case halide_trace_begin_pipeline:
+        case halide_trace_end_pipeline:
+            category = "pipeline";
+            break;
+        case halide_trace_begin_realization:
+        case halide_trace_end_realization:
+            category = "realize";
+            break;
+        case halide_trace_produce:
+        case halide_trace_end_produce:
+            category = "produce";
+            break;
+        case halide_trace_consume:
+        case halide_trace_end_consume:
+            category = "consume";
+            break;
+        default:
+            break;
+        }
+        switch (e->event) {
+        case halide_trace_end_pipeline:
+        case halide_trace_end_realization:
+        case halide_trace_end_produce:
+        case halide_trace_end_consume:
+            phase = 'E';
+            break;
+        default:
+            break;
+        }
+        if (category) {
+            timeline_event(user_context, e->func, category, phase);
+        }
+    }
     return (*halide_custom_trace)(user_context, e);
 }
 
 WEAK int halide_shutdown_trace() {
     if (halide_trace_file_internally_opened) {
-        int ret = fclose(halide_trace_file_internally_opened);
+        int ret = 0;
+        if (halide_trace_buffer) {
+            if (!halide_trace_buffer->finish(NULL, halide_trace_file)) {
+                ret = -1;
+            }
+        }
+        if (fclose(halide_trace_file_internally_opened) != 0) {
+            ret = -1;
+        }
         halide_trace_file = 0;
         halide_trace_file_initialized = false;
         halide_trace_file_internally_opened = NULL;
         if (halide_trace_buffer) {
             free(halide_trace_buffer);
+            halide_trace_buffer = NULL;
         }
         return ret;
     } else {
@@ -364,10 +799,74 @@ WEAK int halide_shutdown_trace() {
     }
 }
 
+WEAK int halide_start_timeline(void *user_context, const char *filename) {
+    halide_stop_timeline(user_context);
+
+    void *file = fopen(filename, "wb");
+    if (!file) {
+        error(user_context) << "Failed to open timeline file " << filename << "\n";
+        return -1;
+    }
+    Timeline *t = (Timeline *)malloc(sizeof(Timeline));
+    if (!t) {
+        fclose(file);
+        return halide_error_code_out_of_memory;
+    }
+    t->file = file;
+    t->fd = fileno(file);
+    t->current = 0;
+    t->cursor = 0;
+    t->writing[0] = t->writing[1] = false;
+    t->first_event = true;
+    t->num_threads = 0;
+    timeline_append(t, "[\n", 2);
+
+    halide_start_clock(user_context);
+    {
+        ScopedSpinLock lock(&halide_timeline_lock);
+        halide_timeline = t;
+    }
+    timeline_hook = timeline_record;
+    return 0;
+}
+
+WEAK int halide_stop_timeline(void *user_context) {
+    Timeline *t = NULL;
+    timeline_hook = NULL;
+    {
+        ScopedSpinLock lock(&halide_timeline_lock);
+        t = halide_timeline;
+        halide_timeline = NULL;
+    }
+    if (!t) {
+        return 0;
+    }
+    // Wait for any buffer other threads are still writing out, then
+    // write the rest.
+    while (t->writing[0] || t->writing[1]) {
+        halide_thread_yield();
+    }
+    timeline_write(user_context, t, timeline_append(t, "\n]\n", 3));
+    t->length[t->current] = t->cursor;
+    timeline_write(user_context, t, t->current);
+    int ret = fclose(t->file);
+    free(t);
+    return ret;
+}
+
 namespace {
+__attribute__((constructor))
+WEAK void halide_timeline_init() {
+    const char *filename = getenv("HL_TIMELINE_FILE");
+    if (filename) {
+        halide_start_timeline(NULL, filename);
+    }
+}
+
 __attribute__((destructor))
 WEAK void halide_trace_cleanup() {
     halide_shutdown_trace();
+    halide_stop_timeline(NULL);
 }
 }
 
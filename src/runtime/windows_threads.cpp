@@ -21,6 +21,7 @@ typedef struct {
 } CriticalSection;
 
 extern WIN32API Thread CreateThread(void *, size_t, void *(*fn)(void *), void *, int32_t, int32_t *);
+extern WIN32API uint32_t GetCurrentThreadId();
 extern WIN32API void InitializeConditionVariable(ConditionVariable *);
 extern WIN32API void WakeConditionVariable(ConditionVariable *);
 extern WIN32API void SleepConditionVariableCS(ConditionVariable *, CriticalSection *, int);
@@ -130,3 +131,11 @@ struct thread_parker {
 #include "synchronization_common.h"
 
 #include "thread_pool_common.h"
+
+extern "C" {
+
+WEAK uint64_t halide_current_thread_id() {
+    return GetCurrentThreadId();
+}
+
+}
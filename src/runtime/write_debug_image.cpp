@@ -1,6 +1,6 @@
 #include "HalideRuntime.h"
 
-// We support three formats, tiff, mat, and tmp.
+// We support four formats, tiff, mat, npy, and tmp.
 //
 // All formats support arbitrary types, and are easy to write in a
 // small amount of code.
@@ -11,6 +11,9 @@
 // mat:
 // - Abitrary dimensionality, type
 // - Readable by matlab, ImageStack, and many other tools
+// npy:
+// - Arbitrary dimensionality, type
+// - Readable by numpy, and mappable in place with np.load(mmap_mode='r')
 // tmp:
 // - Dirt simple, easy to roll your own parser
 // - Readable by ImageStack only
@@ -42,6 +45,11 @@ WEAK uint8_t pixel_type_to_matlab_type_code[] = {
     7, 9, 2, 1, 4, 3, 6, 5, 13, 12
 };
 
+// numpy type descriptors, without the byte order.
+WEAK const char *pixel_type_to_npy_descr[] = {
+    "f4", "f8", "u1", "i1", "u2", "i2", "u4", "i4", "u8", "i8"
+};
+
 #pragma pack(push)
 #pragma pack(2)
 
@@ -299,6 +307,62 @@ WEAK extern "C" int32_t halide_debug_to_file(void *user_context, const char *fil
         if (!f.write(payload_header, sizeof(payload_header))) {
             return -11;
         }
+    } else if (ends_with(filename, ".npy")) {
+        // Halide stores dimension 0 innermost, so write the shape in
+        // dimension order and mark the array as Fortran-ordered;
+        // np.load() then indexes it like the Func, e.g. a[x, y, c].
+        // The header is padded with spaces so that the payload starts
+        // on a 64-byte boundary, as numpy requires to map the file.
+        char header[128];
+        char *end = header + sizeof(header);
+        char *dst = header + 10;
+
+        int32_t one = 1;
+        char byte_order = *(char *)&one ? '<' : '>';
+        const char *descr = pixel_type_to_npy_descr[type_code];
+        if (bytes_per_element == 1) {
+            byte_order = '|';
+            if (buf->type.bits == 1) {
+                descr = "b1";
+            }
+        }
+        char order[2] = {byte_order, 0};
+
+        dst = halide_string_to_string(dst, end, "{'descr': '");
+        dst = halide_string_to_string(dst, end, order);
+        dst = halide_string_to_string(dst, end, descr);
+        dst = halide_string_to_string(dst, end, "', 'fortran_order': True, 'shape': (");
+        for (int i = 0; i < buf->dimensions; i++) {
+            if (i > 0) {
+                dst = halide_string_to_string(dst, end, ", ");
+            }
+            dst = halide_int64_to_string(dst, end, shape[i].extent, 1);
+        }
+        if (buf->dimensions == 1) {
+            dst = halide_string_to_string(dst, end, ",");
+        }
+        dst = halide_string_to_string(dst, end, "), }");
+
+        size_t header_bytes = (dst - header + 1 + 63) & ~63;
+        if (header_bytes > sizeof(header)) {
+            halide_error(user_context, "Unexpectedly large .npy header");
+            return -17;
+        }
+        while (dst < header + header_bytes - 1) {
+            *dst++ = ' ';
+        }
+        *dst = '\n';
+
+        const char magic[] = "\x93NUMPY";
+        memcpy(header, magic, 6);
+        header[6] = 1;
+        header[7] = 0;
+        header[8] = (char)((header_bytes - 10) & 0xff);
+        header[9] = (char)((header_bytes - 10) >> 8);
+
+        if (!f.write(header, header_bytes)) {
+            return -18;
+        }
     } else {
         int32_t header[] = {shape[0].extent,
                             shape[1].extent,
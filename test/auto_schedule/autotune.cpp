@@ -0,0 +1,66 @@
+#include "Halide.h"
+#include "halide_autotune.h"
+
+#include <cstdio>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+int main(int argc, char **argv) {
+    const int W = 1024, H = 1024;
+    Buffer<uint16_t> in(W + 2, H + 2);
+    for (int y = 0; y < in.height(); y++) {
+        for (int x = 0; x < in.width(); x++) {
+            in(x, y) = rand() & 0xfff;
+        }
+    }
+
+    auto make_pipeline = [&]() {
+        Var x("x"), y("y");
+        Func blur_x("blur_x"), blur_y("blur_y");
+        blur_x(x, y) = (in(x, y) + in(x + 1, y) + in(x + 2, y)) / 3;
+        blur_y(x, y) = (blur_x(x, y) + blur_x(x, y + 1) + blur_x(x, y + 2)) / 3;
+        blur_y.estimate(x, 0, W).estimate(y, 0, H);
+        return Pipeline(blur_y);
+    };
+
+    Buffer<uint16_t> out(W, H);
+    auto run = [&](Pipeline p) {
+        p.realize(out);
+    };
+
+    AutotuneConfig config;
+    config.num_candidates = 3;
+    config.time_budget = 20;
+    config.benchmark_config.min_time = 0.01;
+    config.benchmark_config.max_time = 0.04;
+
+    AutotuneResult result = autotune(make_pipeline, run, config);
+    if (result.best_candidate < 0 || result.candidates_tried == 0) {
+        printf("No candidate was timed\n");
+        return -1;
+    }
+    printf("Best of %d candidates: %d (%1.3gms)\n",
+           result.candidates_tried, result.best_candidate, result.best_time * 1e3);
+
+    // Check the output of the winning schedule.
+    Pipeline p = make_pipeline();
+    p.auto_schedule_candidate(config.target, config.machine_params, result.best_candidate);
+    p.realize(out);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            uint16_t bx[3];
+            for (int i = 0; i < 3; i++) {
+                bx[i] = (in(x, y + i) + in(x + 1, y + i) + in(x + 2, y + i)) / 3;
+            }
+            uint16_t correct = (bx[0] + bx[1] + bx[2]) / 3;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
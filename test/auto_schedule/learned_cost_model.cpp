@@ -0,0 +1,144 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+
+#include <cmath>
+#include <cstdio>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+Pipeline make_blur(Buffer<uint16_t> in, int W, int H) {
+    Var x("x"), y("y");
+    Func blur_x("blur_x"), blur_y("blur_y");
+    blur_x(x, y) = (in(x, y) + in(x + 1, y) + in(x + 2, y)) / 3;
+    blur_y(x, y) = (blur_x(x, y) + blur_x(x, y + 1) + blur_x(x, y + 2)) / 3;
+    blur_y.estimate(x, 0, W).estimate(y, 0, H);
+    return Pipeline(blur_y);
+}
+
+bool check_blur(Buffer<uint16_t> in, Buffer<uint16_t> out) {
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            uint16_t bx[3];
+            for (int i = 0; i < 3; i++) {
+                bx[i] = (in(x, y + i) + in(x + 1, y + i) + in(x + 2, y + i)) / 3;
+            }
+            uint16_t correct = (bx[0] + bx[1] + bx[2]) / 3;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    MachineParams params = MachineParams::generic();
+
+    Buffer<uint16_t> in(2048 + 2, 2048 + 2);
+    for (int y = 0; y < in.height(); y++) {
+        for (int x = 0; x < in.width(); x++) {
+            in(x, y) = rand() & 0xfff;
+        }
+    }
+
+    BenchmarkConfig config;
+    config.min_time = 0.005;
+    config.max_time = 0.02;
+
+    // Schedule the pipeline for a range of sizes, and measure each
+    // schedule. Without a profiler, all of the time is attributed to
+    // the output. A second model is given the same times in the form
+    // the profiler reports them in (total nanoseconds over several
+    // runs, next to entries that should be ignored), and should end up
+    // with the same weights.
+    LearnedCostModel model, profiled_model;
+    int samples = 0;
+    for (int size = 128; size <= 2048; size += 128) {
+        Pipeline p = make_blur(in, size, size);
+        p.auto_schedule(target, params, model);
+        Buffer<uint16_t> out(size, size);
+        p.realize(out);
+        if (!check_blur(in, out)) {
+            return -1;
+        }
+        double t = benchmark([&]() { p.realize(out); }, config);
+        int added = model.add_samples({{"blur_y", t}});
+        samples += added;
+
+        make_blur(in, size, size).auto_schedule(target, params, profiled_model);
+        const int runs = 4;
+        halide_profiler_func_stats funcs[3] = {};
+        funcs[0].name = "overhead";
+        funcs[0].time = 1000;
+        funcs[1].name = nullptr;
+        funcs[1].time = 1000;
+        funcs[2].name = "blur_y";
+        funcs[2].time = (uint64_t)std::llround(t * 1e9 * runs);
+        halide_profiler_pipeline_stats stats = {};
+        stats.funcs = funcs;
+        stats.num_funcs = 3;
+        stats.runs = runs;
+        int profiled_samples = profiled_model.add_samples(stats);
+        if (profiled_samples != added) {
+            printf("Recorded %d samples from the profiler stats instead of %d\n",
+                   profiled_samples, added);
+            return -1;
+        }
+    }
+    if (samples < LearnedCostModel::num_features) {
+        printf("Only recorded %d samples\n", samples);
+        return -1;
+    }
+
+    // Samples are only taken from the last schedule, once.
+    halide_profiler_pipeline_stats empty_stats = {};
+    if (profiled_model.add_samples(empty_stats) != 0) {
+        printf("Samples should not be added twice for the same schedule\n");
+        return -1;
+    }
+
+    if (!model.train() || !profiled_model.train()) {
+        printf("Training failed\n");
+        return -1;
+    }
+    for (size_t i = 0; i < model.weights().size(); i++) {
+        double a = model.weights()[i], b = profiled_model.weights()[i];
+        if (std::abs(a - b) > 1e-3 * std::max(std::abs(a), 1.0)) {
+            printf("Weight %d is %f when trained from profiler stats, and %f otherwise\n",
+                   (int)i, b, a);
+            return -1;
+        }
+    }
+    for (double w : model.weights()) {
+        if (w < 0) {
+            printf("Trained weights should not be negative\n");
+            return -1;
+        }
+    }
+
+    // The weights round-trip through a file.
+    std::string path = Internal::get_test_tmp_dir() + "learned_cost_model_weights.txt";
+    model.save(path);
+    LearnedCostModel loaded(path);
+    if (loaded.weights() != model.weights()) {
+        printf("Weights changed when saved and loaded\n");
+        return -1;
+    }
+
+    // The trained model still produces a valid schedule.
+    Pipeline p = make_blur(in, 1024, 1024);
+    p.auto_schedule(target, params, loaded);
+    Buffer<uint16_t> out(1024, 1024);
+    p.realize(out);
+    if (!check_blur(in, out)) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include "Halide.h"
+
+#include <cstdio>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    MachineParams host = MachineParams::host();
+    printf("Host machine parameters: %s\n", host.to_string().c_str());
+
+    const int64_t *parallelism = Internal::as_const_int(host.parallelism);
+    const int64_t *llc = Internal::as_const_int(host.last_level_cache_size);
+    const int64_t *balance = Internal::as_const_int(host.balance);
+    if (!parallelism || !llc || !balance ||
+        *parallelism < 1 || *llc < 1 || *balance < 1) {
+        printf("Invalid host machine parameters\n");
+        return -1;
+    }
+
+    // The measurement is only done once, so every request for the host
+    // parameters gets the same answer.
+    if (MachineParams("host").to_string() != host.to_string() ||
+        MachineParams(host.to_string()).to_string() != host.to_string()) {
+        printf("Host machine parameters don't round-trip through strings\n");
+        return -1;
+    }
+
+    // They're usable by the auto-scheduler.
+    Var x("x"), y("y");
+    Func f("f"), g("g");
+    f(x, y) = x + y;
+    g(x, y) = f(x, y) + f(x + 1, y) + f(x, y + 1);
+    g.estimate(x, 0, 1024).estimate(y, 0, 1024);
+
+    Target target = get_jit_target_from_environment();
+    Pipeline p(g);
+    p.auto_schedule(target, host);
+    Buffer<int> out = p.realize(1024, 1024);
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            int correct = 3 * (x + y) + 2;
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// A reduction with a small pure dimension and a large reduction domain,
+// which the auto-scheduler can only parallelize by rfactoring it.
+double run_test(bool auto_schedule) {
+    const int W = 2048, H = 2048, C = 3;
+    Buffer<float> in(W, H, C);
+    for (int c = 0; c < C; c++) {
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                in(x, y, c) = (float)((x + y * 3 + c * 7) % 17) / 17.0f;
+            }
+        }
+    }
+
+    Var c("c");
+    RDom r(0, W, 0, H);
+    Func sum("sum");
+    sum(c) = 0.0f;
+    sum(c) += in(r.x, r.y, c) * in(r.x, r.y, c);
+
+    Target target = get_jit_target_from_environment();
+    Pipeline p(sum);
+
+    if (auto_schedule) {
+        sum.estimate(c, 0, C);
+        std::string schedule = p.auto_schedule(target);
+        if (schedule.find("rfactor") == std::string::npos) {
+            printf("Expected the reduction to be rfactored:\n%s\n", schedule.c_str());
+            exit(-1);
+        }
+    } else {
+        // A hand schedule that splits the rows into parallel strips.
+        RVar ry_o("ry_o"), ry_i("ry_i");
+        Var u("u");
+        Func intm = sum.update().split(r.y, ry_o, ry_i, 32).rfactor(ry_o, u);
+        intm.compute_root().update().parallel(u);
+    }
+
+    Buffer<float> result(C);
+    p.realize(result, target);
+
+    // Check the result against a double-precision sum.
+    for (int c = 0; c < C; c++) {
+        double correct = 0;
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                correct += (double)in(x, y, c) * in(x, y, c);
+            }
+        }
+        if (std::abs(result(c) - correct) > correct * 1e-3) {
+            printf("sum(%d) = %f instead of %f\n", c, result(c), correct);
+            exit(-1);
+        }
+    }
+
+    double t = benchmark(3, 10, [&]() {
+        p.realize(result, target);
+    });
+
+    return t * 1000;
+}
+
+int main(int argc, char **argv) {
+    double manual_time = run_test(false);
+    double auto_time = run_test(true);
+
+    std::cout << "======================" << std::endl;
+    std::cout << "Manual time: " << manual_time << "ms" << std::endl;
+    std::cout << "Auto time: " << auto_time << "ms" << std::endl;
+    std::cout << "======================" << std::endl;
+
+    if (auto_time > manual_time * 3) {
+        printf("Auto-scheduler is much much slower than it should be.\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
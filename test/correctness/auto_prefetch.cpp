@@ -0,0 +1,151 @@
+#include "Halide.h"
+#include <stdio.h>
+
+#include "test/common/check_call_graphs.h"
+
+namespace {
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+class CountPrefetches : public IRMutator2 {
+    class Count : public IRVisitor {
+        using IRVisitor::visit;
+
+        void visit(const Call *op) {
+            if (op->is_intrinsic(Call::prefetch)) {
+                count++;
+            }
+            IRVisitor::visit(op);
+        }
+    public:
+        int count = 0;
+    };
+
+public:
+    int &count;
+    CountPrefetches(int &c) : count(c) {}
+
+    using IRMutator2::mutate;
+
+    Stmt mutate(const Stmt &s) override {
+        Count c;
+        s.accept(&c);
+        count = c.count;
+        return s;
+    }
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.has_gpu_feature()) {
+        printf("Not running auto prefetch test on a GPU target\n");
+        printf("Success!\n");
+        return 0;
+    }
+
+    Var x("x"), y("y"), xo("xo"), xi("xi");
+
+    {
+        // Walking down the columns of f touches a new row of f per
+        // element, which the hardware prefetcher won't anticipate.
+        Func f("f"), g("g");
+        f(x, y) = x + y * 256;
+        g(x, y) = f(y, x);
+        f.compute_root();
+        g.split(x, xo, xi, 8, TailStrategy::RoundUp).auto_prefetch(xo, 2);
+
+        int count = 0;
+        g.add_custom_lowering_pass(new CountPrefetches(count));
+
+        Buffer<int> im = g.realize(128, 64);
+        auto func = [](int x, int y) { return y + x * 256; };
+        if (check_image(im, func)) {
+            return -1;
+        }
+        if (count == 0) {
+            printf("Expected prefetches of f along the columns of g\n");
+            return -1;
+        }
+    }
+
+    {
+        // A contiguous stream along rows is left to the hardware.
+        Func f("f"), g("g");
+        f(x, y) = x + y * 256;
+        g(x, y) = f(x, y) * 2;
+        f.compute_root();
+        g.split(x, xo, xi, 8, TailStrategy::RoundUp).auto_prefetch(xo, 2);
+
+        int count = 0;
+        g.add_custom_lowering_pass(new CountPrefetches(count));
+
+        Buffer<int> im = g.realize(128, 64);
+        auto func = [](int x, int y) { return (x + y * 256) * 2; };
+        if (check_image(im, func)) {
+            return -1;
+        }
+        if (count != 0) {
+            printf("Expected no prefetches of a contiguous stream, found %d\n", count);
+            return -1;
+        }
+    }
+
+    {
+        // Each row of f read per iteration is larger than the L1, so
+        // only its leading cache lines are prefetched.
+        Func f("f"), g("g");
+        RDom r(0, 8192);
+        f(x, y) = x + y;
+        g(x) = sum(f(r, x));
+        f.compute_root();
+        g.auto_prefetch(x, 1);
+
+        int count = 0;
+        g.add_custom_lowering_pass(new CountPrefetches(count));
+
+        Buffer<int> im = g.realize(16);
+        for (int i = 0; i < 16; i++) {
+            int correct = 8192 * 8191 / 2 + 8192 * i;
+            if (im(i) != correct) {
+                printf("g(%d) = %d instead of %d\n", i, im(i), correct);
+                return -1;
+            }
+        }
+        if (count == 0) {
+            printf("Expected a prefetch of the leading part of each row of f\n");
+            return -1;
+        }
+    }
+
+    {
+        // A lookup into a table indexed by data, as in the grid of a
+        // bilateral filter, is prefetched at the index computed ahead.
+        const int table_size = 1 << 16;
+        Func table("table"), index("index"), g("g");
+        table(x) = x * 3;
+        index(x, y) = (x * 7919 + y * 104729) % table_size;
+        g(x, y) = table(clamp(index(x, y), 0, table_size - 1));
+        table.compute_root();
+        index.compute_root();
+        g.auto_prefetch(x, 16);
+
+        int count = 0;
+        g.add_custom_lowering_pass(new CountPrefetches(count));
+
+        Buffer<int> im = g.realize(256, 16);
+        auto func = [=](int x, int y) { return ((x * 7919 + y * 104729) % table_size) * 3; };
+        if (check_image(im, func)) {
+            return -1;
+        }
+        if (count == 0) {
+            printf("Expected prefetches of the gathers from table\n");
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "halide_benchmark.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace Halide::Tools;
+
+bool near(double a, double b) {
+    return std::abs(a - b) <= 1e-9 * std::max(1.0, std::abs(b));
+}
+
+bool check(const char *what, double actual, double expected) {
+    if (!near(actual, expected)) {
+        printf("%s: %.12f instead of %.12f\n", what, actual, expected);
+        return false;
+    }
+    return true;
+}
+
+bool check_stats(const char *name, const std::vector<double> &times, const BenchmarkStats &expected) {
+    BenchmarkStats s = compute_benchmark_stats(times);
+    printf("%s\n", name);
+    return (check("min", s.min, expected.min) &&
+            check("median", s.median, expected.median) &&
+            check("p90", s.p90, expected.p90) &&
+            check("p99", s.p99, expected.p99) &&
+            check("max", s.max, expected.max) &&
+            check("mean", s.mean, expected.mean) &&
+            check("stddev", s.stddev, expected.stddev) &&
+            check("outliers", (double)s.outliers, (double)expected.outliers));
+}
+
+BenchmarkStats make_stats(double min, double median, double p90, double p99, double max,
+                          double mean, double stddev, uint64_t outliers) {
+    BenchmarkStats s;
+    s.min = min;
+    s.median = median;
+    s.p90 = p90;
+    s.p99 = p99;
+    s.max = max;
+    s.mean = mean;
+    s.stddev = stddev;
+    s.outliers = outliers;
+    return s;
+}
+
+int main(int argc, char **argv) {
+    // Percentiles interpolate linearly between the closest ranks.
+    const std::vector<double> five = {1, 2, 3, 4, 5};
+    if (!check("percentile 0", percentile(five, 0), 1) ||
+        !check("percentile 25", percentile(five, 25), 2) ||
+        !check("percentile 50", percentile(five, 50), 3) ||
+        !check("percentile 90", percentile(five, 90), 4.6) ||
+        !check("percentile 100", percentile(five, 100), 5) ||
+        !check("percentile of one", percentile({7}, 37), 7) ||
+        !check("percentile of none", percentile({}, 50), 0)) {
+        return -1;
+    }
+
+    // The samples need not be sorted.
+    if (!check_stats("no outliers", {5, 1, 4, 2, 3},
+                     make_stats(1, 3, 4.6, 4.96, 5, 3, std::sqrt(2.5), 0))) {
+        return -1;
+    }
+
+    // A sample above the upper fence (q3 + 1.5 * IQR = 7) is left out
+    // of the mean and standard deviation, but not the percentiles.
+    if (!check_stats("high outlier", {1, 2, 3, 4, 100},
+                     make_stats(1, 3, 61.6, 96.16, 100, 2.5, std::sqrt(5.0 / 3), 1))) {
+        return -1;
+    }
+
+    // Likewise below the lower fence (q1 - 1.5 * IQR = 7).
+    if (!check_stats("low outlier", {10, 11, 12, 13, 0.5},
+                     make_stats(0.5, 11, 12.6, 12.96, 13, 11.5, std::sqrt(5.0 / 3), 1))) {
+        return -1;
+    }
+
+    // Identical samples have no spread, and none of them are outliers.
+    if (!check_stats("identical", {3, 3, 3, 3},
+                     make_stats(3, 3, 3, 3, 3, 3, 0, 0))) {
+        return -1;
+    }
+
+    if (!check_stats("one sample", {2},
+                     make_stats(2, 2, 2, 2, 2, 2, 0, 0)) ||
+        !check_stats("no samples", {},
+                     make_stats(0, 0, 0, 0, 0, 0, 0, 0))) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
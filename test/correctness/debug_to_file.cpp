@@ -14,10 +14,12 @@ int main(int argc, char **argv) {
     std::string f_mat = Internal::get_test_tmp_dir() + "f.mat";
     std::string g_mat = Internal::get_test_tmp_dir() + "g.mat";
     std::string h_mat = Internal::get_test_tmp_dir() + "h.mat";
+    std::string j_npy = Internal::get_test_tmp_dir() + "j.npy";
 
     Internal::ensure_no_file_exists(f_mat);
     Internal::ensure_no_file_exists(g_mat);
     Internal::ensure_no_file_exists(h_mat);
+    Internal::ensure_no_file_exists(j_npy);
 
     {
         Func f, g, h, j;
@@ -98,6 +100,54 @@ int main(int argc, char **argv) {
         }
     }
 
+    {
+        // The same again for a .npy file, with a separate pipeline.
+        Func j, k;
+        Var x, y, c;
+        j(x, y, c) = cast<uint16_t>(x + 10 * y + 100 * c);
+        k(x, y, c) = j(x, y, c) + 1;
+
+        Target target = get_jit_target_from_environment();
+        if (target.has_gpu_feature()) {
+            Var xi, yi;
+            j.compute_root().gpu_tile(x, y, xi, yi, 1, 1).debug_to_file(j_npy);
+        } else {
+            j.compute_root().debug_to_file(j_npy);
+        }
+
+        Buffer<uint16_t> im = k.realize(8, 6, 3, target);
+    }
+
+    {
+        Internal::assert_file_exists(j_npy);
+
+        Buffer<uint16_t> loaded = Tools::load_image(j_npy);
+        Buffer<uint16_t> mapped;
+        if (!Tools::load_mapped(j_npy, &mapped)) {
+            printf("Could not map %s\n", j_npy.c_str());
+            return -1;
+        }
+        for (Buffer<uint16_t> *j : {&loaded, &mapped}) {
+            assert(j->dimensions() == 3 &&
+                   j->dim(0).extent() == 8 &&
+                   j->dim(1).extent() == 6 &&
+                   j->dim(2).extent() == 3);
+
+            for (int c = 0; c < 3; c++) {
+                for (int y = 0; y < 6; y++) {
+                    for (int x = 0; x < 8; x++) {
+                        uint16_t val = (*j)(x, y, c);
+                        uint16_t correct = x + 10 * y + 100 * c;
+                        if (val != correct) {
+                            printf("j(%d, %d, %d) = %d instead of %d\n", x, y, c, val, correct);
+                            return -1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
     printf("Success!\n");
     return 0;
 
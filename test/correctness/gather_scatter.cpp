@@ -0,0 +1,119 @@
+#include "Halide.h"
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+// Compile f for the given target, and check whether its assembly
+// contains an instruction starting with any of the given prefixes.
+bool uses_instruction(Func f, const std::string &target, const std::vector<std::string> &prefixes) {
+    std::string asm_file = Internal::get_test_tmp_dir() + "gather_scatter.s";
+    Internal::ensure_no_file_exists(asm_file);
+    f.compile_to_assembly(asm_file, {}, "f", Target(target));
+    Internal::assert_file_exists(asm_file);
+
+    std::ifstream in(asm_file);
+    std::stringstream text;
+    text << in.rdbuf();
+    for (const std::string &p : prefixes) {
+        if (text.str().find("\t" + p) != std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *avx2_target = "x86-64-linux-sse41-avx-avx2-fma-f16c-no_runtime";
+const char *avx512_target = "x86-64-linux-sse41-avx-avx2-fma-f16c-avx512-avx512_skylake-no_runtime";
+
+// Vector loads and stores with data-dependent indices, with and
+// without predication. On x86 with AVX2 or AVX-512 these become
+// hardware gathers and scatters.
+template<typename T>
+bool test() {
+    const int size = 1000;
+    const int W = 123, H = 17;
+
+    Buffer<T> lut(size);
+    for (int i = 0; i < size; i++) {
+        lut(i) = (T)(i * 3 + 1);
+    }
+    Buffer<int> index(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            index(x, y) = (x * 37 + y * 101) % size;
+        }
+    }
+
+    Var x, y;
+
+    // Gathers, with a masked tail.
+    Func g;
+    g(x, y) = lut(clamp(index(x, y), 0, size - 1));
+    g.vectorize(x, 16, TailStrategy::Predicate);
+    Buffer<T> gathered = g.realize(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            T correct = lut(index(x, y));
+            if (gathered(x, y) != correct) {
+                printf("gathered(%d, %d) = %f instead of %f\n",
+                       x, y, (double)gathered(x, y), (double)correct);
+                return false;
+            }
+        }
+    }
+
+    // Scatters. The indices along a row are distinct, so there is
+    // no race between lanes.
+    Func s;
+    RDom r(0, 64);
+    s(x) = cast<T>(-1);
+    s(clamp((r * 13) % size, 0, size - 1)) = cast<T>(r * 2);
+    s.update().allow_race_conditions().vectorize(r, 16);
+    Buffer<T> scattered = s.realize(size);
+    for (int i = 0; i < size; i++) {
+        T correct = (T)-1;
+        for (int j = 0; j < 64; j++) {
+            if ((j * 13) % size == i) {
+                correct = (T)(j * 2);
+            }
+        }
+        if (scattered(i) != correct) {
+            printf("scattered(%d) = %f instead of %f\n",
+                   i, (double)scattered(i), (double)correct);
+            return false;
+        }
+    }
+
+    // Check that the hardware instructions are used, whatever the
+    // host is. AVX2 has gathers, and AVX-512 has gathers and scatters.
+    const std::vector<std::string> gathers = {"vgather", "vpgather"};
+    const std::vector<std::string> scatters = {"vscatter", "vpscatter"};
+    if (!uses_instruction(g, avx2_target, gathers) ||
+        !uses_instruction(g, avx512_target, gathers)) {
+        std::cout << "Expected gather instructions for " << type_of<T>() << "\n";
+        return false;
+    }
+    if (!uses_instruction(s, avx512_target, scatters)) {
+        std::cout << "Expected scatter instructions for " << type_of<T>() << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (!test<int32_t>() ||
+        !test<uint32_t>() ||
+        !test<float>() ||
+        !test<double>() ||
+        !test<int64_t>()) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include "Halide.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+// The host pointers of the two intermediates, as seen by the extern
+// stage that consumes them.
+uint8_t *big1_host = nullptr, *big2_host = nullptr;
+
+// out(x, y) = a(x, y) + b(x, y)
+extern "C" DLLEXPORT int add_and_record(halide_buffer_t *a, halide_buffer_t *b, halide_buffer_t *out) {
+    if (a->is_bounds_query() || b->is_bounds_query()) {
+        for (halide_buffer_t *in : {a, b}) {
+            for (int d = 0; d < 2; d++) {
+                in->dim[d].min = out->dim[d].min;
+                in->dim[d].extent = out->dim[d].extent;
+            }
+        }
+        return 0;
+    }
+    big1_host = a->host;
+    big2_host = b->host;
+    for (int y = 0; y < out->dim[1].extent; y++) {
+        for (int x = 0; x < out->dim[0].extent; x++) {
+            float *dst = (float *)out->host + x * out->dim[0].stride + y * out->dim[1].stride;
+            const float *src_a = (const float *)a->host +
+                (x + out->dim[0].min - a->dim[0].min) * a->dim[0].stride +
+                (y + out->dim[1].min - a->dim[1].min) * a->dim[1].stride;
+            const float *src_b = (const float *)b->host +
+                (x + out->dim[0].min - b->dim[0].min) * b->dim[0].stride +
+                (y + out->dim[1].min - b->dim[1].min) * b->dim[1].stride;
+            *dst = *src_a + *src_b;
+        }
+    }
+    return 0;
+}
+
+// Whether a pointer returned by halide_malloc came from the huge page
+// path, which maps memory starting on a 2MB boundary and returns a
+// pointer just past the start of it. (A pointer from malloc can also
+// pass this test, but only by chance.)
+bool looks_huge_page_backed(const uint8_t *host) {
+    const uintptr_t huge_page_size = 2 * 1024 * 1024;
+    uintptr_t offset = (uintptr_t)host & (huge_page_size - 1);
+    return offset != 0 && offset <= 4096;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.has_gpu_feature()) {
+        printf("Not running huge page test on a GPU target\n");
+        return 0;
+    }
+
+    // Two 4MB intermediates. The threshold is set before the first is
+    // allocated, and changed after it is allocated but before the
+    // second is. Both are freed at the end of the pipeline, so the
+    // first is freed under a different threshold from the one it was
+    // allocated under.
+    const int size = 1024;
+    const Type size_t_type = UInt(sizeof(size_t) * 8);
+    Param<uint64_t> first_threshold, second_threshold, previous_threshold;
+    Var x, y;
+
+    // Each call to halide_set_huge_page_threshold returns the previous
+    // threshold, which the intermediates check; anything other than
+    // what we expect makes the output wrong.
+    Func set_first("set_first"), set_second("set_second"), big1("big1"), big2("big2");
+    set_first() = Call::make(size_t_type, "halide_set_huge_page_threshold",
+                             {cast(size_t_type, first_threshold)}, Call::Extern);
+    big1(x, y) = select(set_first() == cast(size_t_type, previous_threshold),
+                        cast<float>(x + y * size), -1.0f);
+    set_second() = Call::make(size_t_type, "halide_set_huge_page_threshold",
+                              {cast(size_t_type, second_threshold) + cast(size_t_type, big1(0, 0) < 0.0f)},
+                              Call::Extern);
+    big2(x, y) = select(set_second() == cast(size_t_type, first_threshold),
+                        big1(x, y) * 2.0f, -1.0f);
+
+    Func out("out");
+    out.define_extern("add_and_record", {big1, big2}, Float(32), 2);
+
+    set_first.compute_root();
+    big1.compute_root().vectorize(x, 8);
+    set_second.compute_root();
+    big2.compute_root().vectorize(x, 8);
+    out.compile_jit(target);
+
+    struct Case {
+        const char *name;
+        uint64_t first, second;
+    };
+    const uint64_t one_mb = 1024 * 1024, one_gb = 1024 * one_mb;
+    const uint64_t intermediate_bytes = size * size * sizeof(float);
+    Case cases[] = {
+        {"huge pages, then malloc", one_mb, 0},
+        {"malloc, then huge pages", 0, one_mb},
+        {"both above the threshold", one_mb, one_mb},
+        {"both below the threshold", one_gb, one_gb},
+        {"both with no threshold", 0, 0},
+    };
+
+    // Run each case twice, so that every allocation is made with
+    // memory freed under the other path.
+    uint64_t previous = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (const Case &c : cases) {
+            printf("%s\n", c.name);
+            first_threshold.set(c.first);
+            second_threshold.set(c.second);
+            previous_threshold.set(previous);
+            big1_host = big2_host = nullptr;
+            Buffer<float> result = out.realize(size, size, target);
+            previous = c.second;
+
+            for (int j = 0; j < size; j++) {
+                for (int i = 0; i < size; i++) {
+                    float correct = (i + j * size) * 3.0f;
+                    if (result(i, j) != correct) {
+                        printf("result(%d, %d) = %f instead of %f\n", i, j, result(i, j), correct);
+                        return -1;
+                    }
+                }
+            }
+
+#if defined(__linux__) && !defined(__mips__)
+            // On Linux, allocations at or above the threshold come
+            // from the huge page path.
+            auto above_threshold = [&](uint64_t threshold) {
+                return threshold && intermediate_bytes >= threshold;
+            };
+            if ((above_threshold(c.first) && !looks_huge_page_backed(big1_host)) ||
+                (above_threshold(c.second) && !looks_huge_page_backed(big2_host))) {
+                printf("An intermediate at or above the threshold did not use huge pages: %p %p\n",
+                       big1_host, big2_host);
+                return -1;
+            }
+#endif
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -4,6 +4,18 @@
 
 using namespace Halide;
 
+template<typename T>
+uint32_t max_difference(Buffer<T> a, Buffer<T> b) {
+    RDom r(b);
+    std::vector<Expr> args;
+    if (a.dimensions() == 2) {
+        args = {r.x, r.y};
+    } else {
+        args = {r.x, r.y, r.z};
+    }
+    return evaluate<uint32_t>(maximum(abs(cast<int>(a(args)) - cast<int>(b(args)))));
+}
+
 template<typename T>
 void test_round_trip(Buffer<T> buf, std::string format) {
     // Save it
@@ -23,14 +35,7 @@ void test_round_trip(Buffer<T> buf, std::string format) {
     Tools::save_image(reloaded, Internal::get_test_tmp_dir() + "test_reloaded." + format);
 
     // Check they're not too different.
-    RDom r(reloaded);
-    std::vector<Expr> args;
-    if (buf.dimensions() == 2) {
-        args = {r.x, r.y};
-    } else {
-        args = {r.x, r.y, r.z};
-    }
-    uint32_t diff = evaluate<uint32_t>(maximum(abs(cast<int>(buf(args)) - cast<int>(reloaded(args)))));
+    uint32_t diff = max_difference(buf, reloaded);
 
     uint32_t max_diff = 0;
     if (format == "jpg") {
@@ -40,6 +45,22 @@ void test_round_trip(Buffer<T> buf, std::string format) {
         printf("test_round_trip: Difference of %d when saved and loaded as %s\n", diff, format.c_str());
         abort();
     }
+
+    // Reload it again, in place where the format allows it. The
+    // formats that can't be mapped are simply loaded.
+    Buffer<T> mapped;
+    if (!Tools::load_mapped(filename, &mapped)) {
+        printf("test_round_trip: Could not map %s\n", filename.c_str());
+        abort();
+    }
+    for (int d = 0; d < buf.dimensions(); ++d) {
+        mapped.translate(d, buf.dim(d).min() - mapped.dim(d).min());
+    }
+    uint32_t mapped_diff = max_difference(reloaded, mapped);
+    if (mapped_diff != 0) {
+        printf("test_round_trip: Difference of %d between loading and mapping %s\n", mapped_diff, format.c_str());
+        abort();
+    }
 }
 
 // static -> static conversion test
@@ -154,6 +175,89 @@ Func make_noise(int depth) {
     return f;
 }
 
+// Write a C-order .npy file by hand, as numpy would, holding a[i, j, ...]
+// for an array of the given shape.
+template<typename T>
+void write_c_order_npy(const std::string &filename, const std::string &descr,
+                       const std::vector<int> &shape, const std::vector<T> &values) {
+    std::ostringstream dict;
+    dict << "{'descr': '" << descr << "', 'fortran_order': False, 'shape': (";
+    for (int e : shape) {
+        dict << e << ", ";
+    }
+    dict << "), }";
+    std::string header = dict.str();
+    // Pad with spaces and a newline so the payload starts on a 64-byte
+    // boundary, after the 10-byte preamble.
+    header += std::string(63 - (10 + header.size()) % 64, ' ') + "\n";
+
+    FILE *f = fopen(filename.c_str(), "wb");
+    const uint8_t preamble[] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+                                (uint8_t)(header.size() & 0xff), (uint8_t)(header.size() >> 8)};
+    if (!f ||
+        fwrite(preamble, sizeof(preamble), 1, f) != 1 ||
+        fwrite(header.data(), header.size(), 1, f) != 1 ||
+        fwrite(values.data(), sizeof(T), values.size(), f) != values.size() ||
+        fclose(f) != 0) {
+        printf("test_npy_c_order: Could not write %s\n", filename.c_str());
+        abort();
+    }
+}
+
+// Check that the axes of a C-order array become the dimensions of the
+// image in the same order, whether the file is loaded or mapped.
+template<typename T>
+void test_npy_c_order(const char *code) {
+    std::cout << "Testing C-order npy for " << halide_type_of<T>() << "\n";
+    const std::vector<int> shape = {2, 3, 4};
+    std::vector<T> values;
+    // C order: the last axis is innermost.
+    for (int i = 0; i < shape[0]; i++) {
+        for (int j = 0; j < shape[1]; j++) {
+            for (int k = 0; k < shape[2]; k++) {
+                values.push_back((T)(i * 100 + j * 10 + k));
+            }
+        }
+    }
+    // numpy marks multi-byte elements with the byte order they were
+    // written in, and single bytes with '|'.
+    const uint16_t one = 1;
+    const char byte_order = sizeof(T) == 1 ? '|' : (*(const uint8_t *)&one ? '<' : '>');
+    const std::string descr = byte_order + std::string(code);
+    const std::string filename = Internal::get_test_tmp_dir() + "test_c_order_" + code + ".npy";
+    write_c_order_npy(filename, descr, shape, values);
+
+    Buffer<T> loaded = Tools::load_image(filename);
+    Buffer<T> mapped;
+    if (!Tools::load_mapped(filename, &mapped)) {
+        printf("test_npy_c_order: Could not map %s\n", filename.c_str());
+        abort();
+    }
+    for (Buffer<T> *b : {&loaded, &mapped}) {
+        const char *how = b == &loaded ? "loaded" : "mapped";
+        if (b->dimensions() != 3 ||
+            b->dim(0).extent() != shape[0] || b->dim(1).extent() != shape[1] || b->dim(2).extent() != shape[2]) {
+            printf("test_npy_c_order: %s image has the wrong shape\n", how);
+            abort();
+        }
+        b->for_each_element([&](int i, int j, int k) {
+            T correct = (T)(i * 100 + j * 10 + k);
+            if ((*b)(i, j, k) != correct) {
+                printf("test_npy_c_order: %s(%d, %d, %d) = %d instead of %d\n",
+                       how, i, j, k, (int)(*b)(i, j, k), (int)correct);
+                abort();
+            }
+        });
+    }
+    // The mapped image uses the file's layout, in which the last
+    // dimension is innermost.
+    if (mapped.dim(2).stride() != 1 || mapped.dim(1).stride() != shape[2] ||
+        mapped.dim(0).stride() != shape[1] * shape[2]) {
+        printf("test_npy_c_order: mapped image does not use the file's layout\n");
+        abort();
+    }
+}
+
 template<typename T>
 void do_test() {
     const int width = 1600;
@@ -181,7 +285,7 @@ void do_test() {
     luma_buf.copy_from(color_buf);
     luma_buf.slice(2, 0);
 
-    std::vector<std::string> formats = {"ppm","pgm","tmp","mat"};
+    std::vector<std::string> formats = {"ppm","pgm","tmp","mat","npy"};
 #ifndef HALIDE_NO_JPEG
     formats.push_back("jpg");
 #endif
@@ -224,5 +328,7 @@ void do_test() {
 int main(int argc, char **argv) {
     do_test<uint8_t>();
     do_test<uint16_t>();
+    test_npy_c_order<uint8_t>("u1");
+    test_npy_c_order<int16_t>("i2");
     return 0;
 }
@@ -0,0 +1,158 @@
+#include "Halide.h"
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+
+#include "test/common/check_call_graphs.h"
+#include "test/common/halide_test_dirs.h"
+
+namespace {
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+class CountNontemporalStores : public IRMutator2 {
+    class Count : public IRVisitor {
+        using IRVisitor::visit;
+
+        void visit(const Store *op) {
+            const Call *c = op->value.as<Call>();
+            if (c && c->is_intrinsic(Call::nontemporal_store)) {
+                count++;
+            }
+            IRVisitor::visit(op);
+        }
+    public:
+        int count = 0;
+    };
+
+public:
+    int &count;
+    CountNontemporalStores(int &c) : count(c) {}
+
+    using IRMutator2::mutate;
+
+    Stmt mutate(const Stmt &s) override {
+        Count c;
+        s.accept(&c);
+        count = c.count;
+        return s;
+    }
+};
+
+std::string read_file(const std::string &filename) {
+    std::ifstream in(filename);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.has_gpu_feature()) {
+        printf("Not running non-temporal store test on a GPU target\n");
+        printf("Success!\n");
+        return 0;
+    }
+
+    Var x("x"), y("y");
+
+    {
+        // A parallel, vectorized output written with streaming
+        // stores. Streaming stores are only emitted when they are
+        // known to be aligned to the vector size, so the output is
+        // constrained to be aligned, with rows a multiple of the
+        // vector width apart.
+        Func f("f");
+        f(x, y) = cast<uint16_t>(x * 3 + y);
+        f.vectorize(x, 16, TailStrategy::GuardWithIf).parallel(y).store_nontemporal();
+        f.output_buffer()
+            .set_host_alignment(32)
+            .dim(0).set_min(0)
+            .dim(1).set_stride(1008);
+
+        int count = 0;
+        f.add_custom_lowering_pass(new CountNontemporalStores(count));
+
+        // The stores must survive to the generated code.
+        std::string ll_file = Internal::get_test_tmp_dir() + "nontemporal_store.ll";
+        Internal::ensure_no_file_exists(ll_file);
+        f.compile_to_llvm_assembly(ll_file, {}, "f", target);
+        Internal::assert_file_exists(ll_file);
+        if (read_file(ll_file).find("!nontemporal") == std::string::npos) {
+            printf("Expected !nontemporal stores in %s\n", ll_file.c_str());
+            return -1;
+        }
+        if (target.arch == Target::X86) {
+            std::string asm_file = Internal::get_test_tmp_dir() + "nontemporal_store.s";
+            Internal::ensure_no_file_exists(asm_file);
+            f.compile_to_assembly(asm_file, {}, "f", target);
+            Internal::assert_file_exists(asm_file);
+            if (read_file(asm_file).find("movnt") == std::string::npos) {
+                printf("Expected movnt instructions in %s\n", asm_file.c_str());
+                return -1;
+            }
+        }
+
+        Buffer<uint16_t> im(1008, 64);
+        im.crop(0, 0, 1003);
+        f.realize(im);
+        auto func = [](int x, int y) { return (uint16_t)(x * 3 + y); };
+        if (check_image(im, func)) {
+            return -1;
+        }
+        if (count == 0) {
+            printf("Expected non-temporal stores to f\n");
+            return -1;
+        }
+    }
+
+    {
+        // A compute_root Tuple-valued intermediate.
+        Func g("g"), h("h");
+        g(x, y) = Tuple(x + y, x - y);
+        h(x, y) = g(x, y)[0] * g(x, y)[1];
+        g.compute_root().vectorize(x, 8).store_nontemporal();
+        h.vectorize(x, 8);
+
+        int count = 0;
+        h.add_custom_lowering_pass(new CountNontemporalStores(count));
+
+        Buffer<int> im = h.realize(64, 64);
+        auto func = [](int x, int y) { return (x + y) * (x - y); };
+        if (check_image(im, func)) {
+            return -1;
+        }
+        if (count < 2) {
+            printf("Expected non-temporal stores to both values of g, found %d\n", count);
+            return -1;
+        }
+    }
+
+    {
+        // A non-temporal interleaving store should still use st2 on ARM.
+        Target arm("arm-64-linux");
+        if (arm.supported()) {
+            Func g("g"), f("f");
+            g(x) = cast<uint16_t>(x);
+            g.compute_root();
+            f(x, y) = select(x % 2 == 0, g(x / 2), g(x / 2 + 16));
+            f.vectorize(x, 16).store_nontemporal();
+
+            std::string asm_file = Internal::get_test_tmp_dir() + "nontemporal_store_arm.s";
+            Internal::ensure_no_file_exists(asm_file);
+            f.compile_to_assembly(asm_file, {}, "f", arm);
+            Internal::assert_file_exists(asm_file);
+
+            if (read_file(asm_file).find("st2") == std::string::npos) {
+                printf("Expected an st2 instruction for the non-temporal interleaving store\n");
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "Halide.h"
+#include <stdio.h>
+
+#include "test/common/check_call_graphs.h"
+
+namespace {
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+class CountPredicatedStores : public IRMutator2 {
+    class Count : public IRVisitor {
+        using IRVisitor::visit;
+
+        void visit(const Store *op) {
+            if (!is_one(op->predicate)) {
+                count++;
+            }
+            IRVisitor::visit(op);
+        }
+    public:
+        int count = 0;
+    };
+
+public:
+    int &count;
+    CountPredicatedStores(int &c) : count(c) {}
+
+    using IRMutator2::mutate;
+
+    Stmt mutate(const Stmt &s) override {
+        Count c;
+        s.accept(&c);
+        count = c.count;
+        return s;
+    }
+};
+
+template<typename T>
+int pure_tail_test(int width) {
+    Var x("x"), y("y");
+    Func f("f");
+
+    Buffer<T> input(width, 8);
+    input.for_each_element([&](int x, int y) {
+        input(x, y) = (T)(x * 3 + y);
+    });
+
+    f(x, y) = input(x, y) * 2 + 1;
+    f.vectorize(x, 16, TailStrategy::Predicate);
+
+    int predicated_stores = 0;
+    f.add_custom_lowering_pass(new CountPredicatedStores(predicated_stores));
+
+    Buffer<T> im = f.realize(width, 8);
+    auto func = [&](int x, int y) { return (T)(input(x, y) * 2 + 1); };
+    if (check_image(im, func)) {
+        return -1;
+    }
+
+    if (predicated_stores == 0) {
+        printf("Expected a predicated store in the tail of f for width %d\n", width);
+        return -1;
+    }
+    return 0;
+}
+
+int rvar_tail_test() {
+    Var x("x");
+    RDom r(0, 37);
+    Func f("f"), ref("ref");
+
+    ref(x) = cast<uint8_t>(x);
+    ref(r) += cast<uint8_t>(r * 5);
+    Buffer<uint8_t> im_ref = ref.realize(40);
+
+    f(x) = cast<uint8_t>(x);
+    f(r) += cast<uint8_t>(r * 5);
+    RVar ro, ri;
+    f.update(0).split(r, ro, ri, 16, TailStrategy::Predicate).vectorize(ri);
+
+    int predicated_stores = 0;
+    f.add_custom_lowering_pass(new CountPredicatedStores(predicated_stores));
+
+    Buffer<uint8_t> im = f.realize(40);
+    for (int x = 0; x < im.width(); x++) {
+        if (im(x) != im_ref(x)) {
+            printf("im(%d) = %d instead of %d\n", x, im(x), im_ref(x));
+            return -1;
+        }
+    }
+
+    if (predicated_stores == 0) {
+        printf("Expected a predicated store in the update of f\n");
+        return -1;
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.has_gpu_feature()) {
+        printf("Not running tail strategy predicate test on a GPU target\n");
+        printf("Success!\n");
+        return 0;
+    }
+
+    for (int width : {1, 15, 17, 33, 101}) {
+        printf("Running pure tail test with width %d\n", width);
+        if (pure_tail_test<uint8_t>(width) != 0 ||
+            pure_tail_test<uint16_t>(width) != 0 ||
+            pure_tail_test<float>(width) != 0) {
+            return -1;
+        }
+    }
+
+    printf("Running rvar tail test\n");
+    if (rvar_tail_test() != 0) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,152 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+// The kind of event being counted, and how many of them were traced.
+halide_trace_event_code_t counted_event = halide_trace_store;
+int events = 0, lanes = 0;
+int min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+
+int my_trace(void *user_context, const halide_trace_event_t *e) {
+    if (e->event == counted_event) {
+        // The coordinates of a vector access are grouped by dimension.
+        int x = e->coordinates[0];
+        int y = e->coordinates[e->type.lanes];
+        if (events == 0) {
+            min_x = max_x = x;
+            min_y = max_y = y;
+        }
+        min_x = std::min(min_x, x);
+        max_x = std::max(max_x, x);
+        min_y = std::min(min_y, y);
+        max_y = std::max(max_y, y);
+        lanes = e->type.lanes;
+        events++;
+    }
+    return 0;
+}
+
+int count_events(Func f, int size, halide_trace_event_code_t event) {
+    counted_event = event;
+    events = 0;
+    f.set_custom_trace(&my_trace);
+    f.realize(size, size);
+    return events;
+}
+
+int count_stores(Func f, int size) {
+    return count_events(f, size, halide_trace_store);
+}
+
+int count_loads(Func f, int size) {
+    return count_events(f, size, halide_trace_load);
+}
+
+int main(int argc, char **argv) {
+    Var x("x"), y("y");
+    const int size = 256;
+
+    {
+        // Trace about one in 16 stores.
+        Func f("f");
+        f(x, y) = x + y;
+        f.trace_stores(TraceSampling(16));
+        int n = count_stores(f, size);
+        if (n < size * size / 32 || n > size * size / 8) {
+            printf("Traced %d of %d stores, instead of about 1/16 of them\n", n, size * size);
+            return -1;
+        }
+        // The same stores should be traced again.
+        int n2 = count_stores(f, size);
+        if (n2 != n) {
+            printf("Traced %d stores on the second run, instead of %d\n", n2, n);
+            return -1;
+        }
+    }
+
+    {
+        // Sampling vectorized stores traces whole vectors.
+        Func f("f");
+        f(x, y) = x + y;
+        f.vectorize(x, 8);
+        f.trace_stores(TraceSampling(4));
+        int n = count_stores(f, size);
+        int vectors = size * size / 8;
+        if (lanes != 8 || n < vectors / 8 || n > vectors / 2) {
+            printf("Traced %d of %d vector stores of %d lanes, instead of about 1/4 of them\n",
+                   n, vectors, lanes);
+            return -1;
+        }
+    }
+
+    {
+        // Only trace stores inside a region.
+        Func f("f");
+        f(x, y) = x + y;
+        f.trace_stores(TraceSampling({{10, 20}, {30, 5}}));
+        int n = count_stores(f, size);
+        if (n != 20 * 5 ||
+            min_x != 10 || max_x != 29 ||
+            min_y != 30 || max_y != 34) {
+            printf("Traced %d stores in [%d, %d] x [%d, %d], instead of 100 in [10, 29] x [30, 34]\n",
+                   n, min_x, max_x, min_y, max_y);
+            return -1;
+        }
+    }
+
+    {
+        // The region can depend on parameters.
+        Param<int> p;
+        Func f("f");
+        f(x, y) = x + y;
+        f.trace_stores(TraceSampling({{p, 3}, {Expr(), Expr()}}));
+        p.set(100);
+        int n = count_stores(f, size);
+        if (n != 3 * size || min_x != 100 || max_x != 102) {
+            printf("Traced %d stores in [%d, %d], instead of %d in [100, 102]\n",
+                   n, min_x, max_x, 3 * size);
+            return -1;
+        }
+    }
+
+    {
+        // Trace about one in 16 loads from a producer.
+        Func g("g"), f("f");
+        g(x, y) = x + y;
+        f(x, y) = g(x, y) * 2;
+        g.compute_root().trace_loads(TraceSampling(16));
+        int n = count_loads(f, size);
+        if (n < size * size / 32 || n > size * size / 8) {
+            printf("Traced %d of %d loads, instead of about 1/16 of them\n", n, size * size);
+            return -1;
+        }
+        // The same loads should be traced again.
+        int n2 = count_loads(f, size);
+        if (n2 != n) {
+            printf("Traced %d loads on the second run, instead of %d\n", n2, n);
+            return -1;
+        }
+    }
+
+    {
+        // Only trace vector loads inside a region.
+        Func g("g"), f("f");
+        g(x, y) = x + y;
+        f(x, y) = g(x, y) * 2;
+        g.compute_root().trace_loads(TraceSampling({{16, 32}, {30, 5}}));
+        f.vectorize(x, 8);
+        int n = count_loads(f, size);
+        if (lanes != 8 || n != (32 / 8) * 5 ||
+            min_x != 16 || max_x != 40 ||
+            min_y != 30 || max_y != 34) {
+            printf("Traced %d vector loads of %d lanes in [%d, %d] x [%d, %d], "
+                   "instead of 20 of 8 lanes in [16, 40] x [30, 34]\n",
+                   n, lanes, min_x, max_x, min_y, max_y);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
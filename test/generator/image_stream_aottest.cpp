@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <stdio.h>
+
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+
+// Only the raw formats are streamed.
+#define HALIDE_NO_PNG
+#define HALIDE_NO_JPEG
+#include "halide_image_stream.h"
+
+#include "image_stream.h"
+
+using namespace Halide::Runtime;
+using namespace Halide::Tools;
+
+const int W = 300, H = 200;
+
+float pixel(int x, int y) {
+    x = std::min(std::max(x, 0), W - 1);
+    y = std::min(std::max(y, 0), H - 1);
+    return (float)((x * 13 + y * 7) % 64);
+}
+
+int main(int argc, char **argv) {
+    // Write the input one row strip at a time.
+    {
+        ImageStreamWriter<> writer;
+        if (!writer.create("image_stream_input.mat", halide_type_of<float>(), {W, H})) {
+            printf("Could not create input\n");
+            return -1;
+        }
+        for (int y = 0; y < H; y += 16) {
+            Buffer<float> strip(W, std::min(16, H - y));
+            strip.set_min(0, y);
+            strip.for_each_element([&](int x, int y) {
+                strip(x, y) = pixel(x, y);
+            });
+            Buffer<> strip_d = strip;
+            if (!writer.write(strip_d)) {
+                printf("Could not write input\n");
+                return -1;
+            }
+        }
+        if (!writer.close()) {
+            printf("Could not finish input\n");
+            return -1;
+        }
+    }
+
+    // Blur it in tiles that don't divide the image evenly.
+    {
+        ImageStreamReader<> reader;
+        ImageStreamWriter<> writer;
+        if (!reader.open("image_stream_input.mat") ||
+            !writer.create("image_stream_output.mat", halide_type_of<float>(), {W, H})) {
+            printf("Could not open files\n");
+            return -1;
+        }
+        bool ok = run_tiled([](halide_buffer_t *in, halide_buffer_t *out) {
+            return image_stream(in, out);
+        }, reader, writer, 64, 48);
+        if (!ok || !writer.close()) {
+            printf("run_tiled failed\n");
+            return -1;
+        }
+    }
+
+    // Compare with blurring the whole image, with its edges repeated.
+    Buffer<float> input(W + 2, H + 2), expected(W, H);
+    input.set_min(-1, -1);
+    input.for_each_element([&](int x, int y) {
+        input(x, y) = pixel(x, y);
+    });
+    if (image_stream(input, expected) != 0) {
+        printf("Pipeline failed\n");
+        return -1;
+    }
+
+    Buffer<> output_d;
+    if (!load_mapped("image_stream_output.mat", &output_d)) {
+        printf("Could not load output\n");
+        return -1;
+    }
+    Buffer<float> output = output_d;
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            if (output(x, y) != expected(x, y)) {
+                printf("output(%d, %d) = %f instead of %f\n", x, y, output(x, y), expected(x, y));
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
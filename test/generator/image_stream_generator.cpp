@@ -0,0 +1,24 @@
+#include "Halide.h"
+
+namespace {
+
+class ImageStream : public Halide::Generator<ImageStream> {
+public:
+    Input<Buffer<float>>  input{"input", 2};
+    Output<Buffer<float>> output{"output", 2};
+
+    void generate() {
+        Var x, y;
+
+        // No boundary condition: the tiles are read with a halo.
+        Func blur_x("blur_x");
+        blur_x(x, y) = (input(x - 1, y) + input(x, y) + input(x + 1, y)) / 3;
+        output(x, y) = (blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1)) / 3;
+
+        blur_x.compute_at(output, y);
+    }
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(ImageStream, image_stream)
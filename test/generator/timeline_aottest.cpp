@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+#include "timeline.h"
+
+using namespace Halide::Runtime;
+
+int main(int argc, char **argv) {
+    const char *filename = "timeline_aottest.json";
+
+    Buffer<float> input(129, 129), output(128, 128);
+    input.fill(1.0f);
+
+    if (halide_start_timeline(nullptr, filename) != 0) {
+        printf("halide_start_timeline failed\n");
+        return -1;
+    }
+    // Run the pipeline from several threads at once, enough times to
+    // fill the timeline's buffers many times over, so that events are
+    // recorded while full buffers are being written out.
+    const int num_threads = 4, runs = 50;
+    std::vector<int> results(num_threads, 0);
+    std::vector<Buffer<float>> outputs;
+    for (int i = 0; i < num_threads; i++) {
+        outputs.emplace_back(128, 128);
+    }
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back([&, i]() {
+            for (int r = 0; r < runs && results[i] == 0; r++) {
+                results[i] = timeline(input, outputs[i]);
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    for (int result : results) {
+        if (result != 0) {
+            printf("Pipeline failed: %d\n", result);
+            return -1;
+        }
+    }
+    if (halide_stop_timeline(nullptr) != 0) {
+        printf("halide_stop_timeline failed\n");
+        return -1;
+    }
+
+    std::string contents;
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        printf("Could not open %s\n", filename);
+        return -1;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        contents.append(buf, n);
+    }
+    fclose(f);
+    remove(filename);
+
+    // The file should be a single JSON array of events.
+    size_t first = contents.find_first_not_of(" \n");
+    size_t last = contents.find_last_not_of(" \n");
+    if (first == std::string::npos || contents[first] != '[' || contents[last] != ']') {
+        printf("Timeline is not a JSON array:\n%s\n", contents.c_str());
+        return -1;
+    }
+
+    // Each event is on its own line, and was written out whole and in
+    // order: every begin has a matching end.
+    int begins = 0, ends = 0, events = 0;
+    size_t line_start = contents.find('\n', first) + 1;
+    while (line_start < last) {
+        size_t line_end = contents.find('\n', line_start);
+        std::string line = contents.substr(line_start, line_end - line_start);
+        if (line.empty() || line[0] == ']') {
+            break;
+        }
+        if (line.compare(0, 9, "{\"name\":\"") != 0 ||
+            (line.back() != '}' && line.compare(line.size() - 2, 2, "},") != 0)) {
+            printf("Malformed timeline event: %s\n", line.c_str());
+            return -1;
+        }
+        begins += line.find("\"ph\":\"B\"") != std::string::npos;
+        ends += line.find("\"ph\":\"E\"") != std::string::npos;
+        events++;
+        line_start = line_end + 1;
+    }
+    if (begins != ends || events < num_threads * runs) {
+        printf("Timeline has %d events, %d begins and %d ends\n", events, begins, ends);
+        return -1;
+    }
+
+    const char *expected[] = {
+        "\"name\":\"blur_x\",\"cat\":\"realize\",\"ph\":\"B\"",
+        "\"name\":\"blur_x\",\"cat\":\"produce\",\"ph\":\"E\"",
+        "\"name\":\"timeline\",\"cat\":\"pipeline\",\"ph\":\"E\"",
+        "\"name\":\"task\",\"cat\":\"task\",\"ph\":\"B\"",
+    };
+    for (const char *e : expected) {
+        if (contents.find(e) == std::string::npos) {
+            printf("Timeline is missing %s:\n%s\n", e, contents.c_str());
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,27 @@
+#include "Halide.h"
+
+namespace {
+
+class Timeline : public Halide::Generator<Timeline> {
+public:
+    Input<Buffer<float>>  input{"input", 2};
+    Output<Buffer<float>> output{"output", 2};
+
+    void generate() {
+        Var x, y;
+
+        Func blur_x("blur_x");
+        blur_x(x, y) = (input(x, y) + input(x + 1, y)) / 2;
+
+        output(x, y) = (blur_x(x, y) + blur_x(x, y + 1)) / 2;
+
+        output.parallel(y, 8);
+        blur_x.compute_at(output, y);
+
+        blur_x.trace_realizations();
+    }
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(Timeline, timeline)
@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+#include "HalideTraceUtils.h"
+#include "trace_compression.h"
+
+using namespace Halide::Runtime;
+using namespace Halide::Internal;
+
+// Blocks in the LZ4 block format, written by hand, and what they
+// decompress to.
+bool check_lz4_decompress() {
+    struct Case {
+        std::vector<uint8_t> compressed;
+        std::string expected;
+    };
+    std::vector<Case> cases;
+
+    // Literals only.
+    cases.push_back({{0x50, 'h', 'e', 'l', 'l', 'o'}, "hello"});
+
+    // More than 15 + 255 literals, as in an incompressible block.
+    {
+        Case c;
+        c.compressed = {0xf0, 255, 30};
+        for (int i = 0; i < 300; i++) {
+            char ch = (char)('a' + (i * 7) % 26);
+            c.compressed.push_back((uint8_t)ch);
+            c.expected += ch;
+        }
+        cases.push_back(c);
+    }
+
+    // A match that overlaps the bytes it produces, then the last
+    // literals.
+    cases.push_back({{0x26, 'a', 'b', 2, 0, 0x50, 'x', 'x', 'x', 'x', 'x'}, "ababababababxxxxx"});
+
+    // A match longer than 4 + 15 + 255 bytes, ending the block.
+    cases.push_back({{0x1f, 'z', 1, 0, 255, 10, 0x00}, std::string(285, 'z')});
+
+    for (const Case &c : cases) {
+        std::vector<uint8_t> out(c.expected.size());
+        if (!lz4_decompress(c.compressed.data(), c.compressed.size(), out.data(), out.size()) ||
+            std::string(out.begin(), out.end()) != c.expected) {
+            printf("lz4_decompress failed to produce \"%s\"\n", c.expected.c_str());
+            return false;
+        }
+    }
+
+    // Malformed blocks are rejected rather than read or written out of
+    // bounds.
+    std::vector<std::vector<uint8_t>> malformed = {
+        // An offset of zero.
+        {0x10, 'a', 0, 0},
+        // An offset before the start of the output.
+        {0x10, 'a', 2, 0},
+        // Fewer literals than the token says.
+        {0x50, 'a', 'b'},
+        // A truncated offset.
+        {0x10, 'a', 1},
+        // More output than there is room for.
+        {0x1f, 'a', 1, 0, 255, 255},
+    };
+    for (const auto &m : malformed) {
+        std::vector<uint8_t> out(8);
+        if (lz4_decompress(m.data(), m.size(), out.data(), out.size())) {
+            printf("lz4_decompress accepted a malformed block\n");
+            return false;
+        }
+    }
+    // Too little output for the destination.
+    std::vector<uint8_t> out(6);
+    const uint8_t hello[] = {0x50, 'h', 'e', 'l', 'l', 'o'};
+    if (lz4_decompress(hello, sizeof(hello), out.data(), out.size())) {
+        printf("lz4_decompress accepted a block of the wrong size\n");
+        return false;
+    }
+    return true;
+}
+
+long file_size(const char *filename) {
+    struct stat s;
+    return stat(filename, &s) == 0 ? (long)s.st_size : -1;
+}
+
+struct Blob {
+    int32_t id, parent_id, value_index;
+    std::vector<uint8_t> bytes;
+};
+
+int main(int argc, char **argv) {
+    if (!check_lz4_decompress()) {
+        return -1;
+    }
+
+    const char *filename = "trace_compression.trace";
+    remove(filename);
+    // The trace file is opened on the first event.
+#ifdef _WIN32
+    _putenv_s("HL_TRACE_FILE", filename);
+    _putenv_s("HL_TRACE_COMPRESS", "1");
+#else
+    setenv("HL_TRACE_FILE", filename, 1);
+    setenv("HL_TRACE_COMPRESS", "1", 1);
+#endif
+
+    // A pipeline traces enough stores to fill several blocks.
+    std::mt19937 rng(0);
+    const int size = 100000;
+    Buffer<uint8_t> input(size), output(size);
+    input.for_each_value([&](uint8_t &v) { v = (uint8_t)rng(); });
+    if (trace_compression(input, output) != 0) {
+        printf("Pipeline failed\n");
+        return -1;
+    }
+
+    // Then packets of random bytes, which don't compress, are traced
+    // until a block has been written that holds nothing else. The file
+    // grows whenever the packet just traced did not fit in the buffer,
+    // in which case it is the only one left to write at the end, in a
+    // block of its own that is stored as-is.
+    std::vector<Blob> blobs;
+    const int blob_size = 2000;
+    long size_before = file_size(filename);
+    int blocks_written = 0;
+    while (blocks_written < 2) {
+        Blob b;
+        for (int i = 0; i < blob_size; i++) {
+            b.bytes.push_back((uint8_t)rng());
+        }
+        // No zero bytes, so the headers have no repeats either.
+        b.parent_id = (int32_t)(rng() | 0x01010101);
+        b.value_index = (int32_t)(rng() | 0x01010101);
+
+        halide_trace_event_t e = {};
+        e.func = "blob";
+        e.value = b.bytes.data();
+        e.type = halide_type_t(halide_type_uint, 8, blob_size);
+        e.event = halide_trace_store;
+        e.parent_id = b.parent_id;
+        e.value_index = b.value_index;
+        e.dimensions = 0;
+        b.id = halide_trace(nullptr, &e);
+        blobs.push_back(b);
+
+        long s = file_size(filename);
+        if (s != size_before) {
+            blocks_written++;
+            size_before = s;
+        }
+    }
+
+    if (halide_shutdown_trace() != 0) {
+        printf("halide_shutdown_trace failed\n");
+        return -1;
+    }
+
+    // Read everything back.
+    TraceReader reader;
+    if (!reader.open(filename) || !reader.is_compressed() || !reader.is_indexed()) {
+        printf("Could not read %s as a compressed, indexed trace\n", filename);
+        return -1;
+    }
+    for (const char *f : {"noisy", "output", "blob"}) {
+        const auto &funcs = reader.indexed_funcs();
+        if (std::find(funcs.begin(), funcs.end(), f) == funcs.end()) {
+            printf("The index does not name %s\n", f);
+            return -1;
+        }
+    }
+
+    Packet p;
+    std::vector<int32_t> ids;
+    int noisy_stores = 0, output_stores = 0;
+    size_t blob_index = 0;
+    while (reader.next(&p)) {
+        if (!ids.empty() && p.id <= ids.back()) {
+            printf("Packet %d came after packet %d\n", p.id, ids.back());
+            return -1;
+        }
+        ids.push_back(p.id);
+        if (p.event != halide_trace_store) {
+            continue;
+        }
+        std::string func = p.func();
+        if (func == "noisy" || func == "output") {
+            int x = p.get_coord(0);
+            uint8_t correct = input(x) ^ (uint8_t)(x * 37);
+            if (func == "output") {
+                correct++;
+                output_stores++;
+            } else {
+                noisy_stores++;
+            }
+            if (p.get_value_as<uint8_t>(0) != correct) {
+                printf("%s(%d) = %d instead of %d\n", func.c_str(), x, p.get_value_as<uint8_t>(0), correct);
+                return -1;
+            }
+        } else if (func == "blob") {
+            const Blob &b = blobs[blob_index++];
+            if (p.id != b.id || p.parent_id != b.parent_id || p.value_index != b.value_index ||
+                p.type.lanes != blob_size ||
+                memcmp(p.value(), b.bytes.data(), blob_size) != 0) {
+                printf("Blob packet %d did not round-trip\n", b.id);
+                return -1;
+            }
+        }
+    }
+    if (noisy_stores != size || output_stores != size || blob_index != blobs.size()) {
+        printf("Read %d stores to noisy, %d to output and %d blobs instead of %d, %d and %d\n",
+               noisy_stores, output_stores, (int)blob_index, size, size, (int)blobs.size());
+        return -1;
+    }
+
+    // Seek to the packets of one Func through the index, twice.
+    TraceReader by_func;
+    if (!by_func.open(filename)) {
+        return -1;
+    }
+    by_func.set_func("blob");
+    for (int pass = 0; pass < 2; pass++) {
+        size_t count = 0;
+        while (by_func.next(&p)) {
+            if (count >= blobs.size() || p.id != blobs[count].id) {
+                printf("Unexpected packet %d when seeking to blob\n", p.id);
+                return -1;
+            }
+            count++;
+        }
+        if (count != blobs.size()) {
+            printf("Found %d of %d blobs\n", (int)count, (int)blobs.size());
+            return -1;
+        }
+        if (!by_func.rewind()) {
+            printf("Rewind failed\n");
+            return -1;
+        }
+    }
+
+    // Seek to a range of ids in the middle of the file.
+    int32_t min_id = ids[ids.size() / 3], max_id = ids[2 * ids.size() / 3];
+    size_t expected = 0;
+    for (int32_t id : ids) {
+        expected += (id >= min_id && id <= max_id);
+    }
+    TraceReader by_id;
+    if (!by_id.open(filename)) {
+        return -1;
+    }
+    by_id.set_id_range(min_id, max_id);
+    size_t count = 0;
+    while (by_id.next(&p)) {
+        if (p.id < min_id || p.id > max_id) {
+            printf("Packet %d is outside [%d, %d]\n", p.id, min_id, max_id);
+            return -1;
+        }
+        count++;
+    }
+    if (count != expected) {
+        printf("Found %d packets with ids in [%d, %d] instead of %d\n",
+               (int)count, min_id, max_id, (int)expected);
+        return -1;
+    }
+
+    // Both kinds of block were written.
+    FILE *f = fopen(filename, "rb");
+    halide_trace_file_header_t header;
+    if (!f || fread(&header, sizeof(header), 1, f) != 1) {
+        printf("Could not read %s\n", filename);
+        return -1;
+    }
+    int stored_blocks = 0, compressed_blocks = 0;
+    halide_trace_block_header_t block;
+    while (fread(&block, sizeof(block), 1, f) == 1 && block.uncompressed_size) {
+        if (block.compressed_size == block.uncompressed_size) {
+            stored_blocks++;
+        } else {
+            compressed_blocks++;
+        }
+        fseek(f, block.compressed_size, SEEK_CUR);
+    }
+    fclose(f);
+    remove(filename);
+    if (stored_blocks == 0 || compressed_blocks == 0) {
+        printf("Wrote %d stored and %d compressed blocks\n", stored_blocks, compressed_blocks);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,25 @@
+#include "Halide.h"
+
+namespace {
+
+class TraceCompression : public Halide::Generator<TraceCompression> {
+public:
+    Input<Buffer<uint8_t>>  input{"input", 1};
+    Output<Buffer<uint8_t>> output{"output", 1};
+
+    void generate() {
+        Var x;
+
+        Func noisy("noisy");
+        noisy(x) = input(x) ^ cast<uint8_t>(x * 37);
+
+        output(x) = noisy(x) + 1;
+
+        noisy.compute_root().trace_stores();
+        output.trace_stores();
+    }
+};
+
+}  // namespace
+
+HALIDE_REGISTER_GENERATOR(TraceCompression, trace_compression)
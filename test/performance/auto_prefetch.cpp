@@ -0,0 +1,118 @@
+#include "Halide.h"
+#include <cstdio>
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// Compare auto_prefetch() against no prefetching and against the
+// hand-written prefetch() schedules it is meant to replace, on the
+// access patterns hardware prefetchers handle badly: walking down the
+// columns of a large image, and gathering from a large table at
+// data-dependent coordinates, as in the slicing stage of
+// apps/bilateral_grid.
+
+enum Mode {
+    none,
+    hand_written,
+    automatic
+};
+
+const char *mode_names[] = {"none", "prefetch()", "auto_prefetch()"};
+
+// g(x, y) = f(y, x), with f much larger than the caches.
+Buffer<float> column_walk(Mode mode, double *t) {
+    const int size = 4096;
+    Var x, y, xo, xi;
+    Func f, g;
+    f(x, y) = cast<float>(x + y * size);
+    f.compute_root().parallel(y).vectorize(x, 8);
+    g(x, y) = f(y, x) * 2.0f;
+    g.split(x, xo, xi, 8).parallel(y, 16);
+    if (mode == hand_written) {
+        g.prefetch(f, xo, 2);
+    } else if (mode == automatic) {
+        g.auto_prefetch(xo, 2);
+    }
+
+    Buffer<float> out(size, size);
+    g.compile_jit();
+    g.realize(out);
+    *t = benchmark(3, 3, [&]() {
+        g.realize(out);
+    });
+    return out;
+}
+
+// g(x, y) reads a grid of 32 x 32 x 256 cells indexed by the value of
+// an input image, like the trilinear lookups in bilateral_grid. There
+// is no way to write this with prefetch(), which can only fetch the
+// whole range the index is clamped to, so the hand-written schedule
+// prefetches the input instead.
+Buffer<float> grid_gather(Mode mode, double *t) {
+    const int width = 4096, height = 2048, levels = 256, cells = 128;
+    Var x, y, z, c;
+    Func input, grid, g;
+    input(x, y) = cast<float>((x * 7919 + y * 104729) % 65536) / 65536.0f;
+    input.compute_root().parallel(y).vectorize(x, 8);
+    grid(x, y, z, c) = cast<float>(x + y * cells + z * 17 + c);
+    grid.compute_root().parallel(z).vectorize(x, 8);
+
+    Expr zi = clamp(cast<int>(input(x, y) * levels), 0, levels - 1);
+    Expr xc = x / (width / cells), yc = y / (height / cells);
+    g(x, y) = (grid(xc, yc, zi, 0) + grid(xc, yc, zi, 1) +
+               grid(xc, yc, min(zi + 1, levels - 1), 0) + grid(xc, yc, min(zi + 1, levels - 1), 1));
+    g.parallel(y, 8);
+    if (mode == hand_written) {
+        g.prefetch(input, x, 16);
+    } else if (mode == automatic) {
+        g.auto_prefetch(x, 16);
+    }
+
+    Buffer<float> out(width, height);
+    g.compile_jit();
+    g.realize(out);
+    *t = benchmark(3, 3, [&]() {
+        g.realize(out);
+    });
+    return out;
+}
+
+bool check(const char *name, Buffer<float> (*test)(Mode, double *)) {
+    double t[3];
+    Buffer<float> out[3];
+    for (int m = none; m <= automatic; m++) {
+        out[m] = test((Mode)m, &t[m]);
+    }
+    for (int m = hand_written; m <= automatic; m++) {
+        for (int y = 0; y < out[0].height(); y++) {
+            for (int x = 0; x < out[0].width(); x++) {
+                if (out[m](x, y) != out[none](x, y)) {
+                    printf("%s with %s: %f instead of %f at %d %d\n",
+                           name, mode_names[m], out[m](x, y), out[none](x, y), x, y);
+                    return false;
+                }
+            }
+        }
+    }
+    printf("%s: none %1.3f ms, %s %1.3f ms, %s %1.3f ms\n", name,
+           t[none] * 1e3, mode_names[hand_written], t[hand_written] * 1e3,
+           mode_names[automatic], t[automatic] * 1e3);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.has_gpu_feature()) {
+        printf("Not running auto prefetch benchmark on a GPU target\n");
+        return 0;
+    }
+
+    if (!check("Column walk", column_walk) ||
+        !check("Grid gather", grid_gather)) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+
+#include <cmath>
+#include <cstdio>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// How long the auto-scheduler takes on deep pipelines, and on one of
+// the pipelines in test/auto_schedule. The grouping search evaluates
+// every producer-consumer pair on each pass, so its cost grows quickly
+// with the number of stages.
+
+Var x("x"), y("y");
+
+// A long chain of small stencils.
+Func stencil_chain(Func in, int stages, bool compute_root) {
+    Func f = in;
+    for (int i = 0; i < stages; i++) {
+        Func g("chain_" + std::to_string(i));
+        if (i % 2 == 0) {
+            g(x, y) = (f(x - 1, y) + 2 * f(x, y) + f(x + 1, y)) / 4;
+        } else {
+            g(x, y) = (f(x, y - 1) + 2 * f(x, y) + f(x, y + 1)) / 4;
+        }
+        if (compute_root) {
+            g.compute_root();
+        }
+        f = g;
+    }
+    return f;
+}
+
+// A Laplacian-pyramid-like pipeline: downsample, then upsample and
+// combine with each level on the way back up.
+Func pyramid(Func in, int levels, bool compute_root) {
+    std::vector<Func> down(levels);
+    down[0](x, y) = in(x, y);
+    for (int l = 1; l < levels; l++) {
+        Func blur_x("blur_x_" + std::to_string(l));
+        blur_x(x, y) = (down[l - 1](2 * x - 1, y) +
+                        2 * down[l - 1](2 * x, y) +
+                        down[l - 1](2 * x + 1, y)) / 4;
+        down[l](x, y) = (blur_x(x, 2 * y - 1) + 2 * blur_x(x, 2 * y) + blur_x(x, 2 * y + 1)) / 4;
+        if (compute_root) {
+            blur_x.compute_root();
+            down[l].compute_root();
+        }
+    }
+    Func up = down[levels - 1];
+    for (int l = levels - 2; l >= 0; l--) {
+        Func u("up_" + std::to_string(l));
+        u(x, y) = (up(x / 2, y / 2) + up((x + 1) / 2, (y + 1) / 2)) / 2 + down[l](x, y) / 8;
+        if (compute_root && l > 0) {
+            u.compute_root();
+        }
+        up = u;
+    }
+    return up;
+}
+
+// The Harris corner detector from test/auto_schedule/harris.cpp, on a
+// single-channel input.
+Expr sum3x3(Func f) {
+    return f(x - 1, y - 1) + f(x - 1, y) + f(x - 1, y + 1) +
+           f(x, y - 1) + f(x, y) + f(x, y + 1) +
+           f(x + 1, y - 1) + f(x + 1, y) + f(x + 1, y + 1);
+}
+
+Func harris(Func in, bool compute_root) {
+    Func gray("gray"), Ix("Ix"), Iy("Iy"), Ixx("Ixx"), Iyy("Iyy"), Ixy("Ixy");
+    Func Sxx("Sxx"), Syy("Syy"), Sxy("Sxy"), det("det"), trace("trace"), out("harris");
+    gray(x, y) = cast<float>(in(x, y)) / 255.0f;
+    Iy(x, y) = gray(x - 1, y - 1) * (-1.0f / 12) + gray(x - 1, y + 1) * (1.0f / 12) +
+               gray(x, y - 1) * (-2.0f / 12) + gray(x, y + 1) * (2.0f / 12) +
+               gray(x + 1, y - 1) * (-1.0f / 12) + gray(x + 1, y + 1) * (1.0f / 12);
+    Ix(x, y) = gray(x - 1, y - 1) * (-1.0f / 12) + gray(x + 1, y - 1) * (1.0f / 12) +
+               gray(x - 1, y) * (-2.0f / 12) + gray(x + 1, y) * (2.0f / 12) +
+               gray(x - 1, y + 1) * (-1.0f / 12) + gray(x + 1, y + 1) * (1.0f / 12);
+    Ixx(x, y) = Ix(x, y) * Ix(x, y);
+    Iyy(x, y) = Iy(x, y) * Iy(x, y);
+    Ixy(x, y) = Ix(x, y) * Iy(x, y);
+    Sxx(x, y) = sum3x3(Ixx);
+    Syy(x, y) = sum3x3(Iyy);
+    Sxy(x, y) = sum3x3(Ixy);
+    det(x, y) = Sxx(x, y) * Syy(x, y) - Sxy(x, y) * Sxy(x, y);
+    trace(x, y) = Sxx(x, y) + Syy(x, y);
+    out(x, y) = det(x, y) - 0.04f * trace(x, y) * trace(x, y);
+    if (compute_root) {
+        for (Func f : {gray, Ix, Iy, Ixx, Iyy, Ixy, Sxx, Syy, Sxy, det, trace}) {
+            f.compute_root();
+        }
+    }
+    return out;
+}
+
+template<typename T>
+bool test(const char *name, std::function<Func(Func, bool)> make, int W, int H) {
+    Buffer<int> input(W + 64, H + 64);
+    input.set_min(-32, -32);
+    for (int y = input.dim(1).min(); y <= input.dim(1).max(); y++) {
+        for (int x = input.dim(0).min(); x <= input.dim(0).max(); x++) {
+            input(x, y) = (x * 17 + y * 31) % 256;
+        }
+    }
+
+    Func in = BoundaryConditions::repeat_edge(input);
+
+    // The reference, with every stage computed at the root.
+    Func ref = make(in, true);
+    Buffer<T> correct = ref.realize(W, H);
+
+    Func out = make(in, false);
+    out.estimate(x, 0, W).estimate(y, 0, H);
+    Pipeline p(out);
+    Target target = get_jit_target_from_environment();
+
+    double t = benchmark(1, 1, [&]() {
+        p.auto_schedule(target);
+    });
+    printf("Auto-scheduling %s: %1.3g s\n", name, t);
+
+    Buffer<T> result = p.realize(W, H, target);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            // Floating-point stages may be evaluated in a different
+            // order once scheduled, so allow for rounding.
+            double error = std::abs((double)result(x, y) - (double)correct(x, y));
+            if (error > 1e-4 * std::abs((double)correct(x, y)) + 1e-6) {
+                printf("%s: result(%d, %d) = %f instead of %f\n",
+                       name, x, y, (double)result(x, y), (double)correct(x, y));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (!test<int>("a chain of 100 stencils",
+                   [](Func in, bool root) { return stencil_chain(in, 100, root); }, 512, 512) ||
+        !test<int>("an 8-level pyramid",
+                   [](Func in, bool root) { return pyramid(in, 8, root); }, 1024, 1024) ||
+        !test<float>("the Harris corner detector", harris, 1920, 1024)) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
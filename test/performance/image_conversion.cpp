@@ -0,0 +1,79 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+
+// Only the conversions are needed, not the codecs.
+#define HALIDE_NO_PNG
+#define HALIDE_NO_JPEG
+#include "halide_image_io.h"
+
+#include <cstdio>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// How long halide_image_io takes to convert a 4K image between element
+// types, e.g. to save 16-bit data as an 8-bit png, compared to the
+// single for_each_value() on the calling thread that convert_image()
+// used to do.
+
+template<typename Dst, typename Src>
+Buffer<Dst> convert_with_for_each_value(Buffer<Src> src) {
+    Buffer<Dst> dst = Buffer<Dst>::make_with_shape_of(src);
+    const auto converter = [](Dst &dst_elem, Src src_elem) {
+        dst_elem = Tools::Internal::convert<Dst>(src_elem);
+    };
+    dst.for_each_value(converter, src);
+    return dst;
+}
+
+template<typename Dst, typename Src>
+bool test(const char *name, Buffer<Src> src) {
+    Buffer<Dst> correct;
+    double t_ref = benchmark(3, 3, [&]() {
+        correct = convert_with_for_each_value<Dst>(src);
+    });
+
+    ImageTypeConversion::set_num_threads(1);
+    Buffer<Dst> serial;
+    double t_serial = benchmark(3, 3, [&]() {
+        serial = ImageTypeConversion::convert_image<Dst>(src);
+    });
+
+    ImageTypeConversion::set_num_threads(0);
+    Buffer<Dst> parallel;
+    double t_parallel = benchmark(3, 3, [&]() {
+        parallel = ImageTypeConversion::convert_image<Dst>(src);
+    });
+
+    printf("%s: for_each_value %1.3f ms, serial %1.3f ms, parallel %1.3f ms\n",
+           name, t_ref * 1e3, t_serial * 1e3, t_parallel * 1e3);
+
+    for (int c = 0; c < src.channels(); c++) {
+        for (int y = 0; y < src.height(); y++) {
+            for (int x = 0; x < src.width(); x++) {
+                if (serial(x, y, c) != correct(x, y, c) ||
+                    parallel(x, y, c) != correct(x, y, c)) {
+                    printf("Mismatch at %d %d %d\n", x, y, c);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Buffer<uint16_t> in(3840, 2160, 3);
+    in.for_each_element([&](int x, int y, int c) {
+        in(x, y, c) = (uint16_t)(x * 17 + y * 31 + c * 12345);
+    });
+
+    if (!test<uint8_t>("uint16 -> uint8", in) ||
+        !test<float>("uint16 -> float", in) ||
+        !test<uint16_t>("float -> uint16", ImageTypeConversion::convert_image<float>(in))) {
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "Halide.h"
+#include <cstdio>
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+template<typename A>
+const char *string_of_type();
+
+#define DECL_SOT(name)                                          \
+    template<>                                                  \
+    const char *string_of_type<name>() {return #name;}
+
+DECL_SOT(int32_t);
+DECL_SOT(float);
+DECL_SOT(double);
+
+// A lookup table indexed by the input data, as in a tone curve. The
+// vectorized lookup is compiled once for the full target, where it can
+// use hardware gathers, and once for plain AVX, where every lane is
+// loaded separately.
+template<typename A>
+bool test(int lut_size) {
+    const int W = 1024, H = 1024;
+    const int vec = 32 / sizeof(A);
+
+    Buffer<A> lut(lut_size);
+    for (int i = 0; i < lut_size; i++) {
+        lut(i) = (A)((i * 7) ^ (i >> 3));
+    }
+
+    Buffer<uint16_t> input(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            input(x, y) = (uint16_t)(rand() % lut_size);
+        }
+    }
+
+    Var x, y;
+    Func f, g;
+
+    Expr idx = clamp(cast<int>(input(x, y)), 0, lut_size - 1);
+    f(x, y) = lut(idx);
+    g(x, y) = lut(idx);
+
+    f.vectorize(x, vec * 2).parallel(y, 16);
+    g.parallel(y, 16);
+
+    Target target = get_jit_target_from_environment();
+    Target no_gather = target
+        .without_feature(Target::AVX2)
+        .without_feature(Target::AVX512)
+        .without_feature(Target::AVX512_KNL)
+        .without_feature(Target::AVX512_Skylake)
+        .without_feature(Target::AVX512_Cannonlake);
+
+    Buffer<A> output_gather(W, H), output_lanes(W, H), output_scalar(W, H);
+    f.realize(output_gather, target);
+    g.realize(output_scalar, target);
+
+    double t_gather = benchmark([&]() {
+        f.realize(output_gather, target);
+    });
+    double t_scalar = benchmark([&]() {
+        g.realize(output_scalar, target);
+    });
+
+    // This recompiles f for the target without gathers.
+    f.realize(output_lanes, no_gather);
+    double t_lanes = benchmark([&]() {
+        f.realize(output_lanes, no_gather);
+    });
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            A correct = lut(input(x, y));
+            if (output_gather(x, y) != correct ||
+                output_lanes(x, y) != correct ||
+                output_scalar(x, y) != correct) {
+                printf("%s lut of size %d failed at %d %d: %f %f %f instead of %f\n",
+                       string_of_type<A>(), lut_size, x, y,
+                       (double)output_gather(x, y), (double)output_lanes(x, y),
+                       (double)output_scalar(x, y), (double)correct);
+                return false;
+            }
+        }
+    }
+
+    printf("LUT lookup (%s, %d entries): scalar %1.3gms, per-lane %1.3gms, gather %1.3gms. "
+           "Speedup over per-lane = %1.3f\n",
+           string_of_type<A>(), lut_size, t_scalar * 1e3, t_lanes * 1e3, t_gather * 1e3,
+           t_lanes / t_gather);
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch != Target::X86 || !target.has_feature(Target::AVX2)) {
+        printf("Skipping test because it requires AVX2\n");
+        return 0;
+    }
+
+    // A table that fits in L1, and one that only fits in L2.
+    for (int lut_size : {1024, 65536}) {
+        if (!test<int32_t>(lut_size) ||
+            !test<float>(lut_size) ||
+            !test<double>(lut_size)) {
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+using namespace Halide;
+
+bool unavailable = false;
+unsigned long long pipeline_cycles = 0, heavy_cycles = 0, light_cycles = 0;
+
+unsigned long long parse_cycles(const std::string &m) {
+    size_t c = m.find(" cycles: ");
+    return c == std::string::npos ? 0 : strtoull(m.c_str() + c + 9, nullptr, 10);
+}
+
+void my_print(void *, const char *msg) {
+    std::string m(msg);
+    unavailable = unavailable || m.find("Hardware counters are not available") != std::string::npos;
+    if (m.find("\n total time:") != std::string::npos) {
+        pipeline_cycles = parse_cycles(m);
+    } else if (m.find("  heavy:") == 0) {
+        heavy_cycles = parse_cycles(m);
+    } else if (m.find("  light:") == 0) {
+        light_cycles = parse_cycles(m);
+    }
+}
+
+Expr expensive(Expr e, int n) {
+    for (int j = 0; j < n; j++) {
+        e = sin(e);
+    }
+    return e;
+}
+
+int main(int argc, char **argv) {
+    // Ask the profiler to sample hardware counters. It reads the
+    // environment when its thread starts, i.e. on the first run.
+#ifdef _WIN32
+    _putenv("HL_PROFILER_COUNTERS=1");
+#else
+    setenv("HL_PROFILER_COUNTERS", "1", 1);
+#endif
+
+    // An expensive Func computed by a parallel loop nested in the
+    // tasks of another, followed by a cheaper one computed serially by
+    // each outer task once it resumes. While it waits, the thread
+    // running an outer task may run inner tasks in slots of their own,
+    // and its counts must be billed to light again once it is back.
+    Func heavy("heavy"), light("light"), out("out");
+    Var x, y, yo, yi;
+
+    heavy(x, y) = expensive(cast<float>(x + y), 200);
+    light(x, y) = expensive(heavy(x, y), 20);
+    out(x, y) = light(x, y) + 1.0f;
+
+    out.split(y, yo, yi, 50).parallel(yo);
+    heavy.compute_at(out, yo).parallel(y);
+    light.compute_at(out, yo);
+    out.set_custom_print(&my_print);
+
+    Target t = get_jit_target_from_environment().with_feature(Target::Profile);
+    out.realize(1000, 1000, t);
+
+    if (unavailable) {
+        // Containers and non-Linux hosts usually don't let us read
+        // counters. The profiler should still report time.
+        printf("Hardware counters are not available here, skipped\n");
+        return 0;
+    }
+
+    printf("cycles: pipeline %llu, heavy %llu, light %llu\n",
+           pipeline_cycles, heavy_cycles, light_cycles);
+    if (pipeline_cycles == 0 || heavy_cycles == 0 || light_cycles == 0) {
+        printf("The report is missing the cycles of the pipeline or of a Func\n");
+        return -1;
+    }
+    // heavy does ten times the work of light, and almost all of the
+    // work of the pipeline.
+    if (heavy_cycles < light_cycles * 2 || heavy_cycles * 2 < pipeline_cycles) {
+        printf("The cycles were billed to the wrong Funcs\n");
+        return -1;
+    }
+    if (heavy_cycles + light_cycles > pipeline_cycles) {
+        printf("The Funcs were billed for more cycles than the pipeline\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,218 @@
+#include "Halide.h"
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+
+using namespace Halide;
+
+// The parts of the profiler report checked below: the percentage of
+// the time of its pipeline spent in each Func, and the time/run and
+// average threads used of each pipeline.
+std::map<std::string, int> percentage;
+std::map<std::string, float> pipeline_ms, pipeline_threads;
+std::string last_pipeline;
+bool per_slot_times = false;
+
+void my_print(void *, const char *msg) {
+    std::string m(msg);
+    size_t header = m.find("\n total time:");
+    if (header != std::string::npos) {
+        last_pipeline = m.substr(0, header);
+        size_t t = m.find("time/run: ");
+        if (t != std::string::npos) {
+            pipeline_ms[last_pipeline] = atof(m.c_str() + t + 10);
+        }
+    }
+    size_t threads = m.find("average threads used: ");
+    if (threads != std::string::npos) {
+        pipeline_threads[last_pipeline] = atof(m.c_str() + threads + 22);
+    }
+    per_slot_times = per_slot_times || m.find("time/run per profiler slot:") != std::string::npos;
+
+    char name[256];
+    float this_ms;
+    int this_percentage;
+    if (sscanf(msg, " %255[^:]: %fms (%d", name, &this_ms, &this_percentage) == 3) {
+        percentage[name] = this_percentage;
+    }
+}
+
+void reset_report() {
+    percentage.clear();
+    pipeline_ms.clear();
+    pipeline_threads.clear();
+    last_pipeline.clear();
+    per_slot_times = false;
+}
+
+// An expensive Func and a cheap one, computed per row of 'out'.
+Func make_pipeline(const std::string &suffix, Func *heavy, Func *light) {
+    Func out("out" + suffix);
+    *heavy = Func("heavy" + suffix);
+    *light = Func("light" + suffix);
+    Var x, y;
+
+    Expr e = cast<float>(x + y);
+    for (int j = 0; j < 200; j++) {
+        e = sin(e);
+    }
+    (*heavy)(x, y) = e;
+    (*light)(x, y) = (*heavy)(x, y) * 2.0f;
+    out(x, y) = (*light)(x, y) + 1.0f;
+    return out;
+}
+
+bool check_heavy(const std::string &name) {
+    printf("Percentage of runtime spent in %s: %d\n", name.c_str(), percentage[name]);
+    if (percentage[name] < 60) {
+        printf("This is suspiciously low. It should be more like 95%%\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Target t = get_jit_target_from_environment().with_feature(Target::Profile);
+    // The size of the thread pool, counting the thread that calls the
+    // pipeline.
+    int max_threads = std::max((int)std::thread::hardware_concurrency(), 1);
+    if (const char *num_threads = getenv("HL_NUM_THREADS")) {
+        max_threads = std::max(atoi(num_threads), max_threads);
+    }
+
+    {
+        // The tasks of a parallel loop run each Func at the same time,
+        // and each task is sampled separately.
+        Func heavy, light;
+        Func out = make_pipeline("", &heavy, &light);
+        Var y = out.args()[1];
+        out.parallel(y);
+        heavy.compute_at(out, y);
+        light.compute_at(out, y);
+        out.set_custom_print(&my_print);
+
+        reset_report();
+        out.realize(1000, 1000, t);
+
+        if (!check_heavy("heavy")) {
+            return -1;
+        }
+
+        if (pipeline_threads.count("out") && !per_slot_times) {
+            printf("The report did not break down the time by slot\n");
+            return -1;
+        }
+    }
+
+    {
+        // Nested parallelism: the tasks of the outer loop wait for the
+        // tasks of a parallel loop over the rows of heavy. Waiting
+        // tasks hold a slot, but should not be billed for it, neither
+        // to 'out_nested' nor as a busy thread.
+        Func heavy, light;
+        Func out = make_pipeline("_nested", &heavy, &light);
+        Var y = out.args()[1];
+        Var yo, yi;
+        out.split(y, yo, yi, 50).parallel(yo);
+        heavy.compute_at(out, yo).parallel(heavy.args()[1]);
+        light.compute_at(out, yo);
+        out.set_custom_print(&my_print);
+
+        reset_report();
+        out.realize(1000, 1000, t);
+
+        if (!check_heavy("heavy_nested")) {
+            return -1;
+        }
+        float threads = pipeline_threads["out_nested"];
+        printf("Average threads used with nested parallelism: %f\n", threads);
+        if (threads > max_threads + 0.5f) {
+            printf("More threads were busy than there are in the thread pool (%d)\n", max_threads);
+            return -1;
+        }
+    }
+
+    {
+        // Two pipelines running at the same time share the profiler
+        // slots. Each pipeline should only be billed for its own
+        // threads, and only once per sample. The pipelines are called
+        // through their raw function pointers, because realize()
+        // resets the profiler when it returns, which is not safe while
+        // the other pipeline is running. A third pipeline is then
+        // realized just to print the report for all three.
+        Func heavy_a, light_a, heavy_b, light_b;
+        Func out_a = make_pipeline("_a", &heavy_a, &light_a);
+        Func out_b = make_pipeline("_b", &heavy_b, &light_b);
+        out_a.parallel(out_a.args()[1]);
+        heavy_a.compute_at(out_a, out_a.args()[1]);
+        light_a.compute_at(out_a, out_a.args()[1]);
+        out_b.parallel(out_b.args()[1]);
+        heavy_b.compute_at(out_b, out_b.args()[1]);
+        light_b.compute_at(out_b, out_b.args()[1]);
+
+        typedef int (*pipeline_fn)(void *, halide_buffer_t *);
+        pipeline_fn fn_a = (pipeline_fn)out_a.compile_jit(t);
+        pipeline_fn fn_b = (pipeline_fn)out_b.compile_jit(t);
+
+        Func reporter("reporter");
+        Var x;
+        reporter(x) = x;
+        reporter.set_custom_print(&my_print);
+        reporter.compile_jit(t);
+
+        Buffer<float> buf_a(1000, 1000), buf_b(1000, 1000);
+        const int runs = 3;
+        int result_a = 0, result_b = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        std::thread thread_a([&]() {
+            for (int i = 0; i < runs && result_a == 0; i++) {
+                result_a = fn_a(nullptr, buf_a.raw_buffer());
+            }
+        });
+        std::thread thread_b([&]() {
+            for (int i = 0; i < runs && result_b == 0; i++) {
+                result_b = fn_b(nullptr, buf_b.raw_buffer());
+            }
+        });
+        thread_a.join();
+        thread_b.join();
+        auto end = std::chrono::high_resolution_clock::now();
+        if (result_a != 0 || result_b != 0) {
+            printf("Concurrent pipelines failed: %d %d\n", result_a, result_b);
+            return -1;
+        }
+        double wall_ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+        reset_report();
+        reporter.realize(10, t);
+
+        if (!check_heavy("heavy_a") || !check_heavy("heavy_b")) {
+            return -1;
+        }
+        for (const char *name : {"out_a", "out_b"}) {
+            if (!pipeline_ms.count(name)) {
+                printf("No report for %s\n", name);
+                return -1;
+            }
+            printf("%s: %f ms/run, wall time %f ms/run\n", name, pipeline_ms[name], wall_ms / runs);
+            // Allow for the sampling interval and the rounding of the
+            // report.
+            if (pipeline_ms[name] > wall_ms / runs * 1.1 + 2) {
+                printf("%s was billed for more than the time it was running\n", name);
+                return -1;
+            }
+            // Both calling threads work alongside the thread pool.
+            if (pipeline_threads[name] > max_threads + 1.5f) {
+                printf("%s was billed for more threads than there are in the thread pool (%d)\n",
+                       name, max_threads);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
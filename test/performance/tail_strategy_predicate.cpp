@@ -0,0 +1,85 @@
+#include "Halide.h"
+#include <cstdio>
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+template<typename A>
+const char *string_of_type();
+
+#define DECL_SOT(name)                                          \
+    template<>                                                  \
+    const char *string_of_type<name>() {return #name;}
+
+DECL_SOT(uint8_t);
+DECL_SOT(float);
+
+// Short rows with widths that are not a multiple of the vector
+// width. GuardWithIf peels the tail into a scalar epilogue,
+// Predicate handles it with a single masked vector iteration.
+template<typename A>
+bool test(int width) {
+    const int vec = 32 / sizeof(A);
+    const int H = 20000;
+
+    Buffer<A> input(width + 2, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < width + 2; x++) {
+            input(x, y) = (A)(rand() & 0x7f);
+        }
+    }
+
+    Var x, y;
+    Func f, g;
+
+    f(x, y) = input(x, y) / 4 + input(x + 1, y) / 2 + input(x + 2, y) / 4;
+    g(x, y) = input(x, y) / 4 + input(x + 1, y) / 2 + input(x + 2, y) / 4;
+
+    f.vectorize(x, vec, TailStrategy::GuardWithIf);
+    g.vectorize(x, vec, TailStrategy::Predicate);
+
+    Buffer<A> output_f = f.realize(width, H);
+    Buffer<A> output_g = g.realize(width, H);
+
+    double t_f = benchmark([&]() {
+        f.realize(output_f);
+    });
+    double t_g = benchmark([&]() {
+        g.realize(output_g);
+    });
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < width; x++) {
+            if (output_f(x, y) != output_g(x, y)) {
+                printf("%s width %d failed at %d %d: %f vs %f\n",
+                       string_of_type<A>(), width, x, y,
+                       (double)output_f(x, y), (double)output_g(x, y));
+                return false;
+            }
+        }
+    }
+
+    printf("GuardWithIf vs Predicate (%s, width %d): %1.3gms %1.3gms. Speedup = %1.3f\n",
+           string_of_type<A>(), width, t_f * 1e3, t_g * 1e3, t_f / t_g);
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch != Target::X86 || !target.has_feature(Target::AVX2)) {
+        printf("Skipping test because it requires AVX2\n");
+        return 0;
+    }
+
+    for (int width : {7, 19, 45, 71, 129}) {
+        if (!test<uint8_t>(width) ||
+            !test<float>(width)) {
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -2,9 +2,15 @@
 #include "HalideBuffer.h"
 #include "halide_benchmark.h"
 #include "halide_image_io.h"
+#include "RunGen.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
@@ -12,75 +18,22 @@
 #include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 extern "C" int halide_rungen_redirect_argv(void **args);
 extern "C" const struct halide_filter_metadata_t *halide_rungen_redirect_metadata();
 
-// Buffer<> uses "shape" to mean "array of halide_dimension_t", but doesn't
-// provide a typedef for it (and doesn't use a vector for it in any event).
-using Shape = std::vector<halide_dimension_t>;
+using namespace Halide::RunGen;
 
 namespace {
 
-using Halide::Runtime::Buffer;
 using Halide::Tools::FormatInfo;
 using Halide::Tools::BenchmarkConfig;
 
 bool verbose = false;
 bool quiet = false;
 
-// Standard stream output for halide_type_t
-std::ostream &operator<<(std::ostream &stream, const halide_type_t &type) {
-    if (type.code == halide_type_uint && type.bits == 1) {
-        stream << "bool";
-    } else {
-        switch (type.code) {
-        case halide_type_int:
-            stream << "int";
-            break;
-        case halide_type_uint:
-            stream << "uint";
-            break;
-        case halide_type_float:
-            stream << "float";
-            break;
-        case halide_type_handle:
-            stream << "handle";
-            break;
-        default:
-            stream << "#unknown";
-            break;
-        }
-        stream << std::to_string(type.bits);
-    }
-    if (type.lanes > 1) {
-        stream << "x" + std::to_string(type.lanes);
-    }
-    return stream;
-}
-
-// Standard stream output for halide_dimension_t
-std::ostream &operator<<(std::ostream &stream, const halide_dimension_t &d) {
-    stream << "[" << d.min << "," << d.extent << "," << d.stride << "]";
-    return stream;
-}
-
-// Standard stream output for vector<halide_dimension_t>
-std::ostream &operator<<(std::ostream &stream, const Shape &shape) {
-    stream << "[";
-    bool need_comma = false;
-    for (auto &d : shape) {
-        if (need_comma) {
-            stream << ',';
-        }
-        stream << d;
-        need_comma = true;
-    }
-    stream << "]";
-    return stream;
-}
-
 // Log informational output to stderr, but only in verbose mode
 struct info {
     std::ostringstream msg;
@@ -103,50 +56,6 @@ struct info {
     }
 };
 
-// Log warnings to stderr
-struct warn {
-    std::ostringstream msg;
-
-    template<typename T>
-    warn &operator<<(const T &x) {
-        msg << x;
-        return *this;
-    }
-
-    ~warn() {
-        std::cerr << "Warning: " << msg.str();
-        if (msg.str().back() != '\n') {
-            std::cerr << '\n';
-        }
-    }
-};
-
-// Log unrecoverable errors to stderr, then exit
-struct fail {
-    std::ostringstream msg;
-
-    template<typename T>
-    fail &operator<<(const T &x) {
-        msg << x;
-        return *this;
-    }
-
-    #ifdef _MSC_VER
-    #pragma warning(push)
-    #pragma warning(disable:4722)  // destructor never returns, potential memory leak
-    #endif
-    ~fail() {
-        std::cerr << msg.str();
-        if (msg.str().back() != '\n') {
-            std::cerr << '\n';
-        }
-        exit(1);
-    }
-    #ifdef _MSC_VER
-    #pragma warning(pop)
-    #endif
-};
-
 // Replace the failure handlers from halide_image_io to fail()
 bool IOCheckFail(bool condition, const char* msg) {
     if (!condition) {
@@ -176,17 +85,42 @@ class HalideMemoryTracker {
 
     // Total current CPU memory allocated via halide_malloc.
     // Access controlled by tracker_mutex.
-    uint64_t memory_allocated;
+    uint64_t memory_allocated{0};
 
     // High-water mark of CPU memory allocated since program start
     // (or last call to get_cpu_memory_highwater_reset).
     // Access controlled by tracker_mutex.
-    uint64_t memory_highwater;
+    uint64_t memory_highwater{0};
 
     // Map of outstanding allocation sizes.
     // Access controlled by tracker_mutex.
     std::map<void *, size_t> memory_size_map;
 
+    // Number of allocations of each size, and in total.
+    // Access controlled by tracker_mutex.
+    std::map<size_t, uint64_t> size_counts;
+    uint64_t allocation_count{0};
+
+    // The number of allocations and the high-water mark in each call
+    // of the filter, as delimited by end_call(), and so far in the
+    // current one. Access controlled by tracker_mutex.
+    std::vector<uint64_t> call_allocations, call_highwaters;
+    uint64_t call_start_count{0}, call_highwater{0};
+
+    // The memory allocated after each malloc and free, in seconds
+    // since install(), if requested. Access controlled by tracker_mutex.
+    static constexpr size_t kMaxTimelineEvents = 1 << 20;
+    bool record_timeline{false};
+    std::chrono::high_resolution_clock::time_point start_time;
+    std::vector<std::pair<double, uint64_t>> timeline;
+
+    void record_event() {
+        if (record_timeline && timeline.size() < kMaxTimelineEvents) {
+            auto now = std::chrono::high_resolution_clock::now();
+            timeline.emplace_back(std::chrono::duration<double>(now - start_time).count(), memory_allocated);
+        }
+    }
+
     void *tracker_malloc_impl(void *user_context, size_t x) {
         std::lock_guard<std::mutex> lock(tracker_mutex);
 
@@ -196,10 +130,16 @@ class HalideMemoryTracker {
         if (memory_highwater < memory_allocated) {
             memory_highwater = memory_allocated;
         }
+        if (call_highwater < memory_allocated) {
+            call_highwater = memory_allocated;
+        }
         if (memory_size_map.find(ptr) != memory_size_map.end()) {
             halide_error(user_context, "Tracking error in tracker_malloc");
         }
         memory_size_map[ptr] = x;
+        size_counts[x]++;
+        allocation_count++;
+        record_event();
 
         return ptr;
     }
@@ -213,6 +153,7 @@ class HalideMemoryTracker {
         size_t x = it->second;
         memory_allocated -= x;
         memory_size_map.erase(it);
+        record_event();
         halide_default_free(user_context, ptr);
     }
 
@@ -225,13 +166,24 @@ class HalideMemoryTracker {
     }
 
   public:
-    void install() {
+    void install(bool timeline = false) {
         assert(!active);
         active = this;
+        record_timeline = timeline;
+        start_time = std::chrono::high_resolution_clock::now();
         halide_set_custom_malloc(tracker_malloc);
         halide_set_custom_free(tracker_free);
     }
 
+    // Mark the end of a call of the filter.
+    void end_call() {
+        std::lock_guard<std::mutex> lock(tracker_mutex);
+        call_allocations.push_back(allocation_count - call_start_count);
+        call_highwaters.push_back(call_highwater);
+        call_start_count = allocation_count;
+        call_highwater = memory_allocated;
+    }
+
     uint64_t allocated() {
         std::lock_guard<std::mutex> lock(tracker_mutex);
         return memory_allocated;
@@ -246,27 +198,71 @@ class HalideMemoryTracker {
         std::lock_guard<std::mutex> lock(tracker_mutex);
         memory_highwater = memory_allocated;
     }
-};
 
-/* static */ HalideMemoryTracker *HalideMemoryTracker::active{nullptr};
+    // Print the number of allocations per call, a histogram of
+    // allocation sizes (in power-of-two buckets), and the largest
+    // allocations.
+    void report(std::ostream &o, int largest = 10) {
+        std::lock_guard<std::mutex> lock(tracker_mutex);
+        o << "Halide allocations: " << allocation_count << " in total";
+        if (!call_allocations.empty()) {
+            const auto minmax_count = std::minmax_element(call_allocations.begin(), call_allocations.end());
+            const auto minmax_peak = std::minmax_element(call_highwaters.begin(), call_highwaters.end());
+            o << ", " << *minmax_count.first << " to " << *minmax_count.second
+              << " per call over " << call_allocations.size() << " call(s).\n"
+              << "Peak Halide memory per call: " << *minmax_peak.first << " to " << *minmax_peak.second << " bytes";
+        }
+        o << ".\n";
+        if (size_counts.empty()) {
+            return;
+        }
+
+        std::map<int, std::pair<uint64_t, uint64_t>> buckets;
+        for (const auto &s : size_counts) {
+            int log2_size = 0;
+            while (((size_t) 1 << log2_size) < s.first) {
+                log2_size++;
+            }
+            buckets[log2_size].first += s.second;
+            buckets[log2_size].second += s.first * s.second;
+        }
+        o << "Allocation sizes:\n"
+          << std::setw(24) << "bytes" << std::setw(12) << "count" << std::setw(16) << "total bytes" << "\n";
+        for (const auto &b : buckets) {
+            std::ostringstream range;
+            range << (b.first ? ((uint64_t) 1 << (b.first - 1)) + 1 : 0) << " - " << ((uint64_t) 1 << b.first);
+            o << std::setw(24) << range.str() << std::setw(12) << b.second.first
+              << std::setw(16) << b.second.second << "\n";
+        }
 
-std::vector<std::string> split_string(const std::string &source,
-                                      const std::string &delim) {
-    std::vector<std::string> elements;
-    size_t start = 0;
-    size_t found = 0;
-    while ((found = source.find(delim, start)) != std::string::npos) {
-        elements.push_back(source.substr(start, found - start));
-        start = found + delim.size();
+        o << "Largest allocations:\n"
+          << std::setw(24) << "bytes" << std::setw(12) << "count" << "\n";
+        int n = 0;
+        for (auto it = size_counts.rbegin(); it != size_counts.rend() && n < largest; ++it, ++n) {
+            o << std::setw(24) << it->first << std::setw(12) << it->second << "\n";
+        }
     }
 
-    // If start is exactly source.size(), the last thing in source is a
-    // delimiter, in which case we want to add an empty std::string to elements.
-    if (start <= source.size()) {
-        elements.push_back(source.substr(start, std::string::npos));
+    // Write the timeline recorded since install() as CSV.
+    void write_timeline(const std::string &path) {
+        std::lock_guard<std::mutex> lock(tracker_mutex);
+        std::ofstream f(path);
+        f << "seconds,bytes\n" << std::setprecision(9);
+        for (const auto &e : timeline) {
+            f << e.first << "," << e.second << "\n";
+        }
+        if (!f) {
+            fail() << "Unable to write " << path;
+        }
+        if (timeline.size() == kMaxTimelineEvents) {
+            warn() << "Only the first " << kMaxTimelineEvents << " allocations and frees were written to " << path;
+        }
     }
-    return elements;
-}
+};
+
+/* static */ constexpr size_t HalideMemoryTracker::kMaxTimelineEvents;
+
+/* static */ HalideMemoryTracker *HalideMemoryTracker::active{nullptr};
 
 std::string replace_all(const std::string &str,
                         const std::string &find,
@@ -280,215 +276,6 @@ std::string replace_all(const std::string &str,
     return result;
 }
 
-// Must be constexpr to allow use in case clauses.
-inline constexpr int halide_type_code(halide_type_code_t code, int bits) {
-    return (((int) code) << 8) | bits;
-}
-
-// dynamic_type_dispatch is a utility for functors that want to be able
-// to dynamically dispatch a halide_type_t to type-specialized code.
-// To use it, a functor must be a *templated* class, e.g.
-//
-//     template<typename T> class MyFunctor { int operator()(arg1, arg2...); };
-//
-// dynamic_type_dispatch() is called with a halide_type_t as the first argument,
-// followed by the arguments to the Functor's operator():
-//
-//     auto result = dynamic_type_dispatch<MyFunctor>(some_halide_type, arg1, arg2);
-//
-// Note that this means that the functor must be able to instantiate its
-// operator() for all the Halide scalar types; it also means that all those
-// variants *will* be instantiated (increasing code size), so this approach
-// should only be used when strictly necessary.
-template<template<typename> class Functor, typename... Args>
-auto dynamic_type_dispatch(const halide_type_t &type, Args&&... args) ->
-    decltype(std::declval<Functor<uint8_t>>()(std::forward<Args>(args)...)) {
-
-#define HANDLE_CASE(CODE, BITS, TYPE) \
-    case halide_type_code(CODE, BITS): return Functor<TYPE>()(std::forward<Args>(args)...);
-    switch (halide_type_code((halide_type_code_t) type.code, type.bits)) {
-        HANDLE_CASE(halide_type_float, 32, float)
-        HANDLE_CASE(halide_type_float, 64, double)
-        HANDLE_CASE(halide_type_int, 8, int8_t)
-        HANDLE_CASE(halide_type_int, 16, int16_t)
-        HANDLE_CASE(halide_type_int, 32, int32_t)
-        HANDLE_CASE(halide_type_int, 64, int64_t)
-        HANDLE_CASE(halide_type_uint, 1, bool)
-        HANDLE_CASE(halide_type_uint, 8, uint8_t)
-        HANDLE_CASE(halide_type_uint, 16, uint16_t)
-        HANDLE_CASE(halide_type_uint, 32, uint32_t)
-        HANDLE_CASE(halide_type_uint, 64, uint64_t)
-        HANDLE_CASE(halide_type_handle, 64, void*)
-        default:
-            fail() << "Unsupported type: " << type << "\n";
-            using ReturnType = decltype(std::declval<Functor<uint8_t>>()(std::forward<Args>(args)...));
-            return ReturnType();
-    }
-#undef HANDLE_CASE
-}
-
-// Functor to parse a string into one of the known Halide scalar types.
-template<typename T>
-struct ScalarParser {
-    bool operator()(const std::string &str, halide_scalar_value_t *v) {
-        std::istringstream iss(str);
-        // std::setbase(0) means "infer base from input", and allows hex and octal constants
-        iss >> std::setbase(0) >> *(T*)v;
-        return !iss.fail() && iss.get() == EOF;
-    }
-};
-
-// Override for int8 and uint8, to avoid parsing as char variants
-template<>
-bool ScalarParser<int8_t>::operator()(const std::string &str, halide_scalar_value_t *v) {
-    std::istringstream iss(str);
-    int i;
-    iss >> std::setbase(0) >> i;
-    if (!(!iss.fail() && iss.get() == EOF) || i < -128 || i > 127) {
-      return false;
-    }
-    v->u.i8 = (int8_t) i;
-    return true;
-}
-
-template<>
-bool ScalarParser<uint8_t>::operator()(const std::string &str, halide_scalar_value_t *v) {
-    std::istringstream iss(str);
-    unsigned int u;
-    iss >> std::setbase(0) >> u;
-    if (!(!iss.fail() && iss.get() == EOF) || u > 255) {
-      return false;
-    }
-    v->u.u8 = (uint8_t) u;
-    return true;
-}
-
-// Override for bool, since istream just expects '1' or '0'.
-template<>
-bool ScalarParser<bool>::operator()(const std::string &str, halide_scalar_value_t *v) {
-    if (str == "true") {
-        v->u.b = true;
-        return true;
-    }
-    if (str == "false") {
-        v->u.b = false;
-        return true;
-    }
-    return false;
-}
-
-// Override for handle, since we only accept "nullptr".
-template<>
-bool ScalarParser<void*>::operator()(const std::string &str, halide_scalar_value_t *v) {
-    if (str == "nullptr") {
-        v->u.handle = nullptr;
-        return true;
-    }
-    return false;
-}
-
-// Parse a scalar when we know the corresponding C++ type at compile time.
-template<typename T>
-bool parse_scalar(const std::string &str, T *scalar) {
-    return ScalarParser<T>()(str, (halide_scalar_value_t *) scalar);
-}
-
-// Dynamic-dispatch wrapper around ScalarParser.
-bool parse_scalar(const halide_type_t &type,
-                  const std::string &str,
-                  halide_scalar_value_t *scalar) {
-    return dynamic_type_dispatch<ScalarParser>(type, str, scalar);
-}
-
-// Parse an extent list, which should be of the form
-//
-//    [extent0, extent1...]
-//
-// Return a vector<halide_dimension_t> (aka a "shape") with the extents filled in,
-// but with the min of each dimension set to zero and the stride set to the
-// planar-default value.
-Shape parse_extents(const std::string &extent_list) {
-    if (extent_list.empty() || extent_list[0] != '[' || extent_list.back() != ']') {
-        fail() << "Invalid format for extents: " << extent_list;
-    }
-    Shape result;
-    std::vector<std::string> extents = split_string(extent_list.substr(1, extent_list.size()-2), ",");
-    for (size_t i = 0; i < extents.size(); i++) {
-      const std::string &s = extents[i];
-        const int stride = (i == 0) ? 1 : result[i-1].stride * result[i-1].extent;
-        halide_dimension_t d = {0, 0, stride};
-        if (!parse_scalar(s, &d.extent)) {
-            fail() << "Invalid value for extents: " << s << " (" << extent_list << ")";
-        }
-        result.push_back(d);
-    }
-    return result;
-}
-
-// Given a Buffer<>, return its shape in the form of a vector<halide_dimension_t>.
-// (Oddly, Buffer<> has no API to do this directly.)
-Shape get_shape(const Buffer<> &b) {
-    Shape s;
-    for (int i = 0; i < b.dimensions(); ++i) {
-        s.push_back(b.raw_buffer()->dim[i]);
-    }
-    return s;
-}
-
-// Given a type and shape, create a new Buffer<> but *don't* allocate allocate storage for it.
-Buffer<> make_with_shape(const halide_type_t &type, const Shape &shape) {
-    return Buffer<>(type, nullptr, (int) shape.size(), &shape[0]);
-}
-
-// Given a type and shape, create a new Buffer<> and allocate storage for it.
-// (Oddly, Buffer<> has an API to do this with vector-of-extent, but not vector-of-halide_dimension_t.)
-Buffer<> allocate_buffer(const halide_type_t &type, const Shape &shape) {
-    Buffer<> b = make_with_shape(type, shape);
-    b.check_overflow();
-    b.allocate();
-    return b;
-}
-
-// BEGIN TODO: hacky algorithm inspired by Safelight
-// (should really use the algorithm from AddImageChecks to come up with something more rigorous.)
-Shape choose_output_extents(int dimensions, const Shape &defaults) {
-    Shape s(dimensions);
-    for (int i = 0; i < dimensions; ++i) {
-        if ((size_t) i < defaults.size()) {
-            s[i] = defaults[i];
-            continue;
-        }
-        s[i].extent = (i < 2 ? 1000 : 4);
-    }
-    return s;
-}
-
-void fix_chunky_strides(const Shape &constrained_shape, Shape *new_shape) {
-    // Special-case Chunky: most "chunky" generators tend to constrain stride[0]
-    // and stride[2] to exact values, leaving stride[1] unconstrained;
-    // in practice, we must ensure that stride[1] == stride[0] * extent[0]
-    // and stride[0] = extent[2] to get results that are not garbled.
-    // This is unpleasantly hacky and will likely need aditional enhancements.
-    // (Note that there are, theoretically, other stride combinations that might
-    // need fixing; in practice, ~all generators that aren't planar tend
-    // to be classically chunky.)
-    if (new_shape->size() >= 3) {
-        if (constrained_shape[2].stride == 1) {
-            if (constrained_shape[0].stride >= 1) {
-                // If we have stride[0] and stride[2] set to obviously-chunky,
-                // then force extent[2] to match stride[0].
-                (*new_shape)[2].extent = constrained_shape[0].stride;
-            } else {
-                // If we have stride[2] == 1 but stride[0] < 1,
-                // force stride[0] = extent[2]
-                (*new_shape)[0].stride = (*new_shape)[2].extent;
-            }
-            // Ensure stride[1] is reasonable.
-            (*new_shape)[1].stride = (*new_shape)[0].extent * (*new_shape)[0].stride;
-        }
-    }
-}
-
 // Given a constraint Shape (generally produced by a bounds query), update
 // the input Buffer to meet those constraints, allocating and copying into
 // a new Buffer if necessary.
@@ -524,54 +311,6 @@ bool adapt_input_buffer_layout(const Shape &constrained_shape, Buffer<> *buf) {
     return shape_changed;
 }
 
-// Given a constraint Shape (generally produced by a bounds query), create a new
-// Shape that can legally be used to create and allocate a new Buffer:
-// ensure that extents/strides aren't zero, do some reality checking
-// on planar vs interleaved, and generally try to guess at a reasonable result.
-Shape make_legal_output_buffer_shape(const Shape &constrained_shape) {
-    Shape new_shape = constrained_shape;
-
-    // Make sure that the extents and strides for these are nonzero.
-    for (size_t i = 0; i < new_shape.size(); ++i) {
-        if (!new_shape[i].extent) {
-            // A bit of a hack: fill in unconstrained dimensions to 1... except
-            // for probably-the-channels dimension, which we'll special-case to
-            // fill in to 4 when possible (unless it appears to be chunky).
-            // Stride will be fixed below.
-            if (i == 2) {
-                if (constrained_shape[0].stride >= 1 && constrained_shape[2].stride == 1) {
-                    // Definitely chunky, so make extent[2] match the chunk size
-                    new_shape[i].extent = constrained_shape[0].stride;
-                } else {
-                    // Not obviously chunky; let's go with 4 channels.
-                    new_shape[i].extent = 4;
-                }
-            } else {
-                new_shape[i].extent = 1;
-            }
-        }
-    }
-
-    fix_chunky_strides(constrained_shape, &new_shape);
-
-    // If anything else is zero, just set strides to planar and hope for the best.
-    bool any_strides_zero = false;
-    for (size_t i = 0; i < new_shape.size(); ++i) {
-        if (!new_shape[i].stride) {
-            any_strides_zero = true;
-        }
-    }
-    if (any_strides_zero) {
-        // Planar
-        new_shape[0].stride = 1;
-        for (size_t i = 1; i < new_shape.size(); ++i) {
-            new_shape[i].stride = new_shape[i - 1].stride * new_shape[i - 1].extent;
-        }
-    }
-    return new_shape;
-}
-// END TODO: hacky algorithm inspired by Safelight
-
 // Return true iff all of the dimensions in the range [first, last] have an extent of <= 1.
 bool dims_in_range_are_trivial(const Buffer<> &b, int first, int last) {
     for (int d = first; d <= last; ++d) {
@@ -617,7 +356,9 @@ Buffer<> load_input_from_file(const std::string &pathname,
                               const halide_filter_argument_t &metadata) {
     Buffer<> b = Buffer<>(metadata.type, 0);
     info() << "Loading input " << metadata.name << " from " << pathname << " ...";
-    if (!Halide::Tools::load<Buffer<>, IOCheckFail>(pathname, &b)) {
+    // Map the file where the format allows it, so that large inputs
+    // aren't copied before the pipeline reads them.
+    if (!Halide::Tools::load_mapped<Buffer<>, IOCheckFail>(pathname, &b)) {
         fail() << "Unable to load input: " << pathname;
     }
     if (b.dimensions() != metadata.dimensions) {
@@ -730,6 +471,125 @@ uint64_t calc_pixels_out(const std::map<std::string, ArgData> &args) {
     return pixels_out;
 }
 
+// Make the argv for a call of the filter with the given args.
+std::vector<void*> make_filter_argv(std::map<std::string, ArgData> &args) {
+    std::vector<void*> filter_argv(args.size(), nullptr);
+    for (auto &arg_pair : args) {
+        auto &arg = arg_pair.second;
+        switch (arg.metadata->kind) {
+            case halide_argument_kind_input_scalar:
+                filter_argv[arg.index] = &arg.scalar_value;
+                break;
+            case halide_argument_kind_input_buffer:
+            case halide_argument_kind_output_buffer:
+                filter_argv[arg.index] = arg.buffer_value.raw_buffer();
+                break;
+        }
+    }
+    return filter_argv;
+}
+
+// Make a new Buffer<> of the given shape from the contents of 'src',
+// repeating it as necessary to fill the new Buffer.
+Buffer<> tile_buffer(const Buffer<> &src, const Shape &shape) {
+    Buffer<> dst = allocate_buffer(src.type(), shape);
+    const int bytes = src.type().bytes();
+    std::vector<int> src_pos(src.dimensions());
+    dst.for_each_element([&](const int *pos) {
+        for (int d = 0; d < src.dimensions(); d++) {
+            int p = (pos[d] - src.dim(d).min()) % src.dim(d).extent();
+            src_pos[d] = src.dim(d).min() + (p < 0 ? p + src.dim(d).extent() : p);
+        }
+        memcpy(dst.raw_buffer()->address_of(pos), src.raw_buffer()->address_of(&src_pos[0]), bytes);
+    });
+    return dst;
+}
+
+// Scale the first two output extents of 'shape' (keeping their aspect
+// ratio) so that the outputs take about 'bytes', given that they now
+// take 'current_bytes'. Extents are rounded to a multiple of 16 so that
+// they don't trip over the splits of typical schedules. The strides are
+// left for the bounds query to choose.
+Shape scale_output_extents(const Shape &shape, uint64_t current_bytes, uint64_t bytes) {
+    Shape result = shape;
+    for (auto &d : result) {
+        d.stride = 0;
+    }
+    const int scaled_dims = std::min((int) shape.size(), 2);
+    const double scale = std::pow((double) bytes / current_bytes, 1.0 / scaled_dims);
+    for (int i = 0; i < scaled_dims; i++) {
+        int extent = (int) (shape[i].extent * scale / 16 + 0.5) * 16;
+        result[i].extent = std::max(extent, 16);
+    }
+    return result;
+}
+
+// Run 'concurrency' calls of the filter at a time, each on its own thread
+// and with its own output buffers (the inputs are shared), with each
+// thread making 'calls_per_thread' calls in turn. Returns the number of
+// calls completed per second.
+double measure_throughput(const std::map<std::string, ArgData> &args,
+                          int concurrency, uint64_t calls_per_thread) {
+    std::vector<std::vector<Buffer<>>> buffers(concurrency);
+    std::vector<std::vector<void*>> filter_argv(concurrency);
+    for (int t = 0; t < concurrency; t++) {
+        filter_argv[t].resize(args.size(), nullptr);
+        buffers[t].resize(args.size());
+        for (auto &arg_pair : args) {
+            auto &arg = arg_pair.second;
+            switch (arg.metadata->kind) {
+            case halide_argument_kind_input_scalar:
+                filter_argv[t][arg.index] = const_cast<halide_scalar_value_t*>(&arg.scalar_value);
+                break;
+            case halide_argument_kind_input_buffer:
+                // Each thread gets its own halide_buffer_t, but the same storage.
+                buffers[t][arg.index] = arg.buffer_value;
+                filter_argv[t][arg.index] = buffers[t][arg.index].raw_buffer();
+                break;
+            case halide_argument_kind_output_buffer:
+                buffers[t][arg.index] = allocate_buffer(arg.metadata->type, get_shape(arg.buffer_value));
+                filter_argv[t][arg.index] = buffers[t][arg.index].raw_buffer();
+                break;
+            }
+        }
+    }
+
+    // Start all the threads before starting the clock, and then start
+    // them all at once.
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < concurrency; t++) {
+        threads.emplace_back([&, t]() {
+            ready++;
+            while (!go) {
+                std::this_thread::yield();
+            }
+            for (uint64_t i = 0; i < calls_per_thread; i++) {
+                // Ignore result since our halide_error() should catch everything.
+                (void) halide_rungen_redirect_argv(&filter_argv[t][0]);
+            }
+            for (auto &arg_pair : args) {
+                auto &arg = arg_pair.second;
+                if (arg.metadata->kind == halide_argument_kind_output_buffer) {
+                    buffers[t][arg.index].device_sync();
+                }
+            }
+        });
+    }
+    while (ready < concurrency) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    go = true;
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    double elapsed = std::chrono::duration<double>(end - start).count();
+    return (double) concurrency * calls_per_thread / std::max(elapsed, 1e-9);
+}
+
 void usage(const char *argv0) {
 const std::string usage = R"USAGE(
 Usage: $NAME$ argument=value [argument=value... ] [flags]
@@ -808,10 +668,62 @@ Flags:
         Override the default maximum number of benchmarking iterations; ignored
         if --benchmarks is not also specified.
 
+    --benchmark_warmup_iters=NUM [default = 0]:
+        Run the filter this many times before taking any samples; ignored
+        if --benchmarks is not also specified.
+
+    --benchmark_min_samples=NUM [default = 3]:
+        Take at least this many samples (time permitting), so that the
+        reported percentiles are meaningful; ignored if --benchmarks is not
+        also specified.
+
+    --benchmark_per_call:
+        Time each call of the filter separately, rather than the mean of a
+        batch of calls, so that the percentiles describe single calls. This
+        adds timer overhead to each sample, so fast filters will look slower.
+
+    --benchmark_threads=N[,N...]:
+        After the usual benchmark, benchmark again with the Halide thread
+        pool limited to each of the given numbers of threads (via
+        halide_set_num_threads), and report the speedup and efficiency of
+        each relative to the first, e.g. --benchmark_threads=1,2,4,8. Ignored
+        if --benchmarks is not also specified.
+
+    --benchmark_concurrency=N[,N...]:
+        After the usual benchmark, measure throughput with each of the given
+        numbers of calls to the filter running at once, each on its own
+        thread and with its own outputs, and report the speedup and
+        efficiency of each relative to the first, e.g.
+        --benchmark_concurrency=1,2,4. If --benchmark_threads is also given,
+        this is done for each number of Halide threads. Ignored if
+        --benchmarks is not also specified.
+
+    --benchmark_size_sweep[=MIN_BYTES,MAX_BYTES] [default = 16K,256M]:
+        After the usual benchmark, benchmark again with a geometric series of
+        output sizes (each twice the bytes of the last) from MIN_BYTES to
+        MAX_BYTES, e.g. from L1-resident to DRAM-sized. The first two output
+        extents are scaled in proportion; the inputs for each size are
+        shaped by a bounds query and filled by repeating the given inputs.
+        Reports the time per output pixel and the effective bandwidth (bytes
+        of all inputs and outputs moved per second) at each size. Ignored if
+        --benchmarks is not also specified.
+
+    --benchmark_json=PATH:
+        Also write the benchmark results, including the time of each sample,
+        as JSON to the given file; ignored if --benchmarks is not also
+        specified.
+
     --track_memory:
         Override Halide memory allocator to track high-water mark of memory
         allocation during run; note that this may slow down execution, so
         benchmarks may be inaccurate if you combine --benchmark with this.
+        Also reports the number of allocations and the peak memory in each
+        call, a histogram of allocation sizes, and the largest allocations.
+
+    --track_memory_timeline=PATH:
+        Implies --track_memory, and also writes the memory allocated after
+        every Halide allocation and free (up to a million of them) to the
+        given file as CSV, for plotting memory use over time.
 
 Known Issues:
 
@@ -825,6 +737,39 @@ Known Issues:
     std::cout << replace_all(usage, "$NAME$", basename);
 }
 
+// Write the result of --benchmarks in a form that other tools can consume.
+void write_benchmark_json(const std::string &path, const char *name, double megapixels,
+                          const Halide::Tools::BenchmarkResult &result) {
+    std::ofstream f(path);
+    if (!f) {
+        fail() << "Unable to open " << path << " for writing";
+    }
+    const auto &stats = result.stats;
+    f << std::setprecision(9)
+      << "{\n"
+      << "  \"name\": \"" << name << "\",\n"
+      << "  \"megapixels\": " << megapixels << ",\n"
+      << "  \"samples\": " << result.samples << ",\n"
+      << "  \"iterations\": " << result.iterations << ",\n"
+      << "  \"accuracy\": " << result.accuracy << ",\n"
+      << "  \"min\": " << stats.min << ",\n"
+      << "  \"median\": " << stats.median << ",\n"
+      << "  \"p90\": " << stats.p90 << ",\n"
+      << "  \"p99\": " << stats.p99 << ",\n"
+      << "  \"max\": " << stats.max << ",\n"
+      << "  \"mean\": " << stats.mean << ",\n"
+      << "  \"stddev\": " << stats.stddev << ",\n"
+      << "  \"outliers\": " << stats.outliers << ",\n"
+      << "  \"sample_times\": [";
+    for (size_t i = 0; i < result.sample_times.size(); i++) {
+        f << (i ? ", " : "") << result.sample_times[i];
+    }
+    f << "]\n}\n";
+    if (!f) {
+        fail() << "Unable to write " << path;
+    }
+}
+
 void do_describe(const halide_filter_metadata_t *md) {
     std::cout << "Filter name: \"" << md->name << "\"\n";
     for (size_t i = 0; i < (size_t) md->num_arguments; ++i) {
@@ -901,10 +846,17 @@ int main(int argc, char **argv) {
     std::vector<std::string> unknown_args;
     bool benchmark = false;
     bool track_memory = false;
+    std::string track_memory_timeline;
     bool describe = false;
     double benchmark_min_time = BenchmarkConfig().min_time;
     int benchmark_min_iters = BenchmarkConfig().min_iters;
     int benchmark_max_iters = BenchmarkConfig().max_iters;
+    int benchmark_warmup_iters = BenchmarkConfig().warmup_iters;
+    int benchmark_min_samples = BenchmarkConfig().min_samples;
+    bool benchmark_per_call = false;
+    std::string benchmark_json;
+    std::vector<int> benchmark_threads, benchmark_concurrency;
+    uint64_t benchmark_sweep_min_bytes = 0, benchmark_sweep_max_bytes = 0;
     for (int i = 1; i < argc; ++i) {
         if (argv[i][0] == '-') {
             const char *p = argv[i] + 1; // skip -
@@ -945,6 +897,12 @@ int main(int argc, char **argv) {
                 if (!parse_scalar(flag_value, &track_memory)) {
                     fail() << "Invalid value for flag: " << flag_name;
                 }
+            } else if (flag_name == "track_memory_timeline") {
+                if (flag_value.empty()) {
+                    fail() << "Invalid value for flag: " << flag_name;
+                }
+                track_memory_timeline = flag_value;
+                track_memory = true;
             } else if (flag_name == "benchmarks") {
                 if (flag_value != "all") {
                     fail() << "The only valid value for --benchmarks is 'all'";
@@ -962,6 +920,43 @@ int main(int argc, char **argv) {
                 if (!parse_scalar(flag_value, &benchmark_max_iters)) {
                     fail() << "Invalid value for flag: " << flag_name;
                 }
+            } else if (flag_name == "benchmark_warmup_iters") {
+                if (!parse_scalar(flag_value, &benchmark_warmup_iters) || benchmark_warmup_iters < 0) {
+                    fail() << "Invalid value for flag: " << flag_name;
+                }
+            } else if (flag_name == "benchmark_min_samples") {
+                if (!parse_scalar(flag_value, &benchmark_min_samples) || benchmark_min_samples < 1) {
+                    fail() << "Invalid value for flag: " << flag_name;
+                }
+            } else if (flag_name == "benchmark_per_call") {
+                if (flag_value.empty()) {
+                    flag_value = "true";
+                }
+                if (!parse_scalar(flag_value, &benchmark_per_call)) {
+                    fail() << "Invalid value for flag: " << flag_name;
+                }
+            } else if (flag_name == "benchmark_json") {
+                if (flag_value.empty()) {
+                    fail() << "Invalid value for flag: " << flag_name;
+                }
+                benchmark_json = flag_value;
+            } else if (flag_name == "benchmark_threads") {
+                benchmark_threads = parse_int_list(flag_name, flag_value);
+            } else if (flag_name == "benchmark_concurrency") {
+                benchmark_concurrency = parse_int_list(flag_name, flag_value);
+            } else if (flag_name == "benchmark_size_sweep") {
+                if (flag_value.empty()) {
+                    flag_value = "16K,256M";
+                }
+                std::vector<std::string> range = split_string(flag_value, ",");
+                if (range.size() != 2) {
+                    fail() << "Invalid value for flag: " << flag_name;
+                }
+                benchmark_sweep_min_bytes = parse_size_in_bytes(flag_name, range[0]);
+                benchmark_sweep_max_bytes = parse_size_in_bytes(flag_name, range[1]);
+                if (benchmark_sweep_min_bytes > benchmark_sweep_max_bytes) {
+                    fail() << "Invalid value for flag: " << flag_name;
+                }
             } else if (flag_name == "output_extents") {
                 default_output_shape = parse_extents(flag_value);
             } else {
@@ -1092,26 +1087,14 @@ int main(int argc, char **argv) {
     // If we're tracking memory, install the memory tracker *after* doing a bounds query.
     HalideMemoryTracker tracker;
     if (track_memory) {
-        tracker.install();
+        tracker.install(!track_memory_timeline.empty());
     }
 
     {
-        std::vector<void*> filter_argv(args.size(), nullptr);
-        for (auto &arg_pair : args) {
-            auto &arg = arg_pair.second;
-            switch (arg.metadata->kind) {
-                case halide_argument_kind_input_scalar:
-                    filter_argv[arg.index] = &arg.scalar_value;
-                    break;
-                case halide_argument_kind_input_buffer:
-                case halide_argument_kind_output_buffer:
-                    filter_argv[arg.index] = arg.buffer_value.raw_buffer();
-                    break;
-            }
-        }
+        std::vector<void*> filter_argv = make_filter_argv(args);
 
         if (benchmark) {
-            const auto benchmark_inner = [&filter_argv, &args]() {
+            const auto benchmark_inner = [&filter_argv, &args, &tracker, track_memory]() {
                 // Ignore result since our halide_error() should catch everything.
                 (void) halide_rungen_redirect_argv(&filter_argv[0]);
                 // Ensure that all outputs are finished, otherwise we may just be
@@ -1123,6 +1106,9 @@ int main(int argc, char **argv) {
                         b.device_sync();
                     }
                 }
+                if (track_memory) {
+                    tracker.end_call();
+                }
             };
 
             info() << "Benchmarking filter...";
@@ -1132,18 +1118,163 @@ int main(int argc, char **argv) {
             config.max_time = benchmark_min_time * 4;
             config.min_iters = benchmark_min_iters;
             config.max_iters = benchmark_max_iters;
+            config.warmup_iters = benchmark_warmup_iters;
+            config.min_samples = benchmark_min_samples;
+            if (benchmark_per_call) {
+                config.max_iters_per_sample = 1;
+            }
             auto result = Halide::Tools::benchmark(benchmark_inner, config);
+            const auto &stats = result.stats;
 
             std::cout << "Benchmark for " << md->name << " produces best case of " << result.wall_time << " sec/iter (over "
                 << result.samples << " samples, "
                 << result.iterations << " iterations, "
                 << "accuracy " << std::setprecision(2) << (result.accuracy * 100.0) << "%).\n";
             std::cout << "Best output throughput is " << (megapixels / result.wall_time) << " mpix/sec.\n";
+            std::cout << std::setprecision(4)
+                << "Sample times (sec/iter): min " << stats.min
+                << ", median " << stats.median
+                << ", p90 " << stats.p90
+                << ", p99 " << stats.p99
+                << ", max " << stats.max << "\n"
+                << "Excluding " << stats.outliers << " outlier(s): mean " << stats.mean
+                << ", stddev " << stats.stddev
+                << " (" << std::setprecision(2) << (stats.mean > 0 ? stats.stddev / stats.mean * 100.0 : 0.0) << "%).\n";
+
+            if (!benchmark_json.empty()) {
+                write_benchmark_json(benchmark_json, md->name, megapixels, result);
+            }
+
+            if (!benchmark_threads.empty()) {
+                std::cout << "Thread scaling for " << md->name << " (relative to "
+                    << benchmark_threads[0] << " thread(s)):\n"
+                    << std::setw(10) << "threads" << std::setw(14) << "sec/iter"
+                    << std::setw(14) << "median" << std::setw(12) << "mpix/sec"
+                    << std::setw(10) << "speedup" << std::setw(12) << "efficiency" << "\n";
+                double base_time = 0;
+                for (int n : benchmark_threads) {
+                    int old_threads = halide_set_num_threads(n);
+                    auto r = Halide::Tools::benchmark(benchmark_inner, config);
+                    halide_set_num_threads(old_threads);
+                    if (base_time == 0) {
+                        base_time = r.wall_time;
+                    }
+                    double speedup = base_time / r.wall_time;
+                    std::cout << std::setprecision(4)
+                        << std::setw(10) << n << std::setw(14) << r.wall_time
+                        << std::setw(14) << r.stats.median << std::setw(12) << (megapixels / r.wall_time)
+                        << std::setw(10) << speedup
+                        << std::setw(12) << (speedup * benchmark_threads[0] / n) << "\n";
+                }
+            }
+
+            if (!benchmark_concurrency.empty()) {
+                // Run the filter for about min_time per measurement, based
+                // on the time of a single call from the benchmark above.
+                const uint64_t calls_per_thread =
+                    std::max((uint64_t) 1, (uint64_t) (benchmark_min_time / std::max(result.wall_time, 1e-9)));
+                std::vector<int> thread_counts = benchmark_threads;
+                if (thread_counts.empty()) {
+                    thread_counts.push_back(0);
+                }
+                for (int n : thread_counts) {
+                    int old_threads = n ? halide_set_num_threads(n) : 0;
+                    std::cout << "Throughput for " << md->name;
+                    if (n) {
+                        std::cout << " with " << n << " thread(s)";
+                    }
+                    std::cout << " (relative to " << benchmark_concurrency[0] << " concurrent call(s)):\n"
+                        << std::setw(12) << "concurrency" << std::setw(12) << "calls/sec"
+                        << std::setw(12) << "mpix/sec" << std::setw(10) << "speedup"
+                        << std::setw(12) << "efficiency" << "\n";
+                    double base_throughput = 0;
+                    for (int c : benchmark_concurrency) {
+                        double throughput = measure_throughput(args, c, calls_per_thread);
+                        if (base_throughput == 0) {
+                            base_throughput = throughput;
+                        }
+                        double speedup = throughput / base_throughput;
+                        std::cout << std::setprecision(4)
+                            << std::setw(12) << c << std::setw(12) << throughput
+                            << std::setw(12) << (megapixels * throughput) << std::setw(10) << speedup
+                            << std::setw(12) << (speedup * benchmark_concurrency[0] / c) << "\n";
+                    }
+                    if (n) {
+                        halide_set_num_threads(old_threads);
+                    }
+                }
+            }
+
+            if (benchmark_sweep_max_bytes) {
+                // Start from the shape of the outputs allocated above.
+                Shape base_shape;
+                uint64_t base_bytes = 0;
+                for (auto &arg_pair : args) {
+                    auto &arg = arg_pair.second;
+                    if (arg.metadata->kind == halide_argument_kind_output_buffer) {
+                        if (base_shape.empty()) {
+                            base_shape = get_shape(arg.buffer_value);
+                        }
+                        base_bytes += arg.buffer_value.size_in_bytes();
+                    }
+                }
+
+                std::cout << "Size sweep for " << md->name << ":\n"
+                    << std::setw(16) << "output extents" << std::setw(14) << "bytes moved"
+                    << std::setw(14) << "sec/iter" << std::setw(12) << "ns/pixel"
+                    << std::setw(10) << "GB/sec" << "\n";
+                for (uint64_t bytes = benchmark_sweep_min_bytes; bytes <= benchmark_sweep_max_bytes; bytes *= 2) {
+                    Shape output_shape = scale_output_extents(base_shape, base_bytes, bytes);
+                    std::map<std::string, ArgData> sweep_args = args;
+                    std::vector<Shape> sweep_shapes = run_bounds_query(sweep_args, output_shape);
+                    uint64_t bytes_moved = 0;
+                    for (auto &arg_pair : sweep_args) {
+                        auto &arg = arg_pair.second;
+                        const Shape &constrained_shape = sweep_shapes[arg.index];
+                        switch (arg.metadata->kind) {
+                            case halide_argument_kind_input_buffer:
+                                arg.buffer_value = tile_buffer(args[arg_pair.first].buffer_value,
+                                                               make_legal_output_buffer_shape(constrained_shape));
+                                bytes_moved += arg.buffer_value.size_in_bytes();
+                                break;
+                            case halide_argument_kind_output_buffer:
+                                arg.buffer_value = allocate_buffer(arg.metadata->type,
+                                                                   make_legal_output_buffer_shape(constrained_shape));
+                                bytes_moved += arg.buffer_value.size_in_bytes();
+                                break;
+                        }
+                    }
+                    std::vector<void*> sweep_argv = make_filter_argv(sweep_args);
+                    auto r = Halide::Tools::benchmark([&]() {
+                        (void) halide_rungen_redirect_argv(&sweep_argv[0]);
+                        for (auto &arg_pair : sweep_args) {
+                            auto &arg = arg_pair.second;
+                            if (arg.metadata->kind == halide_argument_kind_output_buffer) {
+                                arg.buffer_value.device_sync();
+                            }
+                        }
+                    }, config);
+
+                    std::ostringstream extents;
+                    extents << output_shape[0].extent;
+                    if (output_shape.size() > 1) {
+                        extents << "x" << output_shape[1].extent;
+                    }
+                    std::cout << std::setprecision(4)
+                        << std::setw(16) << extents.str() << std::setw(14) << bytes_moved
+                        << std::setw(14) << r.wall_time
+                        << std::setw(12) << (r.wall_time * 1e9 / calc_pixels_out(sweep_args))
+                        << std::setw(10) << (bytes_moved / r.wall_time * 1e-9) << "\n";
+                }
+            }
 
         } else {
             info() << "Running filter...";
             // Ignore result since our halide_error() should catch everything.
             (void) halide_rungen_redirect_argv(&filter_argv[0]);
+            if (track_memory) {
+                tracker.end_call();
+            }
         }
     }
 
@@ -1159,6 +1290,10 @@ int main(int argc, char **argv) {
         }
         std::cout << "Maximum Halide memory: " << tracker.highwater()
             << " bytes for output of " << megapixels << " mpix.\n";
+        tracker.report(std::cout);
+        if (!track_memory_timeline.empty()) {
+            tracker.write_timeline(track_memory_timeline);
+        }
     }
 
     // Save the output(s), if necessary.
@@ -0,0 +1,438 @@
+#ifndef HALIDE_RUNGEN_H
+#define HALIDE_RUNGEN_H
+
+// Helpers shared by the drivers for AOT-compiled filters in RunGen.cpp
+// and RunGenBatch.cpp: parsing of flag values and scalars, and the
+// shapes to give the buffers of a filter, given a bounds query.
+
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Halide {
+namespace RunGen {
+
+using Halide::Runtime::Buffer;
+
+// Buffer<> uses "shape" to mean "array of halide_dimension_t", but doesn't
+// provide a typedef for it (and doesn't use a vector for it in any event).
+using Shape = std::vector<halide_dimension_t>;
+
+// Standard stream output for halide_type_t
+inline std::ostream &operator<<(std::ostream &stream, const halide_type_t &type) {
+    if (type.code == halide_type_uint && type.bits == 1) {
+        stream << "bool";
+    } else {
+        switch (type.code) {
+        case halide_type_int:
+            stream << "int";
+            break;
+        case halide_type_uint:
+            stream << "uint";
+            break;
+        case halide_type_float:
+            stream << "float";
+            break;
+        case halide_type_handle:
+            stream << "handle";
+            break;
+        default:
+            stream << "#unknown";
+            break;
+        }
+        stream << std::to_string(type.bits);
+    }
+    if (type.lanes > 1) {
+        stream << "x" + std::to_string(type.lanes);
+    }
+    return stream;
+}
+
+// Standard stream output for halide_dimension_t
+inline std::ostream &operator<<(std::ostream &stream, const halide_dimension_t &d) {
+    stream << "[" << d.min << "," << d.extent << "," << d.stride << "]";
+    return stream;
+}
+
+// Standard stream output for vector<halide_dimension_t>
+inline std::ostream &operator<<(std::ostream &stream, const Shape &shape) {
+    stream << "[";
+    bool need_comma = false;
+    for (auto &d : shape) {
+        if (need_comma) {
+            stream << ',';
+        }
+        stream << d;
+        need_comma = true;
+    }
+    stream << "]";
+    return stream;
+}
+
+// Log warnings to stderr
+struct warn {
+    std::ostringstream msg;
+
+    template<typename T>
+    warn &operator<<(const T &x) {
+        msg << x;
+        return *this;
+    }
+
+    ~warn() {
+        std::cerr << "Warning: " << msg.str();
+        if (msg.str().back() != '\n') {
+            std::cerr << '\n';
+        }
+    }
+};
+
+// Log unrecoverable errors to stderr, then exit
+struct fail {
+    std::ostringstream msg;
+
+    template<typename T>
+    fail &operator<<(const T &x) {
+        msg << x;
+        return *this;
+    }
+
+    #ifdef _MSC_VER
+    #pragma warning(push)
+    #pragma warning(disable:4722)  // destructor never returns, potential memory leak
+    #endif
+    ~fail() {
+        std::cerr << msg.str();
+        if (msg.str().back() != '\n') {
+            std::cerr << '\n';
+        }
+        exit(1);
+    }
+    #ifdef _MSC_VER
+    #pragma warning(pop)
+    #endif
+};
+
+// Split a string at each occurrence of the delimiter.
+inline std::vector<std::string> split_string(const std::string &source,
+                                             const std::string &delim) {
+    std::vector<std::string> elements;
+    size_t start = 0;
+    size_t found = 0;
+    while ((found = source.find(delim, start)) != std::string::npos) {
+        elements.push_back(source.substr(start, found - start));
+        start = found + delim.size();
+    }
+
+    // If start is exactly source.size(), the last thing in source is a
+    // delimiter, in which case we want to add an empty std::string to elements.
+    if (start <= source.size()) {
+        elements.push_back(source.substr(start, std::string::npos));
+    }
+    return elements;
+}
+
+// Must be constexpr to allow use in case clauses.
+inline constexpr int halide_type_code(halide_type_code_t code, int bits) {
+    return (((int) code) << 8) | bits;
+}
+
+// dynamic_type_dispatch is a utility for functors that want to be able
+// to dynamically dispatch a halide_type_t to type-specialized code.
+// To use it, a functor must be a *templated* class, e.g.
+//
+//     template<typename T> class MyFunctor { int operator()(arg1, arg2...); };
+//
+// dynamic_type_dispatch() is called with a halide_type_t as the first argument,
+// followed by the arguments to the Functor's operator():
+//
+//     auto result = dynamic_type_dispatch<MyFunctor>(some_halide_type, arg1, arg2);
+//
+// Note that this means that the functor must be able to instantiate its
+// operator() for all the Halide scalar types; it also means that all those
+// variants *will* be instantiated (increasing code size), so this approach
+// should only be used when strictly necessary.
+template<template<typename> class Functor, typename... Args>
+auto dynamic_type_dispatch(const halide_type_t &type, Args&&... args) ->
+    decltype(std::declval<Functor<uint8_t>>()(std::forward<Args>(args)...)) {
+
+#define HANDLE_CASE(CODE, BITS, TYPE) \
+    case halide_type_code(CODE, BITS): return Functor<TYPE>()(std::forward<Args>(args)...);
+    switch (halide_type_code((halide_type_code_t) type.code, type.bits)) {
+        HANDLE_CASE(halide_type_float, 32, float)
+        HANDLE_CASE(halide_type_float, 64, double)
+        HANDLE_CASE(halide_type_int, 8, int8_t)
+        HANDLE_CASE(halide_type_int, 16, int16_t)
+        HANDLE_CASE(halide_type_int, 32, int32_t)
+        HANDLE_CASE(halide_type_int, 64, int64_t)
+        HANDLE_CASE(halide_type_uint, 1, bool)
+        HANDLE_CASE(halide_type_uint, 8, uint8_t)
+        HANDLE_CASE(halide_type_uint, 16, uint16_t)
+        HANDLE_CASE(halide_type_uint, 32, uint32_t)
+        HANDLE_CASE(halide_type_uint, 64, uint64_t)
+        HANDLE_CASE(halide_type_handle, 64, void*)
+        default:
+            fail() << "Unsupported type: " << type << "\n";
+            using ReturnType = decltype(std::declval<Functor<uint8_t>>()(std::forward<Args>(args)...));
+            return ReturnType();
+    }
+#undef HANDLE_CASE
+}
+
+// Functor to parse a string into one of the known Halide scalar types.
+template<typename T>
+struct ScalarParser {
+    bool operator()(const std::string &str, halide_scalar_value_t *v) {
+        std::istringstream iss(str);
+        // std::setbase(0) means "infer base from input", and allows hex and octal constants
+        iss >> std::setbase(0) >> *(T*)v;
+        return !iss.fail() && iss.get() == EOF;
+    }
+};
+
+// Override for int8 and uint8, to avoid parsing as char variants
+template<>
+inline bool ScalarParser<int8_t>::operator()(const std::string &str, halide_scalar_value_t *v) {
+    std::istringstream iss(str);
+    int i;
+    iss >> std::setbase(0) >> i;
+    if (!(!iss.fail() && iss.get() == EOF) || i < -128 || i > 127) {
+      return false;
+    }
+    v->u.i8 = (int8_t) i;
+    return true;
+}
+
+template<>
+inline bool ScalarParser<uint8_t>::operator()(const std::string &str, halide_scalar_value_t *v) {
+    std::istringstream iss(str);
+    unsigned int u;
+    iss >> std::setbase(0) >> u;
+    if (!(!iss.fail() && iss.get() == EOF) || u > 255) {
+      return false;
+    }
+    v->u.u8 = (uint8_t) u;
+    return true;
+}
+
+// Override for bool, since istream just expects '1' or '0'.
+template<>
+inline bool ScalarParser<bool>::operator()(const std::string &str, halide_scalar_value_t *v) {
+    if (str == "true") {
+        v->u.b = true;
+        return true;
+    }
+    if (str == "false") {
+        v->u.b = false;
+        return true;
+    }
+    return false;
+}
+
+// Override for handle, since we only accept "nullptr".
+template<>
+inline bool ScalarParser<void*>::operator()(const std::string &str, halide_scalar_value_t *v) {
+    if (str == "nullptr") {
+        v->u.handle = nullptr;
+        return true;
+    }
+    return false;
+}
+
+// Parse a scalar when we know the corresponding C++ type at compile time.
+template<typename T>
+bool parse_scalar(const std::string &str, T *scalar) {
+    return ScalarParser<T>()(str, (halide_scalar_value_t *) scalar);
+}
+
+// Dynamic-dispatch wrapper around ScalarParser.
+inline bool parse_scalar(const halide_type_t &type,
+                         const std::string &str,
+                         halide_scalar_value_t *scalar) {
+    return dynamic_type_dispatch<ScalarParser>(type, str, scalar);
+}
+
+// Parse an extent list, which should be of the form
+//
+//    [extent0, extent1...]
+//
+// Return a vector<halide_dimension_t> (aka a "shape") with the extents filled in,
+// but with the min of each dimension set to zero and the stride set to the
+// planar-default value.
+inline Shape parse_extents(const std::string &extent_list) {
+    if (extent_list.empty() || extent_list[0] != '[' || extent_list.back() != ']') {
+        fail() << "Invalid format for extents: " << extent_list;
+    }
+    Shape result;
+    std::vector<std::string> extents = split_string(extent_list.substr(1, extent_list.size()-2), ",");
+    for (size_t i = 0; i < extents.size(); i++) {
+      const std::string &s = extents[i];
+        const int stride = (i == 0) ? 1 : result[i-1].stride * result[i-1].extent;
+        halide_dimension_t d = {0, 0, stride};
+        if (!parse_scalar(s, &d.extent)) {
+            fail() << "Invalid value for extents: " << s << " (" << extent_list << ")";
+        }
+        result.push_back(d);
+    }
+    return result;
+}
+
+// Parse a comma-separated list of positive integers, e.g. "1,2,4,8".
+inline std::vector<int> parse_int_list(const std::string &flag_name, const std::string &list) {
+    std::vector<int> result;
+    for (const std::string &s : split_string(list, ",")) {
+        int i = 0;
+        if (!parse_scalar(s, &i) || i < 1) {
+            fail() << "Invalid value for flag: " << flag_name << " (" << list << ")";
+        }
+        result.push_back(i);
+    }
+    return result;
+}
+
+// Parse a size in bytes with an optional K, M or G suffix, e.g. "256K".
+inline uint64_t parse_size_in_bytes(const std::string &flag_name, const std::string &str) {
+    std::string digits = str;
+    uint64_t scale = 1;
+    if (!digits.empty()) {
+        switch (digits.back()) {
+        case 'K': case 'k': scale = 1 << 10; break;
+        case 'M': case 'm': scale = 1 << 20; break;
+        case 'G': case 'g': scale = 1 << 30; break;
+        }
+        if (scale != 1) {
+            digits.pop_back();
+        }
+    }
+    uint64_t size = 0;
+    if (!parse_scalar(digits, &size) || size == 0) {
+        fail() << "Invalid value for flag: " << flag_name << " (" << str << ")";
+    }
+    return size * scale;
+}
+
+// Given a Buffer<>, return its shape in the form of a vector<halide_dimension_t>.
+// (Oddly, Buffer<> has no API to do this directly.)
+inline Shape get_shape(const Buffer<> &b) {
+    Shape s;
+    for (int i = 0; i < b.dimensions(); ++i) {
+        s.push_back(b.raw_buffer()->dim[i]);
+    }
+    return s;
+}
+
+// Given a type and shape, create a new Buffer<> but *don't* allocate allocate storage for it.
+inline Buffer<> make_with_shape(const halide_type_t &type, const Shape &shape) {
+    return Buffer<>(type, nullptr, (int) shape.size(), &shape[0]);
+}
+
+// Given a type and shape, create a new Buffer<> and allocate storage for it.
+// (Oddly, Buffer<> has an API to do this with vector-of-extent, but not vector-of-halide_dimension_t.)
+inline Buffer<> allocate_buffer(const halide_type_t &type, const Shape &shape) {
+    Buffer<> b = make_with_shape(type, shape);
+    b.check_overflow();
+    b.allocate();
+    return b;
+}
+
+// BEGIN TODO: hacky algorithm inspired by Safelight
+// (should really use the algorithm from AddImageChecks to come up with something more rigorous.)
+inline Shape choose_output_extents(int dimensions, const Shape &defaults) {
+    Shape s(dimensions);
+    for (int i = 0; i < dimensions; ++i) {
+        if ((size_t) i < defaults.size()) {
+            s[i] = defaults[i];
+            continue;
+        }
+        s[i].extent = (i < 2 ? 1000 : 4);
+    }
+    return s;
+}
+
+inline void fix_chunky_strides(const Shape &constrained_shape, Shape *new_shape) {
+    // Special-case Chunky: most "chunky" generators tend to constrain stride[0]
+    // and stride[2] to exact values, leaving stride[1] unconstrained;
+    // in practice, we must ensure that stride[1] == stride[0] * extent[0]
+    // and stride[0] = extent[2] to get results that are not garbled.
+    // This is unpleasantly hacky and will likely need aditional enhancements.
+    // (Note that there are, theoretically, other stride combinations that might
+    // need fixing; in practice, ~all generators that aren't planar tend
+    // to be classically chunky.)
+    if (new_shape->size() >= 3) {
+        if (constrained_shape[2].stride == 1) {
+            if (constrained_shape[0].stride >= 1) {
+                // If we have stride[0] and stride[2] set to obviously-chunky,
+                // then force extent[2] to match stride[0].
+                (*new_shape)[2].extent = constrained_shape[0].stride;
+            } else {
+                // If we have stride[2] == 1 but stride[0] < 1,
+                // force stride[0] = extent[2]
+                (*new_shape)[0].stride = (*new_shape)[2].extent;
+            }
+            // Ensure stride[1] is reasonable.
+            (*new_shape)[1].stride = (*new_shape)[0].extent * (*new_shape)[0].stride;
+        }
+    }
+}
+
+// Given a constraint Shape (generally produced by a bounds query), create a new
+// Shape that can legally be used to create and allocate a new Buffer:
+// ensure that extents/strides aren't zero, do some reality checking
+// on planar vs interleaved, and generally try to guess at a reasonable result.
+inline Shape make_legal_output_buffer_shape(const Shape &constrained_shape) {
+    Shape new_shape = constrained_shape;
+
+    // Make sure that the extents and strides for these are nonzero.
+    for (size_t i = 0; i < new_shape.size(); ++i) {
+        if (!new_shape[i].extent) {
+            // A bit of a hack: fill in unconstrained dimensions to 1... except
+            // for probably-the-channels dimension, which we'll special-case to
+            // fill in to 4 when possible (unless it appears to be chunky).
+            // Stride will be fixed below.
+            if (i == 2) {
+                if (constrained_shape[0].stride >= 1 && constrained_shape[2].stride == 1) {
+                    // Definitely chunky, so make extent[2] match the chunk size
+                    new_shape[i].extent = constrained_shape[0].stride;
+                } else {
+                    // Not obviously chunky; let's go with 4 channels.
+                    new_shape[i].extent = 4;
+                }
+            } else {
+                new_shape[i].extent = 1;
+            }
+        }
+    }
+
+    fix_chunky_strides(constrained_shape, &new_shape);
+
+    // If anything else is zero, just set strides to planar and hope for the best.
+    bool any_strides_zero = false;
+    for (size_t i = 0; i < new_shape.size(); ++i) {
+        if (!new_shape[i].stride) {
+            any_strides_zero = true;
+        }
+    }
+    if (any_strides_zero) {
+        // Planar
+        new_shape[0].stride = 1;
+        for (size_t i = 1; i < new_shape.size(); ++i) {
+            new_shape[i].stride = new_shape[i - 1].stride * new_shape[i - 1].extent;
+        }
+    }
+    return new_shape;
+}
+// END TODO: hacky algorithm inspired by Safelight
+
+}  // namespace RunGen
+}  // namespace Halide
+
+#endif  // HALIDE_RUNGEN_H
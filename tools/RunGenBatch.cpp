@@ -0,0 +1,655 @@
+// A driver that benchmarks several AOT-compiled filters in one run, for
+// tracking performance regressions across a set of pipelines. Each
+// filter is linked in via its own copy of RunGenBatchStubs.cpp.
+//
+// Each filter is run with its outputs at the extents given by
+// --output_extents (by default 1000x1000, with 4 for any further
+// dimensions), its inputs shaped by a bounds query and zero-filled, and
+// its scalar inputs at their default values (or zero if there is none).
+// The results can be written to a JSON report, and compared against a
+// report from an earlier run.
+
+#include "HalideRuntime.h"
+#include "HalideBuffer.h"
+#include "halide_benchmark.h"
+#include "RunGen.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace Halide::RunGen;
+
+namespace {
+
+using Halide::Tools::BenchmarkConfig;
+
+typedef int (*ArgvFunction)(void **);
+typedef const halide_filter_metadata_t *(*MetadataFunction)();
+
+struct Filter {
+    ArgvFunction argv;
+    MetadataFunction metadata;
+};
+
+std::vector<Filter> &registered_filters() {
+    static std::vector<Filter> filters;
+    return filters;
+}
+
+// The results of benchmarking one filter (in seconds), as they appear in
+// the report.
+struct FilterResult {
+    std::string name;
+    double megapixels{0};
+    uint64_t samples{0};
+    double min{0}, median{0}, p90{0}, p99{0}, stddev{0};
+};
+
+// Set by our halide_error() handler, so that a failing filter can be
+// reported and skipped rather than ending the run.
+std::string last_error;
+
+void batch_halide_error(void *user_context, const char *message) {
+    last_error = message;
+}
+
+// Benchmark one filter. Returns false (after saying why) if it could not
+// be run.
+bool run_filter(const Filter &filter, const Shape &default_output_shape,
+                const BenchmarkConfig &config, FilterResult *result) {
+    const halide_filter_metadata_t *md = filter.metadata();
+    const int n = md->num_arguments;
+    result->name = md->name;
+
+    std::vector<void *> filter_argv(n, nullptr);
+    std::vector<halide_scalar_value_t> scalars(n);
+    std::vector<Buffer<>> buffers(n);
+
+    // Run a bounds query with all the buffers unallocated, and the
+    // inputs unconstrained.
+    for (int i = 0; i < n; i++) {
+        const halide_filter_argument_t &arg = md->arguments[i];
+        switch (arg.kind) {
+        case halide_argument_kind_input_scalar:
+            if (arg.def) {
+                scalars[i] = *arg.def;
+            } else if (arg.min) {
+                scalars[i] = *arg.min;
+            }
+            filter_argv[i] = &scalars[i];
+            break;
+        case halide_argument_kind_input_buffer:
+            buffers[i] = make_with_shape(arg.type, Shape(arg.dimensions, halide_dimension_t{0, 0, 0}));
+            filter_argv[i] = buffers[i].raw_buffer();
+            break;
+        case halide_argument_kind_output_buffer:
+            buffers[i] = make_with_shape(arg.type, choose_output_extents(arg.dimensions, default_output_shape));
+            filter_argv[i] = buffers[i].raw_buffer();
+            break;
+        }
+    }
+    last_error.clear();
+    if (filter.argv(filter_argv.data()) != 0) {
+        std::cerr << md->name << ": bounds query failed: " << last_error << "\n";
+        return false;
+    }
+
+    // Allocate every buffer as RunGen allocates the outputs, and
+    // zero-fill the inputs.
+    uint64_t pixels_out = 0;
+    for (int i = 0; i < n; i++) {
+        const halide_filter_argument_t &arg = md->arguments[i];
+        if (arg.kind == halide_argument_kind_input_scalar) {
+            continue;
+        }
+        buffers[i] = allocate_buffer(arg.type, make_legal_output_buffer_shape(get_shape(buffers[i])));
+        filter_argv[i] = buffers[i].raw_buffer();
+        if (arg.kind == halide_argument_kind_input_buffer) {
+            memset(buffers[i].data(), 0, buffers[i].size_in_bytes());
+        } else {
+            uint64_t pixels = 1;
+            for (int d = 0; d < std::min(arg.dimensions, 2); d++) {
+                pixels *= buffers[i].dim(d).extent();
+            }
+            pixels_out += pixels;
+        }
+    }
+    result->megapixels = (double) pixels_out / (1024.0 * 1024.0);
+
+    bool failed = false;
+    auto r = Halide::Tools::benchmark([&]() {
+        if (failed || filter.argv(filter_argv.data()) != 0) {
+            failed = true;
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            if (md->arguments[i].kind == halide_argument_kind_output_buffer) {
+                buffers[i].device_sync();
+            }
+        }
+    }, config);
+    if (failed) {
+        std::cerr << md->name << ": " << last_error << "\n";
+        return false;
+    }
+
+    result->samples = r.samples;
+    result->min = r.stats.min;
+    result->median = r.stats.median;
+    result->p90 = r.stats.p90;
+    result->p99 = r.stats.p99;
+    result->stddev = r.stats.stddev;
+    return true;
+}
+
+// Quote a string for JSON.
+std::string json_string(const std::string &str) {
+    std::ostringstream o;
+    o << '"';
+    for (char c : str) {
+        switch (c) {
+        case '"': o << "\\\""; break;
+        case '\\': o << "\\\\"; break;
+        case '\n': o << "\\n"; break;
+        case '\r': o << "\\r"; break;
+        case '\t': o << "\\t"; break;
+        default:
+            if ((unsigned char) c < 0x20) {
+                o << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int) c << std::dec;
+            } else {
+                o << c;
+            }
+        }
+    }
+    o << '"';
+    return o.str();
+}
+
+void write_report(std::ostream &o, const std::vector<FilterResult> &results) {
+    o << std::setprecision(9) << "{\n  \"filters\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const FilterResult &r = results[i];
+        o << "    {\"name\": " << json_string(r.name)
+          << ", \"megapixels\": " << r.megapixels
+          << ", \"samples\": " << r.samples
+          << ", \"min\": " << r.min
+          << ", \"median\": " << r.median
+          << ", \"p90\": " << r.p90
+          << ", \"p99\": " << r.p99
+          << ", \"stddev\": " << r.stddev
+          << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    o << "  ]\n}\n";
+}
+
+// Just enough of JSON to read a report back in, whatever its layout:
+// baselines may have been reformatted or written by other tools.
+struct JsonValue {
+    enum Kind { Null, Bool, Number, String, Array, Object } kind{Null};
+    bool boolean{false};
+    double number{0};
+    std::string str;
+    std::vector<JsonValue> array;
+    std::map<std::string, JsonValue> object;
+
+    // Return the member with the given key and kind, or nullptr.
+    const JsonValue *find(const std::string &key, Kind k) const {
+        auto it = object.find(key);
+        return (it != object.end() && it->second.kind == k) ? &it->second : nullptr;
+    }
+};
+
+class JsonParser {
+    const std::string &text;
+    size_t pos{0};
+    int depth{0};
+
+    static constexpr int kMaxDepth = 64;
+
+    void skip_whitespace() {
+        while (pos < text.size() && strchr(" \t\r\n", text[pos])) {
+            pos++;
+        }
+    }
+
+    bool consume(char c) {
+        skip_whitespace();
+        if (pos < text.size() && text[pos] == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    bool consume_word(const char *word) {
+        size_t len = strlen(word);
+        if (text.compare(pos, len, word) == 0) {
+            pos += len;
+            return true;
+        }
+        return false;
+    }
+
+    // Append a code point as UTF-8.
+    static void append_utf8(uint32_t c, std::string *s) {
+        if (c < 0x80) {
+            *s += (char) c;
+        } else if (c < 0x800) {
+            *s += (char) (0xc0 | (c >> 6));
+            *s += (char) (0x80 | (c & 0x3f));
+        } else {
+            *s += (char) (0xe0 | (c >> 12));
+            *s += (char) (0x80 | ((c >> 6) & 0x3f));
+            *s += (char) (0x80 | (c & 0x3f));
+        }
+    }
+
+    bool parse_string(std::string *s) {
+        if (!consume('"')) {
+            return false;
+        }
+        while (pos < text.size()) {
+            char c = text[pos++];
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                *s += c;
+                continue;
+            }
+            if (pos >= text.size()) {
+                return false;
+            }
+            c = text[pos++];
+            switch (c) {
+            case '"': case '\\': case '/': *s += c; break;
+            case 'b': *s += '\b'; break;
+            case 'f': *s += '\f'; break;
+            case 'n': *s += '\n'; break;
+            case 'r': *s += '\r'; break;
+            case 't': *s += '\t'; break;
+            case 'u': {
+                if (pos + 4 > text.size()) {
+                    return false;
+                }
+                uint32_t code = 0;
+                for (int i = 0; i < 4; i++) {
+                    char h = text[pos++];
+                    code <<= 4;
+                    if (h >= '0' && h <= '9') {
+                        code |= h - '0';
+                    } else if (h >= 'a' && h <= 'f') {
+                        code |= h - 'a' + 10;
+                    } else if (h >= 'A' && h <= 'F') {
+                        code |= h - 'A' + 10;
+                    } else {
+                        return false;
+                    }
+                }
+                append_utf8(code, s);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool parse_number(double *d) {
+        // strtod() accepts more than JSON does (e.g. "inf"), so check
+        // how the number starts first.
+        if (pos >= text.size() || !(text[pos] == '-' || isdigit((unsigned char) text[pos]))) {
+            return false;
+        }
+        const char *start = text.c_str() + pos;
+        char *end = nullptr;
+        *d = strtod(start, &end);
+        if (end == start) {
+            return false;
+        }
+        pos += end - start;
+        return true;
+    }
+
+    bool parse_value(JsonValue *v) {
+        skip_whitespace();
+        if (pos >= text.size() || depth > kMaxDepth) {
+            return false;
+        }
+        switch (text[pos]) {
+        case '{': {
+            v->kind = JsonValue::Object;
+            pos++;
+            depth++;
+            if (consume('}')) {
+                break;
+            }
+            do {
+                std::string key;
+                skip_whitespace();
+                if (!parse_string(&key) || !consume(':') || !parse_value(&v->object[key])) {
+                    return false;
+                }
+            } while (consume(','));
+            if (!consume('}')) {
+                return false;
+            }
+            break;
+        }
+        case '[': {
+            v->kind = JsonValue::Array;
+            pos++;
+            depth++;
+            if (consume(']')) {
+                break;
+            }
+            do {
+                v->array.emplace_back();
+                if (!parse_value(&v->array.back())) {
+                    return false;
+                }
+            } while (consume(','));
+            if (!consume(']')) {
+                return false;
+            }
+            break;
+        }
+        case '"':
+            v->kind = JsonValue::String;
+            return parse_string(&v->str);
+        case 't':
+        case 'f':
+            v->kind = JsonValue::Bool;
+            v->boolean = (text[pos] == 't');
+            return consume_word(v->boolean ? "true" : "false");
+        case 'n':
+            v->kind = JsonValue::Null;
+            return consume_word("null");
+        default:
+            v->kind = JsonValue::Number;
+            return parse_number(&v->number);
+        }
+        depth--;
+        return true;
+    }
+
+  public:
+    explicit JsonParser(const std::string &text) : text(text) {}
+
+    // Parse the whole text as a single value.
+    bool parse(JsonValue *v) {
+        if (!parse_value(v)) {
+            return false;
+        }
+        skip_whitespace();
+        return pos == text.size();
+    }
+};
+
+/* static */ constexpr int JsonParser::kMaxDepth;
+
+// Read the median and standard deviation of each filter from a report
+// written by write_report(). Fields may come in any order, and fields
+// we don't know about are ignored.
+bool read_report(const std::string &path, std::map<std::string, FilterResult> *results) {
+    std::ifstream f(path);
+    if (!f) {
+        std::cerr << "Unable to open " << path << "\n";
+        return false;
+    }
+    std::stringstream contents;
+    contents << f.rdbuf();
+
+    JsonValue report;
+    if (!JsonParser(contents.str()).parse(&report)) {
+        std::cerr << path << " is not valid JSON\n";
+        return false;
+    }
+    const JsonValue *filters = report.find("filters", JsonValue::Array);
+    if (!filters) {
+        std::cerr << path << " has no \"filters\" array\n";
+        return false;
+    }
+    for (const JsonValue &entry : filters->array) {
+        const JsonValue *name = entry.find("name", JsonValue::String);
+        const JsonValue *median = entry.find("median", JsonValue::Number);
+        const JsonValue *stddev = entry.find("stddev", JsonValue::Number);
+        if (!name || !median) {
+            warn() << "Ignoring a filter without a name and median in " << path;
+            continue;
+        }
+        FilterResult &r = (*results)[name->str];
+        r.name = name->str;
+        r.median = median->number;
+        r.stddev = stddev ? stddev->number : 0;
+    }
+    return true;
+}
+
+// Compare the results with a baseline, and return the number of filters
+// that got slower. A filter counts as slower only if its median time
+// grew by more than 'threshold' (as a fraction of the baseline) *and*
+// by more than 'noise_sigmas' times the combined standard deviation of
+// the two runs.
+int compare_with_baseline(const std::vector<FilterResult> &results,
+                          const std::map<std::string, FilterResult> &baseline,
+                          double threshold, double noise_sigmas) {
+    int regressions = 0;
+    std::cout << std::left << std::setw(32) << "filter" << std::right
+              << std::setw(14) << "baseline" << std::setw(14) << "median"
+              << std::setw(10) << "change" << "  status\n";
+    for (const FilterResult &r : results) {
+        std::cout << std::left << std::setw(32) << r.name << std::right << std::setprecision(4);
+        auto it = baseline.find(r.name);
+        if (it == baseline.end()) {
+            std::cout << std::setw(14) << "-" << std::setw(14) << r.median << std::setw(10) << "-" << "  new\n";
+            continue;
+        }
+        const FilterResult &b = it->second;
+        const double delta = r.median - b.median;
+        const double change = b.median > 0 ? delta / b.median : 0;
+        const double noise = noise_sigmas * std::sqrt(r.stddev * r.stddev + b.stddev * b.stddev);
+        const char *status = "ok";
+        if (change > threshold && delta > noise) {
+            status = "SLOWER";
+            regressions++;
+        } else if (change < -threshold && -delta > noise) {
+            status = "faster";
+        }
+        std::ostringstream percent;
+        percent << std::showpos << std::fixed << std::setprecision(1) << change * 100 << "%";
+        std::cout << std::setw(14) << b.median << std::setw(14) << r.median
+                  << std::setw(10) << percent.str() << "  " << status << "\n";
+    }
+    for (const auto &b : baseline) {
+        bool found = false;
+        for (const FilterResult &r : results) {
+            found |= (r.name == b.first);
+        }
+        if (!found) {
+            std::cout << std::left << std::setw(32) << b.first << std::right << "  missing\n";
+        }
+    }
+    return regressions;
+}
+
+void usage(const char *argv0) {
+    std::cout << "Usage: " << argv0 << R"USAGE( [flags]
+
+Benchmarks each of the filters linked into this binary, and optionally
+compares the results with a report from an earlier run. Exits with a
+nonzero status if any filter fails or got slower than the baseline.
+
+Flags:
+
+    --list:
+        Print the names of the filters and exit.
+
+    --filters=NAME[,NAME...]:
+        Benchmark only the given filters.
+
+    --output_extents=[W,H,...] [default = [1000,1000,4,...]]:
+        The extents of the outputs of every filter.
+
+    --benchmark_min_time=DURATION_SECONDS [default = 0.1]:
+    --benchmark_min_samples=NUM [default = 10]:
+        As for RunGen.
+
+    --report=PATH:
+        Write the results to the given file as JSON.
+
+    --baseline=PATH:
+        Compare the results with a report written by an earlier run.
+
+    --threshold=FRACTION [default = 0.05]:
+    --noise_sigmas=NUM [default = 2]:
+        A filter counts as slower than the baseline only if its median time
+        grew by more than the given fraction *and* by more than the given
+        number of standard deviations (of both runs combined).
+)USAGE";
+}
+
+}  // namespace
+
+extern "C" int halide_rungen_batch_register(ArgvFunction argv, MetadataFunction metadata) {
+    registered_filters().push_back({argv, metadata});
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> only_filters;
+    Shape default_output_shape;
+    double benchmark_min_time = BenchmarkConfig().min_time;
+    int benchmark_min_samples = 10;
+    std::string report_path, baseline_path;
+    double threshold = 0.05, noise_sigmas = 2;
+    bool list = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            usage(argv[0]);
+            fail() << "Invalid argument: " << argv[i];
+        }
+        const char *p = argv[i] + 1;  // skip -
+        if (p[0] == '-') {
+            p++;  // allow -- as well, as RunGen does
+        }
+        std::vector<std::string> v = split_string(p, "=");
+        std::string flag_name = v[0];
+        std::string flag_value = v.size() > 1 ? v[1] : "";
+        if (v.size() > 2) {
+            fail() << "Invalid argument: " << argv[i];
+        }
+        if (flag_name == "list") {
+            if (flag_value.empty()) {
+                flag_value = "true";
+            }
+            if (!parse_scalar(flag_value, &list)) {
+                fail() << "Invalid value for flag: " << flag_name;
+            }
+        } else if (flag_name == "filters") {
+            only_filters = split_string(flag_value, ",");
+            for (const std::string &name : only_filters) {
+                auto matches = [&](const Filter &f) { return name == f.metadata()->name; };
+                if (std::none_of(registered_filters().begin(), registered_filters().end(), matches)) {
+                    fail() << "Unknown filter: " << name << " (use --list to see the filters)";
+                }
+            }
+        } else if (flag_name == "output_extents") {
+            default_output_shape = parse_extents(flag_value);
+        } else if (flag_name == "benchmark_min_time") {
+            if (!parse_scalar(flag_value, &benchmark_min_time) || !(benchmark_min_time > 0)) {
+                fail() << "Invalid value for flag: " << flag_name;
+            }
+        } else if (flag_name == "benchmark_min_samples") {
+            if (!parse_scalar(flag_value, &benchmark_min_samples) || benchmark_min_samples < 1) {
+                fail() << "Invalid value for flag: " << flag_name;
+            }
+        } else if (flag_name == "report") {
+            if (flag_value.empty()) {
+                fail() << "Invalid value for flag: " << flag_name;
+            }
+            report_path = flag_value;
+        } else if (flag_name == "baseline") {
+            if (flag_value.empty()) {
+                fail() << "Invalid value for flag: " << flag_name;
+            }
+            baseline_path = flag_value;
+        } else if (flag_name == "threshold") {
+            if (!parse_scalar(flag_value, &threshold) || !(threshold >= 0)) {
+                fail() << "Invalid value for flag: " << flag_name;
+            }
+        } else if (flag_name == "noise_sigmas") {
+            if (!parse_scalar(flag_value, &noise_sigmas) || !(noise_sigmas >= 0)) {
+                fail() << "Invalid value for flag: " << flag_name;
+            }
+        } else {
+            usage(argv[0]);
+            fail() << "Unknown flag: " << flag_name;
+        }
+    }
+
+    if (list) {
+        for (const Filter &f : registered_filters()) {
+            std::cout << f.metadata()->name << "\n";
+        }
+        return 0;
+    }
+
+    BenchmarkConfig config;
+    config.min_time = benchmark_min_time;
+    config.max_time = benchmark_min_time * 4;
+    config.min_samples = benchmark_min_samples;
+
+    std::map<std::string, FilterResult> baseline;
+    if (!baseline_path.empty() && !read_report(baseline_path, &baseline)) {
+        fail() << "Unable to read baseline " << baseline_path;
+    }
+
+    halide_set_error_handler(batch_halide_error);
+
+    int failures = 0;
+    std::vector<FilterResult> results;
+    for (const Filter &f : registered_filters()) {
+        const char *name = f.metadata()->name;
+        if (!only_filters.empty() &&
+            std::find(only_filters.begin(), only_filters.end(), name) == only_filters.end()) {
+            continue;
+        }
+        FilterResult r;
+        if (!run_filter(f, default_output_shape, config, &r)) {
+            failures++;
+            continue;
+        }
+        std::cout << "Benchmark for " << name << ": median " << r.median << " sec/iter ("
+                  << (r.megapixels / r.median) << " mpix/sec), p99 " << r.p99
+                  << ", stddev " << r.stddev << "\n";
+        results.push_back(r);
+    }
+
+    if (!report_path.empty()) {
+        std::ofstream f(report_path);
+        write_report(f, results);
+        if (!f) {
+            fail() << "Unable to write " << report_path;
+        }
+    }
+
+    int regressions = 0;
+    if (!baseline_path.empty()) {
+        regressions = compare_with_baseline(results, baseline, threshold, noise_sigmas);
+    }
+
+    return (failures || regressions) ? 1 : 0;
+}
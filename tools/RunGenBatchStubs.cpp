@@ -0,0 +1,24 @@
+// Like RunGenStubs.cpp, but for linking several filters into a single
+// RunGenBatch binary. Compile this once per filter, with
+// -DHL_RUNGEN_FILTER_HEADER="name.h" and -DHL_RUNGEN_FILTER_NAME=name;
+// each copy registers its filter with the driver in RunGenBatch.cpp.
+
+#define HL_RUNGEN_BATCH_CONCAT_(a, b) a##b
+#define HL_RUNGEN_BATCH_CONCAT(a, b) HL_RUNGEN_BATCH_CONCAT_(a, b)
+
+// The getters are inline functions, so they need a distinct name per filter.
+#define HALIDE_GET_STANDARD_ARGV_FUNCTION HL_RUNGEN_BATCH_CONCAT(halide_rungen_batch_argv_getter_, HL_RUNGEN_FILTER_NAME)
+#define HALIDE_GET_STANDARD_METADATA_FUNCTION HL_RUNGEN_BATCH_CONCAT(halide_rungen_batch_metadata_getter_, HL_RUNGEN_FILTER_NAME)
+
+// This is legal C, as long as the macro expands to a single quoted (or <>-enclosed) string literal
+#include HL_RUNGEN_FILTER_HEADER
+
+extern "C" int halide_rungen_batch_register(int (*argv)(void **),
+                                            const struct halide_filter_metadata_t *(*metadata)());
+
+namespace {
+
+const int registered = halide_rungen_batch_register(HALIDE_GET_STANDARD_ARGV_FUNCTION(),
+                                                    HALIDE_GET_STANDARD_METADATA_FUNCTION());
+
+}  // namespace
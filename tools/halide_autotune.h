@@ -0,0 +1,140 @@
+#ifndef HALIDE_AUTOTUNE_H
+#define HALIDE_AUTOTUNE_H
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <string>
+
+#include "Halide.h"
+#include "halide_benchmark.h"
+
+// Empirical autotuning on top of the auto-scheduler. The cost model
+// ranks the tile configurations it considers for each group of
+// stages; autotune() JIT-compiles the best few according to that
+// ranking, times each on the actual machine, and keeps the fastest.
+// Candidate k uses the k-th ranked configuration in every group (see
+// Pipeline::auto_schedule_candidate), so this explores a few points
+// near the model's choice rather than every combination of them.
+//
+// Scheduling mutates the Funcs of a pipeline, so each candidate is
+// applied to a fresh copy of the algorithm, built by 'make_pipeline'.
+// The estimates needed by the auto-scheduler must be set inside it.
+// 'run' realizes the compiled pipeline on representative inputs; it
+// is called once to warm up, then timed with benchmark().
+
+namespace Halide {
+namespace Tools {
+
+struct AutotuneConfig {
+    // The target and machine model passed to the auto-scheduler.
+    Target target{get_jit_target_from_environment()};
+    MachineParams machine_params{MachineParams::generic()};
+
+    // Try at most this many candidates. Candidate zero is the
+    // schedule the auto-scheduler would pick by itself.
+    int num_candidates{8};
+
+    // Stop starting new candidates once this many seconds have been
+    // spent on compiling and benchmarking.
+    double time_budget{60};
+
+    // How each candidate is timed.
+    BenchmarkConfig benchmark_config{};
+
+    // If non-empty, append one tab-separated line per candidate:
+    // candidate, compile time (s), run time (s), status.
+    std::string log_path;
+
+    // If non-empty, write the fastest schedule here, in the same form
+    // as the .schedule output of a generator.
+    std::string schedule_path;
+};
+
+struct AutotuneResult {
+    // The fastest candidate, or -1 if none ran.
+    int best_candidate{-1};
+
+    // Its time per iteration, in seconds.
+    double best_time{std::numeric_limits<double>::infinity()};
+
+    // Its schedule, as source code.
+    std::string schedule;
+
+    // Number of distinct candidates compiled and timed.
+    int candidates_tried{0};
+};
+
+inline AutotuneResult autotune(std::function<Pipeline()> make_pipeline,
+                               std::function<void(Pipeline)> run,
+                               const AutotuneConfig &config = {}) {
+    using Clock = SteadyClock<>::type;
+    auto seconds_since = [](Clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::duration<double>>(Clock::now() - t).count();
+    };
+
+    std::ofstream log;
+    if (!config.log_path.empty()) {
+        log.open(config.log_path, std::ios::app);
+    }
+
+    AutotuneResult result;
+    std::set<std::string> seen;
+    const auto start = Clock::now();
+    for (int k = 0; k < config.num_candidates; k++) {
+        if (k > 0 && seconds_since(start) > config.time_budget) {
+            break;
+        }
+
+        Pipeline p = make_pipeline();
+        std::string schedule = p.auto_schedule_candidate(config.target, config.machine_params, k);
+        // Strip the candidate comment before comparing, so that
+        // candidates that only differ in rank are not timed twice.
+        std::string key = schedule;
+        size_t pos = key.find("// Candidate:");
+        if (pos != std::string::npos) {
+            key.erase(pos, key.find('\n', pos) - pos);
+        }
+        if (!seen.insert(key).second) {
+            if (log.is_open()) {
+                log << k << "\t0\t0\tduplicate\n";
+            }
+            continue;
+        }
+
+        const auto compile_start = Clock::now();
+        p.compile_jit(config.target);
+        double compile_time = seconds_since(compile_start);
+
+        run(p);
+        double t = benchmark([&]() { run(p); }, config.benchmark_config);
+        result.candidates_tried++;
+
+        if (log.is_open()) {
+            log << k << "\t" << compile_time << "\t" << t << "\tok\n";
+        }
+        if (t < result.best_time) {
+            result.best_time = t;
+            result.best_candidate = k;
+            result.schedule = schedule;
+        }
+    }
+
+    if (!config.schedule_path.empty() && result.best_candidate >= 0) {
+        std::ofstream out(config.schedule_path);
+        out << "// Autotuned: candidate " << result.best_candidate
+            << " of " << config.num_candidates
+            << ", " << result.best_time * 1e3 << " ms\n"
+            << result.schedule;
+    }
+
+    return result;
+}
+
+}  // namespace Tools
+}  // namespace Halide
+
+#endif  // HALIDE_AUTOTUNE_H
@@ -4,8 +4,10 @@
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cmath>
 #include <functional>
 #include <limits>
+#include <vector>
 
 namespace Halide {
 namespace Tools {
@@ -59,7 +61,9 @@ inline double benchmark(int samples, int iterations, std::function<void()> op) {
 // has elapsed, with the constraint of at least min_iters and no more than
 // max_iters times; the number of iterations is expanded as we
 // progress (based on initial runs of 'op') to minimize overhead. The time
-// reported will be that of the best single iteration.
+// reported will be that of the best single iteration; the result also
+// describes the distribution of the time per iteration over all the
+// samples taken.
 //
 // Most callers should be able to get good results without needing to specify
 // custom BenchmarkConfig values.
@@ -94,8 +98,77 @@ struct BenchmarkConfig {
     // this. Controls accuracy. The closer to zero this gets the more
     // reliable the answer, but the longer it may take to run.
     double accuracy{0.03};
+
+    // Run the operation this many times before taking any samples,
+    // e.g. to warm up caches and let the thread pool start.
+    uint64_t warmup_iters{0};
+
+    // Take at least this many samples, if max_time allows, so that
+    // the percentiles in the result mean something.
+    uint64_t min_samples{3};
+
+    // Run at most this many iterations per sample. Each sample
+    // measures the mean time of its iterations, so the percentiles
+    // describe single runs of the operation only if this is 1.
+    uint64_t max_iters_per_sample{kBenchmarkMaxIterations};
+};
+
+// The distribution of the time per iteration over a set of samples
+// (seconds).
+struct BenchmarkStats {
+    double min{0}, median{0}, p90{0}, p99{0}, max{0};
+
+    // The mean and standard deviation of the samples that are not
+    // outliers.
+    double mean{0}, stddev{0};
+
+    // Number of samples outside the Tukey fences: more than 1.5 times
+    // the interquartile range below the first quartile or above the
+    // third. These are still included in the percentiles above.
+    uint64_t outliers{0};
 };
 
+// Linearly interpolated percentile (0 <= p <= 100) of sorted data.
+inline double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    double rank = p / 100.0 * (sorted.size() - 1);
+    size_t lo = (size_t)rank;
+    size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (rank - lo) * (sorted[hi] - sorted[lo]);
+}
+
+inline BenchmarkStats compute_benchmark_stats(std::vector<double> times) {
+    BenchmarkStats stats;
+    if (times.empty()) {
+        return stats;
+    }
+    std::sort(times.begin(), times.end());
+    stats.min = times.front();
+    stats.max = times.back();
+    stats.median = percentile(times, 50);
+    stats.p90 = percentile(times, 90);
+    stats.p99 = percentile(times, 99);
+
+    const double q1 = percentile(times, 25), q3 = percentile(times, 75);
+    const double lo = q1 - 1.5 * (q3 - q1), hi = q3 + 1.5 * (q3 - q1);
+    double sum = 0, sum_sq = 0;
+    uint64_t n = 0;
+    for (double t : times) {
+        if (t < lo || t > hi) {
+            stats.outliers++;
+            continue;
+        }
+        sum += t;
+        sum_sq += t * t;
+        n++;
+    }
+    stats.mean = sum / n;
+    stats.stddev = n > 1 ? std::sqrt(std::max(0.0, (sum_sq - sum * sum / n) / (n - 1))) : 0;
+    return stats;
+}
+
 struct BenchmarkResult {
     // Best elapsed wall-clock time per iteration (seconds).
     double wall_time;
@@ -114,6 +187,12 @@ struct BenchmarkResult {
     // Will be <= config.accuracy unless max_iters is exceeded.
     double accuracy;
 
+    // The distribution of the time per iteration over the samples
+    // used for measurement, and the times themselves, in the order
+    // they were taken.
+    BenchmarkStats stats;
+    std::vector<double> sample_times;
+
     operator double() const { return wall_time; }
 };
 
@@ -128,6 +207,11 @@ inline BenchmarkResult benchmark(std::function<void()> op, const BenchmarkConfig
     const uint64_t max_iters = std::min(
             std::max(config.min_iters, config.max_iters), kBenchmarkMaxIterations);
     const double accuracy = 1.0 + std::min(std::max(0.001, config.accuracy), 0.1);
+    const uint64_t max_iters_per_sample = std::max((uint64_t)1, config.max_iters_per_sample);
+
+    for (uint64_t i = 0; i < config.warmup_iters; i++) {
+        op();
+    }
 
     // We will do (at least) kMinSamples samples; we will do additional
     // samples until the best the kMinSamples'th results are within the
@@ -136,25 +220,28 @@ inline BenchmarkResult benchmark(std::function<void()> op, const BenchmarkConfig
     double times[kMinSamples + 1] = {0};
 
     double total_time = 0;
-    uint64_t iters_per_sample = min_iters;
+    uint64_t iters_per_sample = std::min(min_iters, max_iters_per_sample);
     while (result.iterations < max_iters) {
         result.samples = 0;
         result.iterations = 0;
+        result.sample_times.clear();
         total_time = 0;
         for (int i = 0; i < kMinSamples; i++) {
             times[i] = benchmark(1, iters_per_sample, op);
+            result.sample_times.push_back(times[i]);
             result.samples++;
             result.iterations += iters_per_sample;
             total_time += times[i] * iters_per_sample;
         }
         std::sort(times, times + kMinSamples);
-        if (times[0] * iters_per_sample * kMinSamples >= min_time) {
+        if (times[0] * iters_per_sample * kMinSamples >= min_time ||
+            iters_per_sample >= max_iters_per_sample) {
             break;
         }
         // Use an estimate based on initial times to converge faster.
         double next_iters = std::max(min_time / std::max(times[0] * kMinSamples, 1e-9),
                                                                  iters_per_sample * 2.0);
-        iters_per_sample = (uint64_t)(next_iters + 0.5);
+        iters_per_sample = std::min((uint64_t)(next_iters + 0.5), max_iters_per_sample);
     }
 
     // - Keep taking samples until we are accurate enough (even if we run over min_time).
@@ -162,10 +249,12 @@ inline BenchmarkResult benchmark(std::function<void()> op, const BenchmarkConfig
     // - No matter what, don't go over max_iters or max_time; this is important, in case
     // we happen to get faster results for the first samples, then happen to transition
     // to throttled-down CPU state.
-    while ((times[0] * accuracy < times[kMinSamples - 1] || total_time < min_time) &&
+    while ((times[0] * accuracy < times[kMinSamples - 1] || total_time < min_time ||
+            result.samples < config.min_samples) &&
                  total_time < max_time &&
                  result.iterations < max_iters) {
         times[kMinSamples] = benchmark(1, iters_per_sample, op);
+        result.sample_times.push_back(times[kMinSamples]);
         result.samples++;
         result.iterations += iters_per_sample;
         total_time += times[kMinSamples] * iters_per_sample;
@@ -173,6 +262,7 @@ inline BenchmarkResult benchmark(std::function<void()> op, const BenchmarkConfig
     }
     result.wall_time = times[0];
     result.accuracy = (times[kMinSamples - 1] / times[0]) - 1.0;
+    result.stats = compute_benchmark_stats(result.sample_times);
 
     return result;
 }
@@ -5,16 +5,24 @@
 #define HALIDE_IMAGE_IO_H
 
 #include <algorithm>
+#include <atomic>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <map>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 #include <cctype>
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #ifndef HALIDE_NO_PNG
 #include "png.h"
 #endif
@@ -23,7 +31,7 @@
 #include "jpeglib.h"
 #endif
 
-#include "HalideRuntime.h"  // for halide_type_t
+#include "HalideBuffer.h"  // for halide_type_t, and to adopt mapped files
 
 namespace Halide {
 namespace Tools {
@@ -802,6 +810,17 @@ inline const halide_type_t *tmp_code_to_halide_type() {
     return tmp_code_to_halide_type_;
 }
 
+// The .tmp code for a type, or -1 if .tmp files can't hold it.
+inline int tmp_type_code(const halide_type_t &type) {
+    auto *table = tmp_code_to_halide_type();
+    for (int i = 0; i < kNumTmpCodes; i++) {
+        if (type == table[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 // return true iff the buffer storage has no padding between
 // any elements, and is in strictly planar order.
 template<typename ImageType>
@@ -825,12 +844,9 @@ bool buffer_is_compact_planar(ImageType &im) {
     return true;
 }
 
-// ".tmp" is a file format used by the ImageStack tool (see https://github.com/abadams/ImageStack)
-template<typename ImageType, CheckFunc check = CheckReturn>
-bool load_tmp(const std::string &filename, ImageType *im) {
-    static_assert(!ImageType::has_static_halide_type, "");
-
-    FileOpener f(filename, "rb");
+// Read the header of a .tmp file, leaving f at the start of the payload.
+template<CheckFunc check = CheckReturn>
+bool read_tmp_header(FileOpener &f, halide_type_t *type, std::vector<int> *extents) {
     if (!check(f.f != nullptr, "File could not be opened for reading")) {
         return false;
     }
@@ -845,8 +861,22 @@ bool load_tmp(const std::string &filename, ImageType *im) {
         return false;
     }
 
-    const halide_type_t im_type = tmp_code_to_halide_type()[header[4]];
-    std::vector<int> im_dimensions = { header[0], header[1], header[2], header[3] };
+    *type = tmp_code_to_halide_type()[header[4]];
+    *extents = { header[0], header[1], header[2], header[3] };
+    return true;
+}
+
+// ".tmp" is a file format used by the ImageStack tool (see https://github.com/abadams/ImageStack)
+template<typename ImageType, CheckFunc check = CheckReturn>
+bool load_tmp(const std::string &filename, ImageType *im) {
+    static_assert(!ImageType::has_static_halide_type, "");
+
+    FileOpener f(filename, "rb");
+    halide_type_t im_type;
+    std::vector<int> im_dimensions;
+    if (!read_tmp_header<check>(f, &im_type, &im_dimensions)) {
+        return false;
+    }
     *im = ImageType(im_type, im_dimensions);
 
     // This should never fail unless the default Buffer<> constructor behavior changes.
@@ -910,13 +940,7 @@ bool save_tmp(ImageType &im, const std::string &filename) {
     for (int i = 0; i < im.dimensions(); ++i) {
         header[i] = im.dim(i).extent();
     }
-    auto *table = tmp_code_to_halide_type();
-    for (int i = 0; i < kNumTmpCodes; i++) {
-        if (im.type() == table[i]) {
-            header[4] = i;
-            break;
-        }
-    }
+    header[4] = tmp_type_code(im.type());
     if (!check(header[4] >= 0, "Unsupported type for .tmp file")) {
         return false;
     }
@@ -973,11 +997,9 @@ enum MatlabClassCode {
     mxUINT64_CLASS = 15
 };
 
-template<typename ImageType, CheckFunc check = CheckReturn>
-bool load_mat(const std::string &filename, ImageType *im) {
-    static_assert(!ImageType::has_static_halide_type, "");
-
-    FileOpener f(filename, "rb");
+// Read the headers of a .mat file, leaving f at the start of the payload.
+template<CheckFunc check = CheckReturn>
+bool read_mat_header(FileOpener &f, halide_type_t *type, std::vector<int> *extents) {
     if (!check(f.f != nullptr, "File could not be opened for reading")) {
         return false;
     }
@@ -1014,8 +1036,8 @@ bool load_mat(const std::string &filename, ImageType *im) {
         return false;
     }
     int dims = shape_header[1]/4;
-    std::vector<int> extents(dims);
-    if (!check(f.read_vector(&extents), "Could not read .mat header\n")) {
+    extents->resize(dims);
+    if (!check(f.read_vector(extents), "Could not read .mat header\n")) {
         return false;
     }
     if (dims & 1) {
@@ -1049,38 +1071,53 @@ bool load_mat(const std::string &filename, ImageType *im) {
     if (!check(f.read_array(payload_header), "Could not read .mat header\n")) {
         return false;
     }
-    halide_type_t type;
     switch (payload_header[0]) {
     case miINT8:
-        type = halide_type_of<int8_t>();
+        *type = halide_type_of<int8_t>();
         break;
     case miINT16:
-        type = halide_type_of<int16_t>();
+        *type = halide_type_of<int16_t>();
         break;
     case miINT32:
-        type = halide_type_of<int32_t>();
+        *type = halide_type_of<int32_t>();
         break;
     case miINT64:
-        type = halide_type_of<int64_t>();
+        *type = halide_type_of<int64_t>();
         break;
     case miUINT8:
-        type = halide_type_of<uint8_t>();
+        *type = halide_type_of<uint8_t>();
         break;
     case miUINT16:
-        type = halide_type_of<uint16_t>();
+        *type = halide_type_of<uint16_t>();
         break;
     case miUINT32:
-        type = halide_type_of<uint32_t>();
+        *type = halide_type_of<uint32_t>();
         break;
     case miUINT64:
-        type = halide_type_of<uint64_t>();
+        *type = halide_type_of<uint64_t>();
         break;
     case miSINGLE:
-        type = halide_type_of<float>();
+        *type = halide_type_of<float>();
         break;
     case miDOUBLE:
-        type = halide_type_of<double>();
+        *type = halide_type_of<double>();
         break;
+    default:
+        return check(false, "Could not parse this .mat file: unsupported payload type\n");
+    }
+
+    return true;
+}
+
+template<typename ImageType, CheckFunc check = CheckReturn>
+bool load_mat(const std::string &filename, ImageType *im) {
+    static_assert(!ImageType::has_static_halide_type, "");
+
+    FileOpener f(filename, "rb");
+    halide_type_t type;
+    std::vector<int> extents;
+    if (!read_mat_header<check>(f, &type, &extents)) {
+        return false;
     }
 
     *im = ImageType(type, extents);
@@ -1120,16 +1157,15 @@ inline const std::set<FormatInfo> &query_mat() {
     return info;
 }
 
-template<typename ImageType, CheckFunc check = CheckReturn>
-bool save_mat(ImageType &im, const std::string &filename) {
-    static_assert(!ImageType::has_static_halide_type, "");
-
-    im.copy_to_host();
-
+// Write the headers of a .mat file holding an array of the given type
+// and extents, leaving f at the start of the payload.
+template<CheckFunc check = CheckReturn>
+bool write_mat_header(FileOpener &f, const std::string &filename,
+                      const halide_type_t &type, const std::vector<int> &im_extents) {
     uint32_t class_code = 0, type_code = 0;
-    switch (im.raw_buffer()->type.code) {
+    switch (type.code) {
     case halide_type_int:
-        switch (im.raw_buffer()->type.bits) {
+        switch (type.bits) {
         case 8:
             class_code = mxINT8_CLASS;
             type_code = miINT8;
@@ -1151,7 +1187,7 @@ bool save_mat(ImageType &im, const std::string &filename) {
         };
         break;
     case halide_type_uint:
-        switch (im.raw_buffer()->type.bits) {
+        switch (type.bits) {
         case 8:
             class_code = mxUINT8_CLASS;
             type_code = miUINT8;
@@ -1173,7 +1209,7 @@ bool save_mat(ImageType &im, const std::string &filename) {
         };
         break;
     case halide_type_float:
-        switch (im.raw_buffer()->type.bits) {
+        switch (type.bits) {
         case 32:
             class_code = mxSINGLE_CLASS;
             type_code = miSINGLE;
@@ -1190,7 +1226,6 @@ bool save_mat(ImageType &im, const std::string &filename) {
         check(false, "unreachable");
     }
 
-    FileOpener f(filename, "wb");
     if (!check(f.f != nullptr, "File could not be opened for writing")) {
         return false;
     }
@@ -1227,13 +1262,16 @@ bool save_mat(ImageType &im, const std::string &filename) {
     header[126] = 'I';
     header[127] = 'M';
 
-    uint64_t payload_bytes = im.size_in_bytes();
+    uint64_t payload_bytes = type.bytes();
+    for (int e : im_extents) {
+        payload_bytes *= e;
+    }
 
     if (!check((payload_bytes >> 32) == 0, "Buffer too large to save as .mat")) {
         return false;
     }
 
-    int dims = im.dimensions();
+    int dims = (int)im_extents.size();
     if (dims < 2) {
         dims = 2;
     }
@@ -1251,12 +1289,9 @@ bool save_mat(ImageType &im, const std::string &filename) {
 
     // Shape
     int32_t shape[2] = {
-        miINT32, im.dimensions() * 4,
+        miINT32, (int32_t)im_extents.size() * 4,
     };
-    std::vector<int> extents(im.dimensions());
-    for (int d = 0; d < im.dimensions(); d++) {
-        extents[d] = im.dim(d).extent();
-    }
+    std::vector<int> extents = im_extents;
     while ((int)extents.size() < dims) {
         extents.push_back(1);
     }
@@ -1269,8 +1304,6 @@ bool save_mat(ImageType &im, const std::string &filename) {
         miINT8, name_size
     };
 
-    uint32_t padding_bytes = 7 - ((payload_bytes - 1) & 7);
-
     // Payload header
     uint32_t payload_header[2] = {
         type_code, (uint32_t)payload_bytes
@@ -1286,7 +1319,27 @@ bool save_mat(ImageType &im, const std::string &filename) {
         f.write_bytes(&name[0], name.size()) &&
         f.write_array(payload_header);
 
-    if (!check(success, "Could not write .mat header")) {
+    return check(success, "Could not write .mat header");
+}
+
+// The number of zero bytes that pad the payload of a .mat file to a
+// multiple of 8 bytes.
+inline uint32_t mat_padding_bytes(uint64_t payload_bytes) {
+    return 7 - ((payload_bytes - 1) & 7);
+}
+
+template<typename ImageType, CheckFunc check = CheckReturn>
+bool save_mat(ImageType &im, const std::string &filename) {
+    static_assert(!ImageType::has_static_halide_type, "");
+
+    im.copy_to_host();
+
+    std::vector<int> extents(im.dimensions());
+    for (int d = 0; d < im.dimensions(); d++) {
+        extents[d] = im.dim(d).extent();
+    }
+    FileOpener f(filename, "wb");
+    if (!write_mat_header<check>(f, filename, im.type(), extents)) {
         return false;
     }
 
@@ -1295,6 +1348,7 @@ bool save_mat(ImageType &im, const std::string &filename) {
     }
 
     // Padding
+    uint32_t padding_bytes = mat_padding_bytes(im.size_in_bytes());
     if (!check(padding_bytes < 8, "Too much padding!\n")) {
         return false;
     }
@@ -1306,6 +1360,284 @@ bool save_mat(ImageType &im, const std::string &filename) {
     return true;
 }
 
+// ".npy" is the NumPy array format documented here:
+// https://numpy.org/doc/stable/reference/generated/numpy.lib.format.html
+//
+// The axes of the array are the dimensions of the image, in the same
+// order. Halide stores dimension 0 innermost, so we write arrays in
+// Fortran order, and np.load() returns an array indexed like the image
+// (e.g. a[x, y, c]) without copying. The header is padded so that the
+// payload starts on a 64-byte boundary, which lets both
+// np.load(mmap_mode='r') and load_mapped() use the file in place.
+
+struct NpyType {
+    halide_type_t type;
+    const char *descr;  // Without the byte order
+};
+
+constexpr int kNumNpyTypes = 11;
+
+inline const NpyType *npy_types() {
+    static const NpyType npy_types_[kNumNpyTypes] = {
+      { { halide_type_uint, 1 }, "b1" },
+      { { halide_type_float, 32 }, "f4" },
+      { { halide_type_float, 64 }, "f8" },
+      { { halide_type_uint, 8 }, "u1" },
+      { { halide_type_int, 8 }, "i1" },
+      { { halide_type_uint, 16 }, "u2" },
+      { { halide_type_int, 16 }, "i2" },
+      { { halide_type_uint, 32 }, "u4" },
+      { { halide_type_int, 32 }, "i4" },
+      { { halide_type_uint, 64 }, "u8" },
+      { { halide_type_int, 64 }, "i8" }
+    };
+    return npy_types_;
+}
+
+// The .npy byte order character for multi-byte elements on this machine.
+inline char npy_native_byte_order() {
+    const uint16_t one = 1;
+    return *(const uint8_t *)&one ? '<' : '>';
+}
+
+// The text following "'key':" in a .npy header, or nullptr if the key is missing.
+inline const char *npy_header_field(const std::string &header, const std::string &key) {
+    size_t pos = header.find("'" + key + "'");
+    if (pos == std::string::npos) {
+        return nullptr;
+    }
+    pos = header.find(':', pos);
+    if (pos == std::string::npos) {
+        return nullptr;
+    }
+    const char *p = header.c_str() + pos + 1;
+    while (*p == ' ') p++;
+    return p;
+}
+
+// Read the header of a .npy file, leaving f at the start of the
+// payload. The extents are in the order of the array's axes; a C-order
+// array has its last axis innermost in memory.
+template<CheckFunc check = CheckReturn>
+bool read_npy_header(FileOpener &f, halide_type_t *type, std::vector<int> *extents, bool *fortran_order) {
+    if (!check(f.f != nullptr, "File could not be opened for reading")) {
+        return false;
+    }
+
+    uint8_t preamble[8];
+    if (!check(f.read_array(preamble), "Could not read .npy header")) {
+        return false;
+    }
+    if (!check(memcmp(preamble, "\x93NUMPY", 6) == 0, "Could not parse this .npy file: bad magic string")) {
+        return false;
+    }
+    uint32_t header_len = 0;
+    if (preamble[6] == 1) {
+        uint8_t len[2];
+        if (!check(f.read_array(len), "Could not read .npy header")) {
+            return false;
+        }
+        header_len = len[0] | (len[1] << 8);
+    } else if (preamble[6] == 2 || preamble[6] == 3) {
+        uint8_t len[4];
+        if (!check(f.read_array(len), "Could not read .npy header")) {
+            return false;
+        }
+        header_len = len[0] | (len[1] << 8) | (len[2] << 16) | ((uint32_t)len[3] << 24);
+    } else {
+        return check(false, "Could not parse this .npy file: unsupported version");
+    }
+    std::string header(header_len, ' ');
+    if (!check(header_len > 0 && f.read_bytes(&header[0], header_len), "Could not read .npy header")) {
+        return false;
+    }
+
+    // The header is the repr() of a python dict, e.g.
+    // {'descr': '<f4', 'fortran_order': True, 'shape': (640, 480, 3), }
+    const char *descr = npy_header_field(header, "descr");
+    const char *order = npy_header_field(header, "fortran_order");
+    const char *shape = npy_header_field(header, "shape");
+    if (!check(descr && order && shape && *descr == '\'' && *shape == '(',
+               "Could not parse this .npy file: bad header")) {
+        return false;
+    }
+
+    const char *descr_end = strchr(descr + 1, '\'');
+    if (!check(descr_end && descr_end - descr == 4, "Could not parse this .npy file: unsupported element type")) {
+        return false;
+    }
+    const char byte_order = descr[1];
+    const std::string code(descr + 2, descr_end);
+    bool found = false;
+    for (int i = 0; i < kNumNpyTypes; i++) {
+        if (code == npy_types()[i].descr) {
+            *type = npy_types()[i].type;
+            found = true;
+        }
+    }
+    if (!check(found, "Could not parse this .npy file: unsupported element type")) {
+        return false;
+    }
+    if (!check(byte_order == '|' || byte_order == '=' || byte_order == npy_native_byte_order() || type->bytes() == 1,
+               "Could not parse this .npy file: byte order differs from this machine's")) {
+        return false;
+    }
+
+    if (!strncmp(order, "True", 4)) {
+        *fortran_order = true;
+    } else if (!strncmp(order, "False", 5)) {
+        *fortran_order = false;
+    } else {
+        return check(false, "Could not parse this .npy file: bad fortran_order");
+    }
+
+    extents->clear();
+    const char *p = shape + 1;
+    while (true) {
+        while (*p == ' ') p++;
+        if (*p == ')') {
+            break;
+        }
+        char *next = nullptr;
+        long e = strtol(p, &next, 10);
+        if (!check(next != p && e >= 0 && e <= 0x7fffffff, "Could not parse this .npy file: bad shape")) {
+            return false;
+        }
+        extents->push_back((int)e);
+        p = next;
+        while (*p == ' ') p++;
+        if (*p == ',') {
+            p++;
+        } else if (!check(*p == ')', "Could not parse this .npy file: bad shape")) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template<typename ImageType, CheckFunc check = CheckReturn>
+bool load_npy(const std::string &filename, ImageType *im) {
+    static_assert(!ImageType::has_static_halide_type, "");
+
+    FileOpener f(filename, "rb");
+    halide_type_t type;
+    std::vector<int> extents;
+    bool fortran_order;
+    if (!read_npy_header<check>(f, &type, &extents, &fortran_order)) {
+        return false;
+    }
+
+    // A C-order payload is planar with its axes reversed. Read it that
+    // way and transpose back, so the dimensions match the axes.
+    if (!fortran_order) {
+        std::reverse(extents.begin(), extents.end());
+    }
+    *im = ImageType(type, extents);
+
+    // This should never fail unless the default Buffer<> constructor behavior changes.
+    if (!check(buffer_is_compact_planar(*im), "load_npy() requires compact planar images")) {
+        return false;
+    }
+
+    if (!check(f.read_bytes(im->begin(), im->size_in_bytes()), "Could not read .npy payload")) {
+        return false;
+    }
+
+    if (!fortran_order) {
+        for (int d = 0; d < im->dimensions() / 2; d++) {
+            im->transpose(d, im->dimensions() - 1 - d);
+        }
+    }
+
+    im->set_host_dirty();
+    return true;
+}
+
+inline const std::set<FormatInfo> &query_npy() {
+    // NPY files may have any number of dimensions. As with .mat, our
+    // support arbitrarily stops at 16.
+    static std::set<FormatInfo> info = []() {
+        std::set<FormatInfo> s;
+        for (int i = 1; i < 16; i++) {
+            for (int t = 0; t < kNumNpyTypes; t++) {
+                s.insert({ npy_types()[t].type, i });
+            }
+        }
+        return s;
+    }();
+    return info;
+}
+
+// Write the header of a Fortran-order .npy file holding an array of
+// the given type and extents, leaving f at the start of the payload.
+template<CheckFunc check = CheckReturn>
+bool write_npy_header(FileOpener &f, const halide_type_t &type, const std::vector<int> &extents) {
+    const char *code = nullptr;
+    for (int i = 0; i < kNumNpyTypes; i++) {
+        if (type == npy_types()[i].type) {
+            code = npy_types()[i].descr;
+        }
+    }
+    if (!check(code != nullptr, "Unsupported type for .npy file")) {
+        return false;
+    }
+    if (!check(f.f != nullptr, "File could not be opened for writing")) {
+        return false;
+    }
+
+    const char byte_order = type.bytes() == 1 ? '|' : npy_native_byte_order();
+    std::string header = std::string("{'descr': '") + byte_order + code + "', 'fortran_order': True, 'shape': (";
+    for (size_t i = 0; i < extents.size(); i++) {
+        if (i > 0) {
+            header += ", ";
+        }
+        header += std::to_string(extents[i]);
+    }
+    if (extents.size() == 1) {
+        header += ",";
+    }
+    header += "), }";
+
+    // Pad with spaces up to a newline, so that the 10 byte preamble
+    // plus the header is a multiple of 64 bytes.
+    header.append(63 - (10 + header.size()) % 64, ' ');
+    header += '\n';
+
+    const uint8_t preamble[10] = {
+        0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+        (uint8_t)(header.size() & 0xff), (uint8_t)(header.size() >> 8)
+    };
+
+    bool success =
+        f.write_array(preamble) &&
+        f.write_bytes(&header[0], header.size());
+
+    return check(success, "Could not write .npy header");
+}
+
+template<typename ImageType, CheckFunc check = CheckReturn>
+bool save_npy(ImageType &im, const std::string &filename) {
+    static_assert(!ImageType::has_static_halide_type, "");
+
+    im.copy_to_host();
+
+    std::vector<int> extents(im.dimensions());
+    for (int d = 0; d < im.dimensions(); d++) {
+        extents[d] = im.dim(d).extent();
+    }
+    FileOpener f(filename, "wb");
+    if (!write_npy_header<check>(f, im.type(), extents)) {
+        return false;
+    }
+
+    if (!write_planar_payload<ImageType, check>(im, f)) {
+        return false;
+    }
+
+    return true;
+}
+
 
 template<typename ImageType, Internal::CheckFunc check>
 struct ImageIO {
@@ -1329,7 +1661,8 @@ bool find_imageio(const std::string &filename, ImageIO<ImageType, check> *result
 #endif
         {"ppm", {load_ppm<ImageType, check>, save_ppm<ImageType, check>, query_ppm}},
         {"tmp", {load_tmp<ImageType, check>, save_tmp<ImageType, check>, query_tmp}},
-        {"mat", {load_mat<ImageType, check>, save_mat<ImageType, check>, query_mat}}
+        {"mat", {load_mat<ImageType, check>, save_mat<ImageType, check>, query_mat}},
+        {"npy", {load_npy<ImageType, check>, save_npy<ImageType, check>, query_npy}}
     };
     std::string ext = Internal::get_lowercase_extension(filename);
     auto it = m.find(ext);
@@ -1346,6 +1679,202 @@ bool find_imageio(const std::string &filename, ImageIO<ImageType, check> *result
     return check(false, err.c_str());
 }
 
+#ifndef _WIN32
+
+// The allocation header of a Buffer that wraps a memory-mapped file;
+// the file is unmapped along with the last Buffer that refers to it.
+struct MappedFileAllocation : Halide::Runtime::AllocationHeader {
+    void *addr;
+    size_t length;
+
+    MappedFileAllocation(void *addr, size_t length) :
+        AllocationHeader(release), addr(addr), length(length) {}
+
+    static void release(void *p) {
+        MappedFileAllocation *m = (MappedFileAllocation *)p;
+        munmap(m->addr, m->length);
+        free(p);
+    }
+};
+
+#endif
+
+// Wrap the payload of a .tmp, .mat, .npy, or 8-bit .pgm/.ppm file as a
+// Buffer referring directly to the file's pages. The mapping is
+// private, so writes to the Buffer are never written back to the
+// file. Sets *mapped to false, without failing, if the file can't be
+// used in place: other formats, 16-bit (big-endian) pnm samples,
+// payloads not aligned to their element size, files that can't be
+// mapped, or platforms without mmap.
+template<typename ImageType, CheckFunc check>
+bool map_image(const std::string &filename, ImageType *im, bool *mapped) {
+    static_assert(!ImageType::has_static_halide_type, "");
+
+    *mapped = false;
+#ifndef _WIN32
+    const std::string ext = get_lowercase_extension(filename);
+    if (ext != "tmp" && ext != "mat" && ext != "npy" && ext != "pgm" && ext != "ppm") {
+        return true;
+    }
+
+    FileOpener f(filename, "rb");
+    halide_type_t type;
+    std::vector<halide_dimension_t> shape;
+    if (ext == "pgm" || ext == "ppm") {
+        const int channels = ext == "ppm" ? 3 : 1;
+        int width, height, bit_depth;
+        if (!read_pnm_header<check>(f, channels == 3 ? "P6" : "P5", &width, &height, &bit_depth)) {
+            return false;
+        }
+        if (bit_depth != 8) {
+            return true;
+        }
+        // The samples are interleaved, so the channels are the innermost
+        // dimension in memory.
+        type = halide_type_t(halide_type_uint, 8);
+        shape.emplace_back(0, width, channels);
+        shape.emplace_back(0, height, width * channels);
+        if (channels > 1) {
+            shape.emplace_back(0, channels, 1);
+        }
+    } else if (ext == "npy") {
+        std::vector<int> extents;
+        bool fortran_order;
+        if (!read_npy_header<check>(f, &type, &extents, &fortran_order)) {
+            return false;
+        }
+        // C-order files have their last axis innermost in memory.
+        shape.resize(extents.size());
+        int stride = 1;
+        for (size_t i = 0; i < extents.size(); i++) {
+            const size_t d = fortran_order ? i : extents.size() - 1 - i;
+            shape[d] = halide_dimension_t(0, extents[d], stride);
+            stride *= extents[d];
+        }
+    } else {
+        std::vector<int> extents;
+        if (ext == "tmp") {
+            if (!read_tmp_header<check>(f, &type, &extents)) {
+                return false;
+            }
+        } else if (!read_mat_header<check>(f, &type, &extents)) {
+            return false;
+        }
+        // Both formats store the payload in planar order.
+        int stride = 1;
+        for (int e : extents) {
+            shape.emplace_back(0, e, stride);
+            stride *= e;
+        }
+    }
+
+    const long offset = ftell(f.f);
+    size_t payload_bytes = type.bytes();
+    for (const halide_dimension_t &d : shape) {
+        payload_bytes *= d.extent;
+    }
+    struct stat st;
+    if (offset < 0 || fstat(fileno(f.f), &st) != 0) {
+        return true;
+    }
+    if (!check((size_t)st.st_size >= offset + payload_bytes, "File is too short for the image described by its header")) {
+        return false;
+    }
+    if (payload_bytes == 0 || offset % type.bytes() != 0) {
+        return true;
+    }
+
+    const size_t length = offset + payload_bytes;
+    void *addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f.f), 0);
+    if (addr == MAP_FAILED) {
+        return true;
+    }
+    // We only expect to read the file once, front to back.
+    madvise(addr, length, MADV_SEQUENTIAL);
+
+    Halide::Runtime::Buffer<void> buf(type, (uint8_t *)addr + offset, (int)shape.size(), shape.data());
+    void *header = malloc(sizeof(MappedFileAllocation));
+    buf.adopt_host_allocation(new (header) MappedFileAllocation(addr, length));
+    *im = ImageType(std::move(buf));
+    *mapped = true;
+#endif
+    return true;
+}
+
+// The number of threads convert_image() may use; zero means one per
+// core. Atomic, as images may be converted on several threads while
+// another sets it.
+inline std::atomic<int> &conversion_threads() {
+    static std::atomic<int> threads(0);
+    return threads;
+}
+
+// Convert src into dst, which has the same shape. for_each_value()
+// flattens the two into the longest runs that are contiguous in both,
+// and converts each run with a loop over adjacent elements that the
+// compiler can vectorize for each pair of types. Large images are
+// also split into bands along their outermost dimension in memory,
+// converted on separate threads; besides the arithmetic, this spreads
+// out the cost of first touching the pages of a new dst.
+template<typename DstImageType, typename SrcImageType>
+void convert_values(DstImageType &dst, const SrcImageType &src) {
+    using DstElemType = typename DstImageType::ElemType;
+    using SrcElemType = typename SrcImageType::ElemType;
+    using DstView = Halide::Runtime::Buffer<DstElemType>;
+    using SrcView = Halide::Runtime::Buffer<const SrcElemType>;
+    const auto converter = [](DstElemType &dst_elem, SrcElemType src_elem) {
+        dst_elem = convert<DstElemType>(src_elem);
+    };
+
+    // Below this, starting threads costs more than it saves.
+    const size_t min_elements_per_thread = 1 << 18;
+
+    int threads = conversion_threads();
+    if (threads <= 0) {
+        threads = (int)std::thread::hardware_concurrency();
+    }
+    int outer = -1;
+    for (int d = 0; d < dst.dimensions(); d++) {
+        if (dst.dim(d).extent() > 1 &&
+            (outer < 0 || dst.dim(d).stride() > dst.dim(outer).stride())) {
+            outer = d;
+        }
+    }
+    if (outer >= 0) {
+        threads = std::min(threads, dst.dim(outer).extent());
+        threads = std::min<size_t>(threads, dst.number_of_elements() / min_elements_per_thread);
+    }
+
+    // Work on unowned views of the two buffers, so that the bands can
+    // be cropped independently of each other whatever the ImageType.
+    DstView dst_view(*dst.raw_buffer());
+    SrcView src_view(*src.raw_buffer());
+    if (outer < 0 || threads <= 1) {
+        dst_view.for_each_value(converter, src_view);
+        return;
+    }
+
+    const int min = dst.dim(outer).min();
+    const int extent = dst.dim(outer).extent();
+    std::vector<DstView> dst_bands;
+    std::vector<SrcView> src_bands;
+    for (int i = 0; i < threads; i++) {
+        const int band_min = min + (int)((int64_t)extent * i / threads);
+        const int band_max = min + (int)((int64_t)extent * (i + 1) / threads);
+        dst_bands.push_back(dst_view.cropped(outer, band_min, band_max - band_min));
+        src_bands.push_back(src_view.cropped(outer, band_min, band_max - band_min));
+    }
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back([&, i]() {
+            dst_bands[i].for_each_value(converter, src_bands[i]);
+        });
+    }
+    for (std::thread &w : workers) {
+        w.join();
+    }
+}
+
 // Given something like ImageType<Foo>, produce typedef ImageType<Bar>
 template<typename ImageType, typename ElemType>
 struct ImageTypeWithElemType {
@@ -1388,6 +1917,13 @@ FormatInfo best_save_format(const ImageType &im, const std::set<FormatInfo> &inf
 }  // namespace Internal
 
 struct ImageTypeConversion {
+    // Set the number of threads used to convert large images. The
+    // default, zero, uses one per core; one converts on the calling
+    // thread only.
+    static void set_num_threads(int threads) {
+        Internal::conversion_threads() = threads;
+    }
+
     // Convert an Image from one ElemType to another, where the src and
     // dst types are statically known (e.g. Buffer<uint8_t> -> Buffer<float>).
     // Note that this does conversion with scaling -- intepreting integers
@@ -1406,17 +1942,11 @@ struct ImageTypeConversion {
         static_assert(ImageType::has_static_halide_type,
                       "This variant of convert_image() requires a statically-typed image");
 
-        using SrcImageType = ImageType;
-        using SrcElemType = typename SrcImageType::ElemType;
-
         using DstImageType = typename Internal::ImageTypeWithElemType<ImageType, DstElemType>::type;
 
         DstImageType dst = DstImageType::make_with_shape_of(src);
-        const auto converter = [](DstElemType &dst_elem, SrcElemType src_elem) {
-            dst_elem = Internal::convert<DstElemType>(src_elem);
-        };
         // TODO: do we need src.copy_to_host() here?
-        dst.for_each_value(converter, src);
+        Internal::convert_values(dst, src);
         dst.set_host_dirty();
 
         return dst;
@@ -1589,6 +2119,35 @@ bool load(const std::string &filename, ImageType *im) {
     return true;
 }
 
+// Like load(), but memory-map .tmp, .mat, .npy, and 8-bit .pgm/.ppm files
+// instead of reading them, so that the Image refers to the pixel data
+// in the file rather than a copy of it, and pages are only read when
+// touched. The mapping is private: writing to the Image never modifies
+// the file. Files that can't be used in place are read with load().
+// Pnm samples are interleaved in the file, so a mapped .ppm has the
+// channels as its innermost dimension rather than being planar.
+// Unlike load(), if the output Image has a static type that differs
+// from the file's, the data is converted rather than rejected.
+// Returns false upon failure.
+template<typename ImageType, Internal::CheckFunc check = Internal::CheckReturn>
+bool load_mapped(const std::string &filename, ImageType *im) {
+    using DynamicImageType = typename Internal::ImageTypeWithElemType<ImageType, void>::type;
+    DynamicImageType im_d;
+    bool mapped = false;
+    if (!Internal::map_image<DynamicImageType, check>(filename, &im_d, &mapped)) {
+        return false;
+    }
+    if (!mapped && !load<DynamicImageType, check>(filename, &im_d)) {
+        return false;
+    }
+    if (ImageType::has_static_halide_type && im_d.type() != ImageType::static_halide_type()) {
+        im_d = ImageTypeConversion::convert_image(im_d, ImageType::static_halide_type());
+    }
+    *im = im_d.template as<typename ImageType::ElemType>();
+    im->set_host_dirty();
+    return true;
+}
+
 // Save the Image in the format associated with the filename's extension.
 // If the format can't represent the Image without losing data, fail.
 // Returns false upon failure.
@@ -0,0 +1,467 @@
+// Streaming access to .tmp, .mat, and .pgm/.ppm images that are too
+// large to hold in memory: any rectangular region (a row strip, a
+// tile) can be read from or written to the file on its own. Also a
+// driver that runs an AOT-compiled pipeline over such images one tile
+// of the output at a time.
+
+#ifndef HALIDE_IMAGE_STREAM_H
+#define HALIDE_IMAGE_STREAM_H
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "HalideBuffer.h"
+#include "halide_image_io.h"
+
+namespace Halide {
+namespace Tools {
+
+namespace Internal {
+
+inline bool seek_to(FILE *f, int64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(f, offset, SEEK_SET) == 0;
+#else
+    return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+inline int64_t tell(FILE *f) {
+#ifdef _WIN32
+    return _ftelli64(f);
+#else
+    return (int64_t)ftello(f);
+#endif
+}
+
+// Where the payload of an image file starts, and how its elements are
+// laid out within it. Elements are addressed in "lines": a run of
+// dimension 0, together with any dimensions that are stored inside it
+// (the channels of a pnm image), which is contiguous in the file.
+class ImageStreamBase {
+public:
+    halide_type_t type() const {
+        return image_type;
+    }
+
+    int dimensions() const {
+        return (int)extents.size();
+    }
+
+    int extent(int d) const {
+        return extents[d];
+    }
+
+protected:
+    std::unique_ptr<FileOpener> file;
+    halide_type_t image_type;
+    std::vector<int> extents;
+    // The distance in the file between adjacent elements along each
+    // dimension, in elements.
+    std::vector<int64_t> strides;
+    // The file offset of the payload.
+    int64_t offset{0};
+    // Pnm images store 16-bit samples big-endian.
+    bool big_endian{false};
+
+    void set_planar_strides() {
+        strides.resize(extents.size());
+        int64_t stride = 1;
+        for (size_t d = 0; d < extents.size(); d++) {
+            strides[d] = stride;
+            stride *= extents[d];
+        }
+    }
+
+    void set_interleaved_strides(int channels) {
+        strides = {channels, (int64_t)channels * extents[0]};
+        if (channels > 1) {
+            strides.push_back(1);
+        }
+    }
+
+    int64_t payload_bytes() const {
+        int64_t bytes = image_type.bytes();
+        for (int e : extents) {
+            bytes *= e;
+        }
+        return bytes;
+    }
+
+    bool is_inner(int d) const {
+        return d > 0 && strides[d] < strides[0];
+    }
+
+    int clamp(int d, int coord) const {
+        return std::min(std::max(coord, 0), extents[d] - 1);
+    }
+
+    // Whether a line of the region can be transferred straight
+    // between the file and the region's memory.
+    bool is_direct(const halide_buffer_t *region) const {
+        if (big_endian || region->dim[0].stride != 1) {
+            return false;
+        }
+        for (int d = 1; d < dimensions(); d++) {
+            if (is_inner(d)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Call fn(pos, line_offset, line_min, line_max) for each line the
+    // region covers, where pos holds the region coordinates of the
+    // line's start, and the line spans [line_min, line_max] of
+    // dimension 0 of the image, starting at byte line_offset of the
+    // file. Coordinates outside the image are clamped to its edges.
+    template<typename Fn>
+    bool for_each_line(const halide_buffer_t *region, Fn &&fn) const {
+        const int dims = dimensions();
+        std::vector<int> pos(dims);
+        for (int d = 0; d < dims; d++) {
+            pos[d] = region->dim[d].min;
+            if (region->dim[d].extent <= 0) {
+                return true;
+            }
+        }
+        const int line_min = clamp(0, region->dim[0].min);
+        const int line_max = clamp(0, region->dim[0].min + region->dim[0].extent - 1);
+        while (true) {
+            int64_t element = (int64_t)line_min * strides[0];
+            for (int d = 1; d < dims; d++) {
+                if (!is_inner(d)) {
+                    element += (int64_t)clamp(d, pos[d]) * strides[d];
+                }
+            }
+            if (!fn(pos.data(), offset + element * image_type.bytes(), line_min, line_max)) {
+                return false;
+            }
+            // Advance to the next line.
+            int d = 1;
+            for (; d < dims; d++) {
+                if (is_inner(d)) {
+                    continue;
+                }
+                if (++pos[d] < region->dim[d].min + region->dim[d].extent) {
+                    break;
+                }
+                pos[d] = region->dim[d].min;
+            }
+            if (d >= dims) {
+                return true;
+            }
+        }
+    }
+
+    // Call fn(pos, index) for each element of the region in the line
+    // starting at pos, where index is the element's position within
+    // the line as read from the file, which starts at line_min.
+    template<typename Fn>
+    void for_each_in_line(const halide_buffer_t *region, int *pos, int line_min, Fn &&fn) const {
+        const int dims = dimensions();
+        std::vector<int> start(pos, pos + dims);
+        while (true) {
+            int64_t index = (int64_t)(clamp(0, pos[0]) - line_min) * strides[0];
+            for (int d = 1; d < dims; d++) {
+                if (is_inner(d)) {
+                    index += (int64_t)clamp(d, pos[d]) * strides[d];
+                }
+            }
+            fn(pos, index);
+            int d = 0;
+            for (; d < dims; d++) {
+                if (d > 0 && !is_inner(d)) {
+                    continue;
+                }
+                if (++pos[d] < region->dim[d].min + region->dim[d].extent) {
+                    break;
+                }
+                pos[d] = start[d];
+            }
+            if (d >= dims) {
+                return;
+            }
+        }
+    }
+
+    void swap_bytes(uint8_t *elem) const {
+        std::reverse(elem, elem + image_type.bytes());
+    }
+};
+
+}  // namespace Internal
+
+// Reads regions of an image from a file without loading all of it.
+template<Internal::CheckFunc check = Internal::CheckReturn>
+class ImageStreamReader : public Internal::ImageStreamBase {
+public:
+    // Open a .tmp, .mat, .pgm or .ppm file and read its header. The
+    // image has the same dimensions as load() would give it.
+    bool open(const std::string &filename) {
+        file.reset(new Internal::FileOpener(filename, "rb"));
+        if (!check(file->f != nullptr, "File could not be opened for reading")) {
+            return false;
+        }
+        const std::string ext = Internal::get_lowercase_extension(filename);
+        big_endian = false;
+        if (ext == "tmp" || ext == "mat") {
+            bool ok = ext == "tmp" ?
+                Internal::read_tmp_header<check>(*file, &image_type, &extents) :
+                Internal::read_mat_header<check>(*file, &image_type, &extents);
+            if (!ok) {
+                return false;
+            }
+            set_planar_strides();
+        } else if (ext == "pgm" || ext == "ppm") {
+            const int channels = ext == "ppm" ? 3 : 1;
+            int width, height, bit_depth;
+            if (!Internal::read_pnm_header<check>(*file, channels == 3 ? "P6" : "P5", &width, &height, &bit_depth)) {
+                return false;
+            }
+            image_type = halide_type_t(halide_type_uint, bit_depth);
+            extents = {width, height};
+            if (channels > 1) {
+                extents.push_back(channels);
+            }
+            set_interleaved_strides(channels);
+            big_endian = bit_depth > 8;
+        } else {
+            return check(false, "Only .tmp, .mat, .pgm and .ppm files can be streamed");
+        }
+        offset = Internal::tell(file->f);
+        return check(offset >= 0, "Could not find the image data");
+    }
+
+    // Fill a region of the image into 'region', which must have host
+    // memory, and the type and dimensionality of the image. The
+    // region may extend beyond the image, as a halo would: the parts
+    // outside it repeat the nearest pixel at its edge, as
+    // BoundaryConditions::repeat_edge does.
+    bool read(Halide::Runtime::Buffer<> &region) {
+        if (!check(region.type() == image_type && region.dimensions() == dimensions(),
+                   "Region does not match the type and dimensions of the image")) {
+            return false;
+        }
+        if (!check(region.data() != nullptr, "Region has no host memory")) {
+            return false;
+        }
+        region.copy_to_host();
+        const halide_buffer_t *buf = region.raw_buffer();
+        const int elem_size = image_type.bytes();
+        const bool direct = is_direct(buf);
+        std::vector<uint8_t> line;
+        bool ok = for_each_line(buf, [&](int *pos, int64_t line_offset, int line_min, int line_max) {
+            const size_t line_bytes = (size_t)(line_max - line_min + 1) * strides[0] * elem_size;
+            if (!check(Internal::seek_to(file->f, line_offset), "Could not seek in image file")) {
+                return false;
+            }
+            if (direct && pos[0] == line_min && (int64_t)line_max - line_min + 1 == buf->dim[0].extent) {
+                return check(file->read_bytes(buf->address_of(pos), line_bytes), "Could not read image data");
+            }
+            line.resize(line_bytes);
+            if (!check(file->read_vector(&line), "Could not read image data")) {
+                return false;
+            }
+            for_each_in_line(buf, pos, line_min, [&](const int *p, int64_t index) {
+                uint8_t *dst = buf->address_of(p);
+                memcpy(dst, &line[index * elem_size], elem_size);
+                if (big_endian) {
+                    swap_bytes(dst);
+                }
+            });
+            return true;
+        });
+        if (ok) {
+            region.set_host_dirty();
+        }
+        return ok;
+    }
+};
+
+// Writes regions of an image to a file without holding all of it.
+template<Internal::CheckFunc check = Internal::CheckReturn>
+class ImageStreamWriter : public Internal::ImageStreamBase {
+public:
+    // Create a file for an image of the given type and extents. The
+    // format is chosen by the extension: .tmp (up to 4 dimensions),
+    // .mat, .pgm (uint8 or uint16, 2 dimensions) or .ppm (uint8 or
+    // uint16, 3 dimensions with 3 channels). The file is given its
+    // full size up front, so regions can be written in any order;
+    // parts that are never written read as zero.
+    bool create(const std::string &filename, const halide_type_t &type, const std::vector<int> &image_extents) {
+        file.reset(new Internal::FileOpener(filename, "wb"));
+        if (!check(file->f != nullptr, "File could not be opened for writing")) {
+            return false;
+        }
+        image_type = type;
+        extents = image_extents;
+        big_endian = false;
+        const std::string ext = Internal::get_lowercase_extension(filename);
+        uint32_t padding_bytes = 0;
+        if (ext == "tmp") {
+            int32_t header[5] = { 1, 1, 1, 1, Internal::tmp_type_code(type) };
+            if (!check(extents.size() <= 4 && header[4] >= 0, "Image cannot be saved as .tmp")) {
+                return false;
+            }
+            std::copy(extents.begin(), extents.end(), header);
+            if (!check(file->write_array(header), "Could not write .tmp header")) {
+                return false;
+            }
+            set_planar_strides();
+        } else if (ext == "mat") {
+            if (!Internal::write_mat_header<check>(*file, filename, type, extents)) {
+                return false;
+            }
+            set_planar_strides();
+            padding_bytes = Internal::mat_padding_bytes(payload_bytes());
+        } else if (ext == "pgm" || ext == "ppm") {
+            const int channels = ext == "ppm" ? 3 : 1;
+            const size_t dims = channels > 1 ? 3 : 2;
+            if (!check(type.code == halide_type_uint && (type.bits == 8 || type.bits == 16) &&
+                       extents.size() == dims && (channels == 1 || extents[2] == channels),
+                       "Image cannot be saved in this format")) {
+                return false;
+            }
+            fprintf(file->f, "%s\n%d %d\n%d\n", channels == 3 ? "P6" : "P5",
+                    extents[0], extents[1], (1 << type.bits) - 1);
+            set_interleaved_strides(channels);
+            big_endian = type.bits > 8;
+        } else {
+            return check(false, "Only .tmp, .mat, .pgm and .ppm files can be streamed");
+        }
+        offset = Internal::tell(file->f);
+        if (!check(offset >= 0, "Could not write image header")) {
+            return false;
+        }
+
+        // Write the last byte of the payload, and any padding after it.
+        const int64_t end = offset + payload_bytes();
+        const uint64_t zero = 0;
+        if (end > offset &&
+            !check(Internal::seek_to(file->f, end - 1) && file->write_bytes(&zero, 1),
+                   "Could not size image file")) {
+            return false;
+        }
+        return check(file->write_bytes(&zero, padding_bytes), "Could not write image padding");
+    }
+
+    // Write the contents of 'region' to the part of the image it
+    // covers, which must be inside the image. A region of a pnm image
+    // must cover all of its channels.
+    bool write(Halide::Runtime::Buffer<> &region) {
+        if (!check(region.type() == image_type && region.dimensions() == dimensions(),
+                   "Region does not match the type and dimensions of the image")) {
+            return false;
+        }
+        for (int d = 0; d < dimensions(); d++) {
+            if (!check(region.dim(d).min() >= 0 && region.dim(d).max() < extents[d] &&
+                       (!is_inner(d) || region.dim(d).extent() == extents[d]),
+                       "Region is not inside the image")) {
+                return false;
+            }
+        }
+        region.copy_to_host();
+        const halide_buffer_t *buf = region.raw_buffer();
+        const int elem_size = image_type.bytes();
+        const bool direct = is_direct(buf);
+        std::vector<uint8_t> line;
+        return for_each_line(buf, [&](int *pos, int64_t line_offset, int line_min, int line_max) {
+            const size_t line_bytes = (size_t)(line_max - line_min + 1) * strides[0] * elem_size;
+            if (!check(Internal::seek_to(file->f, line_offset), "Could not seek in image file")) {
+                return false;
+            }
+            if (direct) {
+                return check(file->write_bytes(buf->address_of(pos), line_bytes), "Could not write image data");
+            }
+            line.resize(line_bytes);
+            for_each_in_line(buf, pos, line_min, [&](const int *p, int64_t index) {
+                uint8_t *dst = &line[index * elem_size];
+                memcpy(dst, buf->address_of(p), elem_size);
+                if (big_endian) {
+                    swap_bytes(dst);
+                }
+            });
+            return check(file->write_vector(line), "Could not write image data");
+        });
+    }
+
+    // Finish writing the file. Returns false if any data could not be
+    // written.
+    bool close() {
+        if (!file) {
+            return true;
+        }
+        bool ok = fflush(file->f) == 0 && !ferror(file->f);
+        file.reset();
+        return check(ok, "Could not write image file");
+    }
+};
+
+// Run an AOT-compiled pipeline with one input and one output image
+// over images too large to hold in memory, one tile of the output at
+// a time. 'pipeline' calls the generated function on the two buffers,
+// supplying any other arguments it takes. The output is split into
+// tiles over its first two dimensions, each spanning all of any other
+// dimensions. For each tile, the pipeline is first run in bounds-query
+// mode to find the region of the input the tile needs, halo included;
+// that region is read from 'input', clamped to the edges of the image
+// as described for ImageStreamReader::read(). The input and output
+// buffers have the dimensions of the files, so e.g. a pipeline run on
+// .tmp files must take 4-dimensional buffers.
+template<Internal::CheckFunc check = Internal::CheckReturn>
+bool run_tiled(const std::function<int(halide_buffer_t *input, halide_buffer_t *output)> &pipeline,
+               ImageStreamReader<check> &input, ImageStreamWriter<check> &output,
+               int tile_width, int tile_height) {
+    if (!check(tile_width > 0 && tile_height > 0 && output.dimensions() >= 2, "Bad tile size")) {
+        return false;
+    }
+    const int width = output.extent(0), height = output.extent(1);
+    std::vector<int> tile_extents(output.dimensions()), tile_mins(output.dimensions(), 0);
+    for (int d = 0; d < output.dimensions(); d++) {
+        tile_extents[d] = output.extent(d);
+    }
+    for (int y = 0; y < height; y += tile_height) {
+        for (int x = 0; x < width; x += tile_width) {
+            tile_mins[0] = x;
+            tile_mins[1] = y;
+            tile_extents[0] = std::min(tile_width, width - x);
+            tile_extents[1] = std::min(tile_height, height - y);
+            Halide::Runtime::Buffer<> out_tile(output.type(), tile_extents);
+            out_tile.set_min(tile_mins);
+
+            std::vector<halide_dimension_t> shape(input.dimensions());
+            Halide::Runtime::Buffer<> query(input.type(), nullptr, input.dimensions(), shape.data());
+            if (!check(pipeline(query.raw_buffer(), out_tile.raw_buffer()) == 0, "Bounds query failed")) {
+                return false;
+            }
+
+            std::vector<int> in_extents(input.dimensions()), in_mins(input.dimensions());
+            for (int d = 0; d < input.dimensions(); d++) {
+                in_mins[d] = query.dim(d).min();
+                in_extents[d] = query.dim(d).extent();
+            }
+            Halide::Runtime::Buffer<> in_tile(input.type(), in_extents);
+            in_tile.set_min(in_mins);
+            if (!input.read(in_tile)) {
+                return false;
+            }
+
+            if (!check(pipeline(in_tile.raw_buffer(), out_tile.raw_buffer()) == 0, "Pipeline failed")) {
+                return false;
+            }
+            if (!output.write(out_tile)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}  // namespace Tools
+}  // namespace Halide
+
+#endif  // HALIDE_IMAGE_STREAM_H
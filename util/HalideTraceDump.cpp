@@ -270,13 +270,15 @@ void finish_dump(map<string, FuncInfo> &func_info, BufferOutputOpts output_opts)
 
 void usage(char * const *argv) {
     const string usage =
-        "Usage: " + string(argv[0]) + " -i trace_file -t {png,jpg,pgm,tmp,mat}\n"
+        "Usage: " + string(argv[0]) + " -i trace_file -t {png,jpg,pgm,tmp,mat} [-f func]\n"
         "\n"
         "This tool reads a binary trace produced by Halide, and dumps all\n"
         "Funcs into individual image files in the current directory.\n"
         "To generate a suitable binary trace, use Func::trace_stores(), or the\n"
         "target features trace_stores and trace_realizations, and run with\n"
-        "HL_TRACE_FILE=<filename>.\n";
+        "HL_TRACE_FILE=<filename>. Compressed traces (HL_TRACE_COMPRESS=1)\n"
+        "are also accepted. With -f, only the given Func is dumped, and\n"
+        "only the parts of a compressed trace that contain it are read.\n";
     fprintf(stderr, "%s\n", usage.c_str());
     exit(1);
 }
@@ -284,6 +286,7 @@ void usage(char * const *argv) {
 int main(int argc, char * const *argv) {
     char *buf_filename = nullptr;
     char *buf_imagetype = nullptr;
+    string func_filter;
     BufferOutputOpts outputopts;
     for (int i = 1; i < argc - 1; i++) {
         string arg = argv[i];
@@ -293,6 +296,9 @@ int main(int argc, char * const *argv) {
         } else if (arg == "-i") {
             i++;
             buf_filename = argv[i];
+        } else if (arg == "-f") {
+            i++;
+            func_filter = argv[i];
         }
     }
 
@@ -318,11 +324,12 @@ int main(int argc, char * const *argv) {
         usage(argv);
     }
 
-    FILE *file_desc = fopen(buf_filename, "r");
-    if (file_desc == nullptr) {
-        fprintf(stderr, "[Error opening file: %s. Exiting.\n", argv[1]);
+    TraceReader reader;
+    if (!reader.open(buf_filename)) {
+        fprintf(stderr, "[Error opening file: %s. Exiting.\n", buf_filename);
         exit(1);
     }
+    reader.set_func(func_filter);
 
 
     printf("[INFO] Starting parse of binary trace...\n");
@@ -334,7 +341,7 @@ int main(int argc, char * const *argv) {
 
     for (;;) {
         Packet p;
-        if (!p.read_from_filedesc(file_desc)) {
+        if (!reader.next(&p)) {
             printf("[INFO] Finished pass 1 after %d packets.\n", packet_count);
             break;
         }
@@ -356,8 +363,7 @@ int main(int argc, char * const *argv) {
     }
 
     packet_count = 0;
-    fseek(file_desc, 0, SEEK_SET);
-    if (ferror(file_desc)){
+    if (!reader.rewind()) {
         fprintf(stderr, "Error: couldn't seek back to beginning of trace file. Aborting.\n");
         exit(-1);
     }
@@ -368,11 +374,8 @@ int main(int argc, char * const *argv) {
 
     for (;;) {
         Packet p;
-        if (!p.read_from_filedesc(file_desc)) {
+        if (!reader.next(&p)) {
             printf("[INFO] Finished pass 2 after %d packets.\n", packet_count);
-            if (file_desc != nullptr) {
-                fclose(file_desc);
-            }
             finish_dump(func_info, outputopts);
             exit(0);
         }
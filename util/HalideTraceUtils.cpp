@@ -44,6 +44,271 @@ bool Packet::read(void *d, size_t size, FILE *fdesc) {
     return true;
 }
 
+bool lz4_decompress(const uint8_t *src, size_t src_size, uint8_t *dst, size_t dst_size) {
+    size_t ip = 0, op = 0;
+    auto read_length = [&](size_t len) -> size_t {
+        if (len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= src_size) {
+                    return SIZE_MAX;
+                }
+                b = src[ip++];
+                len += b;
+            } while (b == 255);
+        }
+        return len;
+    };
+    while (ip < src_size) {
+        uint8_t token = src[ip++];
+        size_t literals = read_length(token >> 4);
+        if (literals == SIZE_MAX || literals > src_size - ip || literals > dst_size - op) {
+            return false;
+        }
+        memcpy(dst + op, src + ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == src_size) {
+            // The last sequence has no match.
+            break;
+        }
+        if (src_size - ip < 2) {
+            return false;
+        }
+        size_t offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        size_t len = read_length(token & 15);
+        if (offset == 0 || offset > op || len == SIZE_MAX || len + 4 > dst_size - op) {
+            return false;
+        }
+        len += 4;
+        // The match may overlap the bytes it produces, so copy
+        // forwards one at a time.
+        for (size_t i = 0; i < len; i++, op++) {
+            dst[op] = dst[op - offset];
+        }
+    }
+    return op == dst_size;
+}
+
+TraceReader::~TraceReader() {
+    if (owns_file && file) {
+        fclose(file);
+    }
+}
+
+bool TraceReader::open(const std::string &filename) {
+    file = fopen(filename.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    owns_file = true;
+    if (!read_header()) {
+        return false;
+    }
+    if (compressed) {
+        // Use the index if the trace was finished.
+        indexed = read_index();
+        if (fseek(file, sizeof(halide_trace_file_header_t), SEEK_SET) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TraceReader::open(FILE *f) {
+    file = f;
+    owns_file = false;
+    return read_header();
+}
+
+bool TraceReader::read_header() {
+    prefix_size = fread(prefix, 1, sizeof(prefix), file);
+    prefix_pos = 0;
+    halide_trace_file_header_t header;
+    if (prefix_size == sizeof(header)) {
+        memcpy(&header, prefix, sizeof(header));
+        if (header.magic == halide_trace_file_magic) {
+            if (header.version != halide_trace_file_version) {
+                fprintf(stderr, "Unsupported trace file version %d\n", (int)header.version);
+                return false;
+            }
+            compressed = true;
+            prefix_size = 0;
+        } else if (header.magic == 0x484c545a) {
+            // The magic number, byte-swapped.
+            fprintf(stderr, "Compressed trace was written on a host of the other endianness\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TraceReader::read_index() {
+    halide_trace_file_trailer_t trailer;
+    if (fseek(file, -(long)sizeof(trailer), SEEK_END) != 0 ||
+        fread(&trailer, sizeof(trailer), 1, file) != 1 ||
+        trailer.magic != halide_trace_index_magic ||
+        fseek(file, (long)trailer.index_offset, SEEK_SET) != 0) {
+        return false;
+    }
+
+    uint32_t count;
+    if (fread(&count, sizeof(count), 1, file) != 1) {
+        return false;
+    }
+    funcs.resize(count);
+    for (std::string &f : funcs) {
+        int c;
+        while ((c = fgetc(file)) > 0) {
+            f += (char)c;
+        }
+        if (c != 0) {
+            return false;
+        }
+    }
+    if (fread(&count, sizeof(count), 1, file) != 1) {
+        return false;
+    }
+    blocks.resize(count);
+    if (count && fread(blocks.data(), sizeof(halide_trace_block_index_t), count, file) != count) {
+        return false;
+    }
+    // Recompute the filter's Func against the index.
+    set_func(func_filter);
+    return true;
+}
+
+void TraceReader::set_func(const std::string &func) {
+    func_filter = func;
+    func_filter_index = -1;
+    if (!func.empty()) {
+        func_filter_index = halide_trace_max_indexed_funcs;
+        for (size_t i = 0; i < funcs.size(); i++) {
+            if (funcs[i] == func) {
+                func_filter_index = (int)i;
+            }
+        }
+    }
+}
+
+void TraceReader::set_id_range(int32_t min_id, int32_t max_id) {
+    this->min_id = min_id;
+    this->max_id = max_id;
+}
+
+bool TraceReader::rewind() {
+    if (!owns_file) {
+        return false;
+    }
+    prefix_pos = 0;
+    next_block = 0;
+    block.clear();
+    block_pos = 0;
+    at_end = false;
+    long start = compressed ? (long)sizeof(halide_trace_file_header_t) : (long)prefix_size;
+    return fseek(file, start, SEEK_SET) == 0;
+}
+
+bool TraceReader::read_bytes(void *dst, size_t size) {
+    uint8_t *d = (uint8_t *)dst;
+    while (size && prefix_pos < prefix_size) {
+        *d++ = prefix[prefix_pos++];
+        size--;
+    }
+    return size == 0 || fread(d, 1, size, file) == size;
+}
+
+bool TraceReader::block_may_pass(const halide_trace_block_index_t &b) const {
+    if (b.max_id < min_id || b.min_id > max_id) {
+        return false;
+    }
+    if (func_filter_index < 0) {
+        return true;
+    }
+    // Blocks with Funcs the index doesn't name may contain any Func.
+    const int f = func_filter_index, other = halide_trace_max_indexed_funcs;
+    return (b.func_mask[f / 32] & (1U << (f % 32))) ||
+           (b.func_mask[other / 32] & (1U << (other % 32)));
+}
+
+bool TraceReader::load_next_block() {
+    if (indexed) {
+        while (next_block < blocks.size() && !block_may_pass(blocks[next_block])) {
+            next_block++;
+        }
+        if (next_block == blocks.size() ||
+            fseek(file, (long)blocks[next_block].offset, SEEK_SET) != 0) {
+            return false;
+        }
+        next_block++;
+    }
+
+    halide_trace_block_header_t header;
+    if (!read_bytes(&header, sizeof(header)) || header.uncompressed_size == 0) {
+        return false;
+    }
+    block.resize(header.uncompressed_size);
+    block_pos = 0;
+    if (header.compressed_size == header.uncompressed_size) {
+        return read_bytes(block.data(), block.size());
+    }
+    compressed_block.resize(header.compressed_size);
+    if (!read_bytes(compressed_block.data(), compressed_block.size())) {
+        return false;
+    }
+    if (!lz4_decompress(compressed_block.data(), compressed_block.size(), block.data(), block.size())) {
+        fprintf(stderr, "Corrupt block in compressed trace\n");
+        return false;
+    }
+    return true;
+}
+
+bool TraceReader::passes(const Packet &p) const {
+    return p.id >= min_id && p.id <= max_id &&
+           (func_filter.empty() || func_filter == p.func());
+}
+
+bool TraceReader::next(Packet *p) {
+    const size_t header_size = sizeof(halide_trace_packet_t);
+    while (!at_end) {
+        if (compressed) {
+            if (block_pos == block.size() && !load_next_block()) {
+                at_end = true;
+                break;
+            }
+            const halide_trace_packet_t *h = (const halide_trace_packet_t *)(block.data() + block_pos);
+            if (h->size < header_size || h->size > header_size + sizeof(p->payload) ||
+                h->size > block.size() - block_pos) {
+                fprintf(stderr, "Corrupt packet in compressed trace\n");
+                at_end = true;
+                break;
+            }
+            memcpy((void *)p, h, h->size);
+            block_pos += h->size;
+        } else {
+            if (!read_bytes(p, header_size)) {
+                at_end = true;
+                break;
+            }
+            size_t payload_size = p->size - header_size;
+            if (payload_size > sizeof(p->payload)) {
+                fprintf(stderr, "Payload larger than %d bytes in trace stream (%d)\n", (int)sizeof(p->payload), (int)payload_size);
+                abort();
+            }
+            if (!read_bytes(p->payload, payload_size)) {
+                fprintf(stderr, "Unexpected EOF mid-packet");
+                at_end = true;
+                break;
+            }
+        }
+        if (passes(*p)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void bad_type_error(halide_type_t type) {
     fprintf(stderr, "Can't convert packet with type: %d bits: %d\n", type.code, type.bits);
     exit(-1);
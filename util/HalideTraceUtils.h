@@ -4,6 +4,8 @@
 #include "HalideRuntime.h"
 #include <stdio.h>
 #include <cstring>
+#include <string>
+#include <vector>
 
 namespace Halide {
 namespace Internal {
@@ -94,6 +96,90 @@ private:
     bool read(void *d, size_t size, FILE *fdesc);
 };
 
+// Reads the packets of a trace written by halide_default_trace, in
+// either the plain or the compressed format (see
+// halide_trace_file_header_t). If a compressed file has an index,
+// only the blocks that may contain packets passing the filters are
+// decompressed.
+class TraceReader {
+public:
+    TraceReader() = default;
+    TraceReader(const TraceReader &) = delete;
+    TraceReader &operator=(const TraceReader &) = delete;
+    ~TraceReader();
+
+    // Read from the named file. Returns false if it can't be opened
+    // or isn't a trace.
+    bool open(const std::string &filename);
+
+    // Read from a stream that may not be seekable, e.g. stdin. The
+    // index of a compressed trace is not used.
+    bool open(FILE *f);
+
+    // Only return the packets of this Func. Empty for all Funcs.
+    void set_func(const std::string &func);
+
+    // Only return packets with ids in [min_id, max_id]. Packet ids
+    // increase as the pipeline runs, so this selects a span of time.
+    void set_id_range(int32_t min_id, int32_t max_id);
+
+    // Read the next packet that passes the filters. Returns false
+    // when there are no more.
+    bool next(Packet *p);
+
+    // Start again from the first packet. Only works on files opened
+    // by name.
+    bool rewind();
+
+    bool is_compressed() const {
+        return compressed;
+    }
+
+    bool is_indexed() const {
+        return indexed;
+    }
+
+    // The Funcs named in the index of a compressed trace.
+    const std::vector<std::string> &indexed_funcs() const {
+        return funcs;
+    }
+
+private:
+    FILE *file = nullptr;
+    bool owns_file = false;
+    bool compressed = false, indexed = false;
+
+    // The bytes read from the file to detect the format, which are
+    // the start of the first packet of a plain trace.
+    uint8_t prefix[sizeof(halide_trace_file_header_t)];
+    size_t prefix_size = 0, prefix_pos = 0;
+
+    // The index, if any.
+    std::vector<std::string> funcs;
+    std::vector<halide_trace_block_index_t> blocks;
+    size_t next_block = 0;
+
+    // The current block of a compressed trace, decompressed.
+    std::vector<uint8_t> block, compressed_block;
+    size_t block_pos = 0;
+    bool at_end = false;
+
+    std::string func_filter;
+    int func_filter_index = -1;
+    int32_t min_id = INT32_MIN, max_id = INT32_MAX;
+
+    bool read_header();
+    bool read_index();
+    bool read_bytes(void *dst, size_t size);
+    bool load_next_block();
+    bool block_may_pass(const halide_trace_block_index_t &b) const;
+    bool passes(const Packet &p) const;
+};
+
+// Decompress a block in the LZ4 block format into exactly dst_size
+// bytes. Returns false if the input is malformed.
+bool lz4_decompress(const uint8_t *src, size_t src_size, uint8_t *dst, size_t dst_size);
+
 }
 }
 
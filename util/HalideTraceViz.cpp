@@ -579,6 +579,13 @@ int run(int argc, char **argv) {
 
     map<uint32_t, PipelineInfo> pipeline_info;
 
+    // Accepts plain and compressed traces.
+    TraceReader reader;
+    if (!reader.open(stdin)) {
+        std::cerr << "Could not read a trace from stdin\n";
+        exit(1);
+    }
+
     list<pair<Label, int>> labels_being_drawn;
     size_t end_counter = 0;
     size_t packet_clock = 0;
@@ -633,7 +640,7 @@ int run(int argc, char **argv) {
 
         // Read a tracing packet
         Packet p;
-        if (!p.read_from_stdin()) {
+        if (!reader.next(&p)) {
             end_counter++;
             continue;
         }